@@ -7,6 +7,8 @@
 #include "bloom.h"
 #include "core.h"
 #include "script.h"
+#include "hash.h"
+#include "util.h"
 
 #define LN2SQUARED 0.4804530139182014246671025263266649717305529515945455
 #define LN2 0.6931471805599453094172321214581765680755001343602552
@@ -35,11 +37,11 @@ nFlags(nFlagsIn)
 {
 }
 
-inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const
+inline unsigned int CBloomFilter::Hash(unsigned int nHashNum, const unsigned char* pDataToHash, size_t nSize) const
 {
     // 0xFBA4C795 chosen as it guarantees a reasonable bit difference between nHashNum values.
     //            выбран, поскольку он гарантирует разумные бит разницу между nHashNum значениями.
-    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, vDataToHash) % (vData.size() * 8);
+    return MurmurHash3(nHashNum * 0xFBA4C795 + nTweak, pDataToHash, nSize) % (vData.size() * 8);
 }
 
 void CBloomFilter::insert(const vector<unsigned char>& vKey)
@@ -48,7 +50,7 @@ void CBloomFilter::insert(const vector<unsigned char>& vKey)
         return;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, vKey.empty() ? NULL : &vKey[0], vKey.size());
         // Sets(задаёт) bit nIndex of vData
         vData[nIndex >> 3] |= bit_mask[7 & nIndex];
     }
@@ -69,12 +71,17 @@ void CBloomFilter::insert(const uint256& hash)
 }
 
 bool CBloomFilter::contains(const vector<unsigned char>& vKey) const
+{
+    return contains(vKey.empty() ? NULL : &vKey[0], vKey.size());
+}
+
+bool CBloomFilter::contains(const unsigned char* pKey, size_t nSize) const
 {
     if (vData.size() == 1 && vData[0] == 0xff)
         return true;
     for (unsigned int i = 0; i < nHashFuncs; i++)
     {
-        unsigned int nIndex = Hash(i, vKey);
+        unsigned int nIndex = Hash(i, pKey, nSize);
         // Checks(проверяет) bit nIndex of vData
         if (!(vData[nIndex >> 3] & bit_mask[7 & nIndex]))
             return false;
@@ -92,8 +99,7 @@ bool CBloomFilter::contains(const COutPoint& outpoint) const
 
 bool CBloomFilter::contains(const uint256& hash) const
 {
-    vector<unsigned char> data(hash.begin(), hash.end());
-    return contains(data);
+    return contains(hash.begin(), hash.size());
 }
 
 bool CBloomFilter::IsWithinSizeConstraints() const
@@ -170,3 +176,177 @@ bool CBloomFilter::IsRelevantAndUpdate(const CTransaction& tx, const uint256& ha
 
     return false;
 }
+
+bool CBloomFilter::IsRelevantAndUpdate(const CBloomElements& elements, unsigned int nTx)
+{
+    // Same matches and updates, in the same order, as for the transaction itself  Те же совпадения и обновления, в том же порядке, что и для самой транзакции
+    const uint256& hash = elements.vHash[nTx];
+    bool fFound = contains(hash);
+
+    const unsigned int nOutputBegin = elements.vTxOutput[nTx];
+    const unsigned int nOutputEnd = elements.vTxOutput[nTx + 1];
+    const unsigned int nInputBegin = elements.vTxElement[2 * nTx + 1];
+    const unsigned int nInputEnd = elements.vTxElement[2 * nTx + 2];
+    for (unsigned int o = nOutputBegin; o < nOutputEnd; o++)
+    {
+        unsigned int nEnd = (o + 1 < nOutputEnd ? elements.vOutput[o + 1] : nInputBegin);
+        for (unsigned int e = elements.vOutput[o]; e < nEnd; e++)
+        {
+            if (contains(&elements.vData[elements.vElement[e]], elements.vElement[e + 1] - elements.vElement[e]))
+            {
+                fFound = true;
+                if ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_ALL ||
+                    ((nFlags & BLOOM_UPDATE_MASK) == BLOOM_UPDATE_P2PUBKEY_ONLY && elements.vPubKeyOutput[o]))
+                    insert(COutPoint(hash, o - nOutputBegin));
+                break;
+            }
+        }
+    }
+
+    if (fFound)
+        return true;
+
+    // Outpoints and input pushes, in input order                       Outpoint'ы и данные входов, в порядке входов
+    for (unsigned int e = nInputBegin; e < nInputEnd; e++)
+        if (contains(&elements.vData[elements.vElement[e]], elements.vElement[e + 1] - elements.vElement[e]))
+            return true;
+
+    return false;
+}
+
+CBloomElements::CBloomElements() : vElement(1, 0), vTxOutput(1, 0), vTxElement(1, 0)
+{
+}
+
+void CBloomElements::AddElement(const unsigned char* pbegin, size_t nSize)
+{
+    vData.insert(vData.end(), pbegin, pbegin + nSize);
+    vElement.push_back(vData.size());
+}
+
+void CBloomElements::AddPushes(const CScript& script)
+{
+    // Non-empty pushes up to the first opcode that doesn't parse       Непустые данные до первого опкода, который не разбирается
+    CScript::const_iterator pc = script.begin();
+    vector<unsigned char> data;
+    while (pc < script.end())
+    {
+        opcodetype opcode;
+        if (!script.GetOp(pc, opcode, data))
+            break;
+        if (data.size() != 0)
+            AddElement(&data[0], data.size());
+    }
+}
+
+void CBloomElements::Add(const CTransaction& tx, const uint256& hash)
+{
+    vHash.push_back(hash);
+
+    BOOST_FOREACH(const CTxOut& txout, tx.vout)
+    {
+        unsigned int nFirst = vElement.size() - 1;
+        vOutput.push_back(nFirst);
+        AddPushes(txout.scriptPubKey);
+        // only an output that can match is ever looked at by type     тип смотрится только у выхода, который может совпасть
+        txnouttype type;
+        vector<vector<unsigned char> > vSolutions;
+        vPubKeyOutput.push_back(vElement.size() - 1 > nFirst && Solver(txout.scriptPubKey, type, vSolutions) &&
+                                (type == TX_PUBKEY || type == TX_MULTISIG));
+    }
+    vTxOutput.push_back(vOutput.size());
+    vTxElement.push_back(vElement.size() - 1);
+
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        CDataStream stream(SER_NETWORK, PROTOCOL_VERSION);
+        stream << txin.prevout;
+        AddElement((const unsigned char*)&stream[0], stream.size());
+        AddPushes(txin.scriptSig);
+    }
+    vTxElement.push_back(vElement.size() - 1);
+}
+
+size_t CBloomElements::GetMemoryUsage() const
+{
+    return vHash.capacity() * sizeof(uint256) + vData.capacity() +
+           (vElement.capacity() + vOutput.capacity() + vTxOutput.capacity() + vTxElement.capacity()) * sizeof(unsigned int) +
+           vPubKeyOutput.capacity() / 8;
+}
+
+CRollingBloomFilter::CRollingBloomFilter(unsigned int nElements, double nFPRate)
+{
+    // Up to three generations of nElements/2 entries are in the filter at once;    До трёх поколений по nElements/2 записей находятся в фильтре одновременно;
+    // size it for that many with the optimal number of hash functions              размер рассчитан на столько с оптимальным числом хеш-функций
+    nHashFuncs = max(1, min((int)(log(nFPRate) / log(0.5) + 0.5), (int)MAX_HASH_FUNCS));
+    nEntriesPerGeneration = (nElements + 1) / 2;
+    double nMaxElements = 3.0 * nEntriesPerGeneration;
+    uint64 nBits = (uint64)ceil(-1.0 * nHashFuncs * nMaxElements / log(1.0 - exp(log(nFPRate) / nHashFuncs)));
+    vData.resize(((nBits + 63) / 64) * 2);
+    reset();
+}
+
+void CRollingBloomFilter::reset()
+{
+    k0 = GetRand(~(uint64)0);
+    k1 = GetRand(~(uint64)0);
+    nEntriesThisGeneration = 0;
+    nGeneration = 1;
+    std::fill(vData.begin(), vData.end(), 0);
+}
+
+bool CRollingBloomFilter::insert(const uint256& hash)
+{
+    // The positions are always written into the current generation, so that a   Позиции всегда записываются в текущее поколение, чтобы хеш,
+    // hash that only looked present (a false positive, or an old generation)     который лишь казался присутствующим (ложное срабатывание или старое
+    // stays for a full window; only new entries count towards the generation    поколение), оставался на полное окно; к поколению считаются только новые
+    bool fNew = !contains(hash);
+
+    if (fNew && nEntriesThisGeneration == nEntriesPerGeneration)
+    {
+        nEntriesThisGeneration = 0;
+        if (++nGeneration == 4)
+            nGeneration = 1;
+        // Clear the positions still holding the generation being reused          Очистить позиции, ещё хранящие повторно используемое поколение
+        uint64 nMask1 = -(uint64)(nGeneration & 1);
+        uint64 nMask2 = -(uint64)(nGeneration >> 1);
+        for (unsigned int i = 0; i < vData.size(); i += 2)
+        {
+            uint64 nKeep = (vData[i] ^ nMask1) | (vData[i + 1] ^ nMask2);
+            vData[i] &= nKeep;
+            vData[i + 1] &= nKeep;
+        }
+    }
+
+    // Positions h1 + n*h2 from one 64-bit hash (double hashing)                    Позиции h1 + n*h2 из одного 64-битного хеша (двойное хеширование)
+    uint64 h = SipHashUint256(k0, k1, hash);
+    unsigned int h1 = (unsigned int)h, h2 = (unsigned int)(h >> 32) | 1;
+    unsigned int nPairs = vData.size() / 2;
+    for (unsigned int n = 0; n < nHashFuncs; n++)
+    {
+        unsigned int nIndex = h1 + n * h2;
+        uint64 nBit = (uint64)1 << (nIndex & 63);
+        unsigned int nPos = ((nIndex >> 6) % nPairs) * 2;
+        vData[nPos] = (vData[nPos] & ~nBit) | ((nGeneration & 1) ? nBit : 0);
+        vData[nPos + 1] = (vData[nPos + 1] & ~nBit) | ((nGeneration >> 1) ? nBit : 0);
+    }
+    if (fNew)
+        nEntriesThisGeneration++;
+    return fNew;
+}
+
+bool CRollingBloomFilter::contains(const uint256& hash) const
+{
+    uint64 h = SipHashUint256(k0, k1, hash);
+    unsigned int h1 = (unsigned int)h, h2 = (unsigned int)(h >> 32) | 1;
+    unsigned int nPairs = vData.size() / 2;
+    for (unsigned int n = 0; n < nHashFuncs; n++)
+    {
+        unsigned int nIndex = h1 + n * h2;
+        uint64 nBit = (uint64)1 << (nIndex & 63);
+        unsigned int nPos = ((nIndex >> 6) % nPairs) * 2;
+        if (!((vData[nPos] | vData[nPos + 1]) & nBit))
+            return false;
+    }
+    return true;
+}
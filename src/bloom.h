@@ -11,6 +11,8 @@
 
 class COutPoint;
 class CTransaction;
+class CBloomElements;
+class CScript;
 
 // 20,000 items with fp rate < 0.1% or 10,000 items and <0.0001%                    20,000 пунктов с fp оценкой < 0,1 % или 10,000 пунктов и <0,0001 %
 static const unsigned int MAX_BLOOM_FILTER_SIZE = 36000; // bytes
@@ -47,7 +49,7 @@ private:
     unsigned int nTweak;
     unsigned char nFlags;
 
-    unsigned int Hash(unsigned int nHashNum, const std::vector<unsigned char>& vDataToHash) const;
+    unsigned int Hash(unsigned int nHashNum, const unsigned char* pDataToHash, size_t nSize) const;
 
 public:
     // Creates a new bloom filter which will provide the given fp rate when filled with the given number of elements
@@ -86,6 +88,7 @@ public:
     bool contains(const std::vector<unsigned char>& vKey) const;
     bool contains(const COutPoint& outpoint) const;
     bool contains(const uint256& hash) const;
+    bool contains(const unsigned char* pKey, size_t nSize) const;
 
     // True if the size is <= MAX_BLOOM_FILTER_SIZE and the number of hash functions is <= MAX_HASH_FUNCS
     // (catch a filter which was just deserialized which was too big)
@@ -96,6 +99,68 @@ public:
     // Also adds any outputs which match the filter to the filter (to match their spending txes)
     //      Также добавляет любые выходы, которые соответствуют фильтру для фильтра (для соответствия их расходов txes)
     bool IsRelevantAndUpdate(const CTransaction& tx, const uint256& hash);
+    // The same for transaction nTx of prepared elements, without parsing scripts again
+    //      То же для транзакции nTx подготовленных элементов, без повторного разбора скриптов
+    bool IsRelevantAndUpdate(const CBloomElements& elements, unsigned int nTx);
+};
+
+/**
+ * The data elements IsRelevantAndUpdate looks at in a list of transactions,        Элементы данных, которые IsRelevantAndUpdate просматривает в списке транзакций,
+ * extracted once into flat arrays so that any number of filters can be matched     извлечённые один раз в плоские массивы, чтобы с ними можно было сопоставлять
+ * against them: the pushes of each output script, then for each input the          любое число фильтров: данные каждого скрипта выхода, затем для каждого входа
+ * serialized outpoint followed by the pushes of the input script.                  сериализованный outpoint, за которым следуют данные скрипта входа.
+ */
+class CBloomElements
+{
+public:
+    std::vector<uint256> vHash;                 // txids                                     txid
+    std::vector<unsigned char> vData;           // all elements back to back                 все элементы подряд
+    std::vector<unsigned int> vElement;         // start of each element in vData, and end   начало каждого элемента в vData, и конец
+    std::vector<unsigned int> vOutput;          // first element of each output, and end     первый элемент каждого выхода, и конец
+    std::vector<bool> vPubKeyOutput;            // pay-to-pubkey or multisig output          выход pay-to-pubkey или multisig
+    std::vector<unsigned int> vTxOutput;        // first output of each transaction, and end  первый выход каждой транзакции, и конец
+    std::vector<unsigned int> vTxElement;       // first output element and first input      первый элемент выходов и первый элемент
+                                                // element of each transaction, and end      входов каждой транзакции, и конец
+
+    CBloomElements();
+
+    void Add(const CTransaction& tx, const uint256& hash);
+    unsigned int GetTxCount() const { return vHash.size(); }
+    size_t GetMemoryUsage() const;
+
+private:
+    void AddElement(const unsigned char* pbegin, size_t nSize);
+    void AddPushes(const CScript& script);
+};
+
+/**
+ * RollingBloomFilter remembers at least the last nElements hashes inserted,         RollingBloomFilter помнит по крайней мере последние nElements вставленных хешей,
+ * with a fixed memory cost and constant time insert and lookup. Each position      с фиксированным расходом памяти и постоянным временем вставки и поиска. Каждая
+ * holds the generation (1..3) that set it; a new generation starts every           позиция хранит поколение (1..3), которое её установило; новое поколение начинается
+ * nElements/2 new entries and clears the positions of the one it reuses.          каждые nElements/2 новых записей и очищает позиции того, которое оно использует повторно.
+ *
+ * Keys are hashes, so one keyed SipHash per operation gives all bit positions.     Ключи - хеши, поэтому один SipHash с ключом на операцию даёт все позиции битов.
+ * Used locally only, it is never sent over the network.                             Используется только локально, никогда не передаётся по сети.
+ */
+class CRollingBloomFilter
+{
+private:
+    std::vector<uint64> vData;      // pairs of words: low and high bit of 64 generations    пары слов: младший и старший бит 64 поколений
+    unsigned int nHashFuncs;
+    unsigned int nEntriesPerGeneration;
+    unsigned int nEntriesThisGeneration;
+    unsigned int nGeneration;
+    uint64 k0, k1;
+
+public:
+    CRollingBloomFilter(unsigned int nElements, double nFPRate);
+
+    // Returns false if the hash was (probably) in the filter already                 Возвращает false, если хеш (вероятно) уже был в фильтре
+    bool insert(const uint256& hash);
+    bool contains(const uint256& hash) const;
+    void reset();
+
+    size_t GetMemoryUsage() const { return vData.size() * sizeof(uint64); }
 };
 
 #endif /* BITCOIN_BLOOM_H */
@@ -24,6 +24,12 @@
 #include <net/if.h>
 #include <netinet/in.h>
 #include <ifaddrs.h>
+#include <unistd.h>
+#endif
+
+#if defined(__linux__) && !defined(NO_EPOLL)
+#define USE_EPOLL 1
+#include <sys/epoll.h>
 #endif
 
 typedef u_int SOCKET;   // для ubuntu build
@@ -257,11 +257,16 @@ uint256 CBlockHeader::GetHash() const
     return thash;
 }
 
-uint256 CBlock::BuildMerkleTree() const
+uint256 CBlock::BuildMerkleTree(bool fLeavesKnown) const
 {
-    vMerkleTree.clear();
-    BOOST_FOREACH(const CTransaction& tx, vtx)
-        vMerkleTree.push_back(tx.GetHash());
+    if (fLeavesKnown)
+        assert(vMerkleTree.size() == vtx.size());
+    else
+    {
+        vMerkleTree.clear();
+        BOOST_FOREACH(const CTransaction& tx, vtx)
+            vMerkleTree.push_back(tx.GetHash());
+    }
     int j = 0;
     for (int nSize = vtx.size(); nSize > 1; nSize = (nSize + 1) / 2)
     {
@@ -50,11 +50,11 @@ public:
 class CInPoint
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
     unsigned int n;
 
     CInPoint() { SetNull(); }
-    CInPoint(CTransaction* ptxIn, unsigned int nIn) { ptx = ptxIn; n = nIn; }
+    CInPoint(const CTransaction* ptxIn, unsigned int nIn) { ptx = ptxIn; n = nIn; }
     void SetNull() { ptx = NULL; n = (unsigned int) -1; }
     bool IsNull() const { return (ptx == NULL && n == (unsigned int) -1); }
 };
@@ -333,6 +333,17 @@ public:
 };
 
 
+/** Estimate of the memory taken by one heap allocation of nAlloc bytes,            Оценка памяти, занимаемой одним выделением в куче nAlloc байт,
+ *  including the allocator's own bookkeeping and rounding                          включая служебные данные и округление распределителя */
+inline size_t MallocUsage(size_t nAlloc)
+{
+    if (nAlloc == 0)
+        return 0;
+    if (sizeof(void*) == 8)
+        return ((nAlloc + 31) >> 4) << 4;
+    return ((nAlloc + 15) >> 3) << 3;
+}
+
 /** pruned version of CTransaction: only retains metadata and unspent transaction outputs
  *      сокращенная версия CTransaction: только сохраняет metadata и непотраченные транзакционные outputs
  *
@@ -547,6 +558,14 @@ public:
                 return false;
         return true;
     }
+
+    // heap memory owned by this CCoins (the output array and the scripts)          память кучи, занятая этим CCoins (массив выходов и скрипты)
+    size_t DynamicMemoryUsage() const {
+        size_t nUsage = MallocUsage(vout.capacity() * sizeof(CTxOut));
+        BOOST_FOREACH(const CTxOut &out, vout)
+            nUsage += MallocUsage(out.scriptPubKey.capacity());
+        return nUsage;
+    }
 };
 
 
@@ -625,6 +644,8 @@ public:
 
     // memory only
     mutable std::vector<uint256> vMerkleTree;
+    mutable bool fChecked;      // context-free checks (CheckBlock) already passed     контекстно-независимые проверки (CheckBlock) уже пройдены
+    mutable uint256 hashTxChecked; // merkle root the transactions were checked against   корень Меркля, с которым были проверены транзакции
 
     CBlock()
     {
@@ -641,6 +662,10 @@ public:
     (
         READWRITE(*(CBlockHeader*)this);
         READWRITE(vtx);
+        if (fRead) {
+            fChecked = false;
+            hashTxChecked = 0;
+        }
     )
 
     void SetNull()
@@ -648,6 +673,8 @@ public:
         CBlockHeader::SetNull();
         vtx.clear();
         vMerkleTree.clear();
+        fChecked = false;
+        hashTxChecked = 0;
     }
 
     CBlockHeader GetBlockHeader() const
@@ -662,7 +689,9 @@ public:
         return block;
     }
 
-    uint256 BuildMerkleTree() const;
+    // If fLeavesKnown, vMerkleTree already holds the txid of every transaction          Если fLeavesKnown, vMerkleTree уже содержит txid каждой транзакции
+    // (e.g. computed in parallel by CheckBlock) and only the inner nodes are built.   (например, вычисленные параллельно в CheckBlock) и строятся только внутренние узлы.
+    uint256 BuildMerkleTree(bool fLeavesKnown = false) const;
 
     const uint256 &GetTxHash(unsigned int nIndex) const {
         assert(vMerkleTree.size() > 0); // BuildMerkleTree must have been called first  (BuildMerkleTree должен быть вызван первым)
@@ -5,18 +5,18 @@ inline uint32_t ROTL32 ( uint32_t x, int8_t r )
     return (x << r) | (x >> (32 - r));
 }
 
-unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
+unsigned int MurmurHash3(unsigned int nHashSeed, const unsigned char* pDataToHash, size_t nSize)
 {
     // The following is MurmurHash3 (x86_32), see http://code.google.com/p/smhasher/source/browse/trunk/MurmurHash3.cpp
     uint32_t h1 = nHashSeed;
     const uint32_t c1 = 0xcc9e2d51;
     const uint32_t c2 = 0x1b873593;
 
-    const int nblocks = vDataToHash.size() / 4;
+    const int nblocks = nSize / 4;
 
     //----------
     // body
-    const uint32_t * blocks = (const uint32_t *)(&vDataToHash[0] + nblocks*4);
+    const uint32_t * blocks = (const uint32_t *)(pDataToHash + nblocks*4);
 
     for(int i = -nblocks; i; i++)
     {
@@ -33,11 +33,11 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
     //----------
     // tail
-    const uint8_t * tail = (const uint8_t*)(&vDataToHash[0] + nblocks*4);
+    const uint8_t * tail = (const uint8_t*)(pDataToHash + nblocks*4);
 
     uint32_t k1 = 0;
 
-    switch(vDataToHash.size() & 3)
+    switch(nSize & 3)
     {
     case 3: k1 ^= tail[2] << 16;
     case 2: k1 ^= tail[1] << 8;
@@ -47,7 +47,7 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
     //----------
     // finalization
-    h1 ^= vDataToHash.size();
+    h1 ^= nSize;
     h1 ^= h1 >> 16;
     h1 *= 0x85ebca6b;
     h1 ^= h1 >> 13;
@@ -56,3 +56,50 @@ unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char
 
     return h1;
 }
+
+unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash)
+{
+    return MurmurHash3(nHashSeed, vDataToHash.empty() ? NULL : &vDataToHash[0], vDataToHash.size());
+}
+
+#define SIPROUND do { \
+    v0 += v1; v1 = (v1 << 13) | (v1 >> 51); v1 ^= v0; v0 = (v0 << 32) | (v0 >> 32); \
+    v2 += v3; v3 = (v3 << 16) | (v3 >> 48); v3 ^= v2; \
+    v0 += v3; v3 = (v3 << 21) | (v3 >> 43); v3 ^= v0; \
+    v2 += v1; v1 = (v1 << 17) | (v1 >> 47); v1 ^= v2; v2 = (v2 << 32) | (v2 >> 32); \
+} while (0)
+
+uint64 SipHashUint256(uint64 k0, uint64 k1, const uint256& val)
+{
+    // SipHash-2-4 specialized for a 32 byte message, see https://131002.net/siphash/
+    uint64 v0 = 0x736f6d6570736575ULL ^ k0;
+    uint64 v1 = 0x646f72616e646f6dULL ^ k1;
+    uint64 v2 = 0x6c7967656e657261ULL ^ k0;
+    uint64 v3 = 0x7465646279746573ULL ^ k1;
+
+    const unsigned char* p = val.begin();
+    for (int i = 0; i < 4; i++)
+    {
+        uint64 m = 0;
+        for (int j = 7; j >= 0; j--)
+            m = (m << 8) | p[i * 8 + j];
+        v3 ^= m;
+        SIPROUND;
+        SIPROUND;
+        v0 ^= m;
+    }
+
+    // final block: message length in the top byte
+    uint64 m = ((uint64)32) << 56;
+    v3 ^= m;
+    SIPROUND;
+    SIPROUND;
+    v0 ^= m;
+
+    v2 ^= 0xff;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    SIPROUND;
+    return v0 ^ v1 ^ v2 ^ v3;
+}
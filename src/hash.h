@@ -123,5 +123,9 @@ inline uint160 Hash160(const std::vector<unsigned char>& vch)
 }
 
 unsigned int MurmurHash3(unsigned int nHashSeed, const std::vector<unsigned char>& vDataToHash);
+unsigned int MurmurHash3(unsigned int nHashSeed, const unsigned char* pDataToHash, size_t nSize);
+
+// SipHash-2-4 of a 256-bit value under the 128-bit key (k0, k1)                   SipHash-2-4 от 256-битного значения с 128-битным ключом (k0, k1)
+uint64 SipHashUint256(uint64 k0, uint64 k1, const uint256& val);
 
 #endif
@@ -117,6 +117,9 @@ bool ShutdownRequested()
 }
 
 static CCoinsViewDB *pcoinsdbview;
+// the memory pool is written back only once reading it is over, not to lose what is not read yet
+//      пул памяти записывается обратно, только когда его чтение закончено, чтобы не потерять непрочитанное
+static bool fDumpMempoolLater = false;
 
 void Shutdown()
 {
@@ -131,6 +134,8 @@ void Shutdown()
     bitdb.Flush(false);
     GenerateCoins(false, NULL);
     StopNode();
+    if (fDumpMempoolLater)
+        DumpMempool();
     {
         LOCK(cs_main);
         if (pwalletMain)
@@ -139,7 +144,10 @@ void Shutdown()
             pblocktree->Flush();
         if (pcoinsTip)
             pcoinsTip->Flush();
+        if (pcoinsFlush && !pcoinsFlush->Sync())
+            printf("Shutdown() : failed to write to coin database\n");
         delete pcoinsTip; pcoinsTip = NULL;
+        delete pcoinsFlush; pcoinsFlush = NULL;
         delete pcoinsdbview; pcoinsdbview = NULL;
         delete pblocktree; pblocktree = NULL;
     }
@@ -199,6 +207,12 @@ std::string HelpMessage()
     strUsage += "  -datadir=<dir>         " + _("Specify data directory") + "\n";
     strUsage += "  -wallet=<file>         " + _("Specify wallet file (within data directory)") + "\n";
     strUsage += "  -dbcache=<n>           " + _("Set database cache size in megabytes (default: 25)") + "\n";
+    strUsage += "  -blockcache=<n>        " + _("Set the size of the cache of recent blocks served to peers in megabytes (default: 32)") + "\n";
+    strUsage += "  -relaycache=<n>        " + _("Set the size of the cache of relayed transactions in megabytes (default: 16)") + "\n";
+    strUsage += "  -maxmempool=<n>        " + _("Keep the transactions in the memory pool below <n> megabytes, evicting the lowest fee rates (default: 300)") + "\n";
+    strUsage += "  -persistmempool        " + _("Save the memory pool on shutdown and load it on restart (default: 1)") + "\n";
+    strUsage += "  -sigcachesize=<n>      " + _("Set the size of the cache of verified signatures in megabytes (default: 32)") + "\n";
+    strUsage += "  -maxsigcachesize=<n>   " + _("Without -sigcachesize, size the cache of verified signatures for <n> signatures") + "\n";
     strUsage += "  -timeout=<n>           " + _("Specify connection timeout in milliseconds (default: 5000)") + "\n";
     strUsage += "  -proxy=<ip:port>       " + _("Connect through socks proxy") + "\n";
     strUsage += "  -socks=<n>             " + _("Select the version of socks proxy to use (4-5, default: 5)") + "\n";
@@ -220,6 +234,12 @@ std::string HelpMessage()
     strUsage += "  -bantime=<n>           " + _("Number of seconds to keep misbehaving peers from reconnecting (default: 86400)") + "\n";
     strUsage += "  -maxreceivebuffer=<n>  " + _("Maximum per-connection receive buffer, <n>*1000 bytes (default: 5000)") + "\n";
     strUsage += "  -maxsendbuffer=<n>     " + _("Maximum per-connection send buffer, <n>*1000 bytes (default: 1000)") + "\n";
+#ifdef USE_EPOLL
+    strUsage += "  -epoll                 " + _("Wait for socket events with epoll instead of select (default: 1)") + "\n";
+#endif
+    strUsage += "  -compactblocks         " + _("Download new blocks as compact blocks rebuilt from the memory pool (default: 1)") + "\n";
+    strUsage += "  -fastrelay             " + _("Announce new blocks once their proof of work and merkle root check out, before they are connected (default: 0)") + "\n";
+    strUsage += "  -headersfirst          " + _("Download headers first, then blocks from several peers in parallel (default: 1)") + "\n";
 #ifdef USE_UPNP
 #if USE_UPNP
     strUsage += "  -upnp                  " + _("Use UPnP to map the listening port (default: 1 when listening)") + "\n";
@@ -265,7 +285,7 @@ std::string HelpMessage()
     strUsage += "  -txindex               " + _("Maintain a full transaction index (default: 0)") + "\n";
     strUsage += "  -loadblock=<file>      " + _("Imports blocks from external blk000??.dat file") + "\n";
     strUsage += "  -reindex               " + _("Rebuild block chain index from current blk000??.dat files") + "\n";
-    strUsage += "  -par=<n>               " + _("Set the number of script verification threads (up to 16, 0 = auto, <0 = leave that many cores free, default: 0)") + "\n";
+    strUsage += "  -par=<n>               " + _("Set the number of script, block and message verification threads (up to 16, 0 = auto, <0 = leave that many cores free, default: 0)") + "\n";
 
     strUsage += "\n" + _("Block creation options:") + "\n";
     strUsage += "  -blockminsize=<n>      "   + _("Set minimum block size in bytes (default: 0)") + "\n";
@@ -341,6 +361,14 @@ void ThreadImport(std::vector<boost::filesystem::path> vImportFiles)
             LoadExternalBlockFile(file);
         }
     }
+
+    // mempool.dat, once the chain it builds on is there                        mempool.dat, когда цепь, на которой он строится, на месте
+    if (GetBoolArg("-persistmempool", true))
+    {
+        if (filesystem::exists(GetDataDir() / "mempool.dat"))
+            LoadMempool();
+        fDumpMempoolLater = !fRequestShutdown;
+    }
 }
 
 /** Initialize(инициализировать) bitcoin.
@@ -456,6 +484,9 @@ bool AppInit2(boost::thread_group& threadGroup)
 
     fDebug = GetBoolArg("-debug", false);
     fBenchmark = GetBoolArg("-benchmark", false);
+    fCompactBlockRelay = GetBoolArg("-compactblocks", true);
+    fHeadersFirst = GetBoolArg("-headersfirst", true);
+    fFastBlockRelay = GetBoolArg("-fastrelay", false);
 
     // -par=0 means autodetect, but nScriptCheckThreads==0 means no concurrency  (-par=0 означает, автоопределение, но nScriptCheckThreads==0 означает отсутствие параллелизма)
     nScriptCheckThreads = GetArg("-par", 0);
@@ -570,9 +601,15 @@ bool AppInit2(boost::thread_group& threadGroup)
         fprintf(stdout, "TDC server starting\n");
 
     if (nScriptCheckThreads) {
-        printf("Using %u threads for script verification\n", nScriptCheckThreads);
+        printf("Using %u threads for script, block and message verification\n", nScriptCheckThreads);
         for (int i=0; i<nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadMessagePrepare);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsFetch);
+        for (int i=0; i<nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
     }
 
     int64 nStart;
@@ -766,7 +803,15 @@ bool AppInit2(boost::thread_group& threadGroup)
     nTotalCache -= nBlockTreeDBCache;
     size_t nCoinDBCache = nTotalCache / 2; // use half of the remaining cache for coindb cache  использовать половину оставшегося кэша для кэша coindb
     nTotalCache -= nCoinDBCache;
-    nCoinCacheSize = nTotalCache / 300; // coins in memory require around 300 bytes             Монеты в памяти потребуется около 300 байт
+    nCoinCacheUsage = nTotalCache; // the rest is for the in-memory coins cache                  остаток отводится под кэш монет в памяти
+    blockmsgcache.SetMaxSize(GetArg("-blockcache", 32) << 20);
+    nMaxRelayCacheSize = GetArg("-relaycache", DEFAULT_RELAY_CACHE_SIZE) << 20;
+    mempool.SetMaxSize(GetArg("-maxmempool", DEFAULT_MAX_MEMPOOL_SIZE) * 1000000);
+    uint64 nSigCacheSize = (uint64)std::max((int64)0, GetArg("-sigcachesize", DEFAULT_SIGCACHE_SIZE)) << 20;
+    // the entry count of older versions, -maxsigcachesize, still sets it: one slot per entry   счётчик записей старых версий, -maxsigcachesize, всё ещё задаёт его: один слот на запись
+    if (!mapArgs.count("-sigcachesize") && mapArgs.count("-maxsigcachesize"))
+        nSigCacheSize = (uint64)std::max((int64)0, GetArg("-maxsigcachesize", 0)) * sizeof(uint256);
+    InitSignatureCache(nSigCacheSize);
 
     bool fLoaded = false;
     while (!fLoaded) {
@@ -780,12 +825,14 @@ bool AppInit2(boost::thread_group& threadGroup)
             try {
                 UnloadBlockIndex();
                 delete pcoinsTip;
+                delete pcoinsFlush;
                 delete pcoinsdbview;
                 delete pblocktree;
 
                 pblocktree = new CBlockTreeDB(nBlockTreeDBCache, false, fReindex);
                 pcoinsdbview = new CCoinsViewDB(nCoinDBCache, false, fReindex);
-                pcoinsTip = new CCoinsViewCache(*pcoinsdbview);
+                pcoinsFlush = new CCoinsViewBackgroundFlush(*pcoinsdbview);
+                pcoinsTip = new CCoinsViewCache(*pcoinsFlush);
 
                 if (fReindex)
                     pblocktree->WriteReindexing(true);
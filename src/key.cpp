@@ -2,14 +2,19 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
-#include <openssl/ecdsa.h>
+#include <stdlib.h>
+
+#include <openssl/ec.h>
 #include <openssl/rand.h>
 #include <openssl/obj_mac.h>
 
 #include "key.h"
+#include "secp256k1.h"
 
 
 // anonymous namespace with local implementation code (OpenSSL interaction)     анонимное пространство имён с локальной реализацией кода (OpenSSL взаимодействие)
+// ECDSA itself is in secp256k1.cpp; OpenSSL is left with the DER private       Сам ECDSA находится в secp256k1.cpp; за OpenSSL остаются DER-приватные
+// keys of the wallet                                                           ключи кошелька
 namespace {
 
 // Generate a private key from just the secret parameter                        Создать приватный ключ от только секретный параметр
@@ -49,80 +54,6 @@ err:
     return(ok);
 }
 
-// Perform ECDSA key recovery (see SEC1 4.1.6) for curves over (mod p)-fields   Выполнение ECDSA восстановления ключа (см. SEC1 4.1.6) для кривых над (mod р)-полей
-// recid selects which key is recovered                                         recid выбирает, какой ключ извлекается
-// if check is non-zero, additional checks are performed                        если проверка не равно нулю, дополнительные проверки выполняются
-int ECDSA_SIG_recover_key_GFp(EC_KEY *eckey, ECDSA_SIG *ecsig, const unsigned char *msg, int msglen, int recid, int check)
-{
-    if (!eckey) return 0;
-
-    int ret = 0;
-    BN_CTX *ctx = NULL;
-
-    BIGNUM *x = NULL;
-    BIGNUM *e = NULL;
-    BIGNUM *order = NULL;
-    BIGNUM *sor = NULL;
-    BIGNUM *eor = NULL;
-    BIGNUM *field = NULL;
-    EC_POINT *R = NULL;
-    EC_POINT *O = NULL;
-    EC_POINT *Q = NULL;
-    BIGNUM *rr = NULL;
-    BIGNUM *zero = NULL;
-    int n = 0;
-    int i = recid / 2;
-
-    const EC_GROUP *group = EC_KEY_get0_group(eckey);
-    if ((ctx = BN_CTX_new()) == NULL) { ret = -1; goto err; }
-    BN_CTX_start(ctx);
-    order = BN_CTX_get(ctx);
-    if (!EC_GROUP_get_order(group, order, ctx)) { ret = -2; goto err; }
-    x = BN_CTX_get(ctx);
-    if (!BN_copy(x, order)) { ret=-1; goto err; }
-    if (!BN_mul_word(x, i)) { ret=-1; goto err; }
-    if (!BN_add(x, x, ecsig->r)) { ret=-1; goto err; }
-    field = BN_CTX_get(ctx);
-    if (!EC_GROUP_get_curve_GFp(group, field, NULL, NULL, ctx)) { ret=-2; goto err; }
-    if (BN_cmp(x, field) >= 0) { ret=0; goto err; }
-    if ((R = EC_POINT_new(group)) == NULL) { ret = -2; goto err; }
-    if (!EC_POINT_set_compressed_coordinates_GFp(group, R, x, recid % 2, ctx)) { ret=0; goto err; }
-    if (check)
-    {
-        if ((O = EC_POINT_new(group)) == NULL) { ret = -2; goto err; }
-        if (!EC_POINT_mul(group, O, NULL, R, order, ctx)) { ret=-2; goto err; }
-        if (!EC_POINT_is_at_infinity(group, O)) { ret = 0; goto err; }
-    }
-    if ((Q = EC_POINT_new(group)) == NULL) { ret = -2; goto err; }
-    n = EC_GROUP_get_degree(group);
-    e = BN_CTX_get(ctx);
-    if (!BN_bin2bn(msg, msglen, e)) { ret=-1; goto err; }
-    if (8*msglen > n) BN_rshift(e, e, 8-(n & 7));
-    zero = BN_CTX_get(ctx);
-    if (!BN_zero(zero)) { ret=-1; goto err; }
-    if (!BN_mod_sub(e, zero, e, order, ctx)) { ret=-1; goto err; }
-    rr = BN_CTX_get(ctx);
-    if (!BN_mod_inverse(rr, ecsig->r, order, ctx)) { ret=-1; goto err; }
-    sor = BN_CTX_get(ctx);
-    if (!BN_mod_mul(sor, ecsig->s, rr, order, ctx)) { ret=-1; goto err; }
-    eor = BN_CTX_get(ctx);
-    if (!BN_mod_mul(eor, e, rr, order, ctx)) { ret=-1; goto err; }
-    if (!EC_POINT_mul(group, Q, eor, R, sor, ctx)) { ret=-2; goto err; }
-    if (!EC_KEY_set_public_key(eckey, Q)) { ret=-2; goto err; }
-
-    ret = 1;
-
-err:
-    if (ctx) {
-        BN_CTX_end(ctx);
-        BN_CTX_free(ctx);
-    }
-    if (R != NULL) EC_POINT_free(R);
-    if (O != NULL) EC_POINT_free(O);
-    if (Q != NULL) EC_POINT_free(Q);
-    return ret;
-}
-
 // RAII Wrapper around OpenSSL's EC_KEY                                         RAII оболочка вокруг OpenSSL'льного EC_KEY
 class CECKey {
 private:
@@ -175,86 +106,35 @@ public:
         }
         return false;
     }
+};
 
-    void GetPubKey(CPubKey &pubkey, bool fCompressed) {
-        EC_KEY_set_conv_form(pkey, fCompressed ? POINT_CONVERSION_COMPRESSED : POINT_CONVERSION_UNCOMPRESSED);
-        int nSize = i2o_ECPublicKey(pkey, NULL);
-        assert(nSize);
-        assert(nSize <= 65);
-        unsigned char c[65];
-        unsigned char *pbegin = c;
-        int nSize2 = i2o_ECPublicKey(pkey, &pbegin);
-        assert(nSize == nSize2);
-        pubkey.Set(&c[0], &c[nSize]);
-    }
-
-    bool SetPubKey(const CPubKey &pubkey) {
-        const unsigned char* pbegin = pubkey.begin();
-        return o2i_ECPublicKey(&pkey, &pbegin, pubkey.size());
-    }
-
-    bool Sign(const uint256 &hash, std::vector<unsigned char>& vchSig) {
-        unsigned int nSize = ECDSA_size(pkey);
-        vchSig.resize(nSize); // Make sure it is big enough                     Убедитесь в том, что это достаточно большое
-        assert(ECDSA_sign(0, (unsigned char*)&hash, sizeof(hash), &vchSig[0], &nSize, pkey));
-        vchSig.resize(nSize); // Shrink to fit actual size                      Уменьшить до размеров фактического размера
-        return true;
-    }
-
-    bool Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
-        // -1 = error, 0 = bad sig, 1 = good
-        if (ECDSA_verify(0, (unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) != 1)
-            return false;
-        return true;
-    }
+// Secret random bytes; without them no key or nonce is made at all, since one  Секретные случайные байты; без них ключ или nonce не создаётся вовсе,
+// that may be guessed gives the private key away                               так как угадываемый выдаёт приватный ключ
+void GetSecretRandom(unsigned char *pch, int nSize)
+{
+    if (RAND_bytes(pch, nSize) != 1)
+        abort();
+}
 
-    bool SignCompact(const uint256 &hash, unsigned char *p64, int &rec) {
-        bool fOk = false;
-        ECDSA_SIG *sig = ECDSA_do_sign((unsigned char*)&hash, sizeof(hash), pkey);
-        if (sig==NULL)
-            return false;
-        memset(p64, 0, 64);
-        int nBitsR = BN_num_bits(sig->r);
-        int nBitsS = BN_num_bits(sig->s);
-        if (nBitsR <= 256 && nBitsS <= 256) {
-            CPubKey pubkey;
-            GetPubKey(pubkey, true);
-            for (int i=0; i<4; i++) {
-                CECKey keyRec;
-                if (ECDSA_SIG_recover_key_GFp(keyRec.pkey, sig, (unsigned char*)&hash, sizeof(hash), i, 1) == 1) {
-                    CPubKey pubkeyRec;
-                    keyRec.GetPubKey(pubkeyRec, true);
-                    if (pubkeyRec == pubkey) {
-                        rec = i;
-                        fOk = true;
-                        break;
-                    }
-                }
-            }
-            assert(fOk);
-            BN_bn2bin(sig->r,&p64[32-(nBitsR+7)/8]);
-            BN_bn2bin(sig->s,&p64[64-(nBitsS+7)/8]);
-        }
-        ECDSA_SIG_free(sig);
-        return fOk;
-    }
+// Sign with fresh random nonces until one is usable                           Подписать со свежими случайными числами, пока одно не подойдёт
+void SignRandom(const unsigned char *pchKey, const uint256 &hash, unsigned char *p64, int &rec)
+{
+    unsigned char nonce[32];
+    do {
+        GetSecretRandom(nonce, sizeof(nonce));
+    } while (!Secp256k1::Sign(pchKey, hash, nonce, p64, rec));
+    OPENSSL_cleanse(nonce, sizeof(nonce));
+}
 
-    // reconstruct public key from a compact signature                                  реконструировать открытый ключ из компактной подписи
-    // This is only slightly more CPU intensive than just verifying it.                 Это лишь немного больше ресурсов процессора, чем просто их проверки.
-    // If this function succeeds, the recovered public key is guaranteed to be valid    Если эта функция завершается успешно, восстановленный открытый ключ гарантированно действителен
-    // (the signature is a valid signature of the given data for that key)              (Подпись является действительной подписью данных данных для этого ключа)
-    bool Recover(const uint256 &hash, const unsigned char *p64, int rec)
-    {
-        if (rec<0 || rec>=3)
-            return false;
-        ECDSA_SIG *sig = ECDSA_SIG_new();
-        BN_bin2bn(&p64[0],  32, sig->r);
-        BN_bin2bn(&p64[32], 32, sig->s);
-        bool ret = ECDSA_SIG_recover_key_GFp(pkey, sig, (unsigned char*)&hash, sizeof(hash), rec, 0) == 1;
-        ECDSA_SIG_free(sig);
-        return ret;
-    }
-};
+// recid of a compact signature, -1 if refused: 3 (R at x = r + n, odd y) is     recid компактной подписи, -1 если отклонена: 3 (R с x = r + n, нечётный y)
+// refused as the recovery through OpenSSL did, and so is a header out of range   отклоняется, как делало извлечение через OpenSSL, как и заголовок вне диапазона
+int GetCompactRecId(const std::vector<unsigned char>& vchSig)
+{
+    int rec = (vchSig[0] - 27) & ~4;
+    if (rec < 0 || rec >= 3)
+        return -1;
+    return rec;
+}
 
 }; // end of anonymous namespace                                                        конец анонимному пространству имён
 
@@ -284,7 +164,7 @@ bool CKey::Check(const unsigned char *vch) {
 
 void CKey::MakeNewKey(bool fCompressedIn) {
     do {
-        RAND_bytes(vch, sizeof(vch));
+        GetSecretRandom(vch, sizeof(vch));
     } while (!Check(vch));
     fValid = true;
     fCompressed = fCompressedIn;
@@ -311,53 +191,50 @@ CPrivKey CKey::GetPrivKey() const {
 
 CPubKey CKey::GetPubKey() const {
     assert(fValid);
-    CECKey key;
-    key.SetSecretBytes(vch);
+    unsigned char pch[65];
+    unsigned int nSize;
+    Secp256k1::GetPubKey(vch, fCompressed, pch, nSize);
     CPubKey pubkey;
-    key.GetPubKey(pubkey, fCompressed);
+    pubkey.Set(&pch[0], &pch[nSize]);
     return pubkey;
 }
 
 bool CKey::Sign(const uint256 &hash, std::vector<unsigned char>& vchSig) const {
     if (!fValid)
         return false;
-    CECKey key;
-    key.SetSecretBytes(vch);
-    return key.Sign(hash, vchSig);
+    unsigned char p64[64];
+    int rec;
+    SignRandom(vch, hash, p64, rec);
+    Secp256k1::EncodeSignature(p64, vchSig);
+    return true;
 }
 
 bool CKey::SignCompact(const uint256 &hash, std::vector<unsigned char>& vchSig) const {
     if (!fValid)
         return false;
-    CECKey key;
-    key.SetSecretBytes(vch);
     vchSig.resize(65);
     int rec = -1;
-    if (!key.SignCompact(hash, &vchSig[1], rec))
-        return false;
+    SignRandom(vch, hash, &vchSig[1], rec);
     assert(rec != -1);
     vchSig[0] = 27 + rec + (fCompressed ? 4 : 0);
     return true;
 }
 
 bool CPubKey::Verify(const uint256 &hash, const std::vector<unsigned char>& vchSig) const {
-    if (!IsValid())
-        return false;
-    CECKey key;
-    if (!key.SetPubKey(*this))
-        return false;
-    if (!key.Verify(hash, vchSig))
+    if (!IsValid() || vchSig.empty())
         return false;
-    return true;
+    return Secp256k1::Verify(begin(), size(), hash, &vchSig[0], vchSig.size());
 }
 
 bool CPubKey::RecoverCompact(const uint256 &hash, const std::vector<unsigned char>& vchSig) {
     if (vchSig.size() != 65)
         return false;
-    CECKey key;
-    if (!key.Recover(hash, &vchSig[1], (vchSig[0] - 27) & ~4))
+    unsigned char pch[65];
+    unsigned int nSize;
+    int rec = GetCompactRecId(vchSig);
+    if (rec < 0 || !Secp256k1::Recover(hash, &vchSig[1], rec, (vchSig[0] - 27) & 4, pch, nSize))
         return false;
-    key.GetPubKey(*this, (vchSig[0] - 27) & 4);
+    Set(&pch[0], &pch[nSize]);
     return true;
 }
 
@@ -366,12 +243,12 @@ bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char
         return false;
     if (vchSig.size() != 65)
         return false;
-    CECKey key;
-    if (!key.Recover(hash, &vchSig[1], (vchSig[0] - 27) & ~4))
+    unsigned char pch[65];
+    unsigned int nSize;
+    int rec = GetCompactRecId(vchSig);
+    if (rec < 0 || !Secp256k1::Recover(hash, &vchSig[1], rec, IsCompressed(), pch, nSize))
         return false;
-    CPubKey pubkeyRec;
-    key.GetPubKey(pubkeyRec, IsCompressed());
-    if (*this != pubkeyRec)
+    if (*this != CPubKey(&pch[0], &pch[nSize]))
         return false;
     return true;
 }
@@ -379,18 +256,15 @@ bool CPubKey::VerifyCompact(const uint256 &hash, const std::vector<unsigned char
 bool CPubKey::IsFullyValid() const {
     if (!IsValid())
         return false;
-    CECKey key;
-    if (!key.SetPubKey(*this))
-        return false;
-    return true;
+    return Secp256k1::IsValidPubKey(begin(), size());
 }
 
 bool CPubKey::Decompress() {
     if (!IsValid())
         return false;
-    CECKey key;
-    if (!key.SetPubKey(*this))
+    unsigned char pch[65];
+    if (!Secp256k1::Decompress(begin(), size(), pch))
         return false;
-    key.GetPubKey(*this, false);
+    Set(&pch[0], &pch[65]);
     return true;
 }
@@ -16,6 +16,11 @@
 #include <boost/filesystem.hpp>
 #include <boost/filesystem/fstream.hpp>
 
+#ifndef WIN32
+#include <sys/mman.h>
+#include <sys/stat.h>
+#endif
+
 using namespace std;
 using namespace boost;
 
@@ -46,8 +51,11 @@ int nScriptCheckThreads = 0;
 bool fImporting = false;
 bool fReindex = false;
 bool fBenchmark = false;
+bool fCompactBlockRelay = true;
+bool fHeadersFirst = true;
+bool fFastBlockRelay = false;
 bool fTxIndex = false;
-unsigned int nCoinCacheSize = 5000;
+size_t nCoinCacheUsage = 5000 * 300;
 bool fHaveGUI = false;
 
 /** Fees smaller than this (in satoshi) are considered zero fee (for transaction creation)
@@ -62,8 +70,36 @@ CMedianFilter<int> cPeerBlockCounts(8, 0); // Amount of blocks that other nodes
 map<uint256, CBlock*> mapOrphanBlocks;
 multimap<uint256, CBlock*> mapOrphanBlocksByPrev;
 
-map<uint256, CDataStream*> mapOrphanTransactions;
-map<uint256, map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
+// Headers-first synchronization: index entries of the headers of the best chain     Синхронизация по заголовкам: записи индекса заголовков лучшей цепи
+// past the blocks we have, in chain order (the first one's pprev is in               после имеющихся у нас блоков, по порядку цепи (pprev первой находится в
+// mapBlockIndex), and the blocks asked for along it with peer and time asked         mapBlockIndex), и запрошенные вдоль неё блоки с пиром и временем запроса
+static map<uint256, CBlockIndex*> mapHeaderIndex;
+static deque<CBlockIndex*> vHeaderChain;
+static map<uint256, pair<CNode*, int64> > mapBlocksInFlight;
+// The peer each header of the header chain came from, and how many each sent;     Пир, от которого пришёл каждый заголовок цепи заголовков, и сколько прислал каждый;
+// a header costs nothing to make, so nobody gets more than a share of the chain    заголовок ничего не стоит сделать, поэтому никто не получает больше своей доли цепи
+static deque<CNode*> vHeaderSource;
+static map<CNode*, unsigned int> mapHeadersByPeer;
+// the peer that had more headers when the chain was full, asked again later      пир, у которого были ещё заголовки, когда цепь была полна, спрашивается позже
+static CNode* pnodeHeadersMore = NULL;
+// blocks of the header chain asked for in vain since the last one arrived        блоки цепи заголовков, запрошенные впустую с прихода последнего
+static unsigned int nHeaderChainMisses = 0;
+
+// Compact blocks waiting for "blocktxn", by block and the peer that was asked;    Компактные блоки, ожидающие "blocktxn", по блоку и пиру, у которого они запрошены;
+// every peer that announces a block rebuilds it on its own                        каждый пир, объявивший блок, восстанавливает его сам
+static map<pair<uint256, CNode*>, CPartialBlock> mapPartialBlocks;
+
+// Transactions asked for from one of the peers that announced them, with peer     Транзакции, запрошенные у одного из объявивших их пиров, с пиром
+// and time asked (microseconds); the others wait for it                           и временем запроса (микросекунды); остальные ждут его
+map<uint256, pair<CNode*, int64> > mapTxInFlight;
+
+// Orphan transactions, indexed by the outpoints they spend, and their bytes in     Сиротские транзакции, индексированные по тратимым ими выходам, и их байты
+// total and per peer that sent them                                               всего и по пирам, приславшим их
+map<uint256, COrphanTx> mapOrphanTransactions;
+map<COutPoint, set<uint256> > mapOrphanTransactionsByPrev;
+static map<CNode*, set<uint256> > mapOrphanTransactionsByPeer;
+static map<CNode*, size_t> mapOrphanBytesByPeer;
+size_t nOrphanTransactionsSize = 0;
 
 // Constant stuff for coinbase transactions we create: (Константные переменные для coinbase сделок мы создаем)
 CScript COINBASE_FLAGS;
@@ -181,14 +217,18 @@ void static ResendWalletTransactions()
 
 void RegisterNodeSignals(CNodeSignals& nodeSignals)
 {
+    nodeSignals.PrepareMessages.connect(&PrepareMessages);
     nodeSignals.ProcessMessages.connect(&ProcessMessages);
     nodeSignals.SendMessages.connect(&SendMessages);
+    nodeSignals.FinalizeNode.connect(&FinalizeNode);
 }
 
 void UnregisterNodeSignals(CNodeSignals& nodeSignals)
 {
+    nodeSignals.PrepareMessages.disconnect(&PrepareMessages);
     nodeSignals.ProcessMessages.disconnect(&ProcessMessages);
     nodeSignals.SendMessages.disconnect(&SendMessages);
+    nodeSignals.FinalizeNode.disconnect(&FinalizeNode);
 }
 
 //////////////////////////////////////////////////////////////////////////////
@@ -287,11 +327,18 @@ int CBlockLocator::GetHeight()
 //
 
 bool CCoinsView::GetCoins(const uint256 &txid, CCoins &coins) { return false; }
+void CCoinsView::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins) {
+    vCoins.clear();
+    vCoins.resize(vTxid.size());
+    for (unsigned int i = 0; i < vTxid.size(); i++)
+        if (!GetCoins(vTxid[i], vCoins[i]))
+            vCoins[i] = CCoins();
+}
 bool CCoinsView::SetCoins(const uint256 &txid, const CCoins &coins) { return false; }
 bool CCoinsView::HaveCoins(const uint256 &txid) { return false; }
 CBlockIndex *CCoinsView::GetBestBlock() { return NULL; }
 bool CCoinsView::SetBestBlock(CBlockIndex *pindex) { return false; }
-bool CCoinsView::BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex) { return false; }
+bool CCoinsView::BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex) { return false; }
 bool CCoinsView::GetStats(CCoinsStats &stats) { return false; }
 
 
@@ -302,43 +349,110 @@ bool CCoinsViewBacked::HaveCoins(const uint256 &txid) { return base->HaveCoins(t
 CBlockIndex *CCoinsViewBacked::GetBestBlock() { return base->GetBestBlock(); }
 bool CCoinsViewBacked::SetBestBlock(CBlockIndex *pindex) { return base->SetBestBlock(pindex); }
 void CCoinsViewBacked::SetBackend(CCoinsView &viewIn) { base = &viewIn; }
-bool CCoinsViewBacked::BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex) { return base->BatchWrite(mapCoins, pindex); }
+bool CCoinsViewBacked::BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex) { return base->BatchWrite(mapCoins, pindex); }
 bool CCoinsViewBacked::GetStats(CCoinsStats &stats) { return base->GetStats(stats); }
 
-CCoinsViewCache::CCoinsViewCache(CCoinsView &baseIn, bool fDummy) : CCoinsViewBacked(baseIn), pindexTip(NULL) { }
+CCoinsKeyHasher::CCoinsKeyHasher() {
+    uint256 salt = GetRandHash();
+    memcpy(&k0, salt.begin(), sizeof(k0));
+    memcpy(&k1, salt.begin() + sizeof(k0), sizeof(k1));
+}
+
+CCoinsViewCache::CCoinsViewCache(CCoinsView &baseIn, bool fDummy) : CCoinsViewBacked(baseIn), pindexTip(NULL), cachedCoinsUsage(0) { }
 
 bool CCoinsViewCache::GetCoins(const uint256 &txid, CCoins &coins) {
-    if (cacheCoins.count(txid)) {
-        coins = cacheCoins[txid];
-        return true;
-    }
-    if (base->GetCoins(txid, coins)) {
-        cacheCoins[txid] = coins;
-        return true;
-    }
-    return false;
+    CCoinsMap::iterator it = FetchCoins(txid);
+    if (it == cacheCoins.end())
+        return false;
+    coins = it->second.coins;
+    return true;
 }
 
-std::map<uint256,CCoins>::iterator CCoinsViewCache::FetchCoins(const uint256 &txid) {
-    std::map<uint256,CCoins>::iterator it = cacheCoins.lower_bound(txid);
-    if (it != cacheCoins.end() && it->first == txid)
+CCoinsMap::iterator CCoinsViewCache::FetchCoins(const uint256 &txid) {
+    CCoinsMap::iterator it = cacheCoins.find(txid);
+    if (it != cacheCoins.end())
         return it;
     CCoins tmp;
     if (!base->GetCoins(txid,tmp))
         return cacheCoins.end();
-    std::map<uint256,CCoins>::iterator ret = cacheCoins.insert(it, std::make_pair(txid, CCoins()));
-    tmp.swap(ret->second);
+    CCoinsMap::iterator ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry())).first;
+    tmp.swap(ret->second.coins);
+    cachedCoinsUsage += ret->second.coins.DynamicMemoryUsage();
     return ret;
 }
 
-CCoins &CCoinsViewCache::GetCoins(const uint256 &txid) {
-    std::map<uint256,CCoins>::iterator it = FetchCoins(txid);
+CCoinsCacheEntry &CCoinsViewCache::ModifyCoins(const uint256 &txid) {
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    CCoinsCacheEntry &entry = ret.first->second;
+    if (ret.second) {
+        // a base that does not have the entry (or only a pruned one) lets us      если в базе нет записи (или есть только pruned), то мы можем
+        // drop it at flush time if it gets spent entirely in this cache           отбросить её при сбросе, если она будет полностью потрачена в этом кэше
+        if (!base->GetCoins(txid, entry.coins) || entry.coins.IsPruned()) {
+            entry.coins = CCoins();
+            entry.flags = CCoinsCacheEntry::FRESH;
+        }
+        cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+    }
+    // assume the caller modifies the entry                                         предполагаем, что вызывающий изменяет запись
+    entry.flags |= CCoinsCacheEntry::DIRTY;
+    return entry;
+}
+
+CCoinsModifier::CCoinsModifier(CCoinsViewCache &cacheIn, const uint256 &txid) : cache(cacheIn), entry(cacheIn.ModifyCoins(txid)) {
+    nUsageBefore = entry.coins.DynamicMemoryUsage();
+}
+
+CCoinsModifier::~CCoinsModifier() {
+    cache.cachedCoinsUsage -= nUsageBefore;
+    cache.cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+}
+
+void CCoinsViewCache::Prefetch(const std::vector<uint256> &vTxid) {
+    std::vector<uint256> vMissing;
+    vMissing.reserve(vTxid.size());
+    BOOST_FOREACH(const uint256 &txid, vTxid)
+        if (!cacheCoins.count(txid))
+            vMissing.push_back(txid);
+    if (vMissing.empty())
+        return;
+
+    std::vector<CCoins> vCoins;
+    base->GetCoinsBatch(vMissing, vCoins);
+    for (unsigned int i = 0; i < vMissing.size(); i++) {
+        // empty entries are missing or fully spent; FetchCoins deals with those     пустые записи отсутствуют или полностью потрачены; ими занимается FetchCoins
+        if (vCoins[i].IsPruned())
+            continue;
+        CCoinsMap::iterator it = cacheCoins.insert(std::make_pair(vMissing[i], CCoinsCacheEntry())).first;
+        vCoins[i].swap(it->second.coins);
+        cachedCoinsUsage += it->second.coins.DynamicMemoryUsage();
+    }
+}
+
+void CCoinsViewCache::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins) {
+    Prefetch(vTxid);
+    vCoins.clear();
+    vCoins.resize(vTxid.size());
+    for (unsigned int i = 0; i < vTxid.size(); i++) {
+        CCoinsMap::const_iterator it = cacheCoins.find(vTxid[i]);
+        if (it != cacheCoins.end())
+            vCoins[i] = it->second.coins;
+    }
+}
+
+const CCoins &CCoinsViewCache::GetCoins(const uint256 &txid) {
+    CCoinsMap::iterator it = FetchCoins(txid);
     assert(it != cacheCoins.end());
-    return it->second;
+    return it->second.coins;
 }
 
 bool CCoinsViewCache::SetCoins(const uint256 &txid, const CCoins &coins) {
-    cacheCoins[txid] = coins;
+    std::pair<CCoinsMap::iterator, bool> ret = cacheCoins.insert(std::make_pair(txid, CCoinsCacheEntry()));
+    CCoinsCacheEntry &entry = ret.first->second;
+    if (!ret.second)
+        cachedCoinsUsage -= entry.coins.DynamicMemoryUsage();
+    entry.coins = coins;
+    entry.flags |= CCoinsCacheEntry::DIRTY;
+    cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
     return true;
 }
 
@@ -357,17 +471,42 @@ bool CCoinsViewCache::SetBestBlock(CBlockIndex *pindex) {
     return true;
 }
 
-bool CCoinsViewCache::BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex) {
-    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
-        cacheCoins[it->first] = it->second;
+bool CCoinsViewCache::BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex) {
+    for (CCoinsMap::iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        // entries the child only read are already known here                     записи, которые потомок только читал, здесь уже известны
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
+        CCoinsMap::iterator itUs = cacheCoins.find(it->first);
+        if (itUs == cacheCoins.end()) {
+            // created and spent in the child: nothing to remember                  создана и потрачена в потомке: запоминать нечего
+            if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned())
+                continue;
+            CCoinsCacheEntry &entry = cacheCoins[it->first];
+            entry.coins.swap(it->second.coins);
+            entry.flags = CCoinsCacheEntry::DIRTY | (it->second.flags & CCoinsCacheEntry::FRESH);
+            cachedCoinsUsage += entry.coins.DynamicMemoryUsage();
+        } else {
+            cachedCoinsUsage -= itUs->second.coins.DynamicMemoryUsage();
+            if ((itUs->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned()) {
+                // our base never saw it, so it can be forgotten                    наша база её никогда не видела, поэтому её можно забыть
+                cacheCoins.erase(itUs);
+            } else {
+                itUs->second.coins.swap(it->second.coins);
+                itUs->second.flags |= CCoinsCacheEntry::DIRTY;
+                cachedCoinsUsage += itUs->second.coins.DynamicMemoryUsage();
+            }
+        }
+    }
     pindexTip = pindex;
     return true;
 }
 
 bool CCoinsViewCache::Flush() {
     bool fOk = base->BatchWrite(cacheCoins, pindexTip);
-    if (fOk)
+    if (fOk) {
         cacheCoins.clear();
+        cachedCoinsUsage = 0;
+    }
     return fOk;
 }
 
@@ -375,6 +514,14 @@ unsigned int CCoinsViewCache::GetCacheSize() {
     return cacheCoins.size();
 }
 
+size_t CCoinsViewCache::DynamicMemoryUsage() const {
+    // every map node holds the key, the entry and a link, and the bucket array   каждый узел таблицы хранит ключ, запись и ссылку, а массив корзин
+    // holds one pointer per bucket                                               хранит по одному указателю на корзину
+    return cacheCoins.size() * MallocUsage(sizeof(CCoinsMap::value_type) + 2 * sizeof(void*)) +
+           MallocUsage(cacheCoins.bucket_count() * sizeof(void*)) +
+           cachedCoinsUsage;
+}
+
 /** CCoinsView that brings transactions from a memorypool into view.
     It does not check for spendings by memory pool transactions.
                который переносит транзакций из MemoryPool в поле зрения.
@@ -397,6 +544,7 @@ bool CCoinsViewMemPool::HaveCoins(const uint256 &txid) {
 }
 
 CCoinsViewCache *pcoinsTip = NULL;
+CCoinsViewBackgroundFlush *pcoinsFlush = NULL;
 CBlockTreeDB *pblocktree = NULL;
 
 //////////////////////////////////////////////////////////////////////////////
@@ -404,16 +552,12 @@ CBlockTreeDB *pblocktree = NULL;
 // mapOrphanTransactions (карта висящих транзакций)
 //
 
-bool AddOrphanTx(const CDataStream& vMsg)
+bool AddOrphanTx(const CSharedTxRef& ptx, CNode* pfrom)
 {
-    CTransaction tx;
-    CDataStream(vMsg) >> tx;
-    uint256 hash = tx.GetHash();
+    uint256 hash = ptx->hash;
     if (mapOrphanTransactions.count(hash))
         return false;
 
-    CDataStream* pvMsg = new CDataStream(vMsg);
-
     // Ignore big transactions, to avoid a                                    Игнорировать крупных сделок, чтобы избежать
     // send-big-orphans memory exhaustion attack. If a peer has a legitimate  отправки-Big-сирот исчерпания памяти атаку. Если узел имеет законное
     // large transaction with a missing parent then we assume                 крупной сделки с отсутствующим родителем, то мы предполагаем,
@@ -421,55 +565,126 @@ bool AddOrphanTx(const CDataStream& vMsg)
     // have been mined or received.                                           были добыты или получено.
     // 10,000 orphans, each of which is at most 5,000 bytes big is            10000 сирот, каждый из которых составляет не более 5000 байтов большой
     // at most 500 megabytes of orphans:                                      не более 500 мегабайт сироты
-    if (pvMsg->size() > 5000)
+    if (ptx->GetTxSize() > 5000)
     {
-        printf("ignoring large orphan tx (size: %"PRIszu", hash: %s)\n", pvMsg->size(), hash.ToString().c_str());
-        delete pvMsg;
+        printf("ignoring large orphan tx (size: %u, hash: %s)\n", ptx->GetTxSize(), hash.ToString().c_str());
         return false;
     }
 
-    mapOrphanTransactions[hash] = pvMsg;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
-        mapOrphanTransactionsByPrev[txin.prevout.hash].insert(make_pair(hash, pvMsg));
+    COrphanTx& orphan = mapOrphanTransactions[hash];
+    orphan.ptx = ptx;
+    orphan.pfrom = pfrom;
+    BOOST_FOREACH(const CTxIn& txin, ptx->tx.vin)
+        mapOrphanTransactionsByPrev[txin.prevout].insert(hash);
+    mapOrphanTransactionsByPeer[pfrom].insert(hash);
+    mapOrphanBytesByPeer[pfrom] += ptx->GetTxSize();
+    nOrphanTransactionsSize += ptx->GetTxSize();
 
-    printf("stored orphan tx %s (mapsz %"PRIszu")\n", hash.ToString().c_str(),
-        mapOrphanTransactions.size());
+    printf("stored orphan tx %s (mapsz %"PRIszu", %"PRIszu" bytes)\n", hash.ToString().c_str(),
+        mapOrphanTransactions.size(), nOrphanTransactionsSize);
     return true;
 }
 
 void static EraseOrphanTx(uint256 hash)
 {
-    if (!mapOrphanTransactions.count(hash))
+    map<uint256, COrphanTx>::iterator it = mapOrphanTransactions.find(hash);
+    if (it == mapOrphanTransactions.end())
         return;
-    const CDataStream* pvMsg = mapOrphanTransactions[hash];
-    CTransaction tx;
-    CDataStream(*pvMsg) >> tx;
-    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    const COrphanTx& orphan = it->second;
+    BOOST_FOREACH(const CTxIn& txin, orphan.ptx->tx.vin)
+    {
+        map<COutPoint, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(txin.prevout);
+        if (itPrev == mapOrphanTransactionsByPrev.end())
+            continue;
+        itPrev->second.erase(hash);
+        if (itPrev->second.empty())
+            mapOrphanTransactionsByPrev.erase(itPrev);
+    }
+    mapOrphanTransactionsByPeer[orphan.pfrom].erase(hash);
+    if (mapOrphanTransactionsByPeer[orphan.pfrom].empty())
     {
-        mapOrphanTransactionsByPrev[txin.prevout.hash].erase(hash);
-        if (mapOrphanTransactionsByPrev[txin.prevout.hash].empty())
-            mapOrphanTransactionsByPrev.erase(txin.prevout.hash);
+        mapOrphanTransactionsByPeer.erase(orphan.pfrom);
+        mapOrphanBytesByPeer.erase(orphan.pfrom);
     }
-    delete pvMsg;
-    mapOrphanTransactions.erase(hash);
+    else
+        mapOrphanBytesByPeer[orphan.pfrom] -= orphan.ptx->GetTxSize();
+    nOrphanTransactionsSize -= orphan.ptx->GetTxSize();
+    mapOrphanTransactions.erase(it);
+}
+
+// Drop the orphans a peer sent, when it goes away                                  Удалить сирот, присланных пиром, когда он уходит
+void static EraseOrphansFor(CNode* pfrom)
+{
+    map<CNode*, set<uint256> >::iterator it = mapOrphanTransactionsByPeer.find(pfrom);
+    if (it == mapOrphanTransactionsByPeer.end())
+        return;
+    set<uint256> setHashes;
+    setHashes.swap(it->second);
+    BOOST_FOREACH(const uint256& hash, setHashes)
+        EraseOrphanTx(hash);
+    mapOrphanTransactionsByPeer.erase(pfrom);
+    mapOrphanBytesByPeer.erase(pfrom);
 }
 
-unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans)
+unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxBytes)
 {
     unsigned int nEvicted = 0;
-    while (mapOrphanTransactions.size() > nMaxOrphans)
-    {
-        // Evict a random orphan:   (Исключить случайных сирот)
-        uint256 randomhash = GetRandHash();
-        map<uint256, CDataStream*>::iterator it = mapOrphanTransactions.lower_bound(randomhash);
-        if (it == mapOrphanTransactions.end())
-            it = mapOrphanTransactions.begin();
-        EraseOrphanTx(it->first);
+    while (mapOrphanTransactions.size() > nMaxOrphans || nOrphanTransactionsSize > nMaxBytes)
+    {
+        // Evict a random orphan of the peer whose orphans take the most bytes,    Исключить случайную сироту пира, сироты которого занимают больше всего байт,
+        // so a flood from one peer doesn't push out the orphans of the others      чтобы поток от одного пира не вытеснял сирот остальных
+        map<CNode*, size_t>::iterator itMax = mapOrphanBytesByPeer.begin();
+        for (map<CNode*, size_t>::iterator it = mapOrphanBytesByPeer.begin(); it != mapOrphanBytesByPeer.end(); it++)
+            if (it->second > itMax->second)
+                itMax = it;
+        const set<uint256>& setHashes = mapOrphanTransactionsByPeer[itMax->first];
+        set<uint256>::const_iterator it = setHashes.lower_bound(GetRandHash());
+        if (it == setHashes.end())
+            it = setHashes.begin();
+        EraseOrphanTx(*it);
         ++nEvicted;
     }
     return nEvicted;
 }
 
+bool FinalizeNode(CNode* pnode)
+{
+    // called with cs_vNodes held, so cs_main is only tried                         вызывается при удержании cs_vNodes, поэтому cs_main только пробуется
+    TRY_LOCK(cs_main, lockMain);
+    if (!lockMain)
+        return false;
+
+    EraseOrphansFor(pnode);
+    // its requests may go to other peers right away                                его запросы могут сразу уйти другим пирам
+    for (map<uint256, pair<CNode*, int64> >::iterator it = mapTxInFlight.begin(); it != mapTxInFlight.end(); )
+    {
+        if ((*it).second.first == pnode)
+            mapTxInFlight.erase(it++);
+        else
+            it++;
+    }
+    for (map<uint256, pair<CNode*, int64> >::iterator it = mapBlocksInFlight.begin(); it != mapBlocksInFlight.end(); )
+    {
+        if ((*it).second.first == pnode)
+            mapBlocksInFlight.erase(it++);
+        else
+            it++;
+    }
+    for (map<pair<uint256, CNode*>, CPartialBlock>::iterator it = mapPartialBlocks.begin(); it != mapPartialBlocks.end(); )
+    {
+        if ((*it).first.second == pnode)
+            mapPartialBlocks.erase(it++);
+        else
+            it++;
+    }
+    // its headers stay, a new node at the same address doesn't inherit them      его заголовки остаются, новый узел по тому же адресу их не наследует
+    if (mapHeadersByPeer.erase(pnode))
+        replace(vHeaderSource.begin(), vHeaderSource.end(), pnode, (CNode*)NULL);
+    if (pnodeHeadersMore == pnode)
+        pnodeHeadersMore = NULL;
+    return true;
+}
+
 
 
 
@@ -787,6 +1002,101 @@ int64 GetMinFee(const CTransaction& tx, bool fAllowFree, enum GetMinFee_mode mod
     return nMinFee;
 }
 
+int GetTxMiningBlock(const CTransaction& tx, int nBestHeightIn)
+{
+    int txBl = abs(tx.tBlock);
+    if (txBl >= nBestHeightIn)
+        txBl = nBestHeightIn - TX_TBLOCK;
+    return txBl;
+}
+
+uint256 GetTxMiningHash(const CTransaction& tx, int nBestHeightIn)
+{
+    AssertLockHeld(cs_main);
+    TransM trM;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+        trM.vinM.push_back(CTxIn(txin.prevout.hash, txin.prevout.n));
+    BOOST_FOREACH(const CTxOut& out, tx.vout)
+        trM.voutM.push_back(CTxOut(out.nValue, CScript()));
+
+    int txBl = GetTxMiningBlock(tx, nBestHeightIn);
+    trM.hashBlock = GetTxMiningBlockHash(txBl);
+    if (trM.hashBlock == 0)
+        return 0;
+
+    uint256 HashTr = SerializeHash(trM);
+    if (txBl > HEIGHT_OTHER_ALGO)
+        lyra2TDC(BEGIN(HashTr), BEGIN(HashTr), 32);
+    else
+        lyra2re2_hashTX(BEGIN(HashTr), BEGIN(HashTr), 32);
+    return HashTr;
+}
+
+uint256 GetTxMiningBlockHash(int nMiningBlock)
+{
+    AssertLockHeld(cs_main);
+    if (nMiningBlock < 0 || nMiningBlock >= (int)vBlockIndexByHeight.size())
+        return 0;
+    return vBlockIndexByHeight[nMiningBlock]->GetBlockHash();
+}
+
+uint256 GetTxMiningWork(const uint256& hashMining, int nMiningBlock, int nBestHeightIn)
+{
+    if (hashMining == 0 || nMiningBlock >= nBestHeightIn)
+        return 0;
+    // transactions referring to older blocks count less (protection against 51%)   транзакции, ссылающиеся на более старые блоки, весят меньше (защита от 51%)
+    CBigNum maxBigNum = CBigNum(~uint256(0));
+    return ((maxBigNum / CBigNum(hashMining)) / (nBestHeightIn - nMiningBlock)).getuint256();
+}
+
+CTxMemPoolEntry::CTxMemPoolEntry(const CSharedTxRef& ptxIn, int64 nFeeIn, double dPriorityIn, int64 nValueInChainIn, int nHeightIn, int64 nTimeIn) :
+    ptx(ptxIn), nFee(nFeeIn), dPriority(dPriorityIn), nValueInChain(nValueInChainIn), nHeight(nHeightIn), nTime(nTimeIn),
+    nMiningBlock(-1), hashMiningBlock(0), hashMining(0), nMiningWork(0)
+{
+    nTxSize = ptx->GetTxSize();
+    nFeesWithDescendants = nFee;
+    nSizeWithDescendants = nTxSize;
+    nCountWithDescendants = 1;
+}
+
+double CTxMemPoolEntry::GetPriority(int nCurrentHeight) const
+{
+    // Each block adds one confirmation to every input in the chain            Каждый блок добавляет одно подтверждение каждому входу в цепи
+    return dPriority + (double)nValueInChain * (nCurrentHeight - nHeight) / nTxSize;
+}
+
+double CTxMemPoolEntry::GetDescendantScore() const
+{
+    return std::max((double)nFee / nTxSize, (double)nFeesWithDescendants / nSizeWithDescendants);
+}
+
+// Value of the inputs of tx, and sum(value * age) of those in the chain at nBestHeight
+//      Сумма входов tx и sum(value * age) тех из них, что в цепи, на высоте nBestHeight
+static void GetInputValues(const CTransaction &tx, CCoinsViewCache &view, int64 &nValueIn, int64 &nValueInChain, double &dPriority)
+{
+    nValueIn = nValueInChain = 0;
+    dPriority = 0;
+    BOOST_FOREACH(const CTxIn& txin, tx.vin)
+    {
+        if (!view.HaveCoins(txin.prevout.hash))
+            continue;
+        const CCoins &coins = view.GetCoins(txin.prevout.hash);
+        if (!coins.IsAvailable(txin.prevout.n))
+            continue;
+        int64 nValue = coins.vout[txin.prevout.n].nValue;
+        nValueIn += nValue;
+        if ((unsigned int)coins.nHeight == MEMPOOL_HEIGHT)
+            continue;
+        nValueInChain += nValue;
+        dPriority += (double)nValue * (nBestHeight - coins.nHeight + 1);
+    }
+}
+
+CTxMemPool::CTxMemPool() : nTotalTxSize(0), nMaxSize((uint64)DEFAULT_MAX_MEMPOOL_SIZE * 1000000),
+    dRollingMinFeeRate(0), nRollingFeeTime(0)
+{
+}
+
 void CTxMemPool::pruneSpent(const uint256 &hashTx, CCoins &coins)   // pruneSpent - вырезать траты
 {
     LOCK(cs);
@@ -800,11 +1110,41 @@ void CTxMemPool::pruneSpent(const uint256 &hashTx, CCoins &coins)   // pruneSpen
     }
 }
 
-bool CTxMemPool::accept(CValidationState &state, CTransaction &tx, bool fLimitFree,
+static CCheckQueue<CValidationCheck> scriptcheckqueue(128);
+
+// Hand checks of either kind to the script check threads                     Передать проверки любого вида потокам проверки скриптов
+template<typename T>
+static void AddChecks(CCheckQueueControl<CValidationCheck> &control, std::vector<T> &vChecks)
+{
+    std::vector<CValidationCheck> vQueued(vChecks.size());
+    for (unsigned int i = 0; i < vChecks.size(); i++)
+        vQueued[i].Set(vChecks[i]);
+    control.Add(vQueued);
+}
+
+bool CTxMemPool::accept(CValidationState &state, const CTransaction &tx, bool fLimitFree,
+                        bool* pfMissingInputs)
+{
+    return accept(state, CSharedTxRef(new CSharedTx(tx)), fLimitFree, pfMissingInputs);
+}
+
+// Accept a transaction received from the network; the pool keeps the shared       Принять транзакцию, полученную из сети; пул хранит разделяемый
+// object, which is also relayed and served from it                                объект, который также ретранслируется и отдаётся из него
+bool CTxMemPool::accept(CValidationState &state, const CSharedTxRef &ptx, bool fLimitFree,
                         bool* pfMissingInputs)
 {
+    std::vector<CTxMemPoolAccept> vAccept(1, CTxMemPoolAccept(ptx));
+    acceptBatch(vAccept, fLimitFree);
+    state = vAccept[0].state;
     if (pfMissingInputs)
-        *pfMissingInputs = false;
+        *pfMissingInputs = vAccept[0].fMissingInputs;
+    return vAccept[0].fAccepted;
+}
+
+bool CTxMemPool::acceptInputs(CTxMemPoolAccept &acc, CCoinsViewCache &view, std::set<COutPoint> &setSpent, bool fLimitFree)
+{
+    const CTransaction &tx = acc.ptx->tx;
+    CValidationState &state = acc.state;
 
     if (!CheckTransaction(tx, state))
         return error("CTxMemPool::accept() : CheckTransaction failed");
@@ -824,160 +1164,402 @@ bool CTxMemPool::accept(CValidationState &state, CTransaction &tx, bool fLimitFr
                      reason.c_str());
 
     // is it already in the memory pool?    (это уже в памяти пула?)
-    uint256 hash = tx.GetHash();
-    {
-        LOCK(cs);
-        if (mapTx.count(hash))
+    const uint256 &hash = acc.ptx->hash;
+    if (mapTx.count(hash))
+        return false;
+
+    // Check for conflicts with in-memory transactions, and with those before it in the batch
+    // Проверка отсутствия конфликтов в памяти транзакций и с теми, что перед ней в пакете
+    // (the replacement feature is disabled)                                                (функция замены отключена)
+    BOOST_FOREACH(const CTxIn &txin, tx.vin)
+        if (mapNextTx.count(txin.prevout) || setSpent.count(txin.prevout))
+            return false;
+
+    // do we already have it?   (у нас уже есть это?)
+    if (view.HaveCoins(hash))
+        return false;
+
+    // do all inputs exist?     (у всех входов существует?)
+    // Note that this does not check for the presence of actual outputs (see the next check for that),  (Заметим, что это не проверяет на наличие фактических выходов (см. следующую проверку на это))
+    // only helps filling in pfMissingInputs (to determine missing vs spent).   (только помогает заполнить pfMissingInputs (для определения отсутствующий vs потраченный))
+    BOOST_FOREACH(const CTxIn txin, tx.vin) {
+        if (!view.HaveCoins(txin.prevout.hash)) {
+            acc.fMissingInputs = true;
             return false;
+        }
     }
 
-    // Check for conflicts with in-memory transactions  (Проверка отсутствия конфликтов в памяти транзакций)
-    CTransaction* ptxOld = NULL;
-    for (unsigned int i = 0; i < tx.vin.size(); i++)
+    // are the actual inputs available? (являются фактическими входами?)
+    if (!view.HaveInputs(tx))
+        return state.Invalid(error("CTxMemPool::accept() : inputs already spent"));
+
+    // Check for non-standard pay-to-script-hash in inputs  (Проверьте на нестандартную оплату-за-скрипт-хэш в входы)
+    if (!TestNet() && !AreInputsStandard(tx, view))
+        return error("CTxMemPool::accept() : nonstandard transaction input");
+
+    // Note: if you modify this code to accept non-standard transactions, then  Примечание: Если вы измените этот код, чтобы принимать нестандартные операции, то
+    // you should add code here to check that the transaction does a            Вы должны добавить код здесь, чтобы проверить, что сделка делает
+    // reasonable number of ECDSA signature verifications.                      разумное количество проверок ECDSA подпись.
+    int64 nValueIn;
+    GetInputValues(tx, view, nValueIn, acc.nValueInChain, acc.dPriority);
+    acc.nFee = nValueIn-GetValueOut(tx);
+    unsigned int nSize = acc.ptx->GetTxSize();
+    acc.dPriority /= nSize;
+
+    // Don't accept it if it can't get into a block (Не принимайте его, если он не может попасть в блок)
+    int64 txMinFee = GetMinFee(tx, true, GMF_RELAY);
+    if (fLimitFree && acc.nFee < txMinFee)
+        return error("CTxMemPool::accept() : not enough fees %s, %"PRI64d" < %"PRI64d,
+                     hash.ToString().c_str(),
+                     acc.nFee, txMinFee);
+
+    // Nor if it pays less than what the pool evicted lately                     И если она платит меньше, чем недавно вытесненное пулом
+    int64 nRollingMinFee = GetRollingMinFee(nSize);
+    if (fLimitFree && acc.nFee < nRollingMinFee)
+        return error("CTxMemPool::accept() : mempool min fee not met %s, %"PRI64d" < %"PRI64d,
+                     hash.ToString().c_str(),
+                     acc.nFee, nRollingMinFee);
+
+    // Continuously rate-limit free transactions                                         Постоянное ограничение скорости бесплатных операций
+    // This mitigates 'penny-flooding' -- sending thousands of free transactions just to Это уменьшает "penny-flooding" - посылая тысячи бесплатных операций только, чтобы
+    // be annoying or make others' transactions take longer to confirm.                  быть раздражающим или совершать сделки других занять больше времени для подтверждения.
+    if (fLimitFree && acc.nFee < CTransaction::nMinRelayTxFee)
     {
-        COutPoint outpoint = tx.vin[i].prevout;
-        if (mapNextTx.count(outpoint))
-        {
-            // Disable replacement feature for now  (Отключена функция замены на данный момент)
-            return false;
+        static double dFreeCount;
+        static int64 nLastTime;
+        int64 nNow = GetTime();
+
+        // Use an exponentially decaying ~10-minute window: (Используйте экспоненциально затухающей ~10-минутное окно)
+        dFreeCount *= pow(1.0 - 1.0/600.0, (double)(nNow - nLastTime));
+        nLastTime = nNow;
+        // -limitfreerelay unit is thousand-bytes-per-minute        -limitfreerelay eстройство тысячи-байт-в-минуту
+        // At default rate it would take over a month to fill 1GB   При невыполнении оценить возьмет на месяц, чтобы заполнить 1GB
+        if (dFreeCount >= GetArg("-limitfreerelay", 15)*10*1000)
+            return error("CTxMemPool::accept() : free transaction rejected by rate limiter");
+        if (fDebug)
+            printf("Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
+        dFreeCount += nSize;
+    }
+
+    // Check against previous transactions; the scripts are checked by the caller   Проверка по предыдущим транзакциям; скрипты проверяет вызывающий
+    // This is done last to help prevent CPU exhaustion denial-of-service attacks.  Это делается последним, чтобы помочь предотвратить истощение CPU отказ-в-обслуживании.
+    if (!CheckInputs(tx, state, view, true, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC, &acc.vChecks))
+        return error("CTxMemPool::accept() : ConnectInputs failed %s", hash.ToString().c_str());
+
+    // the rest of the batch sees its outputs                                       остальной пакет видит её выходы
+    BOOST_FOREACH(const CTxIn &txin, tx.vin)
+        setSpent.insert(txin.prevout);
+    CTxUndo txundo;
+    UpdateCoins(tx, state, view, txundo, MEMPOOL_HEIGHT, hash);
+    return true;
+}
 
-            // Allow replacing with a newer version of the same transaction (Позволить заменить более новой версией той же сделки)
-            if (i != 0)
-                return false;
-            ptxOld = mapNextTx[outpoint].ptx;
-            if (IsFinalTx(*ptxOld))
-                return false;
-            if (!tx.IsNewerThan(*ptxOld))
-                return false;
-            for (unsigned int i = 0; i < tx.vin.size(); i++)
+unsigned int CTxMemPool::acceptBatch(std::vector<CTxMemPoolAccept> &vAccept, bool fLimitFree)
+{
+    // the script check queue is shared with ConnectBlock, one master at a time   очередь проверки скриптов общая с ConnectBlock, один мастер за раз
+    AssertLockHeld(cs_main);
+    // Everything but the scripts, in order, against one view of the coins        Всё, кроме скриптов, по порядку, на одном представлении монет
+    std::vector<CTxMemPoolAccept*> vCandidates;
+    {
+        LOCK(cs);
+        CCoinsViewMemPool viewMemPool(*pcoinsTip, *this);
+        CCoinsViewCache view(viewMemPool);
+        std::set<COutPoint> setSpent;
+        BOOST_FOREACH(CTxMemPoolAccept &acc, vAccept)
+            if (acceptInputs(acc, view, setSpent, fLimitFree))
+                vCandidates.push_back(&acc);
+    }
+
+    // The scripts of the whole batch at once, on the script check threads         Скрипты всего пакета сразу, в потоках проверки скриптов
+    bool fScriptsOk = false;
+    if (nScriptCheckThreads) {
+        std::vector<CScriptCheck> vChecks;
+        BOOST_FOREACH(CTxMemPoolAccept* pacc, vCandidates)
+            vChecks.insert(vChecks.end(), pacc->vChecks.begin(), pacc->vChecks.end());
+        CCheckQueueControl<CValidationCheck> control(&scriptcheckqueue);
+        AddChecks(control, vChecks);
+        fScriptsOk = control.Wait();
+    }
+    if (!fScriptsOk) {
+        // Without threads, or the rare path after a failure: transaction by       Без потоков, или редкий случай после сбоя: транзакция за
+        // transaction, so that each gets its own result. Those spending a         транзакцией, чтобы каждая получила свой результат. Тратящие выходы
+        // failed one's outputs miss their inputs.                                 не прошедшей лишаются своих входов.
+        std::set<uint256> setFailed;
+        std::vector<CTxMemPoolAccept*> vPassed;
+        BOOST_FOREACH(CTxMemPoolAccept* pacc, vCandidates)
+        {
+            bool fOk = true;
+            BOOST_FOREACH(const CTxIn &txin, pacc->ptx->tx.vin)
+                if (setFailed.count(txin.prevout.hash))
+                    fOk = false;
+            if (!fOk)
+                pacc->fMissingInputs = true;
+            BOOST_FOREACH(const CScriptCheck &check, pacc->vChecks)
             {
-                COutPoint outpoint = tx.vin[i].prevout;
-                if (!mapNextTx.count(outpoint) || mapNextTx[outpoint].ptx != ptxOld)
-                    return false;
+                if (!fOk)
+                    break;
+                if (!check()) {
+                    fOk = false;
+                    // For now, don't trigger DoS protection for non-canonical encodings  Пока не вызывать DoS защиту для неканонических кодировок
+                    if (check.PassesWithoutStrictEnc())
+                        pacc->state.Invalid();
+                    else
+                        pacc->state.DoS(100, false);
+                    error("CTxMemPool::accept() : ConnectInputs failed %s", pacc->ptx->hash.ToString().c_str());
+                }
             }
-            break;
+            if (fOk)
+                vPassed.push_back(pacc);
+            else
+                setFailed.insert(pacc->ptx->hash);
         }
+        vCandidates.swap(vPassed);
     }
 
+    // Store transactions in memory (склад транзакций в пмяти)
+    unsigned int nAccepted = 0;
     {
-        CCoinsView dummy;
-        CCoinsViewCache view(dummy);
-
-        {
         LOCK(cs);
-        CCoinsViewMemPool viewMemPool(*pcoinsTip, *this);
-        view.SetBackend(viewMemPool);
-
-        // do we already have it?   (у нас уже есть это?)
-        if (view.HaveCoins(hash))
-            return false;
-
-        // do all inputs exist?     (у всех входов существует?)
-        // Note that this does not check for the presence of actual outputs (see the next check for that),  (Заметим, что это не проверяет на наличие фактических выходов (см. следующую проверку на это))
-        // only helps filling in pfMissingInputs (to determine missing vs spent).   (только помогает заполнить pfMissingInputs (для определения отсутствующий vs потраченный))
-        BOOST_FOREACH(const CTxIn txin, tx.vin) {
-            if (!view.HaveCoins(txin.prevout.hash)) {
-                if (pfMissingInputs)
-                    *pfMissingInputs = true;
-                return false;
+        // a transaction whose chain of in-pool ancestors or their packages grow   транзакция, чья цепь предков в пуле или их пакеты становятся
+        // too long is refused, and so are its descendants in the batch            слишком длинными, отклоняется, как и её потомки в пакете
+        std::set<uint256> setTooLong;
+        BOOST_FOREACH(CTxMemPoolAccept* pacc, vCandidates)
+        {
+            std::string strReason;
+            BOOST_FOREACH(const CTxIn &txin, pacc->ptx->tx.vin)
+                if (setTooLong.count(txin.prevout.hash))
+                    strReason = "ancestor refused";
+            if (strReason.empty())
+                CheckPackageLimits(pacc->ptx->tx, pacc->ptx->GetTxSize(), strReason);
+            if (!strReason.empty())
+            {
+                setTooLong.insert(pacc->ptx->hash);
+                pacc->state.Invalid(error("CTxMemPool::accept() : too long mempool chain %s, %s", pacc->ptx->hash.ToString().c_str(), strReason.c_str()));
+                continue;
             }
+
+            CTxMemPoolEntry entry(pacc->ptx, pacc->nFee, pacc->dPriority, pacc->nValueInChain, nBestHeight, pacc->nTime ? pacc->nTime : GetTime());
+            // the mining hash depends on the block it refers to, one kept from before holds while that block is the same
+            //      хэш добычи зависит от блока, на который ссылается, сохранённый ранее верен, пока этот блок тот же
+            entry.nMiningBlock = GetTxMiningBlock(pacc->ptx->tx, nBestHeight);
+            entry.hashMiningBlock = GetTxMiningBlockHash(entry.nMiningBlock);
+            if (pacc->hashMining != 0 && GetTxMiningBlock(pacc->ptx->tx, pacc->nHeight) == entry.nMiningBlock &&
+                pacc->hashMiningBlock == entry.hashMiningBlock)
+                entry.hashMining = pacc->hashMining;
+            else
+                entry.hashMining = GetTxMiningHash(pacc->ptx->tx, nBestHeight);
+            entry.nMiningWork = GetTxMiningWork(entry.hashMining, entry.nMiningBlock, nBestHeight);
+            addUnchecked(entry);
         }
 
-        // are the actual inputs available? (являются фактическими входами?)
-        if (!view.HaveInputs(tx))
-            return state.Invalid(error("CTxMemPool::accept() : inputs already spent"));
+        // Make room; a transaction not paying enough for it doesn't stay        Освободить место; транзакция, которая недостаточно за него платит, не остаётся
+        unsigned int nEvicted = TrimToSize(nMaxSize);
+        if (nEvicted > 0)
+            printf("CTxMemPool::accept() : mempool full, evicted %u tx\n", nEvicted);
+        BOOST_FOREACH(CTxMemPoolAccept* pacc, vCandidates)
+        {
+            pacc->fAccepted = mapTx.count(pacc->ptx->hash) != 0;
+            if (pacc->fAccepted)
+                nAccepted++;
+            else if (!setTooLong.count(pacc->ptx->hash))
+                error("CTxMemPool::accept() : mempool full, fee rate of %s too low", pacc->ptx->hash.ToString().c_str());
+        }
+    }
 
-        // Bring the best block into scope  (Занести лучший блок в область)
-        view.GetBestBlock();
+    BOOST_FOREACH(CTxMemPoolAccept* pacc, vCandidates)
+    {
+        if (!pacc->fAccepted)
+            continue;
+        SyncWithWallets(pacc->ptx->hash, pacc->ptx->tx, NULL, true);
+        printf("CTxMemPool::accept() : accepted %s (poolsz %"PRIszu")\n",
+               pacc->ptx->hash.ToString().c_str(),
+               mapTx.size());
+    }
+    return nAccepted;
+}
 
-        // we have all inputs cached now, so switch back to dummy, so we don't need to keep lock on mempool
-        // у нас есть все входы кэшировать сейчас, так что переключиться обратно на dummy, так что мы не должны держать замок на mempool
-        view.SetBackend(dummy);
-        }
 
-        // Check for non-standard pay-to-script-hash in inputs  (Проверьте на нестандартную оплату-за-скрипт-хэш в входы)
-        if (!TestNet() && !AreInputsStandard(tx, view))
-            return error("CTxMemPool::accept() : nonstandard transaction input");
+bool CTxMemPool::addUnchecked(const uint256& hash, const CTransaction &tx)
+{
+    return addUnchecked(CSharedTxRef(new CSharedTx(tx)));
+}
 
-        // Note: if you modify this code to accept non-standard transactions, then  Примечание: Если вы измените этот код, чтобы принимать нестандартные операции, то
-        // you should add code here to check that the transaction does a            Вы должны добавить код здесь, чтобы проверить, что сделка делает
-        // reasonable number of ECDSA signature verifications.                      разумное количество проверок ECDSA подпись.
-        int64 nFees = view.GetValueIn(tx)-GetValueOut(tx);
-        unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+bool CTxMemPool::addUnchecked(const CSharedTxRef &ptx)
+{
+    // Fee and priority from the coins there are, as accept would find them    Комиссия и приоритет по имеющимся монетам, как их нашёл бы accept
+    int64 nValueIn = 0, nValueInChain = 0;
+    double dPriority = 0;
+    if (pcoinsTip)
+    {
+        LOCK(cs);
+        CCoinsViewMemPool viewMemPool(*pcoinsTip, *this);
+        CCoinsViewCache view(viewMemPool);
+        GetInputValues(ptx->tx, view, nValueIn, nValueInChain, dPriority);
+    }
+    int64 nFee = nValueIn > 0 ? nValueIn - GetValueOut(ptx->tx) : 0;
+    return addUnchecked(CTxMemPoolEntry(ptx, nFee, dPriority / ptx->GetTxSize(), nValueInChain, nBestHeight, GetTime()));
+}
 
-        // Don't accept it if it can't get into a block (Не принимайте его, если он не может попасть в блок)
-        int64 txMinFee = GetMinFee(tx, true, GMF_RELAY);
-        if (fLimitFree && nFees < txMinFee)
-            return error("CTxMemPool::accept() : not enough fees %s, %"PRI64d" < %"PRI64d,
-                         hash.ToString().c_str(),
-                         nFees, txMinFee);
+bool CTxMemPool::addUnchecked(const CTxMemPoolEntry &entryIn)
+{
+    // Add to memory pool without checking anything.  Don't call this directly, Добавить в пул памяти, не проверяя ничего. Не называйте это непосредственно,
+    // call CTxMemPool::accept to properly check the transaction first.         вызвать CTxMemPool::accept для надлежащей проверки сделки в первую очередь.
+    {
+        LOCK(cs);
+        const uint256 hash = entryIn.GetHash();
+        if (mapTx.count(hash))
+            return false;
+        CTxMemPoolEntry& entry = mapTx.insert(make_pair(hash, entryIn)).first->second;
+        const CTransaction& tx = entry.GetTx();
+        for (unsigned int i = 0; i < tx.vin.size(); i++)
+            mapNextTx[tx.vin[i].prevout] = CInPoint(&tx, i);
 
-        // Continuously rate-limit free transactions                                         Постоянное ограничение скорости бесплатных операций
-        // This mitigates 'penny-flooding' -- sending thousands of free transactions just to Это уменьшает "penny-flooding" - посылая тысячи бесплатных операций только, чтобы
-        // be annoying or make others' transactions take longer to confirm.                  быть раздражающим или совершать сделки других занять больше времени для подтверждения.
-        if (fLimitFree && nFees < CTransaction::nMinRelayTxFee)
+        // Transactions already spending it (after a reorganization) join its package, Транзакции, уже тратящие её (после реорганизации), входят в её пакет,
+        // and the whole package joins those of its ancestors                          а весь пакет - в пакеты её предков
+        set<uint256> setDescendants;
+        CalculateDescendants(hash, setDescendants);
+        BOOST_FOREACH(const uint256& hashDescendant, setDescendants)
         {
-            static double dFreeCount;
-            static int64 nLastTime;
-            int64 nNow = GetTime();
-
-            LOCK(cs);
-
-            // Use an exponentially decaying ~10-minute window: (Используйте экспоненциально затухающей ~10-минутное окно)
-            dFreeCount *= pow(1.0 - 1.0/600.0, (double)(nNow - nLastTime));
-            nLastTime = nNow;
-            // -limitfreerelay unit is thousand-bytes-per-minute        -limitfreerelay eстройство тысячи-байт-в-минуту
-            // At default rate it would take over a month to fill 1GB   При невыполнении оценить возьмет на месяц, чтобы заполнить 1GB
-            if (dFreeCount >= GetArg("-limitfreerelay", 15)*10*1000)
-                return error("CTxMemPool::accept() : free transaction rejected by rate limiter");
-            if (fDebug)
-                printf("Rate limit dFreeCount: %g => %g\n", dFreeCount, dFreeCount+nSize);
-            dFreeCount += nSize;
+            const CTxMemPoolEntry& descendant = mapTx.find(hashDescendant)->second;
+            entry.nFeesWithDescendants += descendant.nFee;
+            entry.nSizeWithDescendants += descendant.nTxSize;
         }
+        entry.nCountWithDescendants += setDescendants.size();
+        UpdateAncestors(tx, entry.nFeesWithDescendants, entry.nSizeWithDescendants, entry.nCountWithDescendants);
+
+        setByScore.insert(&entry);
+        setByMiningWork.insert(make_pair(entry.nMiningWork, hash));
+        nTotalTxSize += entry.nTxSize;
+        nTransactionsUpdated++;
+    }
+    return true;
+}
 
-        // Check against previous transactions                                          Проверка по предыдущим transactions
-        // This is done last to help prevent CPU exhaustion denial-of-service attacks.  Это делается последним, чтобы помочь предотвратить истощение CPU отказ-в-обслуживании.
-        if (!CheckInputs(tx, state, view, true, SCRIPT_VERIFY_P2SH | SCRIPT_VERIFY_STRICTENC))
+void CTxMemPool::CalculateAncestors(const CTransaction &tx, std::set<uint256> &setAncestors)
+{
+    vector<const CTransaction*> vQueue(1, &tx);
+    for (unsigned int i = 0; i < vQueue.size(); i++)
+    {
+        BOOST_FOREACH(const CTxIn& txin, vQueue[i]->vin)
         {
-            return error("CTxMemPool::accept() : ConnectInputs failed %s", hash.ToString().c_str());
+            std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mapTx.find(txin.prevout.hash);
+            if (mi != mapTx.end() && setAncestors.insert(txin.prevout.hash).second)
+                vQueue.push_back(&mi->second.GetTx());
         }
     }
+}
 
-    // Store transaction in memory (склад транзакций в пмяти)
+void CTxMemPool::CalculateDescendants(const uint256 &hash, std::set<uint256> &setDescendants)
+{
+    vector<uint256> vQueue(1, hash);
+    for (unsigned int i = 0; i < vQueue.size(); i++)
     {
-        LOCK(cs);
-        if (ptxOld)
+        std::map<COutPoint, CInPoint>::iterator it = mapNextTx.lower_bound(COutPoint(vQueue[i], 0));
+        for (; it != mapNextTx.end() && it->first.hash == vQueue[i]; ++it)
         {
-            printf("CTxMemPool::accept() : replacing tx %s with new version\n", ptxOld->GetHash().ToString().c_str());
-            remove(*ptxOld);
+            uint256 hashSpender = it->second.ptx->GetHash();
+            if (setDescendants.insert(hashSpender).second)
+                vQueue.push_back(hashSpender);
         }
-        addUnchecked(hash, tx);
     }
+}
 
-    ///// are we sure this is ok when loading transactions or restoring block txes  (мы уверены, что это нормально, когда операции загрузки или восстановления блока txes)
-    // If updated, erase old tx from wallet (Если обновляется, стереть старые TX из бумажника)
-    if (ptxOld)
-        EraseFromWallets(ptxOld->GetHash());
-    SyncWithWallets(hash, tx, NULL, true);
+void CTxMemPool::UpdateAncestors(const CTransaction &tx, int64 nFee, int64 nSize, int64 nCount)
+{
+    set<uint256> setAncestors;
+    CalculateAncestors(tx, setAncestors);
+    BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+    {
+        // the score is the key of setByScore                                   оценка - ключ setByScore
+        CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+        setByScore.erase(&ancestor);
+        ancestor.nFeesWithDescendants += nFee;
+        ancestor.nSizeWithDescendants += nSize;
+        ancestor.nCountWithDescendants += nCount;
+        setByScore.insert(&ancestor);
+    }
+}
 
-    printf("CTxMemPool::accept() : accepted %s (poolsz %"PRIszu")\n",
-           hash.ToString().c_str(),
-           mapTx.size());
+bool CTxMemPool::CheckPackageLimits(const CTransaction &tx, unsigned int nTxSize, std::string &strReason)
+{
+    // the walk is bounded by the limits of the transactions already in   обход ограничен пределами транзакций, уже находящихся в пуле
+    set<uint256> setAncestors;
+    CalculateAncestors(tx, setAncestors);
+    if (setAncestors.size() + 1 > MEMPOOL_ANCESTOR_LIMIT)
+    {
+        strReason = strprintf("too many unconfirmed ancestors (%"PRIszu")", setAncestors.size());
+        return false;
+    }
+    uint64 nSizeWithAncestors = nTxSize;
+    BOOST_FOREACH(const uint256& hashAncestor, setAncestors)
+    {
+        const CTxMemPoolEntry& ancestor = mapTx.find(hashAncestor)->second;
+        nSizeWithAncestors += ancestor.nTxSize;
+        if (ancestor.nCountWithDescendants + 1 > MEMPOOL_DESCENDANT_LIMIT ||
+            ancestor.nSizeWithDescendants + nTxSize > MEMPOOL_DESCENDANT_SIZE_LIMIT)
+        {
+            strReason = strprintf("too many descendants of %s", hashAncestor.ToString().c_str());
+            return false;
+        }
+    }
+    if (nSizeWithAncestors > MEMPOOL_ANCESTOR_SIZE_LIMIT)
+    {
+        strReason = strprintf("unconfirmed ancestors too large (%"PRI64u" bytes)", nSizeWithAncestors);
+        return false;
+    }
     return true;
 }
 
+unsigned int CTxMemPool::TrimToSize(uint64 nMaxSizeIn)
+{
+    LOCK(cs);
+    unsigned int nEvicted = 0;
+    double dMaxEvictedRate = 0;
+    while (nTotalTxSize > nMaxSizeIn && !setByScore.empty())
+    {
+        // The package goes as a whole, its descendants can't be mined without it   Пакет уходит целиком, его потомков нельзя добыть без него
+        CSharedTxRef ptx = (*setByScore.begin())->ptx;
+        dMaxEvictedRate = std::max(dMaxEvictedRate, (*setByScore.begin())->GetDescendantScore());
+        unsigned int nBefore = mapTx.size();
+        remove(ptx->tx, true);
+        nEvicted += nBefore - mapTx.size();
+    }
+
+    // What comes next has to pay more than what just left                     То, что приходит следом, должно платить больше, чем только что ушедшее
+    if (nEvicted > 0)
+    {
+        double dRate = dMaxEvictedRate + (double)CTransaction::nMinRelayTxFee / 1000;
+        dRollingMinFeeRate = std::max(GetRollingMinFee(1000) / 1000.0, dRate);
+        nRollingFeeTime = GetTime();
+    }
+    return nEvicted;
+}
 
-bool CTxMemPool::addUnchecked(const uint256& hash, CTransaction &tx)
+int64 CTxMemPool::GetRollingMinFee(unsigned int nTxSize)
 {
-    // Add to memory pool without checking anything.  Don't call this directly, Добавить в пул памяти, не проверяя ничего. Не называйте это непосредственно,
-    // call CTxMemPool::accept to properly check the transaction first.         вызвать CTxMemPool::accept для надлежащей проверки сделки в первую очередь.
+    LOCK(cs);
+    if (dRollingMinFeeRate == 0)
+        return 0;
+
+    int64 nNow = GetTime();
+    if (nNow > nRollingFeeTime)
     {
-        mapTx[hash] = tx;
-        for (unsigned int i = 0; i < tx.vin.size(); i++)
-            mapNextTx[tx.vin[i].prevout] = CInPoint(&mapTx[hash], i);
-        nTransactionsUpdated++;
+        double dHalflife = ROLLING_FEE_HALFLIFE;
+        if (nTotalTxSize < nMaxSize / 4)
+            dHalflife /= 4;
+        else if (nTotalTxSize < nMaxSize / 2)
+            dHalflife /= 2;
+        dRollingMinFeeRate /= pow(2.0, (nNow - nRollingFeeTime) / dHalflife);
+        nRollingFeeTime = nNow;
+
+        // gone down to about the relay fee, the usual checks are enough       опустившись примерно до комиссии ретрансляции, достаточно обычных проверок
+        if (dRollingMinFeeRate < (double)CTransaction::nMinRelayTxFee / 1000 / 2)
+        {
+            dRollingMinFeeRate = 0;
+            return 0;
+        }
     }
-    return true;
+    return (int64)(dRollingMinFeeRate * nTxSize);
 }
 
 
@@ -996,9 +1578,16 @@ bool CTxMemPool::remove(const CTransaction &tx, bool fRecursive)
                         remove(*it->second.ptx, true);          // (A std::map stores a key and a value.     map::iterator.second refers to the value)
                 }
             }
+            // descendants are gone already when recursive                    потомки уже удалены, если рекурсивно
+            std::map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.find(hash);
+            const CTxMemPoolEntry& entry = mi->second;
+            setByScore.erase(&entry);
+            setByMiningWork.erase(make_pair(entry.nMiningWork, hash));
+            UpdateAncestors(tx, -entry.nFee, -(int64)entry.nTxSize, -1);
+            nTotalTxSize -= entry.nTxSize;
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
                 mapNextTx.erase(txin.prevout);
-            mapTx.erase(hash);
+            mapTx.erase(mi);
             nTransactionsUpdated++;
         }
     }
@@ -1023,8 +1612,11 @@ bool CTxMemPool::removeConflicts(const CTransaction &tx)
 void CTxMemPool::clear()
 {
     LOCK(cs);
+    setByScore.clear();
+    setByMiningWork.clear();
     mapTx.clear();
     mapNextTx.clear();
+    nTotalTxSize = 0;
     ++nTransactionsUpdated;
 }
 
@@ -1034,36 +1626,184 @@ void CTxMemPool::queryHashes(std::vector<uint256>& vtxid)
 
     LOCK(cs);
     vtxid.reserve(mapTx.size());
-    for (map<uint256, CTransaction>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
+    for (map<uint256, CTxMemPoolEntry>::iterator mi = mapTx.begin(); mi != mapTx.end(); ++mi)
         vtxid.push_back((*mi).first);
 }
 
+static const int MEMPOOL_DUMP_VERSION = 2;
+static const unsigned int MEMPOOL_LOAD_BATCH = 1000;
 
-
-
-int CMerkleTx::GetDepthInMainChain(CBlockIndex* &pindexRet) const
+bool DumpMempool()
 {
-    if (hashBlock == 0 || nIndex == -1)
-        return 0;
-
-    // Find the block it claims to be in    (Найти блок с подтверждением что это он)
-    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
-    if (mi == mapBlockIndex.end())
-        return 0;
-    CBlockIndex* pindex = (*mi).second;
-    if (!pindex || !pindex->IsInMainChain())
-        return 0;
+    int64 nStart = GetTimeMillis();
 
-    // Make sure the merkle branch connects to this block   (Убедитесь, что ветвь Меркле подключается к этому блоку)
-    if (!fMerkleVerified)
+    // Parents first, so that each transaction finds its inputs when read back  Сначала родители, чтобы каждая транзакция нашла свои входы при чтении
+    vector<CTxMemPoolEntry> vEntries;
     {
-        if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->hashMerkleRoot)
-            return 0;
-        fMerkleVerified = true;
-    }
-
-    pindexRet = pindex;
-    return pindexBest->nHeight - pindex->nHeight + 1;
+        LOCK(mempool.cs);
+        vEntries.reserve(mempool.mapTx.size());
+        map<uint256, unsigned int> mapParentsLeft;
+        vector<uint256> vQueue;
+        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        {
+            set<uint256> setParents;
+            BOOST_FOREACH(const CTxIn& txin, mi->second.GetTx().vin)
+                if (mempool.mapTx.count(txin.prevout.hash))
+                    setParents.insert(txin.prevout.hash);
+            if (setParents.empty())
+                vQueue.push_back(mi->first);
+            else
+                mapParentsLeft[mi->first] = setParents.size();
+        }
+        for (unsigned int i = 0; i < vQueue.size(); i++)
+        {
+            vEntries.push_back(mempool.mapTx.find(vQueue[i])->second);
+            set<uint256> setChildren;
+            map<COutPoint, CInPoint>::iterator it = mempool.mapNextTx.lower_bound(COutPoint(vQueue[i], 0));
+            for (; it != mempool.mapNextTx.end() && it->first.hash == vQueue[i]; ++it)
+                setChildren.insert(it->second.ptx->GetHash());
+            BOOST_FOREACH(const uint256& hashChild, setChildren)
+                if (--mapParentsLeft[hashChild] == 0)
+                    vQueue.push_back(hashChild);
+        }
+    }
+
+    // serialize the entries, checksum data up to that point, then append csum    сериализовать записи, контрольная сумма данных до того момента, затем добавить CSUM
+    CDataStream ssMempool(SER_DISK, CLIENT_VERSION);
+    ssMempool << FLATDATA(Params().MessageStart());
+    ssMempool << MEMPOOL_DUMP_VERSION << (uint64)vEntries.size();
+    BOOST_FOREACH(const CTxMemPoolEntry& entry, vEntries)
+        ssMempool << entry.GetTx() << entry.nTime << entry.nFee << entry.nHeight << entry.hashMiningBlock << entry.hashMining;
+    uint256 hash = Hash(ssMempool.begin(), ssMempool.end());
+    ssMempool << hash;
+
+    boost::filesystem::path pathTmp = GetDataDir() / "mempool.dat.new";
+    FILE *file = fopen(pathTmp.string().c_str(), "wb");
+    CAutoFile fileout = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!fileout)
+        return error("DumpMempool() : open failed");
+    try {
+        fileout << ssMempool;
+    }
+    catch (std::exception &e) {
+        return error("DumpMempool() : I/O error");
+    }
+    FileCommit(fileout);
+    fileout.fclose();
+    if (!RenameOver(pathTmp, GetDataDir() / "mempool.dat"))
+        return error("DumpMempool() : Rename-into-place failed");
+
+    printf("Dumped %"PRIszu" transactions to mempool.dat  %"PRI64d"ms\n", vEntries.size(), GetTimeMillis() - nStart);
+    return true;
+}
+
+bool LoadMempool()
+{
+    int64 nStart = GetTimeMillis();
+
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    FILE *file = fopen(path.string().c_str(), "rb");
+    CAutoFile filein = CAutoFile(file, SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("LoadMempool() : open failed");
+
+    int nDataSize = std::max(GetFilesize(filein) - (int)sizeof(uint256), 0);
+    vector<unsigned char> vchData(nDataSize);
+    uint256 hashIn;
+    try {
+        if (nDataSize > 0)
+            filein.read((char *)&vchData[0], nDataSize);
+        filein >> hashIn;
+    }
+    catch (std::exception &e) {
+        return error("LoadMempool() : I/O error or stream data corrupted");
+    }
+    filein.fclose();
+
+    CDataStream ssMempool(vchData, SER_DISK, CLIENT_VERSION);
+    if (Hash(ssMempool.begin(), ssMempool.end()) != hashIn)
+        return error("LoadMempool() : checksum mismatch; data corrupted");
+
+    unsigned int nAccepted = 0, nKnown = 0, nFailed = 0;
+    try {
+        unsigned char pchMsgTmp[4];
+        int nVersion;
+        uint64 nCount;
+        ssMempool >> FLATDATA(pchMsgTmp) >> nVersion >> nCount;
+        if (memcmp(pchMsgTmp, Params().MessageStart(), sizeof(pchMsgTmp)))
+            return error("LoadMempool() : invalid network magic number");
+        if (nVersion != MEMPOOL_DUMP_VERSION)
+            return error("LoadMempool() : unknown version %d", nVersion);
+
+        // in batches, parents go with or before their children                  пакетами, родители идут вместе со своими потомками или раньше
+        std::vector<CTxMemPoolAccept> vAccept;
+        for (uint64 i = 0; i < nCount; i++)
+        {
+            CTransaction tx;
+            int64 nTime, nFee;
+            int nHeight;
+            uint256 hashMiningBlock, hashMining;
+            ssMempool >> tx >> nTime >> nFee >> nHeight >> hashMiningBlock >> hashMining;
+
+            // the fee and priority are found again from the coins, and checked  комиссия и приоритет находятся снова по монетам и проверяются
+            // as for any transaction relayed to us                             как для любой присланной нам транзакции
+            CTxMemPoolAccept acc(CSharedTxRef(new CSharedTx(tx)));
+            acc.nTime = nTime;
+            acc.nHeight = nHeight;
+            acc.hashMiningBlock = hashMiningBlock;
+            acc.hashMining = hashMining;
+            vAccept.push_back(acc);
+
+            if (vAccept.size() == MEMPOOL_LOAD_BATCH || i + 1 == nCount)
+            {
+                LOCK(cs_main);
+                BOOST_FOREACH(const CTxMemPoolAccept& accBatch, vAccept)
+                    if (mempool.exists(accBatch.ptx->hash))
+                        nKnown++;
+                unsigned int nBatchAccepted = mempool.acceptBatch(vAccept, true);
+                nAccepted += nBatchAccepted;
+                nFailed += vAccept.size() - nBatchAccepted;
+                vAccept.clear();
+            }
+            boost::this_thread::interruption_point();
+        }
+        nFailed -= nKnown;
+    }
+    catch (std::exception &e) {
+        return error("LoadMempool() : deserialize or I/O error");
+    }
+
+    printf("Loaded %u transactions from mempool.dat (%u known, %u failed)  %"PRI64d"ms\n",
+           nAccepted, nKnown, nFailed, GetTimeMillis() - nStart);
+    return true;
+}
+
+
+
+
+int CMerkleTx::GetDepthInMainChain(CBlockIndex* &pindexRet) const
+{
+    if (hashBlock == 0 || nIndex == -1)
+        return 0;
+
+    // Find the block it claims to be in    (Найти блок с подтверждением что это он)
+    map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(hashBlock);
+    if (mi == mapBlockIndex.end())
+        return 0;
+    CBlockIndex* pindex = (*mi).second;
+    if (!pindex || !pindex->IsInMainChain())
+        return 0;
+
+    // Make sure the merkle branch connects to this block   (Убедитесь, что ветвь Меркле подключается к этому блоку)
+    if (!fMerkleVerified)
+    {
+        if (CBlock::CheckMerkleBranch(GetHash(), vMerkleBranch, nIndex) != pindex->hashMerkleRoot)
+            return 0;
+        fMerkleVerified = true;
+    }
+
+    pindexRet = pindex;
+    return pindexBest->nHeight - pindex->nHeight + 1;
 }
 
 
@@ -1086,7 +1826,7 @@ bool CMerkleTx::AcceptToMemoryPool(bool fLimitFree)
 bool CWalletTx::AcceptWalletTransaction()
 {
     {
-        LOCK(mempool.cs);
+        LOCK2(cs_main, mempool.cs);
         // Add previous supporting transactions first   (Добавление предыдущих подтверждённых транзакций первыми)
         BOOST_FOREACH(CMerkleTx& tx, vtxPrev)
         {
@@ -1122,12 +1862,22 @@ bool GetTransaction(const uint256 &hash, CTransaction &txOut, uint256 &hashBlock
         if (fTxIndex) {
             CDiskTxPos postx;
             if (pblocktree->ReadTxIndex(hash, postx)) {
-                CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
                 CBlockHeader header;
+                boost::shared_ptr<const CMappedFile> pmap = MapBlockFile(postx.nFile);
                 try {
-                    file >> header;
-                    fseek(file, postx.nTxOffset, SEEK_CUR);
-                    file >> txOut;
+                    if (pmap) {
+                        if (postx.nPos >= pmap->nSize)
+                            return error("%s() : position beyond end of block file", __PRETTY_FUNCTION__);
+                        CMemoryReader reader(pmap->pbegin + postx.nPos, pmap->pbegin + pmap->nSize, SER_DISK, CLIENT_VERSION);
+                        reader >> header;
+                        reader.ignore(postx.nTxOffset);
+                        reader >> txOut;
+                    } else {
+                        CAutoFile file(OpenBlockFile(postx, true), SER_DISK, CLIENT_VERSION);
+                        file >> header;
+                        fseek(file, postx.nTxOffset, SEEK_CUR);
+                        file >> txOut;
+                    }
                 } catch (std::exception &e) {
                     return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
                 }
@@ -1215,17 +1965,31 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 {
     block.SetNull();
 
-    // Open history file to read  (Открытие файлов истории для чтения)
-    CAutoFile filein = CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
-    if (!filein)
-        return error("ReadBlockFromDisk(CBlock&, CDiskBlockPos&) : OpenBlockFile failed");
+    // Finalized block files are read straight from their mapping                  Завершённые файлы блоков читаются прямо из их отображения
+    boost::shared_ptr<const CMappedFile> pmap = MapBlockFile(pos.nFile);
+    if (pmap) {
+        if (pos.nPos >= pmap->nSize)
+            return error("ReadBlockFromDisk(CBlock&, CDiskBlockPos&) : position %u beyond end of block file %d", pos.nPos, pos.nFile);
+        try {
+            CMemoryReader reader(pmap->pbegin + pos.nPos, pmap->pbegin + pmap->nSize, SER_DISK, CLIENT_VERSION);
+            reader >> block;
+        }
+        catch (std::exception &e) {
+            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
+        }
+    } else {
+        // Open history file to read  (Открытие файлов истории для чтения)
+        CAutoFile filein = CAutoFile(OpenBlockFile(pos, true), SER_DISK, CLIENT_VERSION);
+        if (!filein)
+            return error("ReadBlockFromDisk(CBlock&, CDiskBlockPos&) : OpenBlockFile failed");
 
-    // Read block
-    try {
-        filein >> block;
-    }
-    catch (std::exception &e) {
-        return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        // Read block
+        try {
+            filein >> block;
+        }
+        catch (std::exception &e) {
+            return error("%s() : deserialize or I/O error", __PRETTY_FUNCTION__);
+        }
     }
 
     // Check the header (проверка заголовка)
@@ -1238,13 +2002,175 @@ bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos)
 
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex)
 {
+    // Recently used blocks are deserialized from memory; they were checked         Недавно использованные блоки десериализуются из памяти; они были проверены
+    // when they entered the cache                                                  при попадании в кэш
+    uint256 hash = pindex->GetBlockHash();
+    boost::shared_ptr<const CSerializeData> pmsg = blockmsgcache.Get(hash);
+    if (pmsg) {
+        try {
+            CDataStream ss(pmsg->begin() + CMessageHeader::HEADER_SIZE, pmsg->end(), SER_NETWORK, PROTOCOL_VERSION);
+            block.SetNull();
+            ss >> block;
+            return true;
+        }
+        catch (std::exception &e) {
+            printf("ReadBlockFromDisk(CBlock&, CBlockIndex*) : bad cached block %s\n", hash.ToString().c_str());
+        }
+    }
+
     if (!ReadBlockFromDisk(block, pindex->GetBlockPos()))
         return false;
-    if (block.GetHash() != pindex->GetBlockHash())
+    if (block.GetHash() != hash)
         return error("ReadBlockFromDisk(CBlock&, CBlockIndex*) : GetHash() doesn't match index");
+    // not cached here: rescans, reorgs and RPC would push out the blocks peers    здесь не кэшируется: пересканирования, реорганизации и RPC вытеснили бы блоки,
+    // ask for; GetBlockMessage and AcceptBlock fill the cache                     которые запрашивают пиры; кэш заполняют GetBlockMessage и AcceptBlock
+    return true;
+}
+
+bool ReadRawBlockFromDisk(CDataStream& ss, const CDiskBlockPos& pos)
+{
+    // The block is preceded by the message start and its size                     Блоку предшествуют начало сообщения и его размер
+    if (pos.nPos < 8)
+        return error("ReadRawBlockFromDisk() : bad position");
+
+    boost::shared_ptr<const CMappedFile> pmap = MapBlockFile(pos.nFile);
+    if (pmap) {
+        if (pos.nPos > pmap->nSize)
+            return error("ReadRawBlockFromDisk() : position beyond end of block file");
+        unsigned int nSize = 0;
+        memcpy(&nSize, pmap->pbegin + pos.nPos - 4, sizeof(nSize));
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE || nSize > pmap->nSize - pos.nPos)
+            return error("ReadRawBlockFromDisk() : bad block size %u", nSize);
+        ss.write(pmap->pbegin + pos.nPos, nSize);
+        return true;
+    }
+
+    CAutoFile filein = CAutoFile(OpenBlockFile(CDiskBlockPos(pos.nFile, pos.nPos - 4), true), SER_DISK, CLIENT_VERSION);
+    if (!filein)
+        return error("ReadRawBlockFromDisk() : OpenBlockFile failed");
+
+    try {
+        unsigned int nSize = 0;
+        filein >> nSize;
+        if (nSize < 80 || nSize > MAX_BLOCK_SIZE)
+            return error("ReadRawBlockFromDisk() : bad block size %u", nSize);
+        unsigned int nOldSize = ss.size();
+        ss.resize(nOldSize + nSize);
+        filein.read(&ss[nOldSize], nSize);
+    }
+    catch (std::exception &e) {
+        return error("%s() : I/O error", __PRETTY_FUNCTION__);
+    }
     return true;
 }
 
+CBlockMessageCache blockmsgcache(32 << 20);
+
+void CBlockMessageCache::SetMaxSize(size_t nMaxSizeIn)
+{
+    LOCK(cs);
+    nMaxSize = nMaxSizeIn;
+    while (nSize > nMaxSize && !listMsgs.empty()) {
+        nSize -= listMsgs.back().second->size();
+        mapMsgs.erase(listMsgs.back().first);
+        listMsgs.pop_back();
+    }
+}
+
+boost::shared_ptr<const CSerializeData> CBlockMessageCache::Get(const uint256 &hash)
+{
+    LOCK(cs);
+    std::map<uint256, list_type::iterator>::iterator it = mapMsgs.find(hash);
+    if (it == mapMsgs.end())
+        return boost::shared_ptr<const CSerializeData>();
+    listMsgs.splice(listMsgs.begin(), listMsgs, it->second);
+    return it->second->second;
+}
+
+void CBlockMessageCache::Put(const uint256 &hash, const boost::shared_ptr<const CSerializeData> &pmsg)
+{
+    LOCK(cs);
+    if (!pmsg || pmsg->size() > nMaxSize || mapMsgs.count(hash))
+        return;
+    listMsgs.push_front(std::make_pair(hash, pmsg));
+    mapMsgs[hash] = listMsgs.begin();
+    nSize += pmsg->size();
+    while (nSize > nMaxSize) {
+        nSize -= listMsgs.back().second->size();
+        mapMsgs.erase(listMsgs.back().first);
+        listMsgs.pop_back();
+    }
+}
+
+size_t CBlockMessageCache::GetSize() const
+{
+    LOCK(cs);
+    return nSize;
+}
+
+void CBlockMessageCache::Clear()
+{
+    LOCK(cs);
+    listMsgs.clear();
+    mapMsgs.clear();
+    nSize = 0;
+}
+
+// Fill in the size and checksum of a message serialized after an empty header     Заполнить размер и контрольную сумму сообщения, сериализованного после пустого заголовка
+static boost::shared_ptr<const CSerializeData> FinishBlockMessage(CDataStream& ss)
+{
+    unsigned int nSize = ss.size() - CMessageHeader::HEADER_SIZE;
+    memcpy((char*)&ss[CMessageHeader::MESSAGE_SIZE_OFFSET], &nSize, sizeof(nSize));
+    uint256 hash = Hash(ss.begin() + CMessageHeader::HEADER_SIZE, ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+
+    boost::shared_ptr<CSerializeData> pmsg(new CSerializeData());
+    ss.GetAndClear(*pmsg);
+    return pmsg;
+}
+
+boost::shared_ptr<const CSerializeData> MakeBlockMessage(const CBlock& block)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION));
+    ss << CMessageHeader("block", 0) << block;
+    return FinishBlockMessage(ss);
+}
+
+boost::shared_ptr<const CSerializeData> GetBlockMessage(const CBlockIndex* pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    boost::shared_ptr<const CSerializeData> pmsg = blockmsgcache.Get(hash);
+    if (pmsg)
+        return pmsg;
+
+    // Take the bytes from the block file as they are; only the header is hashed    Взять байты из файла блоков как есть; хэшируется только заголовок,
+    // to make sure the index points at the right block                             чтобы убедиться, что индекс указывает на нужный блок
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << CMessageHeader("block", 0);
+    if (!ReadRawBlockFromDisk(ss, pindex->GetBlockPos()))
+        return pmsg;
+    CBlockHeader header;
+    try {
+        CDataStream ssHeader(ss.begin() + CMessageHeader::HEADER_SIZE, ss.begin() + CMessageHeader::HEADER_SIZE + 80, SER_NETWORK, PROTOCOL_VERSION);
+        ssHeader >> header;
+    }
+    catch (std::exception &e) {
+        error("GetBlockMessage() : bad block header");
+        return pmsg;
+    }
+    if (header.GetHash() != hash) {
+        error("GetBlockMessage() : GetHash() doesn't match index");
+        return pmsg;
+    }
+
+    pmsg = FinishBlockMessage(ss);
+    blockmsgcache.Put(hash, pmsg);
+    return pmsg;
+}
+
 uint256 static GetOrphanRoot(const CBlockHeader* pblock)
 {
     // Work back to the first block in the orphan chain (возврат работы к первому блоку в orphan цепи)
@@ -1430,6 +2356,32 @@ printf(">>>>> hash: %s > hashTarget: %s\n\n", hash.ToString().c_str(), hashTarge
 }
 
 
+uint256 GetProofOfWorkBound(unsigned int nBits)
+{
+    CBigNum bnTarget;
+    bnTarget.SetCompact(nBits);
+    if (bnTarget <= 0 || bnTarget > Params().ProofOfWorkLimit())
+        return 0;
+
+    // the target of CheckProofOfWorkNEW at the largest backlash, 999 of a         цель CheckProofOfWorkNEW при наибольшем backlash, 999 из точности
+    // precision of 1000: about 1000 times the nBits target                        1000: примерно в 1000 раз больше цели nBits
+    CBigNum maxBigNum = CBigNum(~uint256(0));
+    CBigNum divideTarget = (maxBigNum / bnTarget) - 1;
+    int precision = 1000;
+    int backlash = precision - 1;
+    return (maxBigNum / (1 + divideTarget - (divideTarget / precision) * backlash)).getuint256();
+}
+
+bool CheckProofOfWorkBound(uint256 hash, unsigned int nBits)
+{
+    uint256 hashBound = GetProofOfWorkBound(nBits);
+    if (hashBound == 0)
+        return error("CheckProofOfWorkBound() : nBits below minimum work");
+    if (hash > hashBound)
+        return error("CheckProofOfWorkBound() : hash doesn't match nBits with any sumTrDif");
+    return true;
+}
+
 // Return maximum amount of blocks that other nodes claim to have   (Вернуть максимальное количество блоков, подтверждённые другими узлами)
 int GetNumBlocksOfPeers()
 {
@@ -1481,7 +2433,7 @@ void static InvalidBlockFound(CBlockIndex *pindex) {
     }
 }
 
-bool ConnectBestBlock(CValidationState &state) {
+bool ConnectBestBlock(CValidationState &state, CBlockIndex* pindexBlockIn, CBlock* pblockIn) {
     do {
         CBlockIndex *pindexNewBest;
 
@@ -1520,7 +2472,7 @@ bool ConnectBestBlock(CValidationState &state) {
                 BOOST_FOREACH(CBlockIndex *pindexSwitch, vAttach) {
                     boost::this_thread::interruption_point();
                     try {
-                        if (!SetBestChain(state, pindexSwitch))
+                        if (!SetBestChain(state, pindexSwitch, pindexBlockIn, pblockIn))
                             return false;
                     } catch(std::runtime_error &e) {
                         return state.Abort(_("System error: ") + e.what());
@@ -1574,15 +2526,16 @@ void UpdateCoins(const CTransaction& tx, CValidationState &state, CCoinsViewCach
     // mark inputs spent                        отмечаем потраченные входы
     if (!tx.IsCoinBase()) {
         BOOST_FOREACH(const CTxIn &txin, tx.vin) {
-            CCoins &coins = inputs.GetCoins(txin.prevout.hash);
+            CCoinsModifier coins(inputs, txin.prevout.hash);
             CTxInUndo undo;
-            assert(coins.Spend(txin.prevout, undo));
+            assert(coins->Spend(txin.prevout, undo));
             txundo.vprevout.push_back(undo);
         }
     }
 
     // add outputs                              добавляем выходы
-    assert(inputs.SetCoins(txhash, CCoins(tx, nHeight)));
+    CCoinsModifier outs(inputs, txhash);
+    *outs = CCoins(tx, nHeight);
 }
 
 bool CCoinsViewCache::HaveInputs(const CTransaction& tx)
@@ -1613,6 +2566,21 @@ bool CScriptCheck::operator()() const {
     return true;
 }
 
+bool CScriptCheck::PassesWithoutStrictEnc() const {
+    if (!(nFlags & SCRIPT_VERIFY_STRICTENC))
+        return false;
+    return VerifyScript(ptxTo->vin[nIn].scriptSig, scriptPubKey, *ptxTo, nIn, nFlags & ~SCRIPT_VERIFY_STRICTENC, nHashType);
+}
+
+bool CTxCheck::operator()() const {
+    CValidationState state;
+    if (!CheckTransaction(*ptx, state))
+        return false;
+    *phash = ptx->GetHash();
+    *pnSigOps = GetLegacySigOpCount(*ptx);
+    return true;
+}
+
 bool VerifySignature(const CCoins& txFrom, const CTransaction& txTo, unsigned int nIn, unsigned int flags, int nHashType)
 {
     return CScriptCheck(txFrom, txTo, nIn, flags, nHashType)();
@@ -1726,18 +2694,18 @@ bool DisconnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex
         uint256 hash = tx.GetHash();
 
         // check that all outputs are available (убедитесь, что все выходы доступны)
-        if (!view.HaveCoins(hash)) {
+        if (!view.HaveCoins(hash))
             fClean = fClean && error("DisconnectBlock() : outputs still spent? database corrupted");
-            view.SetCoins(hash, CCoins());
-        }
-        CCoins &outs = view.GetCoins(hash);
+        {
+            CCoinsModifier outs(view, hash);
 
-        CCoins outsBlock = CCoins(tx, pindex->nHeight);
-        if (outs != outsBlock)
-            fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
+            CCoins outsBlock = CCoins(tx, pindex->nHeight);
+            if (*outs != outsBlock)
+                fClean = fClean && error("DisconnectBlock() : added transaction mismatch? database corrupted");
 
-        // remove outputs   (удаление выходов)
-        outs = CCoins();
+            // remove outputs   (удаление выходов)
+            *outs = CCoins();
+        }
 
         // restore inputs   (восстановление входов)
         if (i > 0) { // not coinbases
@@ -1809,13 +2777,80 @@ void static FlushBlockFile(bool fFinalize = false)
 
 bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigned int nAddSize);
 
-static CCheckQueue<CScriptCheck> scriptcheckqueue(128);
-
 void ThreadScriptCheck() {
     RenameThread("TDC-scriptch");
     scriptcheckqueue.Thread();
 }
 
+static CCheckQueue<CHeaderCheck> headercheckqueue(128);
+
+void ThreadHeaderCheck() {
+    RenameThread("TDC-headerch");
+    headercheckqueue.Thread();
+}
+
+static CCheckQueue<CMessagePrepare> msgpreparequeue(16);
+
+void ThreadMessagePrepare() {
+    RenameThread("TDC-msgprep");
+    msgpreparequeue.Thread();
+}
+
+bool CMessagePrepare::operator()() const {
+    CNetMessage& msg = *pmsg;
+    boost::shared_ptr<CPreparedMessage> pprepared(new CPreparedMessage());
+
+    CDataStream& vRecv = msg.vRecv;
+    uint256 hash = Hash(vRecv.begin(), vRecv.begin() + msg.hdr.nMessageSize);
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    pprepared->fChecksumOk = (nChecksum == msg.hdr.nChecksum);
+
+    if (pprepared->fChecksumOk && msg.hdr.IsValid())
+    {
+        // Errors are left to ProcessMessage, which runs into them again and         Ошибки оставлены ProcessMessage, который снова наткнётся на них
+        // reports them                                                             и сообщит о них
+        std::string strCommand = msg.hdr.GetCommand();
+        try {
+            if (strCommand == "tx") {
+                CDataStream ssTx(vRecv);
+                ssTx >> pprepared->tx;
+                pprepared->fDeserialized = true;
+            } else if (strCommand == "block" && !fImporting && !fReindex) {
+                CDataStream ssBlock(vRecv);
+                ssBlock >> pprepared->block;
+                pprepared->fDeserialized = true;
+                // everything but the proof of work, which needs cs_main            всё, кроме доказательства работы, которому нужен cs_main
+                CValidationState state;
+                CheckBlock(pprepared->block, state, false, true, false);
+            }
+        } catch (std::exception &e) {
+            pprepared->fDeserialized = false;
+        }
+    }
+
+    msg.pprepared = pprepared;
+    msg.fPrepared = true;
+    return true;
+}
+
+void PrepareMessages(const std::vector<CNetMessage*>& vMsgs)
+{
+    std::vector<CMessagePrepare> vChecks;
+    vChecks.reserve(vMsgs.size());
+    BOOST_FOREACH(CNetMessage* pmsg, vMsgs)
+        vChecks.push_back(CMessagePrepare(*pmsg));
+
+    if (nScriptCheckThreads && vChecks.size() > 1) {
+        CCheckQueueControl<CMessagePrepare> control(&msgpreparequeue);
+        control.Add(vChecks);
+        control.Wait();
+    } else {
+        BOOST_FOREACH(const CMessagePrepare &check, vChecks)
+            check();
+    }
+}
+
 bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, CCoinsViewCache& view, bool fJustCheck)
 {
     // Check it again in case a previous version let a bad block in
@@ -1843,12 +2878,39 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
     int64 nBIP16SwitchTime = 1333238400;
     bool fStrictPayToScriptHash = (pindex->nTime >= nBIP16SwitchTime);
 
-    unsigned int flags = SCRIPT_VERIFY_NOCACHE |
+    // signatures cached at memory pool acceptance are not needed again once the block is in
+    //      подписи, кэшированные при приёме в пул памяти, больше не нужны, когда блок принят
+    unsigned int flags = SCRIPT_VERIFY_NOCACHE | (fJustCheck ? SCRIPT_VERIFY_NONE : SCRIPT_VERIFY_CACHEERASE) |
                          (fStrictPayToScriptHash ? SCRIPT_VERIFY_P2SH : SCRIPT_VERIFY_NONE);
 
     CBlockUndo blockundo;
 
-    CCheckQueueControl<CScriptCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
+    // Load the coins spent by this block into the view in one batch, instead of   Загрузить монеты, расходуемые этим блоком, в view одним пакетом, вместо
+    // one blocking database read per missing input in the loop below. Outputs     одного блокирующего чтения базы данных на каждый отсутствующий вход в цикле ниже.
+    // created inside the block itself are not looked up.                           Выходы, созданные в самом блоке, не ищутся.
+    int64 nStartPrefetch = GetTimeMicros();
+    {
+        std::set<uint256> setCreated;
+        std::set<uint256> setPrevout;
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+        {
+            const CTransaction &tx = block.vtx[i];
+            if (!tx.IsCoinBase())
+            {
+                BOOST_FOREACH(const CTxIn &txin, tx.vin)
+                {
+                    if (!setCreated.count(txin.prevout.hash))
+                        setPrevout.insert(txin.prevout.hash);
+                }
+            }
+            setCreated.insert(block.GetTxHash(i));
+        }
+        view.Prefetch(std::vector<uint256>(setPrevout.begin(), setPrevout.end()));
+        if (fBenchmark)
+            printf("- Prefetch %"PRIszu" input transactions: %.2fms\n", setPrevout.size(), 0.001 * (GetTimeMicros() - nStartPrefetch));
+    }
+
+    CCheckQueueControl<CValidationCheck> control(fScriptChecks && nScriptCheckThreads ? &scriptcheckqueue : NULL);
 
     vector<TxHashPriority> vecTxHashPriority;                           ////////// новое //////////
     vecTxHashPriority.reserve(block.vtx.size());                        ////////// новое //////////
@@ -1963,7 +3025,7 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
                 std::vector<CScriptCheck> vChecks;
                 if (!CheckInputs(tx, state, view, fScriptChecks, flags, nScriptCheckThreads ? &vChecks : NULL))
                     return false;
-                control.Add(vChecks);
+                AddChecks(control, vChecks);
             }
         }
 
@@ -2167,7 +3229,7 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
     return true;
 }
 
-bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew)
+bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew, CBlockIndex* pindexBlockIn, CBlock* pblockIn)
 {
     // All modifications to the coin state will be done in this cache.      Все изменения в состоянии монета будет сделано в этом кэше.
     // Only when all have succeeded, we push it to pcoinsTip.               Только когда все удалось, мы толкнём ее к pcoinsTip.
@@ -2227,9 +3289,15 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew)
     // Connect longer branch    (Подключение длинной ветви)
     vector<CTransaction> vDelete;
     BOOST_FOREACH(CBlockIndex *pindex, vConnect) {
-        CBlock block;
-        if (!ReadBlockFromDisk(block, pindex))
+        // The block we were just handed is connected from memory, so the results of   Блок, который нам только что передали, подключается из памяти, так что результаты
+        // its context-free checks (cached on it by CheckBlock) are reused.             его контекстно-независимых проверок (сохранённые в нём CheckBlock) используются повторно.
+        CBlock blockRead;
+        CBlock *pblock = &blockRead;
+        if (pblockIn && pindex == pindexBlockIn)
+            pblock = pblockIn;
+        else if (!ReadBlockFromDisk(blockRead, pindex))
             return state.Abort(_("Failed to read block 2"));
+        CBlock &block = *pblock;
         int64 nStart = GetTimeMicros();
         if (!ConnectBlock(block, state, pindex, view)) {
             if (state.IsInvalid()) {
@@ -2256,7 +3324,21 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew)
 
     // Make sure it's successfully written to disk before changing memory structure (Убедитесь, что он успешно записаны на диск, прежде чем изменять структуру памяти)
     bool fIsInitialDownload = IsInitialBlockDownload();
-    if (!fIsInitialDownload || pcoinsTip->GetCacheSize() > nCoinCacheSize) {
+    static int64 nLastCoinsFlush = 0;
+    static bool fWasInitialDownload = true;
+    if (nLastCoinsFlush == 0)
+        nLastCoinsFlush = GetTime();
+    // Write the coins when the cache outgrows -dbcache, when the initial           Записывать монеты, когда кэш превысил -dbcache, когда заканчивается
+    // download ends or a checkpoint is reached, and once an hour after that,      начальная загрузка или достигнута контрольная точка, и раз в час после,
+    // so that a crash costs at most an hour of blocks to reconnect. Shutdown       чтобы сбой стоил не более часа блоков на переподключение. Shutdown
+    // and gettxoutsetinfo write the cache as well.                                 и gettxoutsetinfo тоже записывают кэш.
+    bool fFlushCoins = pcoinsTip->DynamicMemoryUsage() > nCoinCacheUsage;
+    if (!fIsInitialDownload && (fWasInitialDownload || GetTime() - nLastCoinsFlush > 60 * 60))
+        fFlushCoins = true;
+    if (pindexNew->nHeight == Checkpoints::GetTotalBlocksEstimate())
+        fFlushCoins = true;
+    fWasInitialDownload = fIsInitialDownload;
+    if (fFlushCoins) {
         // Typical CCoins structures on disk are around 100 bytes in size.      Типичные структуры CCoins на диске около 100 байт.
         // Pushing a new one to the database can cause it to be written         Нажатие на новый, чтобы база данных может привести к его написано
         // twice (once in the log, and once in the tables). This is already     дважды (один раз в журнале, и один раз в таблицу). Это уже
@@ -2268,6 +3350,11 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew)
         pblocktree->Sync();
         if (!pcoinsTip->Flush())
             return state.Abort(_("Failed to write to coin database"));
+        nLastCoinsFlush = GetTime();
+        if (fBenchmark && pcoinsFlush) {
+            CCoinsFlushStats stats = pcoinsFlush->GetFlushStats();
+            printf("- Coins flush stalled %.2fms (previous write took %.2fms)\n", 0.001 * stats.nStallLast, 0.001 * stats.nWriteLast);
+        }
     }
 
     // At this point, all changes have been done to the database.       На данный момент, все изменения были внесены в базу данных.
@@ -2342,6 +3429,70 @@ bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew)
 }
 
 
+void ClearHeaderChain()
+{
+    BOOST_FOREACH(CBlockIndex* pindex, vHeaderChain)
+        delete pindex;
+    vHeaderChain.clear();
+    mapHeaderIndex.clear();
+    mapBlocksInFlight.clear();
+    vHeaderSource.clear();
+    mapHeadersByPeer.clear();
+    pnodeHeadersMore = NULL;
+    nHeaderChainMisses = 0;
+}
+
+void static ForgetHeaderSource(CNode* pnode)
+{
+    if (pnode && --mapHeadersByPeer[pnode] == 0)
+        mapHeadersByPeer.erase(pnode);
+}
+
+// Drop the headers from position nSize on                                        Отбросить заголовки начиная с позиции nSize
+void static TruncateHeaderChain(unsigned int nSize)
+{
+    while (vHeaderChain.size() > nSize)
+    {
+        CBlockIndex* pindex = vHeaderChain.back();
+        vHeaderChain.pop_back();
+        mapHeaderIndex.erase(pindex->GetBlockHash());
+        delete pindex;
+        ForgetHeaderSource(vHeaderSource.back());
+        vHeaderSource.pop_back();
+    }
+}
+
+// The peer didn't serve a block whose header it sent us: its headers from there   Пир не отдал блок, заголовок которого прислал нам: его заголовки оттуда
+// on go, and it is synchronized with "getblocks" from now on                       отбрасываются, и с ним теперь синхронизируются через "getblocks"
+void static HeadersUnserved(CNode* pnode, unsigned int nPos)
+{
+    printf("header chain: blocks from height %d on not served, dropping %"PRIszu" headers\n",
+           vHeaderChain[nPos]->nHeight, vHeaderChain.size() - nPos);
+    TruncateHeaderChain(nPos);
+    nHeaderChainMisses = 0;
+    if (pnode && !pnode->fHeadersUnserved)
+    {
+        pnode->fHeadersUnserved = true;
+        PushGetBlocks(pnode, pindexBest, uint256(0));
+    }
+}
+
+// The block of the first header arrived, the header chain now starts after it     Пришёл блок первого заголовка, теперь цепь заголовков начинается после него
+void static AdvanceHeaderChain(CBlockIndex* pindexNew)
+{
+    if (vHeaderChain.empty() || vHeaderChain.front()->GetBlockHash() != pindexNew->GetBlockHash())
+        return;
+    CBlockIndex* pindexHeader = vHeaderChain.front();
+    vHeaderChain.pop_front();
+    mapHeaderIndex.erase(pindexNew->GetBlockHash());
+    delete pindexHeader;
+    ForgetHeaderSource(vHeaderSource.front());
+    vHeaderSource.pop_front();
+    nHeaderChainMisses = 0;
+    if (!vHeaderChain.empty())
+        vHeaderChain.front()->pprev = pindexNew;
+}
+
 bool AddToBlockIndex(CBlock& block, CValidationState& state, const CDiskBlockPos& pos)
 {
     // Check for duplicate (Проверка на дублирование)
@@ -2368,12 +3519,13 @@ bool AddToBlockIndex(CBlock& block, CValidationState& state, const CDiskBlockPos
     pindexNew->nUndoPos = 0;
     pindexNew->nStatus = BLOCK_VALID_TRANSACTIONS | BLOCK_HAVE_DATA;
     setBlockIndexValid.insert(pindexNew);
+    AdvanceHeaderChain(pindexNew);
 
     if (!pblocktree->WriteBlockIndex(CDiskBlockIndex(pindexNew)))
         return state.Abort(_("Failed to write block index"));
 
     // New best?    (Новый лучшие?)
-    if (!ConnectBestBlock(state))
+    if (!ConnectBestBlock(state, pindexNew, &block))
         return false;
 
     if (pindexNew == pindexBest)
@@ -2486,40 +3638,53 @@ bool FindUndoPos(CValidationState &state, int nFile, CDiskBlockPos &pos, unsigne
     return true;
 }
 
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot)
+// The part of CheckBlock that depends only on the transactions of the block    Часть CheckBlock, зависящая только от транзакций блока
+static bool CheckBlockTransactions(const CBlock& block, CValidationState& state, bool fCheckMerkleRoot, bool fParallel)
 {
-    // These are checks that are independent of context     Эти проверки, которые не зависят от контекста,
-    // that can be verified before saving an orphan block.  который может быть проверен перед сохранением сиротского блока.
-
-    // Size limits
-    if (block.vtx.empty() || block.vtx.size() > MAX_BLOCK_SIZE || ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
-        return state.DoS(100, error("CheckBlock() : size limits failed"));
-
-    // Check proof of work matches claimed amount   (Проверьте доказательство работы состояния заявленной суммы)
-    if (fCheckPOW && !CheckProofOfWorkNEW(block.vtx, block.GetHash(), block.nBits))
-//    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits))
-        return state.DoS(50, error("CheckBlock() : proof of work failed"));
-
-    // Check timestamp
-    if (block.GetBlockTime() > GetAdjustedTime() + 2 * 60 * 60)
-        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"));
-
     // First transaction must be coinbase, the rest must not be (Первая транзакция должна быть coinbase, остальное не должны быть)
     if (block.vtx.empty() || !block.vtx[0].IsCoinBase())
-        return state.DoS(100, error("CheckBlock() : first tx is not coinbase"));
+        return state.DoS(100, error("CheckBlockTransactions() : first tx is not coinbase"));
     for (unsigned int i = 1; i < block.vtx.size(); i++)
         if (block.vtx[i].IsCoinBase())
-            return state.DoS(100, error("CheckBlock() : more than one coinbase"));
+            return state.DoS(100, error("CheckBlockTransactions() : more than one coinbase"));
+
+    // Check transactions, computing their hashes and legacy sigop counts on the     Проверка транзакций, с вычислением их хэшей и количества legacy sigop
+    // way. This is spread over the script check threads, if there are any.          попутно. Работа распределяется по потокам проверки скриптов, если они есть.
+    std::vector<unsigned int> vSigOps(block.vtx.size(), 0);
+    block.vMerkleTree.clear();
+    block.vMerkleTree.resize(block.vtx.size());
+    {
+        std::vector<CTxCheck> vChecks;
+        vChecks.reserve(block.vtx.size());
+        for (unsigned int i = 0; i < block.vtx.size(); i++)
+            vChecks.push_back(CTxCheck(block.vtx[i], block.vMerkleTree[i], vSigOps[i]));
+
+        bool fTxOk = true;
+        if (fParallel && nScriptCheckThreads) {
+            CCheckQueueControl<CValidationCheck> control(&scriptcheckqueue);
+            AddChecks(control, vChecks);
+            fTxOk = control.Wait();
+        } else {
+            BOOST_FOREACH(const CTxCheck &check, vChecks)
+                if (!(fTxOk = check()))
+                    break;
+        }
 
-    // Check transactions   (проверка транзакций)
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
-        if (!CheckTransaction(tx, state))
-            return error("CheckBlock() : CheckTransaction failed");
+        if (!fTxOk) {
+            // Rare path: redo the checks in order to get the DoS score of the      Редкий случай: повторяем проверки по порядку, чтобы получить оценку DoS
+            // first failing transaction into state.                                первой не прошедшей транзакции в state.
+            block.vMerkleTree.clear();
+            BOOST_FOREACH(const CTransaction& tx, block.vtx)
+                if (!CheckTransaction(tx, state))
+                    return error("CheckBlockTransactions() : CheckTransaction failed");
+            return state.DoS(100, error("CheckBlockTransactions() : CheckTransaction failed"));
+        }
+    }
 
     // Build the merkle tree already. We need it anyway later, and it makes the     Построить дерево Меркле уже. Нам нужно это в любом случае позже, и это делает
     // block cache the transaction hashes, which means they don't need to be        блок кэш сделки хэшей, которая означает, что они не должны быть
     // recalculated many times during this block's validation.                      пересчитаны много раз во время проверки этого блока.
-    block.BuildMerkleTree();
+    uint256 hashMerkleRoot = block.BuildMerkleTree(true);
 
     // Check for duplicate txids. This is caught by ConnectInputs(),        Проверьте дублирование txids. Это пойман ConnectInputs ()
     // but catching it earlier avoids a potential DoS attack:               но ловить его ранних избежать потенциальной атаки DoS
@@ -2528,33 +3693,116 @@ bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bo
         uniqueTx.insert(block.GetTxHash(i));
     }
     if (uniqueTx.size() != block.vtx.size())
-        return state.DoS(100, error("CheckBlock() : duplicate transaction"));
+        return state.DoS(100, error("CheckBlockTransactions() : duplicate transaction"));
 
     unsigned int nSigOps = 0;
-    BOOST_FOREACH(const CTransaction& tx, block.vtx)
+    BOOST_FOREACH(unsigned int nTxSigOps, vSigOps)
     {
-        nSigOps += GetLegacySigOpCount(tx);
+        nSigOps += nTxSigOps;
     }
     if (nSigOps > MAX_BLOCK_SIGOPS)
-        return state.DoS(100, error("CheckBlock() : out-of-bounds SigOpCount"));
+        return state.DoS(100, error("CheckBlockTransactions() : out-of-bounds SigOpCount"));
 
     // Check merkle root
-    if (fCheckMerkleRoot && block.hashMerkleRoot != block.BuildMerkleTree())
-        return state.DoS(100, error("CheckBlock() : hashMerkleRoot mismatch"));
+    if (fCheckMerkleRoot && block.hashMerkleRoot != hashMerkleRoot)
+        return state.DoS(100, error("CheckBlockTransactions() : hashMerkleRoot mismatch"));
+
+    // Remember the result for the next CheckBlock (see CMessagePrepare)           Запомнить результат для следующего CheckBlock (см. CMessagePrepare)
+    if (fCheckMerkleRoot)
+        block.hashTxChecked = block.hashMerkleRoot;
 
     return true;
 }
 
-
-bool AcceptBlock(CBlock& block, CValidationState& state, CDiskBlockPos* dbp)
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW, bool fCheckMerkleRoot, bool fParallel)
 {
-    // Check for duplicate (Проверка на дублирование)
-    uint256 hash = block.GetHash();
-    if (mapBlockIndex.count(hash))
-        return state.Invalid(error("AcceptBlock() : block already in mapBlockIndex"));
+    // These are checks that are independent of context     Эти проверки, которые не зависят от контекста,
+    // that can be verified before saving an orphan block.  который может быть проверен перед сохранением сиротского блока.
 
-    // Get prev block index (Получить предыдущее индекс блока)
-    CBlockIndex* pindexPrev = NULL;
+    // A block that already passed all of them does not need to be checked again    Блок, уже прошедший их все, не нужно проверять повторно
+    if (block.fChecked)
+        return true;
+
+    // Size limits
+    if (block.vtx.empty() || block.vtx.size() > MAX_BLOCK_SIZE || ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION) > MAX_BLOCK_SIZE)
+        return state.DoS(100, error("CheckBlock() : size limits failed"));
+
+    // Check proof of work matches claimed amount   (Проверьте доказательство работы состояния заявленной суммы)
+    if (fCheckPOW && !CheckProofOfWorkNEW(block.vtx, block.GetHash(), block.nBits))
+//    if (fCheckPOW && !CheckProofOfWork(block.GetHash(), block.nBits))
+        return state.DoS(50, error("CheckBlock() : proof of work failed"));
+
+    // Check timestamp
+    if (block.GetBlockTime() > GetAdjustedTime() + 2 * 60 * 60)
+        return state.Invalid(error("CheckBlock() : block timestamp too far in the future"));
+
+    // Transactions, merkle tree and sigops; a message preparation thread may have   Транзакции, дерево Меркля и sigops; поток подготовки сообщений мог
+    // checked them already against the same merkle root                            уже проверить их с тем же корнем Меркля
+    if (!fCheckMerkleRoot || block.hashTxChecked == 0 || block.hashTxChecked != block.hashMerkleRoot)
+        if (!CheckBlockTransactions(block, state, fCheckMerkleRoot, fParallel))
+            return false;
+
+    // Remember the result, but only when nothing was skipped                       Запомнить результат, но только если ничего не было пропущено
+    if (fCheckPOW && fCheckMerkleRoot)
+        block.fChecked = true;
+
+    return true;
+}
+
+
+// Announce a block at height nHeight to the peers that are not far behind. Peers     Объявить блок на высоте nHeight пирам, не сильно отстающим. Пиры,
+// that asked for it get the compact block right away instead of inv. A block not     которые об этом просили, сразу получают компактный блок вместо inv. Блок, ещё
+// connected yet (fFast) only goes to the peers that accept that ("sendfast"), and    не подключённый (fFast), уходит только пирам, которые это принимают ("sendfast"),
+// they get their inv at once too, not with the next SendMessages                     и они тоже сразу получают свой inv, а не со следующим SendMessages
+void static RelayBlock(const CBlock& block, int nHeight, bool fFast)
+{
+    int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
+    CInv inv(MSG_BLOCK, block.GetHash());
+    CCompactBlock cmpctblock;
+    bool fCmpctBlockMade = false;
+    LOCK(cs_vNodes);
+    BOOST_FOREACH(CNode* pnode, vNodes)
+        if (nHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
+        {
+            // the others get it once it is connected                                остальные получат его, когда он будет подключён
+            if (fFast && !pnode->fFastRelay)
+                continue;
+            // mark it as not connected yet; control messages go out first        пометить его как ещё не подключённый; управляющие сообщения уходят первыми
+            if (fFast)
+                pnode->PushMessage("fastblock", inv.hash);
+            if (!pnode->fCompactAnnounce && !fFast)
+            {
+                pnode->PushInventory(inv);
+                continue;
+            }
+            {
+                LOCK(pnode->cs_inventory);
+                if (!pnode->filterInventoryKnown.insert(inv.hash))
+                    continue;
+            }
+            if (!pnode->fCompactAnnounce)
+            {
+                pnode->PushMessage("inv", vector<CInv>(1, inv));
+                continue;
+            }
+            if (!fCmpctBlockMade)
+            {
+                cmpctblock = CCompactBlock(block);
+                fCmpctBlockMade = true;
+            }
+            pnode->PushMessage("cmpctblock", cmpctblock);
+        }
+}
+
+bool AcceptBlock(CBlock& block, CValidationState& state, CDiskBlockPos* dbp)
+{
+    // Check for duplicate (Проверка на дублирование)
+    uint256 hash = block.GetHash();
+    if (mapBlockIndex.count(hash))
+        return state.Invalid(error("AcceptBlock() : block already in mapBlockIndex"));
+
+    // Get prev block index (Получить предыдущее индекс блока)
+    CBlockIndex* pindexPrev = NULL;
     int nHeight = 0;
     if (hash != Params().HashGenesisBlock()) {
         map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(block.hashPrevBlock);
@@ -2618,19 +3866,16 @@ bool AcceptBlock(CBlock& block, CValidationState& state, CDiskBlockPos* dbp)
                 return state.Abort(_("Failed to write block"));
         if (!AddToBlockIndex(block, state, blockPos))
             return error("AcceptBlock() : AddToBlockIndex failed");
+        // A new block is about to be asked for by many peers at once             Новый блок вот-вот запросят многие пиры одновременно
+        if (dbp == NULL && !IsInitialBlockDownload())
+            blockmsgcache.Put(hash, MakeBlockMessage(block));
     } catch(std::runtime_error &e) {
         return state.Abort(_("System error: ") + e.what());
     }
 
     // Relay inventory, but don't relay old inventory during initial block download (Эстафета инвентаризации, но не старая эстафета инвентаризации во время начальной загрузки блока)
-    int nBlockEstimate = Checkpoints::GetTotalBlocksEstimate();
     if (hashBestChain == hash)
-    {
-        LOCK(cs_vNodes);
-        BOOST_FOREACH(CNode* pnode, vNodes)
-            if (nBestHeight > (pnode->nStartingHeight != -1 ? pnode->nStartingHeight - 2000 : nBlockEstimate))
-                pnode->PushInventory(CInv(MSG_BLOCK, hash));
-    }
+        RelayBlock(block, nBestHeight, false);
 
     return true;
 }
@@ -2656,12 +3901,229 @@ void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd)
     pnode->hashLastGetBlocksEnd = hashEnd;
 
     pnode->PushMessage("getblocks", CBlockLocator(pindexBegin), hashEnd);
+    if (!pnode->nSyncAskTime)
+        pnode->nSyncAskTime = GetTimeMicros();
+}
+
+void PushGetHeaders(CNode* pnode)
+{
+    CBlockIndex* pindexBegin = vHeaderChain.empty() ? pindexBest : vHeaderChain.back();
+    pnode->PushMessage("getheaders", CBlockLocator(pindexBegin), uint256(0));
+    if (!pnode->nSyncAskTime)
+        pnode->nSyncAskTime = GetTimeMicros();
+}
+
+bool CheckHeaderContext(CValidationState &state, const CBlockHeader& header, const uint256& hash, CBlockIndex* pindexPrev)
+{
+    int nHeight = pindexPrev->nHeight + 1;
+    if (header.hashPrevBlock != pindexPrev->GetBlockHash())
+        return state.DoS(20, error("CheckHeaderContext() : non-continuous headers"));
+    if (header.nBits != GetNextWorkRequired(pindexPrev, &header))
+        return state.DoS(100, error("CheckHeaderContext() : incorrect proof of work"));
+    if (!CheckProofOfWorkBound(hash, header.nBits))
+        return state.DoS(100, error("CheckHeaderContext() : proof of work failed"));
+    if (header.GetBlockTime() <= pindexPrev->GetMedianTimePast())
+        return state.Invalid(error("CheckHeaderContext() : block's timestamp is too early"));
+    if (header.GetBlockTime() > GetAdjustedTime() + 2 * 60 * 60)
+        return state.Invalid(error("CheckHeaderContext() : block timestamp too far in the future"));
+    if (!Checkpoints::CheckBlock(nHeight, hash))
+        return state.DoS(100, error("CheckHeaderContext() : rejected by checkpoint lock-in at %d", nHeight));
+    return true;
+}
+
+bool ProcessHeaders(CValidationState &state, CNode* pfrom, const vector<CBlockHeader>& vHeaders)
+{
+    if (vHeaders.empty())
+        return true;
+    if (vHeaders.size() > MAX_HEADERS_RESULTS)
+        return state.DoS(20, error("ProcessHeaders() : %"PRIszu" headers", vHeaders.size()));
+    // its headers led nowhere before, it is synchronized with "getblocks"          его заголовки уже никуда не вели, с ним синхронизируются через "getblocks"
+    if (pfrom && pfrom->fHeadersUnserved)
+        return true;
+
+    // The headers attach to a block we have or to a header of the header chain       Заголовки присоединяются к имеющемуся блоку или к заголовку цепи заголовков
+    CBlockIndex* pindexPrev = NULL;
+    map<uint256, CBlockIndex*>::iterator mi = mapHeaderIndex.find(vHeaders[0].hashPrevBlock);
+    if (mi != mapHeaderIndex.end())
+        pindexPrev = (*mi).second;
+    else if ((mi = mapBlockIndex.find(vHeaders[0].hashPrevBlock)) != mapBlockIndex.end())
+        pindexPrev = (*mi).second;
+    if (!pindexPrev)
+        return error("ProcessHeaders() : headers don't connect to a known block");
+
+    // Lyra2 hashing is the expensive part, it is spread over the header check threads   Хэширование Lyra2 - дорогая часть, она распределяется по потокам проверки заголовков
+    vector<uint256> vHash(vHeaders.size());
+    {
+        vector<CHeaderCheck> vChecks;
+        vChecks.reserve(vHeaders.size());
+        for (unsigned int i = 0; i < vHeaders.size(); i++)
+            vChecks.push_back(CHeaderCheck(vHeaders[i], pindexPrev->nHeight + 1 + i, vHash[i]));
+        if (nScriptCheckThreads && vChecks.size() > 1) {
+            CCheckQueueControl<CHeaderCheck> control(&headercheckqueue);
+            control.Add(vChecks);
+            control.Wait();
+        } else {
+            BOOST_FOREACH(const CHeaderCheck &check, vChecks)
+                check();
+        }
+    }
+
+    // Check the headers in chain order. Without its transactions the proof of work   Проверить заголовки по порядку цепи. Без транзакций доказательство работы
+    // of a TDC block can only be checked against the bound of the sumTrDif             блока TDC можно проверить только по границе ослабления sumTrDif,
+    // relaxation, the rest is checked when the block arrives.                          остальное проверяется, когда приходит сам блок.
+    vector<CBlockIndex*> vNew;
+    bool fValid = true;
+    for (unsigned int i = 0; i < vHeaders.size(); i++)
+    {
+        const CBlockHeader& header = vHeaders[i];
+        int nHeight = pindexPrev->nHeight + 1;
+        if (!CheckHeaderContext(state, header, vHash[i], pindexPrev))
+        {
+            fValid = false;
+            break;
+        }
+
+        // skip what we know already, as a block or as a header                     пропустить то, что уже известно, как блок или как заголовок
+        if (vNew.empty())
+        {
+            if ((mi = mapBlockIndex.find(vHash[i])) != mapBlockIndex.end() ||
+                ((mi = mapHeaderIndex.find(vHash[i])) != mapHeaderIndex.end()))
+            {
+                pindexPrev = (*mi).second;
+                continue;
+            }
+        }
+
+        CBlockHeader headerNew = header;
+        CBlockIndex* pindexNew = new CBlockIndex(headerNew);
+        pindexNew->phashBlock = &vHash[i];
+        pindexNew->pprev = pindexPrev;
+        pindexNew->nHeight = nHeight;
+        pindexNew->nChainWork = pindexPrev->nChainWork + pindexNew->GetBlockWork().getuint256();
+        vNew.push_back(pindexNew);
+        pindexPrev = pindexNew;
+    }
+    if (pfrom)
+        pfrom->nHeadersHeight = max(pfrom->nHeadersHeight, pindexPrev->nHeight);
+
+    if (!vNew.empty())
+    {
+        // Take the new headers if they extend the header chain, or, without one,   Принять новые заголовки, если они продлевают цепь заголовков, или, если её нет,
+        // branch off our blocks with more work. The work of a header is only       ответвляются от наших блоков с большей работой. Работа заголовка только
+        // claimed, so a branch of headers never replaces the header chain; that    заявлена, поэтому ветвь заголовков никогда не заменяет цепь заголовков; это
+        // one goes when its blocks are not served or our blocks overtake it.       делает только она сама, когда её блоки не отдают или наши блоки её обгоняют.
+        CBlockIndex* pindexAttach = vNew.front()->pprev;
+        CBlockIndex* pindexTip = vHeaderChain.empty() ? pindexBest : vHeaderChain.back();
+        if (pindexAttach != pindexTip && (!vHeaderChain.empty() || (pindexTip && vNew.back()->nChainWork <= pindexTip->nChainWork)))
+        {
+            BOOST_FOREACH(CBlockIndex* pindex, vNew)
+                delete pindex;
+            return fValid;
+        }
+
+        // as many as fit, in total and from this peer                              сколько поместится, всего и от этого пира
+        unsigned int nRoom = MAX_HEADER_CHAIN - vHeaderChain.size();
+        map<CNode*, unsigned int>::iterator itPeer = mapHeadersByPeer.find(pfrom);
+        if (pfrom && itPeer != mapHeadersByPeer.end())
+            nRoom = min(nRoom, MAX_HEADER_CHAIN_PER_PEER - (*itPeer).second);
+        else if (pfrom)
+            nRoom = min(nRoom, MAX_HEADER_CHAIN_PER_PEER);
+        if (vNew.size() > nRoom)
+        {
+            for (unsigned int i = nRoom; i < vNew.size(); i++)
+                delete vNew[i];
+            vNew.resize(nRoom);
+            pnodeHeadersMore = pfrom;
+        }
+        BOOST_FOREACH(CBlockIndex* pindex, vNew)
+        {
+            mi = mapHeaderIndex.insert(make_pair(*pindex->phashBlock, pindex)).first;
+            pindex->phashBlock = &((*mi).first);
+            vHeaderChain.push_back(pindex);
+            vHeaderSource.push_back(pfrom);
+        }
+        if (pfrom && !vNew.empty())
+            mapHeadersByPeer[pfrom] += vNew.size();
+        if (!vNew.empty())
+            printf("ProcessHeaders: header chain extended to height %d (%"PRIszu" new)\n", vHeaderChain.back()->nHeight, vNew.size());
+    }
+    return fValid;
+}
+
+// Room for more headers from the peer, with some slack so it is asked in batches   Место для новых заголовков от пира, с запасом, чтобы спрашивать пачками
+bool static HeaderChainHasRoom(CNode* pnode)
+{
+    if (vHeaderChain.size() > MAX_HEADER_CHAIN / 2)
+        return false;
+    map<CNode*, unsigned int>::iterator it = mapHeadersByPeer.find(pnode);
+    return it == mapHeadersByPeer.end() || (*it).second <= MAX_HEADER_CHAIN_PER_PEER / 2;
+}
+
+int GetBestHeaderHeight()
+{
+    return vHeaderChain.empty() ? nBestHeight : vHeaderChain.back()->nHeight;
+}
+
+void FindBlocksToDownload(CNode* pnode, unsigned int nMax, vector<CInv>& vInv)
+{
+    if (vHeaderChain.empty())
+        return;
+    // the blocks caught up some other way                                          блоки догнали другим путём
+    if (pindexBest && vHeaderChain.back()->nChainWork <= pindexBest->nChainWork)
+    {
+        ClearHeaderChain();
+        return;
+    }
+
+    // Blocks that didn't arrive in time may be asked for from other peers. The    Блоки, не пришедшие вовремя, можно запросить у других пиров. Пир,
+    // peer that sent the header and doesn't serve the block, or the one that      приславший заголовок и не отдающий блок, или тот, кто прислал первый
+    // sent the first missing header when nobody serves it, loses its headers.     недостающий заголовок, когда его никто не отдаёт, теряет свои заголовки.
+    int64 nNow = GetTime();
+    unsigned int nInFlight = 0;
+    for (map<uint256, pair<CNode*, int64> >::iterator it = mapBlocksInFlight.begin(); it != mapBlocksInFlight.end(); )
+    {
+        if ((*it).second.second < nNow - BLOCK_DOWNLOAD_TIMEOUT)
+        {
+            map<uint256, CBlockIndex*>::iterator mi = mapHeaderIndex.find((*it).first);
+            if (mi != mapHeaderIndex.end())
+            {
+                unsigned int nPos = (*mi).second->nHeight - vHeaderChain.front()->nHeight;
+                if (vHeaderSource[nPos] == (*it).second.first)
+                    HeadersUnserved(vHeaderSource[nPos], nPos);
+                else if (++nHeaderChainMisses >= MAX_HEADER_CHAIN_MISSES)
+                    HeadersUnserved(vHeaderSource[0], 0);
+            }
+            mapBlocksInFlight.erase(it++);
+        }
+        else
+        {
+            if ((*it).second.first == pnode)
+                nInFlight++;
+            it++;
+        }
+    }
+
+    // Spread the window after the first missing block over the peers               Распределить окно после первого недостающего блока между пирами
+    int nPeerHeight = max(pnode->nStartingHeight, pnode->nHeadersHeight);
+    for (unsigned int i = 0; i < vHeaderChain.size() && i < BLOCK_DOWNLOAD_WINDOW && nInFlight < nMax; i++)
+    {
+        CBlockIndex* pindex = vHeaderChain[i];
+        if (pindex->nHeight > nPeerHeight)
+            break;
+        const uint256& hash = pindex->GetBlockHash();
+        if (mapBlocksInFlight.count(hash) || mapOrphanBlocks.count(hash))
+            continue;
+        mapBlocksInFlight[hash] = make_pair(pnode, nNow);
+        vInv.push_back(CInv(MSG_BLOCK, hash));
+        nInFlight++;
+    }
 }
 
 bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBlockPos *dbp)
 {
     // Check for duplicate (Проверка на дублирование)
     uint256 hash = pblock->GetHash();
+    mapBlocksInFlight.erase(hash);
     if (mapBlockIndex.count(hash))
         return state.Invalid(error("ProcessBlock() : already have block %d %s", mapBlockIndex[hash]->nHeight, hash.ToString().c_str()));
     if (mapOrphanBlocks.count(hash))
@@ -2703,15 +4165,47 @@ bool ProcessBlock(CValidationState &state, CNode* pfrom, CBlock* pblock, CDiskBl
             mapOrphanBlocks.insert(make_pair(hash, pblock2));
             mapOrphanBlocksByPrev.insert(make_pair(pblock2->hashPrevBlock, pblock2));
 
-            // Ask this guy to fill in what we're missing   (Спросите этого парня, чтобы заполнить то, что нам не хватает)
-            PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(pblock2));
+            // Ask this guy to fill in what we're missing, unless the parents are being downloaded    (Спросите этого парня, чтобы заполнить то, что нам не хватает,
+            // along the header chain already                                                       если родители уже не загружаются вдоль цепи заголовков)
+            if (!mapHeaderIndex.count(pblock2->hashPrevBlock))
+            {
+                if (fHeadersFirst && !pfrom->fHeadersUnserved)
+                    PushGetHeaders(pfrom);
+                else
+                    PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(pblock2));
+            }
         }
         return true;
     }
 
+    // Fast relay: a block on top of our best chain that passed the proof of work   Быстрая ретрансляция: блок поверх нашей лучшей цепи, прошедший доказательство
+    // and merkle checks is announced while it is being connected                   работы и проверку Меркля, объявляется, пока он подключается
+    bool fFastRelayable = pblock->hashPrevBlock == hashBestChain && !IsInitialBlockDownload() &&
+        pblock->nBits == GetNextWorkRequired(pindexBest, pblock) &&
+        pblock->GetBlockTime() > pindexBest->GetMedianTimePast();
+    if (fFastBlockRelay && pfrom && fFastRelayable)
+    {
+        printf("ProcessBlock: fast relay of %s\n", hash.ToString().c_str());
+        RelayBlock(*pblock, nBestHeight + 1, true);
+    }
+
     // Store to disk (Хранить на диске)
-    if (!AcceptBlock(*pblock, state, dbp))
+    CValidationState stateAccept;
+    if (!AcceptBlock(*pblock, stateAccept, dbp))
+    {
+        // A peer we told "sendfast" may have relayed such a block before it was     Пир, которому мы сказали "sendfast", мог ретранслировать такой блок до того,
+        // connected, and marked it so with "fastblock"; it checked as much as we   как он был подключён, и пометил его "fastblock"; он проверил столько же,
+        // did above and isn't punished for the rest                                 сколько мы выше, и не наказывается за остальное
+        bool fFastRelayed = pfrom && pfrom->fFastRelayOffered && pfrom->fFastRelay && pfrom->setFastRelayed.count(hash);
+        int nDoS = 0;
+        if (stateAccept.IsError())
+            state.Error();
+        else if (stateAccept.IsInvalid(nDoS) && fFastRelayable && fFastRelayed)
+            state.Invalid();
+        else if (stateAccept.IsInvalid(nDoS))
+            state.DoS(nDoS);
         return error("ProcessBlock() : AcceptBlock FAILED");
+    }
 
     // Recursively process any orphan blocks that depended on this one (Рекурсивно обрабатывать любые сирота блоки, которые зависели от этого)
     vector<uint256> vWorkQueue;
@@ -2774,6 +4268,64 @@ CMerkleBlock::CMerkleBlock(const CBlock& block, CBloomFilter& filter)
     txn = CPartialMerkleTree(vHashes, vMatch);
 }
 
+CMerkleBlock::CMerkleBlock(const CFilterableBlock& block, CBloomFilter& filter)
+{
+    header = block.header;
+
+    vector<bool> vMatch(block.GetTxCount(), false);
+    for (unsigned int i = 0; i < block.GetTxCount(); i++)
+    {
+        if (filter.IsRelevantAndUpdate(block.elements, i))
+        {
+            vMatch[i] = true;
+            vMatchedTxn.push_back(make_pair(i, block.vMerkleTree[i]));
+        }
+    }
+
+    txn = CPartialMerkleTree(block.GetTxCount(), block.vMerkleTree, vMatch);
+}
+
+CFilterableBlock::CFilterableBlock(CBlock& block)
+{
+    header = block.GetBlockHeader();
+    block.BuildMerkleTree();
+    vMerkleTree.swap(block.vMerkleTree);
+    vtx.swap(block.vtx);
+    for (unsigned int i = 0; i < vtx.size(); i++)
+        elements.Add(vtx[i], vMerkleTree[i]);
+}
+
+// Most recently filtered first                                         Сначала недавно фильтрованные
+static list<pair<uint256, boost::shared_ptr<const CFilterableBlock> > > listFilterableBlocks;
+static CCriticalSection cs_listFilterableBlocks;
+
+boost::shared_ptr<const CFilterableBlock> GetFilterableBlock(const CBlockIndex* pindex)
+{
+    uint256 hash = pindex->GetBlockHash();
+    {
+        LOCK(cs_listFilterableBlocks);
+        for (list<pair<uint256, boost::shared_ptr<const CFilterableBlock> > >::iterator it = listFilterableBlocks.begin(); it != listFilterableBlocks.end(); it++)
+        {
+            if ((*it).first == hash)
+            {
+                listFilterableBlocks.splice(listFilterableBlocks.begin(), listFilterableBlocks, it);
+                return listFilterableBlocks.front().second;
+            }
+        }
+    }
+
+    CBlock block;
+    if (!ReadBlockFromDisk(block, pindex))
+        return boost::shared_ptr<const CFilterableBlock>();
+    boost::shared_ptr<const CFilterableBlock> pblock(new CFilterableBlock(block));
+
+    LOCK(cs_listFilterableBlocks);
+    listFilterableBlocks.push_front(make_pair(hash, pblock));
+    if (listFilterableBlocks.size() > MAX_FILTERABLE_BLOCKS)
+        listFilterableBlocks.pop_back();
+    return pblock;
+}
+
 
 
 
@@ -2785,6 +4337,12 @@ uint256 CPartialMerkleTree::CalcHash(int height, unsigned int pos, const std::ve
     if (height == 0) {
         // hash at height 0 is the txids themself                       Хэш на высоте 0 txids сам по себе
         return vTxid[pos];
+    } else if (vTxid.size() > nTransactions) {
+        // a complete tree has the upper levels after the txids         в полном дереве верхние уровни идут после txid
+        unsigned int nOffset = 0;
+        for (int h = 0; h < height; h++)
+            nOffset += CalcTreeWidth(h);
+        return vTxid[nOffset + pos];
     } else {
         // calculate left hash (вычислить левый хэш)
         uint256 left = CalcHash(height-1, pos*2, vTxid), right;
@@ -2862,6 +4420,14 @@ CPartialMerkleTree::CPartialMerkleTree(const std::vector<uint256> &vTxid, const
     TraverseAndBuild(nHeight, 0, vTxid, vMatch);
 }
 
+CPartialMerkleTree::CPartialMerkleTree(unsigned int nTransactionsIn, const std::vector<uint256> &vTree, const std::vector<bool> &vMatch) : nTransactions(nTransactionsIn), fBad(false) {
+    int nHeight = 0;
+    while (CalcTreeWidth(nHeight) > 1)
+        nHeight++;
+
+    TraverseAndBuild(nHeight, 0, vTree, vMatch);
+}
+
 CPartialMerkleTree::CPartialMerkleTree() : nTransactions(0), fBad(true) {}
 
 uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch) {
@@ -2902,6 +4468,141 @@ uint256 CPartialMerkleTree::ExtractMatches(std::vector<uint256> &vMatch) {
 
 
 
+CCompactBlock::CCompactBlock(const CBlock& block)
+{
+    header = block.GetBlockHeader();
+    nNonce = GetRand(std::numeric_limits<uint64>::max());
+    SetShortTxIDKey();
+
+    for (unsigned int i = 0; i < block.vtx.size(); i++)
+    {
+        const CTransaction& tx = block.vtx[i];
+        if (IsPrefilled(tx))
+            vPrefilled.push_back(CPrefilledTransaction(i, tx));
+        else
+            vShortTxID.push_back(GetShortTxID(tx.GetHash()));
+    }
+}
+
+void CCompactBlock::SetShortTxIDKey()
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << header << nNonce;
+    uint256 hash = Hash(ss.begin(), ss.end());
+    memcpy(&nKey0, hash.begin(), sizeof(nKey0));
+    memcpy(&nKey1, hash.begin() + sizeof(nKey0), sizeof(nKey1));
+}
+
+uint64 CCompactBlock::GetShortTxID(const uint256& hash) const
+{
+    return SipHashUint256(nKey0, nKey1, hash) & 0xffffffffffffULL;
+}
+
+bool CCompactBlock::IsPrefilled(const CTransaction& tx)
+{
+    // coinbase and transfer transactions are made by the miner of the block       coinbase и переносящие транзакции создаются майнером блока
+    return tx.IsCoinBase() || (!tx.vin.empty() && tx.vin[0].scriptSig == CScript() << OP_0 << OP_0);
+}
+
+bool CPartialBlock::Init(const CCompactBlock& cmpctblock, CTxMemPool& pool)
+{
+    header = cmpctblock.header;
+    unsigned int nTx = cmpctblock.GetTxCount();
+    if (nTx == 0 || nTx > MAX_BLOCK_SIZE / 60)
+        return false;
+    vtx.assign(nTx, CTransaction());
+    vHave.assign(nTx, false);
+    nFromPool = 0;
+
+    // prefilled transactions go to their positions, short ids fill the gaps      переданные целиком транзакции встают на свои места, короткие id заполняют промежутки
+    std::vector<unsigned int> vShortPos;
+    vShortPos.reserve(cmpctblock.vShortTxID.size());
+    unsigned int nPos = 0;
+    BOOST_FOREACH(const CPrefilledTransaction& prefilled, cmpctblock.vPrefilled)
+    {
+        if (prefilled.nIndex < nPos || prefilled.nIndex >= nTx)
+            return false;
+        while (nPos < prefilled.nIndex)
+            vShortPos.push_back(nPos++);
+        vtx[nPos] = prefilled.tx;
+        vHave[nPos] = true;
+        nPos++;
+    }
+    while (nPos < nTx)
+        vShortPos.push_back(nPos++);
+    if (vShortPos.size() != cmpctblock.vShortTxID.size())
+        return false;
+
+    // a short id that is used twice in the block is never filled from the pool   короткий id, использованный в блоке дважды, не заполняется из пула
+    std::map<uint64, unsigned int> mapShortPos;
+    std::set<uint64> setAmbiguous;
+    for (unsigned int i = 0; i < vShortPos.size(); i++)
+        if (!mapShortPos.insert(std::make_pair(cmpctblock.vShortTxID[i], vShortPos[i])).second)
+            setAmbiguous.insert(cmpctblock.vShortTxID[i]);
+    BOOST_FOREACH(uint64 nShortID, setAmbiguous)
+        mapShortPos.erase(nShortID);
+
+    {
+        LOCK(pool.cs);
+        for (std::map<uint256, CTxMemPoolEntry>::const_iterator mi = pool.mapTx.begin(); mi != pool.mapTx.end() && !mapShortPos.empty(); ++mi)
+        {
+            uint64 nShortID = cmpctblock.GetShortTxID(mi->first);
+            std::map<uint64, unsigned int>::iterator it = mapShortPos.find(nShortID);
+            if (it == mapShortPos.end())
+                continue;
+            if (!vHave[it->second])
+            {
+                vtx[it->second] = mi->second.GetTx();
+                vHave[it->second] = true;
+            }
+            else
+            {
+                // two pool transactions share the id: ask for the one in the block  две транзакции пула делят id: запрашиваем ту, что в блоке
+                vHave[it->second] = false;
+                vtx[it->second] = CTransaction();
+                mapShortPos.erase(it);
+            }
+        }
+    }
+
+    for (unsigned int i = 0; i < vShortPos.size(); i++)
+        if (vHave[vShortPos[i]])
+            nFromPool++;
+    return true;
+}
+
+std::vector<unsigned int> CPartialBlock::GetMissing() const
+{
+    std::vector<unsigned int> vMissing;
+    for (unsigned int i = 0; i < vHave.size(); i++)
+        if (!vHave[i])
+            vMissing.push_back(i);
+    return vMissing;
+}
+
+bool CPartialBlock::Fill(const std::vector<CTransaction>& vtxMissing, CBlock& block) const
+{
+    block = CBlock(header);
+    block.vtx = vtx;
+    unsigned int nNext = 0;
+    for (unsigned int i = 0; i < vHave.size(); i++)
+    {
+        if (vHave[i])
+            continue;
+        if (nNext >= vtxMissing.size())
+            return false;
+        block.vtx[i] = vtxMissing[nNext++];
+    }
+    if (nNext != vtxMissing.size())
+        return false;
+
+    // a short id collision with a pool transaction gives a different merkle root  коллизия короткого id с транзакцией пула даёт другой корень Меркля
+    return block.BuildMerkleTree() == header.hashMerkleRoot;
+}
+
+
+
+
 
 
 
@@ -2959,6 +4660,70 @@ FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly) {
     return OpenDiskFile(pos, "rev", fReadOnly);
 }
 
+CMappedFile::~CMappedFile()
+{
+#ifndef WIN32
+    munmap((void*)pbegin, nSize);
+#endif
+}
+
+// At most this many block files are mapped at once, the least recently used       Одновременно отображается не больше стольких файлов блоков, реже всего используемый
+// one is dropped first                                                            убирается первым
+static const unsigned int MAX_MAPPED_BLOCK_FILES = 16;
+
+static CCriticalSection cs_MappedBlockFiles;
+static std::list<std::pair<int, boost::shared_ptr<const CMappedFile> > > listMappedBlockFiles;
+
+boost::shared_ptr<const CMappedFile> MapBlockFile(int nFile)
+{
+    boost::shared_ptr<const CMappedFile> pmap;
+#ifndef WIN32
+    // block files are up to MAX_BLOCKFILE_SIZE, too much address space on 32 bit   файлы блоков до MAX_BLOCKFILE_SIZE, слишком много адресного пространства на 32 битах
+    if (sizeof(void*) < 8)
+        return pmap;
+    {
+        LOCK(cs_LastBlockFile);
+        if (nFile >= nLastBlockFile)
+            return pmap;
+    }
+
+    LOCK(cs_MappedBlockFiles);
+    typedef std::pair<int, boost::shared_ptr<const CMappedFile> > PairType;
+    for (std::list<PairType>::iterator it = listMappedBlockFiles.begin(); it != listMappedBlockFiles.end(); it++) {
+        if (it->first == nFile) {
+            listMappedBlockFiles.splice(listMappedBlockFiles.begin(), listMappedBlockFiles, it);
+            return listMappedBlockFiles.front().second;
+        }
+    }
+
+    FILE *file = OpenBlockFile(CDiskBlockPos(nFile, 0), true);
+    if (!file)
+        return pmap;
+    struct stat st;
+    if (fstat(fileno(file), &st) == 0 && st.st_size > 0) {
+        void *p = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fileno(file), 0);
+        if (p != MAP_FAILED)
+            pmap.reset(new CMappedFile((const char*)p, st.st_size));
+        else
+            printf("MapBlockFile() : mmap of block file %d failed, error %d\n", nFile, errno);
+    }
+    fclose(file);
+    if (!pmap)
+        return pmap;
+
+    listMappedBlockFiles.push_front(std::make_pair(nFile, pmap));
+    if (listMappedBlockFiles.size() > MAX_MAPPED_BLOCK_FILES)
+        listMappedBlockFiles.pop_back();
+#endif
+    return pmap;
+}
+
+void UnmapBlockFiles()
+{
+    LOCK(cs_MappedBlockFiles);
+    listMappedBlockFiles.clear();
+}
+
 CBlockIndex * InsertBlockIndex(uint256 hash)
 {
     if (hash == 0)
@@ -3085,7 +4850,7 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth)
             }
         }
         // check level 3: check for inconsistencies during memory-only disconnect of tip blocks (проверить на наличие несоответствий во время память только отключение конца блоков)
-        if (nCheckLevel >= 3 && pindex == pindexState && (coins.GetCacheSize() + pcoinsTip->GetCacheSize()) <= 2*nCoinCacheSize + 32000) {
+        if (nCheckLevel >= 3 && pindex == pindexState && (coins.DynamicMemoryUsage() + pcoinsTip->DynamicMemoryUsage()) <= nCoinCacheUsage) {
             bool fClean = true;
             if (!DisconnectBlock(block, state, pindex, coins, &fClean))
                 return error("VerifyDB() : *** irrecoverable inconsistency in block data at %d, hash=%s", pindex->nHeight, pindex->GetBlockHash().ToString().c_str());
@@ -3121,6 +4886,8 @@ bool VerifyDB(int nCheckLevel, int nCheckDepth)
 
 void UnloadBlockIndex()
 {
+    UnmapBlockFiles();
+    ClearHeaderChain();
     mapBlockIndex.clear();
     setBlockIndexValid.clear();
     pindexGenesisBlock = NULL;
@@ -3410,6 +5177,7 @@ bool static AlreadyHave(const CInv& inv)
                 pcoinsTip->HaveCoins(inv.hash);
         }
     case MSG_BLOCK:
+    case MSG_CMPCT_BLOCK:
         return mapBlockIndex.count(inv.hash) ||
                mapOrphanBlocks.count(inv.hash);
     }
@@ -3428,7 +5196,7 @@ void static ProcessGetData(CNode* pfrom)
 
     while (it != pfrom->vRecvGetData.end()) {
         // Don't bother if send buffer is too full to respond anyway (Не беспокойтесь, если буфер передачи слишком полной, чтобы так или иначе отвечают)
-        if (pfrom->nSendSize >= SendBufferSize())
+        if (pfrom->IsSendFull(GetInvSendClass(*it)))
             break;
 
         const CInv &inv = *it;
@@ -3436,22 +5204,40 @@ void static ProcessGetData(CNode* pfrom)
             boost::this_thread::interruption_point();
             it++;
 
-            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK)
+            if (inv.type == MSG_BLOCK || inv.type == MSG_FILTERED_BLOCK || inv.type == MSG_CMPCT_BLOCK)
             {
                 // Send block from disk (Отправить блока с диска)
                 map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(inv.hash);
                 if (mi != mapBlockIndex.end())
                 {
-                    CBlock block;
-                    ReadBlockFromDisk(block, (*mi).second);
-                    if (inv.type == MSG_BLOCK)
-                        pfrom->PushMessage("block", block);
+                    // Transactions of old blocks have left the peer's pool, send those in full    Транзакции старых блоков уже покинули пул пира, такие отправляем целиком
+                    int nType = inv.type;
+                    if (nType == MSG_CMPCT_BLOCK && (*mi).second->nHeight < nBestHeight - MAX_CMPCT_BLOCK_DEPTH)
+                        nType = MSG_BLOCK;
+
+                    if (nType == MSG_BLOCK)
+                    {
+                        // Send the cached message, no deserialization or hashing    Отправить кэшированное сообщение, без десериализации и хэширования
+                        boost::shared_ptr<const CSerializeData> pmsg = GetBlockMessage((*mi).second);
+                        if (pmsg)
+                            pfrom->PushRawMessage(*pmsg);
+                    }
+                    else if (nType == MSG_CMPCT_BLOCK)
+                    {
+                        CBlock block;
+                        if (ReadBlockFromDisk(block, (*mi).second))
+                            pfrom->PushMessage("cmpctblock", CCompactBlock(block));
+                    }
                     else // MSG_FILTERED_BLOCK)
                     {
                         LOCK(pfrom->cs_filter);
+                        // Prepared once per block for all the peers filtering it      Подготовлен один раз на блок для всех пиров, которые его фильтруют
+                        boost::shared_ptr<const CFilterableBlock> pblock;
                         if (pfrom->pfilter)
+                            pblock = GetFilterableBlock((*mi).second);
+                        if (pblock)
                         {
-                            CMerkleBlock merkleBlock(block, *pfrom->pfilter);
+                            CMerkleBlock merkleBlock(*pblock, *pfrom->pfilter);
                             pfrom->PushMessage("merkleblock", merkleBlock);
                             // CMerkleBlock just contains hashes, so also push any transactions in the block the client did not see
                             // This avoids hurting performance by pointlessly requiring a round-trip
@@ -3468,9 +5254,10 @@ void static ProcessGetData(CNode* pfrom)
                             // Однако мы всегда должны обеспечить по крайней мере то, что удаленному узлу нуждается
 
                             typedef std::pair<unsigned int, uint256> PairType;
+                            // (they go with the block data, so they follow their merkleblock)   (они идут с данными блоков, чтобы следовать за своим merkleblock)
                             BOOST_FOREACH(PairType& pair, merkleBlock.vMatchedTxn)
-                                if (!pfrom->setInventoryKnown.count(CInv(MSG_TX, pair.second)))
-                                    pfrom->PushMessage("tx", block.vtx[pair.first]);
+                                if (!pfrom->filterInventoryKnown.contains(pair.second))
+                                    pfrom->PushMessageClass(SEND_BLOCK, "tx", pblock->vtx[pair.first]);
                         }
                         // else
                             // no response (Нет ответа)
@@ -3484,31 +5271,27 @@ void static ProcessGetData(CNode* pfrom)
                         // wait for other stuff first.                                  ждали, когда другие вещи в первую очередь.
                         vector<CInv> vInv;
                         vInv.push_back(CInv(MSG_BLOCK, hashBestChain));
-                        pfrom->PushMessage("inv", vInv);
+                        pfrom->PushMessageClass(SEND_BLOCK, "inv", vInv);
                         pfrom->hashContinue = 0;
                     }
                 }
             }
             else if (inv.IsKnownType())
             {
-                // Send stream from relay memory    (Отправить поток по эстафете памяти)
+                // Send the ready message from relay memory or the memory pool  (Отправить готовое сообщение из памяти ретрансляции или пула памяти)
                 bool pushed = false;
                 {
                     LOCK(cs_mapRelay);
-                    map<CInv, CDataStream>::iterator mi = mapRelay.find(inv);
+                    map<CInv, CSharedTxRef>::iterator mi = mapRelay.find(inv);
                     if (mi != mapRelay.end()) {
-                        pfrom->PushMessage(inv.GetCommand(), (*mi).second);
+                        pfrom->PushRawMessage((*mi).second->msg);
                         pushed = true;
                     }
                 }
                 if (!pushed && inv.type == MSG_TX) {
-                    LOCK(mempool.cs);
-                    if (mempool.exists(inv.hash)) {
-                        CTransaction tx = mempool.lookup(inv.hash);
-                        CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-                        ss.reserve(1000);
-                        ss << tx;
-                        pfrom->PushMessage("tx", ss);
+                    CSharedTxRef ptx = mempool.get(inv.hash);
+                    if (ptx) {
+                        pfrom->PushRawMessage(ptx->msg);
                         pushed = true;
                     }
                 }
@@ -3545,17 +5328,254 @@ void static ProcessGetData(CNode* pfrom)
     }
 }
 
-bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
+// Response times of the peers to block requests, for the choice of the sync node    Время ответа пиров на запросы блоков, для выбора узла синхронизации
+void static UpdateBlockLatency(CNode* pnode, int64 nLatency)
 {
-    RandAddSeedPerfmon();
-    if (fDebug)
-        printf("received: %s (%"PRIszu" bytes)\n", strCommand.c_str(), vRecv.size());
-    if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
-    {
-        printf("dropmessagestest DROPPING RECV MESSAGE\n");
-        return true;
-    }
-
+    pnode->nBlockLatency = pnode->nBlockLatency < 0 ? nLatency : (pnode->nBlockLatency * 3 + nLatency) / 4;
+}
+
+void static MarkBlockReceived(CNode* pfrom, const uint256& hash)
+{
+    map<uint256, int64>::iterator it = pfrom->mapBlocksAsked.find(hash);
+    if (it == pfrom->mapBlocksAsked.end())
+        return;
+    UpdateBlockLatency(pfrom, GetTimeMicros() - (*it).second);
+    pfrom->mapBlocksAsked.erase(it);
+}
+
+void static MarkSyncAnswered(CNode* pfrom)
+{
+    if (!pfrom->nSyncAskTime)
+        return;
+    UpdateBlockLatency(pfrom, GetTimeMicros() - pfrom->nSyncAskTime);
+    pfrom->nSyncAskTime = 0;
+}
+
+// The peer answered a transaction request, with the transaction or "notfound"    Пир ответил на запрос транзакции, транзакцией или "notfound"
+void static MarkTxReceived(CNode* pfrom, const uint256& hash)
+{
+    map<uint256, pair<CNode*, int64> >::iterator mi = mapTxInFlight.find(hash);
+    if (mi != mapTxInFlight.end() && (*mi).second.first == pfrom)
+        mapTxInFlight.erase(mi);
+    if (pfrom->mapTxAsked.erase(hash))
+    {
+        LOCK(pfrom->cs_vSend);
+        pfrom->nTxMissed = 0;
+    }
+}
+
+// The block arrived, from whichever peer: nobody has to finish rebuilding it     Блок пришёл, неважно от какого пира: никому не нужно заканчивать его восстановление
+void static ErasePartialBlocks(const uint256& hash)
+{
+    map<pair<uint256, CNode*>, CPartialBlock>::iterator it = mapPartialBlocks.lower_bound(make_pair(hash, (CNode*)NULL));
+    while (it != mapPartialBlocks.end() && (*it).first.first == hash)
+        mapPartialBlocks.erase(it++);
+}
+
+// Forget "getblocktxn" requests that were never answered                         Забыть запросы "getblocktxn", на которые так и не ответили
+void static ExpirePartialBlocks(int64 nNowMicros)
+{
+    for (map<pair<uint256, CNode*>, CPartialBlock>::iterator it = mapPartialBlocks.begin(); it != mapPartialBlocks.end(); )
+    {
+        if (nNowMicros - (*it).second.nTimeReceived > PARTIAL_BLOCK_TIMEOUT * 1000000)
+            mapPartialBlocks.erase(it++);
+        else
+            it++;
+    }
+}
+
+// Fall back to the full block when a compact block could not be rebuilt        Вернуться к полному блоку, если компактный блок не удалось восстановить
+void static RequestFullBlock(CNode* pfrom, const uint256& hash)
+{
+    vector<CInv> vInv(1, CInv(MSG_BLOCK, hash));
+    pfrom->PushMessage("getdata", vInv);
+}
+
+void static ProcessCompactBlock(CNode* pfrom, const CPartialBlock& partial, const vector<CTransaction>& vtxMissing)
+{
+    CBlock block;
+    uint256 hash = partial.header.GetHash();
+    if (!partial.Fill(vtxMissing, block))
+    {
+        printf("compact block %s could not be rebuilt, asking for the full block\n", hash.ToString().c_str());
+        RequestFullBlock(pfrom, hash);
+        return;
+    }
+    printf("compact block %s rebuilt: %u of %"PRIszu" transactions from the memory pool, %"PRIszu" fetched, %"PRI64d"us\n",
+           hash.ToString().c_str(), partial.nFromPool, block.vtx.size(), vtxMissing.size(), GetTimeMicros() - partial.nTimeReceived);
+
+    // only a complete block answers a block request                                 только полный блок является ответом на запрос блока
+    MarkBlockReceived(pfrom, hash);
+    ErasePartialBlocks(hash);
+
+    CInv inv(MSG_BLOCK, hash);
+    CValidationState state;
+    if (ProcessBlock(state, pfrom, &block))
+        mapAlreadyAskedFor.erase(inv);
+    int nDoS;
+    if (state.IsInvalid(nDoS))
+        pfrom->Misbehaving(nDoS);
+}
+
+// Transaction of a "tx" message, sharing the received payload                     Транзакция сообщения "tx", разделяющая полученную полезную нагрузку
+static CSharedTxRef ReadTransaction(CDataStream& vRecv, CPreparedMessage* pprepared)
+{
+    CDataStream vMsg(vRecv);
+    CTransaction tx;
+    if (pprepared && pprepared->fDeserialized)
+        tx = pprepared->tx;
+    else
+        vRecv >> tx;
+
+    // Truncate messages to the size of the tx in them (Усечение сообщения с размером TX в них)
+    unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    unsigned int oldSize = vMsg.size();
+    if (nSize < oldSize) {
+        vMsg.resize(nSize);
+        printf("truncating oversized TX %s (%u -> %u)\n",
+               tx.GetHash().ToString().c_str(),
+               oldSize, nSize);
+    }
+
+    // one shared copy for the memory pool, relay and orphans                   одна разделяемая копия для пула памяти, ретрансляции и сирот
+    return CSharedTxRef(new CSharedTx(tx, vMsg));
+}
+
+// Transactions received from pfrom, accepted as one batch                         Транзакции, полученные от pfrom, принимаемые одним пакетом
+static void ProcessTransactions(CNode* pfrom, const vector<CSharedTxRef>& vptx)
+{
+    vector<CTxMemPoolAccept> vAccept;
+    vAccept.reserve(vptx.size());
+    BOOST_FOREACH(const CSharedTxRef& ptx, vptx)
+    {
+        CInv inv(MSG_TX, ptx->hash);
+        pfrom->AddInventoryKnown(inv);
+        MarkTxReceived(pfrom, inv.hash);
+        mapTxInFlight.erase(inv.hash);
+        vAccept.push_back(CTxMemPoolAccept(ptx));
+    }
+    mempool.acceptBatch(vAccept, true);
+
+    vector<CSharedTxRef> vWorkQueue;
+    vector<uint256> vEraseQueue;
+    unsigned int nOrphans = 0;
+    BOOST_FOREACH(CTxMemPoolAccept& acc, vAccept)
+    {
+        if (acc.fAccepted)
+        {
+            RelayTransaction(acc.ptx);
+            vWorkQueue.push_back(acc.ptx);
+            vEraseQueue.push_back(acc.ptx->hash);
+        }
+        else if (acc.fMissingInputs)
+        {
+            AddOrphanTx(acc.ptx, pfrom);
+            nOrphans++;
+        }
+        int nDoS;
+        if (acc.state.IsInvalid(nDoS))
+            pfrom->Misbehaving(nDoS);
+    }
+
+    // Recursively process any orphan transactions that depended on these ones (Рекурсивный обрабатывать любые операции сироты, которые зависели от этих)
+    // through the outputs they spend, each orphan once, one batch per generation через тратимые ими выходы, каждую сироту один раз, по пакету на поколение
+    set<uint256> setTried;
+    while (!vWorkQueue.empty())
+    {
+        vector<CTxMemPoolAccept> vOrphans;
+        BOOST_FOREACH(const CSharedTxRef& ptxPrev, vWorkQueue)
+        {
+            for (unsigned int n = 0; n < ptxPrev->tx.vout.size(); n++)
+            {
+                map<COutPoint, set<uint256> >::iterator itPrev = mapOrphanTransactionsByPrev.find(COutPoint(ptxPrev->hash, n));
+                if (itPrev == mapOrphanTransactionsByPrev.end())
+                    continue;
+                BOOST_FOREACH(const uint256& hashOrphan, itPrev->second)
+                    if (setTried.insert(hashOrphan).second)
+                        vOrphans.push_back(CTxMemPoolAccept(mapOrphanTransactions[hashOrphan].ptx));
+            }
+        }
+        vWorkQueue.clear();
+        if (vOrphans.empty())
+            break;
+
+        // The states are not used, so someone can't setup nodes to counter-DoS based on orphan resolution
+        //(that is, feeding people an invalid transaction based on LegitTxX in order to get anyone relaying LegitTxX banned)
+        // Состояния не используются, так кто-то не может установить узлы борьбы с DoS-сирот на основе резолюции
+        //(то есть, кормить людей недействительной сделке на основе LegitTxX, чтобы получить любой LegitTxX запрещена ретрансляция)
+        mempool.acceptBatch(vOrphans, true);
+        BOOST_FOREACH(CTxMemPoolAccept& acc, vOrphans)
+        {
+            if (acc.fAccepted)
+            {
+                printf("   accepted orphan tx %s\n", acc.ptx->hash.ToString().c_str());
+                RelayTransaction(acc.ptx);
+                vWorkQueue.push_back(acc.ptx);
+                vEraseQueue.push_back(acc.ptx->hash);
+            }
+            else if (!acc.fMissingInputs)
+            {
+                // invalid or too-little-fee orphan (недействительным или слишком мало плату сирот)
+                vEraseQueue.push_back(acc.ptx->hash);
+                printf("   removed orphan tx %s\n", acc.ptx->hash.ToString().c_str());
+            }
+            else
+                setTried.erase(acc.ptx->hash);      // still missing other parents      ещё не хватает других родителей
+        }
+    }
+
+    BOOST_FOREACH(uint256 hash, vEraseQueue)
+        EraseOrphanTx(hash);
+
+    if (nOrphans > 0)
+    {
+        // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (DoS Профилактика: не позволяют mapOrphanTransactions расти неограниченно)
+        unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS, MAX_ORPHAN_TRANSACTIONS_SIZE);
+        if (nEvicted > 0)
+            printf("mapOrphan overflow, removed %u tx\n", nEvicted);
+    }
+}
+
+// A "tx" message and the prepared "tx" messages right behind it in the queue,   Сообщение "tx" и подготовленные сообщения "tx" сразу за ним в очереди,
+// up to MAX_TX_BATCH, are accepted together; it moves past those taken          до MAX_TX_BATCH, принимаются вместе; it сдвигается за взятые
+static bool ProcessTxMessages(CNode* pfrom, CNetMessage& msg, std::deque<CNetMessage>::iterator& it)
+{
+    RandAddSeedPerfmon();
+    vector<CSharedTxRef> vptx(1, ReadTransaction(msg.vRecv, msg.pprepared.get()));
+    while (it != pfrom->vRecvMsg.end() && vptx.size() < MAX_TX_BATCH)
+    {
+        CNetMessage& msgNext = *it;
+        if (!msgNext.complete() || !msgNext.pprepared || !msgNext.pprepared->fChecksumOk ||
+            memcmp(msgNext.hdr.pchMessageStart, Params().MessageStart(), MESSAGE_START_SIZE) != 0 ||
+            !msgNext.hdr.IsValid() || msgNext.hdr.GetCommand() != "tx")
+            break;
+        it++;
+        pfrom->nMsgProcessed++;
+        try {
+            vptx.push_back(ReadTransaction(msgNext.vRecv, msgNext.pprepared.get()));
+        }
+        catch (std::exception& e) {
+            PrintExceptionContinue(&e, "ProcessTxMessages()");
+        }
+    }
+    if (fDebug)
+        printf("received: %"PRIszu" tx\n", vptx.size());
+
+    ProcessTransactions(pfrom, vptx);
+    return true;
+}
+
+bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv, CPreparedMessage* pprepared)
+{
+    RandAddSeedPerfmon();
+    if (fDebug)
+        printf("received: %s (%"PRIszu" bytes)\n", strCommand.c_str(), vRecv.size());
+    if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
+    {
+        printf("dropmessagestest DROPPING RECV MESSAGE\n");
+        return true;
+    }
+
 
 
 
@@ -3673,6 +5693,45 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     else if (strCommand == "verack")
     {
         pfrom->SetRecvVersion(min(pfrom->nVersion, PROTOCOL_VERSION));
+
+        // Offer compact blocks; outbound peers are asked to push new blocks at once    Предложить компактные блоки; исходящих пиров просим сразу присылать новые блоки
+        if (fCompactBlockRelay && pfrom->nVersion >= COMPACT_BLOCKS_VERSION)
+            pfrom->PushMessage("sendcmpct", !pfrom->fInbound, (uint64)1);
+        // Blocks may be relayed to us before they are connected                   Блоки можно ретранслировать нам до их подключения
+        if (pfrom->nVersion >= FAST_RELAY_VERSION)
+        {
+            pfrom->PushMessage("sendfast");
+            pfrom->fFastRelayOffered = true;
+        }
+    }
+
+
+    else if (strCommand == "sendfast")
+    {
+        pfrom->fFastRelay = true;
+    }
+
+
+    // The next block with this hash was relayed before the peer connected it     Следующий блок с этим хэшем ретранслирован до того, как пир его подключил
+    else if (strCommand == "fastblock")
+    {
+        uint256 hashBlock;
+        vRecv >> hashBlock;
+        if (pfrom->fFastRelayOffered)
+            pfrom->setFastRelayed.insert(hashBlock);
+    }
+
+
+    else if (strCommand == "sendcmpct")
+    {
+        bool fAnnounce = false;
+        uint64 nCmpctVersion = 0;
+        vRecv >> fAnnounce >> nCmpctVersion;
+        if (nCmpctVersion == 1)
+        {
+            pfrom->fCompactBlocks = true;
+            pfrom->fCompactAnnounce = fAnnounce;
+        }
     }
 
 
@@ -3761,6 +5820,8 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 break;
             }
         }
+        if (nLastBlock != (unsigned int)(-1))
+            MarkSyncAnswered(pfrom);
         for (unsigned int nInv = 0; nInv < vInv.size(); nInv++)
         {
             const CInv &inv = vInv[nInv];
@@ -3773,10 +5834,12 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
                 printf("  got inventory: %s  %s\n", inv.ToString().c_str(), fAlreadyHave ? "have" : "new");
 
             if (!fAlreadyHave) {
-                if (!fImporting && !fReindex)
+                if (!fImporting && !fReindex && !mapBlocksInFlight.count(inv.hash))
                     pfrom->AskFor(inv);
             } else if (inv.type == MSG_BLOCK && mapOrphanBlocks.count(inv.hash)) {
-                PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(mapOrphanBlocks[inv.hash]));
+                // orphans along the header chain just wait for their parents       сироты вдоль цепи заголовков просто ждут своих родителей
+                if (!mapHeaderIndex.count(inv.hash))
+                    PushGetBlocks(pfrom, pindexBest, GetOrphanRoot(mapOrphanBlocks[inv.hash]));
             } else if (nInv == nLastBlock) {
                 // In case we are on a very long side-chain, it is possible that we already have
                 // the last block in an inv bundle sent in response to getblocks. Try to detect
@@ -3879,7 +5942,7 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
         // we must use CBlocks, as CBlockHeaders won't include the 0x00 nTx count at the end
         // мы должны использовать CBlocks, как CBlockHeaders не будет включать 0x00 nTx количество в конце
         vector<CBlock> vHeaders;
-        int nLimit = 2000;
+        int nLimit = MAX_HEADERS_RESULTS;
         printf("getheaders %d to %s\n", (pindex ? pindex->nHeight : -1), hashStop.ToString().c_str());
         for (; pindex; pindex = pindex->GetNextInMainChain())
         {
@@ -3891,108 +5954,198 @@ bool static ProcessMessage(CNode* pfrom, string strCommand, CDataStream& vRecv)
     }
 
 
-    else if (strCommand == "tx")
+    else if (strCommand == "headers" && !fImporting && !fReindex)
     {
-        vector<uint256> vWorkQueue;
-        vector<uint256> vEraseQueue;
-        CDataStream vMsg(vRecv);
-        CTransaction tx;
-        vRecv >> tx;
+        // headers come as blocks without transactions                              заголовки приходят как блоки без транзакций
+        vector<CBlock> vBlocks;
+        vRecv >> vBlocks;
+        MarkSyncAnswered(pfrom);
+        vector<CBlockHeader> vHeaders;
+        vHeaders.reserve(vBlocks.size());
+        BOOST_FOREACH(const CBlock& block, vBlocks)
+            vHeaders.push_back(block.GetBlockHeader());
 
-        CInv inv(MSG_TX, tx.GetHash());
-        pfrom->AddInventoryKnown(inv);
+        CValidationState state;
+        bool fOk = ProcessHeaders(state, pfrom, vHeaders);
+        int nDoS;
+        if (state.IsInvalid(nDoS))
+            pfrom->Misbehaving(nDoS);
 
-        // Truncate messages to the size of the tx in them (Усечение сообщения с размером TX в них)
-        unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-        unsigned int oldSize = vMsg.size();
-        if (nSize < oldSize) {
-            vMsg.resize(nSize);
-            printf("truncating oversized TX %s (%u -> %u)\n",
-                   tx.GetHash().ToString().c_str(),
-                   oldSize, nSize);
+        // a full message means the peer has more, asked for once there is room    полное сообщение означает, что у пира есть ещё, запрашивается, когда есть место
+        if (fOk && vHeaders.size() == MAX_HEADERS_RESULTS && !pfrom->fHeadersUnserved)
+        {
+            if (pnodeHeadersMore != pfrom)
+                PushGetHeaders(pfrom);
         }
+    }
 
-        bool fMissingInputs = false;
-        CValidationState state;
-        if (mempool.accept(state, tx, true, &fMissingInputs))
+
+    else if (strCommand == "notfound")
+    {
+        vector<CInv> vInv;
+        vRecv >> vInv;
+        if (vInv.size() > MAX_INV_SZ)
         {
-            RelayTransaction(tx, inv.hash, vMsg);
-            mapAlreadyAskedFor.erase(inv);
-            vWorkQueue.push_back(inv.hash);
-            vEraseQueue.push_back(inv.hash);
+            pfrom->Misbehaving(20);
+            return error("message notfound size() = %"PRIszu"", vInv.size());
+        }
 
-            // Recursively process any orphan transactions that depended on this one (Рекурсивный обрабатывать любые операции сироты, которые зависели от этого)
-            for (unsigned int i = 0; i < vWorkQueue.size(); i++)
-            {
-                uint256 hashPrev = vWorkQueue[i];
-                for (map<uint256, CDataStream*>::iterator mi = mapOrphanTransactionsByPrev[hashPrev].begin();
-                     mi != mapOrphanTransactionsByPrev[hashPrev].end();
-                     ++mi)
-                {
-                    const CDataStream& vMsg = *((*mi).second);
-                    CTransaction tx;
-                    CDataStream(vMsg) >> tx;
-                    CInv inv(MSG_TX, tx.GetHash());
-                    bool fMissingInputs2 = false;
-                    // Use a dummy CValidationState so someone can't setup nodes to counter-DoS based on orphan resolution
-                    //(that is, feeding people an invalid transaction based on LegitTxX in order to get anyone relaying LegitTxX banned)
-                    // Использование фиктивных CValidationState так кто-то не может установить узлы борьбы с DoS-сирот на основе резолюции
-                    //(то есть, кормить людей недействительной сделке на основе LegitTxX, чтобы получить любой LegitTxX запрещена ретрансляция)
-                    CValidationState stateDummy;
-
-                    if (mempool.accept(stateDummy, tx, true, &fMissingInputs2))
-                    {
-                        printf("   accepted orphan tx %s\n", inv.hash.ToString().c_str());
-                        RelayTransaction(tx, inv.hash, vMsg);
-                        mapAlreadyAskedFor.erase(inv);
-                        vWorkQueue.push_back(inv.hash);
-                        vEraseQueue.push_back(inv.hash);
-                    }
-                    else if (!fMissingInputs2)
-                    {
-                        // invalid or too-little-fee orphan (недействительным или слишком мало плату сирот)
-                        vEraseQueue.push_back(inv.hash);
-                        printf("   removed orphan tx %s\n", inv.hash.ToString().c_str());
-                    }
-                }
-            }
+        // another announcer may be asked right away                                 другого объявившего можно запросить сразу
+        BOOST_FOREACH(const CInv& inv, vInv)
+            if (inv.type == MSG_TX)
+                MarkTxReceived(pfrom, inv.hash);
+    }
 
-            BOOST_FOREACH(uint256 hash, vEraseQueue)
-                EraseOrphanTx(hash);
-        }
-        else if (fMissingInputs)
-        {
-            AddOrphanTx(vMsg);
 
-            // DoS prevention: do not allow mapOrphanTransactions to grow unbounded (DoS Профилактика: не позволяют mapOrphanTransactions расти неограниченно)
-            unsigned int nEvicted = LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS);
-            if (nEvicted > 0)
-                printf("mapOrphan overflow, removed %u tx\n", nEvicted);
-        }
-        int nDoS;
-        if (state.IsInvalid(nDoS))
-            pfrom->Misbehaving(nDoS);
+    else if (strCommand == "tx")
+    {
+        ProcessTransactions(pfrom, vector<CSharedTxRef>(1, ReadTransaction(vRecv, pprepared)));
     }
 
 
     else if (strCommand == "block" && !fImporting && !fReindex) // Ignore blocks received while importing
     {
         printf("received block\n");
-        CBlock block;
-        vRecv >> block;
+        // A prepared block was deserialized and checked on a preparation thread      Подготовленный блок был десериализован и проверен в потоке подготовки
+        CBlock blockRead;
+        CBlock *pblock = &blockRead;
+        if (pprepared && pprepared->fDeserialized)
+            pblock = &pprepared->block;
+        else
+            vRecv >> blockRead;
+        CBlock &block = *pblock;
 
         printf("received block %s\n", block.GetHash().ToString().c_str());
         // block.print();
 
         CInv inv(MSG_BLOCK, block.GetHash());
         pfrom->AddInventoryKnown(inv);
+        MarkBlockReceived(pfrom, inv.hash);
+        ErasePartialBlocks(inv.hash);
 
         CValidationState state;
         if (ProcessBlock(state, pfrom, &block))
             mapAlreadyAskedFor.erase(inv);
         int nDoS;
         if (state.IsInvalid(nDoS))
+        {
             pfrom->Misbehaving(nDoS);
+            // the header chain leads through an invalid block                      цепь заголовков ведёт через недействительный блок
+            if (nDoS > 0 && mapHeaderIndex.count(inv.hash))
+                ClearHeaderChain();
+        }
+    }
+
+
+    else if (strCommand == "cmpctblock" && !fImporting && !fReindex)
+    {
+        CCompactBlock cmpctblock;
+        vRecv >> cmpctblock;
+
+        uint256 hash = cmpctblock.header.GetHash();
+        CInv inv(MSG_BLOCK, hash);
+        pfrom->AddInventoryKnown(inv);
+        if (AlreadyHave(inv) || mapPartialBlocks.count(make_pair(hash, pfrom)))
+            return true;
+
+        // Check the header before the memory pool is searched for the block      Проверить заголовок прежде, чем искать блок в пуле памяти
+        // or anything is asked for; the bound of the proof of work needs no       или что-либо запрошено; границе доказательства работы не нужен
+        // parent                                                                   родитель
+        if (!CheckProofOfWorkBound(hash, cmpctblock.header.nBits))
+        {
+            pfrom->Misbehaving(100);
+            return error("message cmpctblock : proof of work failed for compact block %s", hash.ToString().c_str());
+        }
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(cmpctblock.header.hashPrevBlock);
+        if (mi == mapBlockIndex.end())
+        {
+            // not on top of a block we have: the full block goes the orphan way    не поверх имеющегося блока: полный блок идёт путём сирот
+            RequestFullBlock(pfrom, hash);
+            return true;
+        }
+        CValidationState state;
+        if (!CheckHeaderContext(state, cmpctblock.header, hash, (*mi).second))
+        {
+            int nDoS;
+            if (state.IsInvalid(nDoS))
+                pfrom->Misbehaving(nDoS);
+            return error("message cmpctblock : bad header of compact block %s", hash.ToString().c_str());
+        }
+
+        CPartialBlock partial;
+        partial.nTimeReceived = GetTimeMicros();
+        if (!partial.Init(cmpctblock, mempool))
+        {
+            pfrom->Misbehaving(100);
+            return error("message cmpctblock : malformed compact block %s", hash.ToString().c_str());
+        }
+
+        vector<unsigned int> vMissing = partial.GetMissing();
+        if (vMissing.empty())
+        {
+            ProcessCompactBlock(pfrom, partial, vector<CTransaction>());
+            return true;
+        }
+
+        // One peer can't take all the places                                     Один пир не может занять все места
+        unsigned int nFromPeer = 0;
+        for (map<pair<uint256, CNode*>, CPartialBlock>::iterator it = mapPartialBlocks.begin(); it != mapPartialBlocks.end(); it++)
+            if ((*it).first.second == pfrom)
+                nFromPeer++;
+        if (mapPartialBlocks.size() >= MAX_PARTIAL_BLOCKS || nFromPeer >= MAX_PARTIAL_BLOCKS_PER_PEER)
+        {
+            RequestFullBlock(pfrom, hash);
+            return true;
+        }
+
+        mapPartialBlocks[make_pair(hash, pfrom)] = partial;
+        CBlockTxRequest req;
+        req.hashBlock = hash;
+        req.vIndex = vMissing;
+        pfrom->PushMessage("getblocktxn", req);
+    }
+
+
+    else if (strCommand == "getblocktxn")
+    {
+        CBlockTxRequest req;
+        vRecv >> req;
+
+        // Only recent blocks, older ones are asked for in full                    Только недавние блоки, более старые запрашиваются целиком
+        map<uint256, CBlockIndex*>::iterator mi = mapBlockIndex.find(req.hashBlock);
+        if (mi == mapBlockIndex.end() || (*mi).second->nHeight < nBestHeight - MAX_CMPCT_BLOCK_DEPTH)
+            return true;
+
+        CBlock block;
+        if (!ReadBlockFromDisk(block, (*mi).second))
+            return error("message getblocktxn : ReadBlockFromDisk failed");
+
+        CBlockTxResponse resp;
+        resp.hashBlock = req.hashBlock;
+        BOOST_FOREACH(unsigned int nIndex, req.vIndex)
+        {
+            if (nIndex >= block.vtx.size())
+            {
+                pfrom->Misbehaving(100);
+                return error("message getblocktxn : index %u out of range", nIndex);
+            }
+            resp.vtx.push_back(block.vtx[nIndex]);
+        }
+        pfrom->PushMessage("blocktxn", resp);
+    }
+
+
+    else if (strCommand == "blocktxn" && !fImporting && !fReindex)
+    {
+        CBlockTxResponse resp;
+        vRecv >> resp;
+
+        map<pair<uint256, CNode*>, CPartialBlock>::iterator it = mapPartialBlocks.find(make_pair(resp.hashBlock, pfrom));
+        if (it == mapPartialBlocks.end())
+            return true;
+        CPartialBlock partial = (*it).second;
+        mapPartialBlocks.erase(it);
+        ProcessCompactBlock(pfrom, partial, resp.vtx);
     }
 
 
@@ -4174,10 +6327,6 @@ bool ProcessMessages(CNode* pfrom)
 
     std::deque<CNetMessage>::iterator it = pfrom->vRecvMsg.begin();
     while (!pfrom->fDisconnect && it != pfrom->vRecvMsg.end()) {
-        // Don't bother if send buffer is too full to respond anyway (Не беспокойтесь, если буфер передачи слишком полной, чтобы так или иначе отвечают)
-        if (pfrom->nSendSize >= SendBufferSize())
-            break;
-
         // get next message (получить следующее сообщение)
         CNetMessage& msg = *it;
 
@@ -4190,6 +6339,10 @@ bool ProcessMessages(CNode* pfrom)
         if (!msg.complete())
             break;
 
+        // Don't bother if send buffer is too full to respond anyway (Не беспокойтесь, если буфер передачи слишком полной, чтобы так или иначе отвечают)
+        if (!pfrom->CanProcessMessage(msg))
+            break;
+
         // at this point, any failure means we can delete the current message (На данный момент, любой отказ означает, что мы можем удалить текущее сообщение)
         it++;
 
@@ -4214,24 +6367,34 @@ bool ProcessMessages(CNode* pfrom)
 
         // Checksum
         CDataStream& vRecv = msg.vRecv;
-        uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
-        unsigned int nChecksum = 0;
-        memcpy(&nChecksum, &hash, sizeof(nChecksum));
-        if (nChecksum != hdr.nChecksum)
+        CPreparedMessage* pprepared = msg.pprepared.get();
+        if (!pprepared || !pprepared->fChecksumOk)
         {
-            printf("ProcessMessages(%s, %u bytes) : CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n",
-               strCommand.c_str(), nMessageSize, nChecksum, hdr.nChecksum);
-            continue;
+            uint256 hash = Hash(vRecv.begin(), vRecv.begin() + nMessageSize);
+            unsigned int nChecksum = 0;
+            memcpy(&nChecksum, &hash, sizeof(nChecksum));
+            if (nChecksum != hdr.nChecksum)
+            {
+                printf("ProcessMessages(%s, %u bytes) : CHECKSUM ERROR nChecksum=%08x hdr.nChecksum=%08x\n",
+                   strCommand.c_str(), nMessageSize, nChecksum, hdr.nChecksum);
+                continue;
+            }
         }
 
         // Process message (обработка сообщений)
         bool fRet = false;
         try
         {
+            int64 nStart = GetTimeMicros();
             {
                 LOCK(cs_main);
-                fRet = ProcessMessage(pfrom, strCommand, vRecv);
+                if (strCommand == "tx" && pfrom->nVersion != 0)
+                    fRet = ProcessTxMessages(pfrom, msg, it);
+                else
+                    fRet = ProcessMessage(pfrom, strCommand, vRecv, pprepared);
             }
+            pfrom->nMsgProcessed++;
+            pfrom->nProcessTime += GetTimeMicros() - nStart;
             boost::this_thread::interruption_point();
         }
         catch (std::ios_base::failure& e)
@@ -4262,6 +6425,10 @@ bool ProcessMessages(CNode* pfrom)
 
         if (!fRet)
             printf("ProcessMessage(%s, %u bytes) FAILED\n", strCommand.c_str(), nMessageSize);
+
+        // One message per call, so that a peer flooding us does not starve the     Одно сообщение за вызов, чтобы пир, заваливающий нас сообщениями, не лишал
+        // others; the message handler comes back while messages are left           остальных обработки; обработчик сообщений вернётся, пока сообщения остаются
+        break;
     }
 
     // In case the connection got shut down, its receive buffer was wiped (В случае если соединение получил закрыли, его принимающего буфера была уничтожена)
@@ -4282,7 +6449,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
 
         // Keep-alive ping. We send a nonce of zero because we don't use it anywhere    Контроль активности пинг. Мы посылаем одноразовый номер нулевой,
         // right now.                                                                   потому что мы не будем использовать его в любом месте прямо сейчас
-        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->vSendMsg.empty()) {
+        if (pto->nLastSend && GetTime() - pto->nLastSend > 30 * 60 && pto->nSendSize == 0) {
             uint64 nonce = 0;
             if (pto->nVersion > BIP0031_VERSION)
                 pto->PushMessage("ping", nonce);
@@ -4293,7 +6460,10 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Start block sync (Начало блока синхронизации)
         if (pto->fStartSync && !fImporting && !fReindex) {
             pto->fStartSync = false;
-            PushGetBlocks(pto, pindexBest, uint256(0));
+            if (fHeadersFirst && !pto->fHeadersUnserved)
+                PushGetHeaders(pto);
+            else
+                PushGetBlocks(pto, pindexBest, uint256(0));
         }
 
         // Resend wallet transactions that haven't gotten in a block yet    Повторная бумажник операции, которые не получили в блоке еще
@@ -4359,6 +6529,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
         // Message: inventory
         //
         vector<CInv> vInv;
+        vector<CInv> vInvBlock;
         vector<CInv> vInvWait;
         {
             LOCK(pto->cs_inventory);
@@ -4366,9 +6537,24 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             vInvWait.reserve(pto->vInventoryToSend.size());
             BOOST_FOREACH(const CInv& inv, pto->vInventoryToSend)
             {
-                if (pto->setInventoryKnown.count(inv))
+                if (pto->filterInventoryKnown.contains(inv.hash))
                     continue;
 
+                // no more transactions while the peer is still busy with those sent    больше никаких транзакций, пока пир ещё занят отправленными
+                if (inv.type == MSG_TX && pto->IsSendFull(SEND_TX))
+                {
+                    vInvWait.push_back(inv);
+                    continue;
+                }
+
+                // blocks are announced in their own inv, ahead of transaction relay     блоки объявляются в собственном inv, раньше ретрансляции транзакций
+                if (inv.type == MSG_BLOCK)
+                {
+                    if (pto->filterInventoryKnown.insert(inv.hash))
+                        vInvBlock.push_back(inv);
+                    continue;
+                }
+
                 // trickle out tx inv to protect privacy  (течь тонкой струйкой TX инв для защиты privacy)
                 if (inv.type == MSG_TX && !fSendTrickle)
                 {
@@ -4397,7 +6583,7 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                 }
 
                 // returns true if wasn't already contained in the set (Возвращает TRUE, если бы не было уже содержится в множестве)
-                if (pto->setInventoryKnown.insert(inv).second)
+                if (pto->filterInventoryKnown.insert(inv.hash))
                 {
                     vInv.push_back(inv);
                     if (vInv.size() >= 1000)
@@ -4409,22 +6595,112 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
             }
             pto->vInventoryToSend = vInvWait;
         }
+        if (!vInvBlock.empty())
+            pto->PushMessage("inv", vInvBlock);
         if (!vInv.empty())
             pto->PushMessage("inv", vInv);
 
 
+        //
+        // Requests the node left unanswered    Запросы, оставленные узлом без ответа
+        //
+        int64 nNowMicros = GetTimeMicros();
+        bool fStalled = false;
+        for (map<uint256, int64>::iterator it = pto->mapBlocksAsked.begin(); it != pto->mapBlocksAsked.end(); )
+        {
+            if (nNowMicros - (*it).second > BLOCK_DOWNLOAD_TIMEOUT * 1000000)
+            {
+                // another peer's announcement may ask for the block right away     объявление другого пира может сразу запросить блок
+                mapAlreadyAskedFor.erase(CInv(MSG_BLOCK, (*it).first));
+                pto->mapBlocksAsked.erase(it++);
+                fStalled = true;
+            }
+            else
+                it++;
+        }
+        if (pto->nSyncAskTime && nNowMicros - pto->nSyncAskTime > SYNC_RESPONSE_TIMEOUT * 1000000)
+        {
+            pto->nSyncAskTime = 0;
+            // a node with nothing newer doesn't have to answer                     узлу без новых блоков можно не отвечать
+            if (max(pto->nStartingHeight, pto->nHeadersHeight) > GetBestHeaderHeight())
+                fStalled = true;
+        }
+        if (fStalled)
+        {
+            pto->nStalls++;
+            pto->nStallTime = GetTime();
+            printf("peer %s stalled on requests (%u times)\n", pto->addrName.c_str(), pto->nStalls);
+        }
+        for (map<uint256, int64>::iterator it = pto->mapTxAsked.begin(); it != pto->mapTxAsked.end(); )
+        {
+            if (nNowMicros - (*it).second > TX_REQUEST_TIMEOUT * 1000000)
+            {
+                // the next announcer in line asks for it                              следующий объявивший в очереди запрашивает её
+                map<uint256, pair<CNode*, int64> >::iterator mi = mapTxInFlight.find((*it).first);
+                if (mi != mapTxInFlight.end() && (*mi).second.first == pto)
+                    mapTxInFlight.erase(mi);
+                // a whole batch that times out is one missed round                 целый пакет, истёкший по времени, один пропущенный раунд
+                if (nNowMicros - pto->nTxMissTime > TX_REQUEST_TIMEOUT * 1000000)
+                {
+                    pto->nTxMissed++;
+                    pto->nTxMissTime = nNowMicros;
+                }
+                pto->mapTxAsked.erase(it++);
+            }
+            else
+                it++;
+        }
+        // requests of peers that went away                                         запросы ушедших пиров
+        static int64 nLastTxSweep;
+        if (nNowMicros - nLastTxSweep > TX_REQUEST_TIMEOUT * 1000000)
+        {
+            nLastTxSweep = nNowMicros;
+            ExpirePartialBlocks(nNowMicros);
+            for (map<uint256, pair<CNode*, int64> >::iterator mi = mapTxInFlight.begin(); mi != mapTxInFlight.end(); )
+            {
+                if (nNowMicros - (*mi).second.second > TX_REQUEST_TIMEOUT * 1000000)
+                    mapTxInFlight.erase(mi++);
+                else
+                    mi++;
+            }
+        }
+        if (pto->nTxMissed >= MAX_TX_MISSED && !pto->fDisconnect)
+        {
+            printf("disconnecting peer %s: %u rounds of transaction requests in a row not answered\n", pto->addrName.c_str(), pto->nTxMissed);
+            pto->fDisconnect = true;
+        }
+
         //
         // Message: getdata
         //
         vector<CInv> vGetData;
         int64 nNow = GetTime() * 1000000;
-        while (!pto->mapAskFor.empty() && (*pto->mapAskFor.begin()).first <= nNow)
+        multimap<int64, CInv>::iterator itAsk = pto->mapAskFor.begin();
+        while (itAsk != pto->mapAskFor.end() && (*itAsk).first <= nNow)
         {
-            const CInv& inv = (*pto->mapAskFor.begin()).second;
-            if (!AlreadyHave(inv))
+            const CInv& inv = (*itAsk).second;
+            if (inv.type == MSG_TX && !AlreadyHave(inv))
             {
+                // at most MAX_TX_IN_FLIGHT per peer, the rest waits in the queue        не больше MAX_TX_IN_FLIGHT на пира, остальное ждёт в очереди
+                if (pto->mapTxAsked.size() >= MAX_TX_IN_FLIGHT)
+                {
+                    itAsk++;
+                    continue;
+                }
+                map<uint256, pair<CNode*, int64> >::iterator mi = mapTxInFlight.find(inv.hash);
+                if (mi != mapTxInFlight.end() && nNowMicros - (*mi).second.second <= TX_REQUEST_TIMEOUT * 1000000)
+                {
+                    // asked from another announcer: this one is next if that one       запрошена у другого объявившего: этот следующий, если тот
+                    // doesn't deliver in time                                          не доставит вовремя
+                    if ((*mi).second.first != pto)
+                        pto->mapAskFor.insert(make_pair((*mi).second.second + TX_REQUEST_TIMEOUT * 1000000 + 1, inv));
+                    pto->mapAskFor.erase(itAsk++);
+                    continue;
+                }
                 if (fDebugNet)
                     printf("sending getdata: %s\n", inv.ToString().c_str());
+                mapTxInFlight[inv.hash] = make_pair(pto, nNowMicros);
+                pto->mapTxAsked[inv.hash] = nNowMicros;
                 vGetData.push_back(inv);
                 if (vGetData.size() >= 1000)
                 {
@@ -4432,11 +6708,54 @@ bool SendMessages(CNode* pto, bool fSendTrickle)
                     vGetData.clear();
                 }
             }
-            pto->mapAskFor.erase(pto->mapAskFor.begin());
+            else if (inv.type != MSG_TX && !AlreadyHave(inv))
+            {
+                if (fDebugNet)
+                    printf("sending getdata: %s\n", inv.ToString().c_str());
+                // Once synced, new blocks are rebuilt from the memory pool          После синхронизации новые блоки восстанавливаются из пула памяти
+                if (inv.type == MSG_BLOCK && fCompactBlockRelay && pto->fCompactBlocks && !IsInitialBlockDownload())
+                    vGetData.push_back(CInv(MSG_CMPCT_BLOCK, inv.hash));
+                else
+                    vGetData.push_back(inv);
+                if (inv.type == MSG_BLOCK)
+                    pto->mapBlocksAsked[inv.hash] = nNowMicros;
+                if (vGetData.size() >= 1000)
+                {
+                    pto->PushMessage("getdata", vGetData);
+                    vGetData.clear();
+                }
+            }
+            pto->mapAskFor.erase(itAsk++);
         }
         if (!vGetData.empty())
             pto->PushMessage("getdata", vGetData);
 
+        //
+        // Message: getdata (blocks along the header chain)     (блоки вдоль цепи заголовков)
+        //
+        if (fHeadersFirst && !pto->fClient && !fImporting && !fReindex)
+        {
+            // the rest of the headers, now that the blocks made room for them     остальные заголовки, теперь, когда блоки освободили для них место
+            if (pto == pnodeHeadersMore && HeaderChainHasRoom(pto))
+            {
+                pnodeHeadersMore = NULL;
+                PushGetHeaders(pto);
+            }
+
+            // a peer that stalled lately gets one block at a time              пир, недавно зависавший, получает по одному блоку
+            bool fStalledLately = pto->nStallTime && GetTime() - pto->nStallTime < 10 * BLOCK_DOWNLOAD_TIMEOUT;
+            vector<CInv> vBlocks;
+            FindBlocksToDownload(pto, fStalledLately ? 1 : MAX_BLOCKS_IN_FLIGHT, vBlocks);
+            BOOST_FOREACH(const CInv& inv, vBlocks)
+                pto->mapBlocksAsked[inv.hash] = nNowMicros;
+            if (!vBlocks.empty())
+            {
+                if (fDebugNet)
+                    printf("sending getdata: %"PRIszu" blocks along the header chain to %s\n", vBlocks.size(), pto->addr.ToString().c_str());
+                pto->PushMessage("getdata", vBlocks);
+            }
+        }
+
     }
     return true;
 }
@@ -4464,9 +6783,10 @@ public:
         mapOrphanBlocks.clear();
 
         // orphan transactions (осиротевшие транзакции)
-        std::map<uint256, CDataStream*>::iterator it3 = mapOrphanTransactions.begin();
-        for (; it3 != mapOrphanTransactions.end(); it3++)
-            delete (*it3).second;
+        mapOrphanTransactionsByPrev.clear();
+        mapOrphanTransactionsByPeer.clear();
+        mapOrphanBytesByPeer.clear();
         mapOrphanTransactions.clear();
+        nOrphanTransactionsSize = 0;
     }
 } instance_of_cmaincleanup;
@@ -13,9 +13,13 @@
 
 #include <list>
 
+#include <boost/noncopyable.hpp>
+#include <boost/unordered_map.hpp>
+
 class CWallet;
 class CBlock;
 class CBlockIndex;
+class CFilterableBlock;
 class CKeyItem;
 class CReserveKey;
 
@@ -69,6 +73,23 @@ static const unsigned int MAX_BLOCK_SIGOPS = MAX_BLOCK_SIZE/50;
 /** The maximum number of orphan transactions kept in memory
  *                  Максимальное количество сиротских транзакций сохраняемых в памяти*/
 static const unsigned int MAX_ORPHAN_TRANSACTIONS = MAX_BLOCK_SIZE/200;     // было 100
+/** The maximum total size in bytes of the orphan transactions kept in memory
+ *                  Максимальный общий размер в байтах сиротских транзакций сохраняемых в памяти*/
+static const unsigned int MAX_ORPHAN_TRANSACTIONS_SIZE = 2 * MAX_BLOCK_SIZE;
+/** Default limit of the transactions in the memory pool, in megabytes of serialized transactions
+ *                  Ограничение транзакций пула памяти по умолчанию, в мегабайтах сериализованных транзакций*/
+static const unsigned int DEFAULT_MAX_MEMPOOL_SIZE = 300;
+/** Seconds in which the minimum fee raised by a full memory pool halves (faster while the pool is emptier)
+ *                  Секунды, за которые минимальная комиссия, поднятая полным пулом памяти, уменьшается вдвое (быстрее, пока пул пустее)*/
+static const int64 ROLLING_FEE_HALFLIFE = 60 * 60 * 12;
+/** The most in-pool ancestors, and their total size in bytes, a transaction entering the memory pool may have (counting itself)
+ *                  Наибольшее число предков в пуле и их общий размер в байтах, которые может иметь входящая в пул транзакция (считая её саму)*/
+static const unsigned int MEMPOOL_ANCESTOR_LIMIT = 25;
+static const unsigned int MEMPOOL_ANCESTOR_SIZE_LIMIT = 101000;
+/** The most in-pool descendants, and their total size in bytes, an entry may get (counting itself)
+ *                  Наибольшее число потомков в пуле и их общий размер в байтах, которые может получить запись (считая её саму)*/
+static const unsigned int MEMPOOL_DESCENDANT_LIMIT = 25;
+static const unsigned int MEMPOOL_DESCENDANT_SIZE_LIMIT = 101000;
 /** The maximum size of a blk?????.dat file (since 0.8)
  *                  Максимальный размер BLK???. DAT файлов (с 0,8)*/
 static const unsigned int MAX_BLOCKFILE_SIZE = 0x8000000; // 128 MiB
@@ -98,6 +119,54 @@ static const int MAX_SCRIPTCHECK_THREADS = 16;
 /** Default amount of block size reserved for high-priority transactions (in bytes)
  *                  по умолчанию количество от размера блока зарезервировано для приоритетных транзакций (в байтах)*/
 static const int DEFAULT_BLOCK_PRIORITY_SIZE = 105000;   // было 27000
+/** Blocks deeper than this are sent in full even when asked for as compact blocks
+ *                  Блоки глубже этого отправляются целиком, даже если запрошены как компактные*/
+static const int MAX_CMPCT_BLOCK_DEPTH = 10;
+/** The maximum number of compact blocks waiting for their missing transactions
+ *                  Максимальное количество компактных блоков, ожидающих недостающие транзакции*/
+static const unsigned int MAX_PARTIAL_BLOCKS = 16;
+/** The maximum number of those waiting for the same peer
+ *                  Максимальное количество таких, ожидающих одного и того же пира*/
+static const unsigned int MAX_PARTIAL_BLOCKS_PER_PEER = 2;
+/** Seconds a compact block waits for its missing transactions
+ *                  Секунды, которые компактный блок ждёт недостающие транзакции*/
+static const int64 PARTIAL_BLOCK_TIMEOUT = 60;
+/** The number of recently filtered blocks whose prepared filter data is kept
+ *                  Количество недавно фильтрованных блоков, подготовленные данные фильтрации которых сохраняются*/
+static const unsigned int MAX_FILTERABLE_BLOCKS = 16;
+/** The maximum number of headers in a "headers" message
+ *                  Максимальное количество заголовков в сообщении "headers"*/
+static const unsigned int MAX_HEADERS_RESULTS = 2000;
+/** The maximum number of headers past our blocks, in total and from one peer
+ *                  Максимальное количество заголовков после наших блоков, всего и от одного пира*/
+static const unsigned int MAX_HEADER_CHAIN = 8 * MAX_HEADERS_RESULTS;
+static const unsigned int MAX_HEADER_CHAIN_PER_PEER = 2 * MAX_HEADERS_RESULTS;
+/** Blocks of the header chain not delivered in a row before the first missing header is dropped
+ *                  Блоков цепи заголовков, не доставленных подряд, прежде чем первый недостающий заголовок отбрасывается*/
+static const unsigned int MAX_HEADER_CHAIN_MISSES = 8;
+/** How far past the first missing block of the header chain blocks are downloaded
+ *                  Насколько дальше первого недостающего блока цепи заголовков загружаются блоки*/
+static const unsigned int BLOCK_DOWNLOAD_WINDOW = 128;
+/** The maximum number of blocks asked for from one peer at a time
+ *                  Максимальное количество блоков, запрошенных у одного пира одновременно*/
+static const unsigned int MAX_BLOCKS_IN_FLIGHT = 16;
+/** Seconds after which a block that didn't arrive is asked for from another peer
+ *                  Секунды, после которых не пришедший блок запрашивается у другого пира*/
+static const int64 BLOCK_DOWNLOAD_TIMEOUT = 60;
+/** The maximum number of transactions asked for from one peer at a time
+ *                  Максимальное количество транзакций, запрошенных у одного пира одновременно*/
+static const unsigned int MAX_TX_IN_FLIGHT = 100;
+/** The maximum number of "tx" messages of one peer accepted as one batch
+ *                  Максимальное количество сообщений "tx" одного пира, принимаемых одним пакетом*/
+static const unsigned int MAX_TX_BATCH = 100;
+/** Seconds after which a transaction that didn't arrive is asked for from another peer that announced it
+ *                  Секунды, после которых не пришедшая транзакция запрашивается у другого объявившего её пира*/
+static const int64 TX_REQUEST_TIMEOUT = 30;
+/** Rounds of transaction requests in a row a peer may leave unanswered before it is dropped; requests
+ *  timing out within TX_REQUEST_TIMEOUT of each other are one round
+ *                  Раундов запросов транзакций подряд, которые пир может оставить без ответа, прежде чем он будет
+ *                  отключён; запросы, истёкшие в пределах TX_REQUEST_TIMEOUT друг от друга, один раунд*/
+static const unsigned int MAX_TX_MISSED = 20;
 #ifdef USE_UPNP
 static const int fHaveUPnP = true;
 #else
@@ -133,9 +202,12 @@ extern std::set<CWallet*> setpwalletRegistered;
 extern bool fImporting;
 extern bool fReindex;
 extern bool fBenchmark;
+extern bool fCompactBlockRelay;
+extern bool fFastBlockRelay;
+extern bool fHeadersFirst;
 extern int nScriptCheckThreads;
 extern bool fTxIndex;
-extern unsigned int nCoinCacheSize;
+extern size_t nCoinCacheUsage;
 extern bool fHaveGUI;
 
 // Settings
@@ -149,6 +221,7 @@ static const uint64 nMinDiskSpace = 52428800;
 class CReserveKey;
 class CCoinsDB;
 class CBlockTreeDB;
+class CCoinsViewBackgroundFlush;
 struct CDiskBlockPos;
 class CCoins;
 class CTxUndo;
@@ -180,6 +253,24 @@ void RegisterNodeSignals(CNodeSignals& nodeSignals);
 void UnregisterNodeSignals(CNodeSignals& nodeSignals);
 
 void PushGetBlocks(CNode* pnode, CBlockIndex* pindexBegin, uint256 hashEnd);
+/** Ask a node for the headers following our best known header
+ *                  Запросить у узла заголовки, следующие за нашим лучшим известным заголовком */
+void PushGetHeaders(CNode* pnode);
+/** Check a header (with its hash) against the block it builds on: linkage, nBits, time and checkpoints
+ *                  Проверить заголовок (с его хэшем) относительно блока, на котором он строится: связь, nBits, время и контрольные точки */
+bool CheckHeaderContext(CValidationState &state, const CBlockHeader& header, const uint256& hash, CBlockIndex* pindexPrev);
+/** Check headers received with "headers" and extend the header chain with them
+ *                  Проверить заголовки, полученные в "headers", и продлить ими цепь заголовков */
+bool ProcessHeaders(CValidationState &state, CNode* pfrom, const std::vector<CBlockHeader>& vHeaders);
+/** Forget the header chain and the blocks asked for along it
+ *                  Забыть цепь заголовков и блоки, запрошенные вдоль неё */
+void ClearHeaderChain();
+/** Height of the best known header, the best block height without a header chain
+ *                  Высота лучшего известного заголовка, высота лучшего блока без цепи заголовков */
+int GetBestHeaderHeight();
+/** Pick blocks of the header chain to ask the given node for and mark them in flight
+ *                  Выбрать блоки цепи заголовков для запроса у данного узла и отметить их как запрошенные */
+void FindBlocksToDownload(CNode* pnode, unsigned int nMax, std::vector<CInv>& vInv);
 
 /** Process an incoming block
  *                  Обработка входящего блока */
@@ -193,6 +284,25 @@ FILE* OpenBlockFile(const CDiskBlockPos &pos, bool fReadOnly = false);
 /** Open an undo file (rev?????.dat)
  *                  Открытие файла отката (Rev???. DAT)*/
 FILE* OpenUndoFile(const CDiskBlockPos &pos, bool fReadOnly = false);
+/** A block file mapped read-only into memory; unmapped with the last reference
+ *                  Файл блоков, отображённый в память только для чтения; отображение снимается с последней ссылкой*/
+class CMappedFile : private boost::noncopyable
+{
+public:
+    const char *pbegin;
+    size_t nSize;
+
+    CMappedFile(const char *pbeginIn, size_t nSizeIn) : pbegin(pbeginIn), nSize(nSizeIn) {}
+    ~CMappedFile();
+};
+/** Map a finalized block file (one that is no longer appended to) into memory; NULL
+ *  if the file is still being written or cannot be mapped
+ *                  Отобразить в память завершённый файл блоков (в который больше не дописывают);
+ *                  NULL, если файл ещё пишется или не может быть отображён*/
+boost::shared_ptr<const CMappedFile> MapBlockFile(int nFile);
+/** Drop all block file mappings
+ *                  Убрать все отображения файлов блоков*/
+void UnmapBlockFiles();
 /** Import blocks from an external file
  *                  Импорт блоков из внешнего файла*/
 bool LoadExternalBlockFile(FILE* fileIn, CDiskBlockPos *dbp = NULL);
@@ -220,13 +330,36 @@ bool ProcessMessages(CNode* pfrom);
 /** Send queued protocol messages to be sent to a give node
  *                  Отправка очереди сообщений протокола, который будет отправлены данному узлу*/
 bool SendMessages(CNode* pto, bool fSendTrickle);
+/** Forget a node that is about to be deleted; false while cs_main is busy
+ *                  Забыть узел, который вот-вот будет удалён; false, пока cs_main занят*/
+bool FinalizeNode(CNode* pnode);
 /** Run an instance of the script checking thread
  *                  Запустить экземпляр проверки сценария в потоке*/
 void ThreadScriptCheck();
+/** Run an instance of the header hashing thread
+ *                  Запустить экземпляр хэширования заголовков в потоке*/
+void ThreadHeaderCheck();
+/** Run an instance of the network message preparation thread
+ *                  Запустить экземпляр подготовки сетевых сообщений в потоке*/
+void ThreadMessagePrepare();
+/** Do the lock-free work of the given complete messages (checksum, deserialization,
+ *  context-free checks), spread over the message preparation threads
+ *                  Выполнить не требующую блокировок работу для данных полных сообщений
+ *                  (контрольная сумма, десериализация, контекстно-независимые проверки),
+ *                  распределив её по потокам подготовки сообщений */
+void PrepareMessages(const std::vector<CNetMessage*>& vMsgs);
 /** Check whether a block hash satisfies the proof-of-work requirement specified by nBits
  *                  Проверить, удовлетворяет ли хэш блока требованию доказательства-работы указанное в nBits */
 //bool CheckProofOfWork(uint256 hash, unsigned int nBits);
 bool CheckProofOfWorkNEW(std::vector<CTransaction> vtx, uint256 hash, unsigned int nBits);
+/** Largest hash any block with nBits can have: the nBits target with the largest sumTrDif relaxation,
+ *  0 if nBits is out of range
+ *                  Наибольший хэш, который может иметь блок с nBits: цель nBits с наибольшим ослаблением sumTrDif,
+ *                  0, если nBits вне диапазона */
+uint256 GetProofOfWorkBound(unsigned int nBits);
+/** Check the part of the proof of work a header shows without its transactions
+ *                  Проверить часть доказательства работы, видимую у заголовка без транзакций */
+bool CheckProofOfWorkBound(uint256 hash, unsigned int nBits);
 /** Calculate the minimum amount of work a received block needs, without knowing its direct parent
  *                  Рассчитайте минимальное количество работы необходимое для получения блока, не зная его прямого родителя*/
 unsigned int ComputeMinWork(unsigned int nBase, int64 nTime);
@@ -242,12 +375,16 @@ std::string GetWarnings(std::string strFor);
 /** Retrieve a transaction (from memory pool, or from disk, if possible)
  *                  Получение транзакций (от памяти пула, или с диска, если это возможно)*/
 bool GetTransaction(const uint256 &hash, CTransaction &tx, uint256 &hashBlock, bool fAllowSlow = false);
-/** Connect/disconnect blocks until pindexNew is the new tip of the active block chain
- *                  Подключение/отключение блоков до тех пор пока pindexNew станет новым активным окончанием цепи блоков*/
-bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew);
+/** Connect/disconnect blocks until pindexNew is the new tip of the active block chain.
+ *  If pblockIn is given it holds the (already checked) data of pindexBlockIn, which is
+ *  then connected from memory instead of being read back from disk.
+ *                  Подключение/отключение блоков до тех пор пока pindexNew станет новым активным окончанием цепи блоков.
+ *                  Если задан pblockIn, он содержит (уже проверенные) данные pindexBlockIn, которые
+ *                  тогда подключаются из памяти, а не читаются заново с диска.*/
+bool SetBestChain(CValidationState &state, CBlockIndex* pindexNew, CBlockIndex* pindexBlockIn = NULL, CBlock* pblockIn = NULL);
 /** Find the best known block, and make it the tip of the block chain
  *                  Найти наилучший известный блок, и сделать его окончанием цепи блоков*/
-bool ConnectBestBlock(CValidationState &state);
+bool ConnectBestBlock(CValidationState &state, CBlockIndex* pindexBlockIn = NULL, CBlock* pblockIn = NULL);
 int GetHeightPartChain(int nHeight);                              ////////// новое //////////
 int64 GetBlockValue(int nHeight, int64 nFees);
 unsigned int GetNextWorkRequired(const CBlockIndex* pindexLast, const CBlockHeader *pblock);
@@ -544,6 +681,8 @@ public:
         ptxTo(&txToIn), nIn(nInIn), nFlags(nFlagsIn), nHashType(nHashTypeIn) { }
 
     bool operator()() const;
+    // whether a failed check only failed on non-canonical encodings         не прошла ли проверка лишь из-за неканонических кодировок
+    bool PassesWithoutStrictEnc() const;
 
     void swap(CScriptCheck &check) {
         scriptPubKey.swap(check.scriptPubKey);
@@ -554,6 +693,113 @@ public:
     }
 };
 
+/** Closure representing the context-free checks of one transaction of a block     Закрытое исполнение контекстно-независимых проверок одной транзакции блока
+ *  (CheckTransaction, its txid for the merkle tree and its legacy sigop count).     (CheckTransaction, её txid для дерева Меркля и количество legacy sigop).
+ *  The results are written to slots owned by the caller.                           Результаты записываются в ячейки, принадлежащие вызывающему. */
+class CTxCheck
+{
+private:
+    const CTransaction *ptx;
+    uint256 *phash;
+    unsigned int *pnSigOps;
+
+public:
+    CTxCheck() : ptx(NULL), phash(NULL), pnSigOps(NULL) {}
+    CTxCheck(const CTransaction& txIn, uint256& hashOut, unsigned int& nSigOpsOut) :
+        ptx(&txIn), phash(&hashOut), pnSigOps(&nSigOpsOut) { }
+
+    bool operator()() const;
+
+    void swap(CTxCheck &check) {
+        std::swap(ptx, check.ptx);
+        std::swap(phash, check.phash);
+        std::swap(pnSigOps, check.pnSigOps);
+    }
+};
+
+/** Work for the script check threads: a script check of ConnectBlock and the      Работа для потоков проверки скриптов: проверка скрипта из ConnectBlock и
+ *  memory pool, or a transaction check of CheckBlock. Both run under cs_main,      пула памяти или проверка транзакции из CheckBlock. Обе идут под cs_main,
+ *  one at a time, so they share the threads.                                       по одной за раз, поэтому делят потоки. */
+class CValidationCheck
+{
+private:
+    CScriptCheck scriptCheck;
+    CTxCheck txCheck;
+    bool fTxCheck;
+
+public:
+    CValidationCheck() : fTxCheck(false) {}
+
+    void Set(CScriptCheck &check) { scriptCheck.swap(check); fTxCheck = false; }
+    void Set(CTxCheck &check) { txCheck.swap(check); fTxCheck = true; }
+
+    bool operator()() const {
+        return fTxCheck ? txCheck() : scriptCheck();
+    }
+
+    void swap(CValidationCheck &check) {
+        scriptCheck.swap(check.scriptCheck);
+        txCheck.swap(check.txCheck);
+        std::swap(fTxCheck, check.fTxCheck);
+    }
+};
+
+/** Closure computing the proof-of-work hash of a header received with "headers"   Замыкание, вычисляющее хэш доказательства работы заголовка из "headers" */
+class CHeaderCheck
+{
+private:
+    const CBlockHeader *pheader;
+    int nHeight;
+    uint256 *phash;
+
+public:
+    CHeaderCheck() : pheader(NULL), nHeight(0), phash(NULL) {}
+    CHeaderCheck(const CBlockHeader& headerIn, int nHeightIn, uint256& hashOut) :
+        pheader(&headerIn), nHeight(nHeightIn), phash(&hashOut) { }
+
+    bool operator()() const {
+        *phash = pheader->GetHashFork(nHeight);
+        return true;
+    }
+
+    void swap(CHeaderCheck &check) {
+        std::swap(pheader, check.pheader);
+        std::swap(nHeight, check.nHeight);
+        std::swap(phash, check.phash);
+    }
+};
+
+/** Results of the part of processing a network message that needs no locks. Computed   Результаты той части обработки сетевого сообщения, которой не нужны блокировки.
+ *  by PrepareMessages on the message preparation threads, for all peers in parallel,   Вычисляются PrepareMessages в потоках подготовки сообщений, для всех пиров параллельно,
+ *  and used by ProcessMessage under cs_main.                                           и используются ProcessMessage под cs_main. */
+class CPreparedMessage
+{
+public:
+    bool fChecksumOk;
+    bool fDeserialized;     // tx or block below holds the payload                 tx или block ниже содержит полезную нагрузку
+    CTransaction tx;        // "tx"
+    CBlock block;           // "block", with CheckBlock(fCheckPOW=false) done     "block", с выполненным CheckBlock(fCheckPOW=false)
+
+    CPreparedMessage() : fChecksumOk(false), fDeserialized(false) {}
+};
+
+/** Closure preparing one complete network message (see CPreparedMessage)            Закрытое исполнение подготовки одного полного сетевого сообщения (см. CPreparedMessage) */
+class CMessagePrepare
+{
+private:
+    CNetMessage *pmsg;
+
+public:
+    CMessagePrepare() : pmsg(NULL) {}
+    CMessagePrepare(CNetMessage& msgIn) : pmsg(&msgIn) { }
+
+    bool operator()() const;
+
+    void swap(CMessagePrepare &check) {
+        std::swap(pmsg, check.pmsg);
+    }
+};
+
 /** A transaction with a merkle branch linking it to the block chain.   Сделки с ветвью Меркля связывающие их с цепью блоков*/
 class CMerkleTx : public CTransaction
 {
@@ -699,6 +945,12 @@ public:
     //                  Построить частичное дерева Меркля из списка идентификатор транзакции, и маску, которая выбирает их подмножество
     CPartialMerkleTree(const std::vector<uint256> &vTxid, const std::vector<bool> &vMatch);
 
+    // The same from the complete merkle tree of nTransactions (txids, then the upper levels, as CBlock::vMerkleTree),
+    // so that no hashes are computed
+    //                  То же из полного дерева Меркля для nTransactions (txid, затем верхние уровни, как CBlock::vMerkleTree),
+    //                  чтобы не вычислять хэши
+    CPartialMerkleTree(unsigned int nTransactionsIn, const std::vector<uint256> &vTree, const std::vector<bool> &vMatch);
+
     CPartialMerkleTree();
 
     // extract the matching txid's represented by this partial merkle tree.     извлечь соответствующие txid's, представленные этой частью дерева Меркля.
@@ -712,6 +964,41 @@ public:
 bool WriteBlockToDisk(CBlock& block, CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CDiskBlockPos& pos);
 bool ReadBlockFromDisk(CBlock& block, const CBlockIndex* pindex);
+/** Append the serialized block stored at pos to ss, as it is on disk           Добавить к ss сериализованный блок, хранящийся в pos, в том виде, как он на диске */
+bool ReadRawBlockFromDisk(CDataStream& ss, const CDiskBlockPos& pos);
+
+
+/** LRU cache of complete "block" network messages (header with size and checksum,   LRU-кэш полных сетевых сообщений "block" (заголовок с размером и контрольной суммой,
+ *  then the serialized block) of recently used blocks, by block hash. Peers asking    затем сериализованный блок) недавно использованных блоков, по хэшу блока. Пирам,
+ *  for a block get the cached bytes, and ReadBlockFromDisk deserializes from memory   запрашивающим блок, отдаются кэшированные байты, а ReadBlockFromDisk десериализует из
+ *  instead of reading and checking the block file again.                              памяти вместо повторного чтения и проверки файла блоков. */
+class CBlockMessageCache
+{
+private:
+    typedef std::list<std::pair<uint256, boost::shared_ptr<const CSerializeData> > > list_type;
+
+    mutable CCriticalSection cs;
+    list_type listMsgs;                                 // most recently used first   сначала недавно использованные
+    std::map<uint256, list_type::iterator> mapMsgs;
+    size_t nMaxSize;
+    size_t nSize;
+
+public:
+    CBlockMessageCache(size_t nMaxSizeIn) : nMaxSize(nMaxSizeIn), nSize(0) {}
+
+    void SetMaxSize(size_t nMaxSizeIn);
+    boost::shared_ptr<const CSerializeData> Get(const uint256 &hash);
+    void Put(const uint256 &hash, const boost::shared_ptr<const CSerializeData> &pmsg);
+    size_t GetSize() const;
+    void Clear();
+};
+
+extern CBlockMessageCache blockmsgcache;
+
+/** The complete "block" network message for a block                            Полное сетевое сообщение "block" для блока */
+boost::shared_ptr<const CSerializeData> MakeBlockMessage(const CBlock& block);
+/** The "block" message of a block on disk, from blockmsgcache or the block file   Сообщение "block" для блока на диске, из blockmsgcache или из файла блоков */
+boost::shared_ptr<const CSerializeData> GetBlockMessage(const CBlockIndex* pindex);
 
 
 /** Functions for validating blocks and updating the block tree                 Функции для проверки блоков и обновление блока дерева */
@@ -736,7 +1023,7 @@ bool ConnectBlock(CBlock& block, CValidationState& state, CBlockIndex* pindex, C
 bool AddToBlockIndex(CBlock& block, CValidationState& state, const CDiskBlockPos& pos);
 
 // Context-independent validity checks                                          Контекстно-независимые проверки достоверности
-bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true);
+bool CheckBlock(const CBlock& block, CValidationState& state, bool fCheckPOW = true, bool fCheckMerkleRoot = true, bool fParallel = true);
 
 // Store block on disk                                                          Сохранить блок на диске
 // if dbp is provided, the file is known to already reside on disk              если DBP в том случае, то файл, как известно, уже находятся на диске
@@ -1219,21 +1506,128 @@ public:
 
 
 
+/** Height of the block the mining hash of tx refers to when it is mined on top     Высота блока, на который ссылается хэш добычи tx, когда она добывается поверх
+ *  of the block at nBestHeightIn                                                   блока на высоте nBestHeightIn */
+int GetTxMiningBlock(const CTransaction& tx, int nBestHeightIn);
+/** The hash the fee return orders a transaction by when it is mined on top of      Хэш, по которому возврат комиссии упорядочивает транзакцию, добытую поверх
+ *  the block at nBestHeightIn (requires cs_main)                                   блока на высоте nBestHeightIn (требует cs_main) */
+uint256 GetTxMiningHash(const CTransaction& tx, int nBestHeightIn);
+/** Hash of the block at nMiningBlock in the best chain, 0 if none (requires cs_main)    Хэш блока на nMiningBlock в лучшей цепи, 0 если его нет (требует cs_main) */
+uint256 GetTxMiningBlockHash(int nMiningBlock);
+/** What a transaction adds to sumTrDif of a block on top of nBestHeightIn         Что транзакция добавляет к sumTrDif блока поверх nBestHeightIn */
+uint256 GetTxMiningWork(const uint256& hashMining, int nMiningBlock, int nBestHeightIn);
+
+/** A transaction in the memory pool with what block assembly and eviction          Транзакция в пуле памяти с тем, что нужно сборке блока и вытеснению,
+ *  need, computed once when it enters the pool                                     вычисленным один раз при попадании в пул */
+class CTxMemPoolEntry
+{
+public:
+    CSharedTxRef ptx;               // shared with the relay cache and orphans    разделяется с кэшем ретрансляции и сиротами
+    int64 nFee;
+    unsigned int nTxSize;
+    double dPriority;               // at nHeight                                 на высоте nHeight
+    int64 nValueInChain;            // inputs whose priority grows with each block  входы, приоритет которых растёт с каждым блоком
+    int nHeight;                    // best height when it entered the pool       лучшая высота при попадании в пул
+    int64 nTime;
+    int nMiningBlock;               // GetTxMiningBlock at nHeight                GetTxMiningBlock на высоте nHeight
+    uint256 hashMiningBlock;        // hash of the block at nMiningBlock then     хэш блока на nMiningBlock в тот момент
+    uint256 hashMining;             // GetTxMiningHash at nHeight                 GetTxMiningHash на высоте nHeight
+    uint256 nMiningWork;            // GetTxMiningWork at nHeight                 GetTxMiningWork на высоте nHeight
+
+    // the package it heads: itself and its descendants in the pool             пакет, который она возглавляет: она и её потомки в пуле
+    int64 nFeesWithDescendants;
+    int64 nSizeWithDescendants;
+    int64 nCountWithDescendants;
+
+    CTxMemPoolEntry(const CSharedTxRef& ptxIn, int64 nFeeIn, double dPriorityIn, int64 nValueInChainIn, int nHeightIn, int64 nTimeIn);
+
+    const CTransaction& GetTx() const { return ptx->tx; }
+    const uint256& GetHash() const { return ptx->hash; }
+    double GetPriority(int nCurrentHeight) const;
+    double GetFeePerKb() const { return nFee * 1000.0 / nTxSize; }
+    // the higher of its own fee rate and that of its package                  большая из её собственной ставки комиссии и ставки её пакета
+    double GetDescendantScore() const;
+};
+
+/** One transaction given to CTxMemPool::acceptBatch, with what is found on the way     Одна транзакция, переданная CTxMemPool::acceptBatch, с найденным по пути */
+class CTxMemPoolAccept
+{
+public:
+    CSharedTxRef ptx;
+    // kept from before (mempool.dat): entry time, and mining hash at best height nHeight
+    // with the hash of the block it referred to
+    //      сохранённое ранее (mempool.dat): время входа и хэш добычи на лучшей высоте nHeight
+    //      с хэшем блока, на который он ссылался
+    int64 nTime;
+    int nHeight;
+    uint256 hashMiningBlock;
+    uint256 hashMining;
+
+    CValidationState state;
+    bool fMissingInputs;
+    bool fAccepted;
+    int64 nFee;
+    double dPriority;
+    int64 nValueInChain;
+    std::vector<CScriptCheck> vChecks;
+
+    CTxMemPoolAccept(const CSharedTxRef& ptxIn) : ptx(ptxIn), nTime(0), nHeight(-1), hashMiningBlock(0), hashMining(0),
+        fMissingInputs(false), fAccepted(false), nFee(0), dPriority(0), nValueInChain(0) {}
+};
+
+/** Lowest descendant score first: evicting the first entry and its descendants     Сначала наименьшая оценка потомков: вытеснение первой записи с её потомками
+ *  frees space paying the least                                                    освобождает место, оплаченное меньше всего */
+struct CompareTxMemPoolEntryByScore
+{
+    bool operator()(const CTxMemPoolEntry* a, const CTxMemPoolEntry* b) const
+    {
+        double fa = a->GetDescendantScore(), fb = b->GetDescendantScore();
+        if (fa != fb)
+            return fa < fb;
+        return a->GetHash() < b->GetHash();
+    }
+};
+
 class CTxMemPool
 {
 public:
     mutable CCriticalSection cs;
-    std::map<uint256, CTransaction> mapTx;
+    std::map<uint256, CTxMemPoolEntry> mapTx;
     std::map<COutPoint, CInPoint> mapNextTx;
-
-    bool accept(CValidationState &state, CTransaction &tx, bool fLimitFree, bool* pfMissingInputs);
-    bool addUnchecked(const uint256& hash, CTransaction &tx);
+    std::set<const CTxMemPoolEntry*, CompareTxMemPoolEntryByScore> setByScore;
+    std::set<std::pair<uint256, uint256> > setByMiningWork;    // (nMiningWork, txid)
+
+    CTxMemPool();
+
+    bool accept(CValidationState &state, const CTransaction &tx, bool fLimitFree, bool* pfMissingInputs);
+    bool accept(CValidationState &state, const CSharedTxRef &ptx, bool fLimitFree, bool* pfMissingInputs);
+    // Accept transactions in order, later ones may spend earlier ones; the scripts of all of them
+    // are checked at once on the script check threads. Returns the number accepted. Requires cs_main.
+    //      Принять транзакции по порядку, поздние могут тратить ранние; скрипты их всех
+    //      проверяются сразу в потоках проверки скриптов. Возвращает число принятых. Требует cs_main.
+    unsigned int acceptBatch(std::vector<CTxMemPoolAccept> &vAccept, bool fLimitFree);
+    bool addUnchecked(const uint256& hash, const CTransaction &tx);
+    bool addUnchecked(const CSharedTxRef &ptx);
+    bool addUnchecked(const CTxMemPoolEntry &entry);
     bool remove(const CTransaction &tx, bool fRecursive = false);
     bool removeConflicts(const CTransaction &tx);
     void clear();
     void queryHashes(std::vector<uint256>& vtxid);
     void pruneSpent(const uint256& hash, CCoins &coins);
 
+    // Evict the lowest scoring packages until the transactions fit in nMaxSizeIn bytes,
+    // returns the number of transactions evicted
+    //      Вытеснять пакеты с наименьшей оценкой, пока транзакции не уместятся в nMaxSizeIn байт,
+    //      возвращает число вытесненных транзакций
+    unsigned int TrimToSize(uint64 nMaxSizeIn);
+    void SetMaxSize(uint64 nMaxSizeIn) { LOCK(cs); nMaxSize = nMaxSizeIn; }
+    // Fee a transaction of nTxSize bytes needs after evictions: above the fee rate of what was evicted,
+    // decaying back to 0 once nothing is evicted any more
+    //      Комиссия, нужная транзакции размером nTxSize байт после вытеснений: выше ставки вытесненного,
+    //      спадает обратно до 0, когда больше ничего не вытесняется
+    int64 GetRollingMinFee(unsigned int nTxSize);
+    uint64 GetTotalTxSize() { LOCK(cs); return nTotalTxSize; }
+
     unsigned long size()
     {
         LOCK(cs);
@@ -1245,14 +1639,55 @@ public:
         return (mapTx.count(hash) != 0);
     }
 
-    CTransaction& lookup(uint256 hash)
+    const CTransaction& lookup(uint256 hash)
+    {
+        std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mapTx.find(hash);
+        assert(mi != mapTx.end());
+        return mi->second.GetTx();
+    }
+
+    CSharedTxRef get(const uint256& hash)
     {
-        return mapTx[hash];
+        LOCK(cs);
+        std::map<uint256, CTxMemPoolEntry>::const_iterator mi = mapTx.find(hash);
+        if (mi == mapTx.end())
+            return CSharedTxRef();
+        return mi->second.ptx;
     }
+
+private:
+    uint64 nTotalTxSize;
+    uint64 nMaxSize;
+    double dRollingMinFeeRate;      // per byte, at nRollingFeeTime               за байт, на момент nRollingFeeTime
+    int64 nRollingFeeTime;
+
+    // the checks of accept but the scripts, which go to acc.vChecks; the outputs of   проверки accept, кроме скриптов, которые идут в acc.vChecks; выходы
+    // a transaction passing them are added to view for the rest of the batch        прошедшей их транзакции добавляются в view для остального пакета
+    bool acceptInputs(CTxMemPoolAccept &acc, CCoinsViewCache &view, std::set<COutPoint> &setSpent, bool fLimitFree);
+    // in-pool transactions tx spends, directly or not                         транзакции пула, которые tx тратит, прямо или косвенно
+    void CalculateAncestors(const CTransaction &tx, std::set<uint256> &setAncestors);
+    // in-pool transactions spending hash, directly or not                    транзакции пула, тратящие hash, прямо или косвенно
+    void CalculateDescendants(const uint256 &hash, std::set<uint256> &setDescendants);
+    // add to the package of each ancestor                                    добавить к пакету каждого предка
+    void UpdateAncestors(const CTransaction &tx, int64 nFee, int64 nSize, int64 nCount);
+    // would tx of nTxSize keep its ancestors and their packages within the limits   остались бы предки tx размера nTxSize и их пакеты в пределах ограничений
+    bool CheckPackageLimits(const CTransaction &tx, unsigned int nTxSize, std::string &strReason);
 };
 
 extern CTxMemPool mempool;
 
+/** Write the memory pool to mempool.dat, parents before their children            Записать пул памяти в mempool.dat, родителей перед их потомками */
+bool DumpMempool();
+/** Accept the transactions of mempool.dat again                                   Снова принять транзакции из mempool.dat */
+bool LoadMempool();
+
+/** A transaction whose inputs are missing, with the peer that sent it             Транзакция, входы которой отсутствуют, с пиром, который её прислал */
+struct COrphanTx
+{
+    CSharedTxRef ptx;
+    CNode* pfrom;           // only compared, the peer may be gone                 только сравнивается, пира может уже не быть
+};
+
 struct CCoinsStats
 {
     int nHeight;
@@ -1260,12 +1695,51 @@ struct CCoinsStats
     uint64 nTransactions;
     uint64 nTransactionOutputs;
     uint64 nSerializedSize;
-    uint256 hashSerialized;
+    uint256 hashSet;
     int64 nTotalAmount;
 
-    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSerialized(0), nTotalAmount(0) {}
+    CCoinsStats() : nHeight(0), hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), hashSet(0), nTotalAmount(0) {}
 };
 
+/** Hasher for the coins cache. Keys are txids, which are already uniformly          Хешер для кэша монет. Ключи - это txid, которые уже равномерно
+ *  distributed, so mixing them with a per-map random salt is enough to keep         распределены, поэтому смешивания со случайной солью каждой таблицы
+ *  crafted transactions from piling up in one bucket.                               достаточно, чтобы специально созданные транзакции не собирались в одну корзину. */
+class CCoinsKeyHasher
+{
+private:
+    uint64 k0, k1;
+
+public:
+    CCoinsKeyHasher();
+
+    size_t operator()(const uint256 &key) const {
+        uint64 w[4];
+        memcpy(w, key.begin(), sizeof(w));
+        uint64 h = k0;
+        for (int i = 0; i < 4; i++) {
+            h = (h ^ w[i] ^ k1) * 0x9E3779B97F4A7C15ULL;
+            h ^= h >> 29;
+        }
+        return (size_t)h;
+    }
+};
+
+/** One entry of the coins cache                                                    Одна запись кэша монет */
+struct CCoinsCacheEntry
+{
+    CCoins coins;
+    unsigned char flags;
+
+    enum Flags {
+        DIRTY = (1 << 0), // differs from the version in the base view                  отличается от версии в базовом view
+        FRESH = (1 << 1), // the base view does not have it, or only a pruned version   в базовом view её нет, или есть только pruned версия
+    };
+
+    CCoinsCacheEntry() : coins(), flags(0) {}
+};
+
+typedef boost::unordered_map<uint256, CCoinsCacheEntry, CCoinsKeyHasher> CCoinsMap;
+
 /** Abstract view on the open txout dataset.                                        Абстрактное представление об открытом txout наборе данных */
 class CCoinsView
 {
@@ -1273,6 +1747,10 @@ public:
     // Retrieve the CCoins (unspent transaction outputs) for a given txid           Получить CCoins (неизрасходованные выходы сделки) для данного TXID
     virtual bool GetCoins(const uint256 &txid, CCoins &coins);
 
+    // Retrieve the CCoins for several txids at once. vCoins is resized to match    Получить CCoins сразу для нескольких txid. Размер vCoins подгоняется под
+    // vTxid; entries that are not found are left empty (pruned).                   vTxid; не найденные записи остаются пустыми (pruned).
+    virtual void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins);
+
     // Modify the CCoins for a given txid                                           Изменить CCoins для данной TXID
     virtual bool SetCoins(const uint256 &txid, const CCoins &coins);
 
@@ -1287,7 +1765,9 @@ public:
     virtual bool SetBestBlock(CBlockIndex *pindex);
 
     // Do a bulk modification (multiple SetCoins + one SetBestBlock)                При массовой модификации (несколько SetCoins + один SetBestBlock)
-    virtual bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex);
+    // Only DIRTY entries are applied. The entries of mapCoins may be moved out     Применяются только DIRTY записи. Записи mapCoins могут быть перемещены
+    // of it, so the caller must not use them afterwards.                           из неё, поэтому вызывающий не должен использовать их после этого.
+    virtual bool BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex);
 
     // Calculate statistics about the unspent transaction output set                Вычислить статистику относительно неизрасходованного набора выходной транзакции
     virtual bool GetStats(CCoinsStats &stats);
@@ -1310,7 +1790,7 @@ public:
     CBlockIndex *GetBestBlock();
     bool SetBestBlock(CBlockIndex *pindex);
     void SetBackend(CCoinsView &viewIn);
-    bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex);
+    bool BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex);
     bool GetStats(CCoinsStats &stats);
 };
 
@@ -1319,23 +1799,31 @@ class CCoinsViewCache : public CCoinsViewBacked
 {
 protected:
     CBlockIndex *pindexTip;
-    std::map<uint256,CCoins> cacheCoins;
+    CCoinsMap cacheCoins;
+
+    // Heap memory held by the CCoins in cacheCoins                                 Память кучи, занятая CCoins в cacheCoins
+    size_t cachedCoinsUsage;
 
 public:
     CCoinsViewCache(CCoinsView &baseIn, bool fDummy = false);
 
     // Standard CCoinsView methods                                                  Стандартные CCoinsView методы
     bool GetCoins(const uint256 &txid, CCoins &coins);
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins);
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid);
     CBlockIndex *GetBestBlock();
     bool SetBestBlock(CBlockIndex *pindex);
-    bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex);
+    bool BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex);
 
-    // Return a modifiable reference to a CCoins. Check HaveCoins first.            Возвращает ссылку на модифицированные CCoins. Проверьте HaveCoins первым.
+    // Return a reference to a CCoins. Check HaveCoins first.                       Возвращает ссылку на CCoins. Проверьте HaveCoins первым.
     // Many methods explicitly require a CCoinsViewCache because of this method,    Многие методы явно требуют CCoinsViewCache из-за этого способа,
-    // to reduce copying.                                                           для сокращения копирования.
-    CCoins &GetCoins(const uint256 &txid);
+    // to reduce copying. Use a CCoinsModifier to change an entry in place.         для сокращения копирования. Для изменения записи на месте используйте CCoinsModifier.
+    const CCoins &GetCoins(const uint256 &txid);
+
+    // Load the CCoins for the given txids that are not cached yet from the base    Загрузить из базы в кэш ещё не кэшированные CCoins для данных txid
+    // in a single batch, so a backing database can read them concurrently.         одним пакетом, чтобы нижележащая база данных могла читать их параллельно.
+    void Prefetch(const std::vector<uint256> &vTxid);
 
     // Push the modifications applied to this cache to its base. Failure to call    Протолкните приложенные модификации в кэш на его базу. Если не вызывать
     // this method before destruction will cause the changes to be forgotten.       этот метод до деструктора, сделанные изменения будут забыты.
@@ -1344,6 +1832,9 @@ public:
     // Calculate the size of the cache (in number of transactions)                  Вычислить размер кэша (в количестве сделок)
     unsigned int GetCacheSize();
 
+    // Calculate the memory used by the cache, in bytes                             Вычислить объём памяти, занимаемой кэшем, в байтах
+    size_t DynamicMemoryUsage() const;
+
     /** Amount of bitcoins coming in to a transaction
         Note that lightweight clients may not know anything besides the hash of previous transactions,
         so may not be able to calculate this.
@@ -1364,7 +1855,29 @@ public:
     const CTxOut &GetOutputFor(const CTxIn& input);
 
 private:
-    std::map<uint256,CCoins>::iterator FetchCoins(const uint256 &txid);
+    CCoinsMap::iterator FetchCoins(const uint256 &txid);
+    CCoinsCacheEntry &ModifyCoins(const uint256 &txid);
+
+    friend class CCoinsModifier;
+};
+
+/** Write access to one CCoins of a CCoinsViewCache. The entry is fetched (or       Доступ на запись к одному CCoins из CCoinsViewCache. Запись загружается (или
+    created empty) and marked DIRTY; when the modifier goes out of scope, the       создаётся пустой) и помечается DIRTY; когда модификатор выходит из области
+    memory accounting of the cache is updated for the changes made through it.      видимости, учёт памяти кэша обновляется с учётом сделанных изменений.
+ */
+class CCoinsModifier : private boost::noncopyable
+{
+private:
+    CCoinsViewCache &cache;
+    CCoinsCacheEntry &entry;
+    size_t nUsageBefore;
+
+public:
+    CCoinsModifier(CCoinsViewCache &cacheIn, const uint256 &txid);
+    ~CCoinsModifier();
+
+    CCoins *operator->() { return &entry.coins; }
+    CCoins &operator*() { return entry.coins; }
 };
 
 /** CCoinsView that brings transactions from a memorypool into view.                CCoinsView который переносит транзакции из MemoryPool в поле зрения.
@@ -1384,6 +1897,9 @@ public:
 /** Global variable that points to the active CCoinsView (protected by cs_main)    Глобальная переменная, которая указывает на активную CCoinsView*/
 extern CCoinsViewCache *pcoinsTip;
 
+/** Global variable that points to the background writer below pcoinsTip          Глобальная переменная, которая указывает на фоновый писатель под pcoinsTip*/
+extern CCoinsViewBackgroundFlush *pcoinsFlush;
+
 /** Global variable that points to the active block tree (protected by cs_main)    Глобальная переменная, которая указывает на активное дерево блок*/
 extern CBlockTreeDB *pblocktree;
 
@@ -1419,6 +1935,9 @@ public:
     // transaction, thus the filter will likely be modified.                        сделки, при этом фильтр, вероятно, будет изменен.
     CMerkleBlock(const CBlock& block, CBloomFilter& filter);
 
+    // The same from a block prepared for filtering                                  То же из блока, подготовленного к фильтрации
+    CMerkleBlock(const CFilterableBlock& block, CBloomFilter& filter);
+
     IMPLEMENT_SERIALIZE
     (
         READWRITE(header);
@@ -1426,4 +1945,157 @@ public:
     )
 };
 
+/** A block prepared once for any number of peers asking for it filtered            Блок, подготовленный один раз для любого числа пиров, запрашивающих его
+ *  ("merkleblock"): its merkle tree and the data elements bloom filters are        отфильтрованным ("merkleblock"): его дерево Меркля и элементы данных, с которыми
+ *  matched against, with the transactions to send along.                           сопоставляются блум фильтры, с транзакциями для отправки.
+ */
+class CFilterableBlock
+{
+public:
+    CBlockHeader header;
+    std::vector<CTransaction> vtx;
+    std::vector<uint256> vMerkleTree;       // txids, then the upper levels          txid, затем верхние уровни
+    CBloomElements elements;
+
+    // Takes the transactions of the block                                          Забирает транзакции блока
+    CFilterableBlock(CBlock& block);
+
+    unsigned int GetTxCount() const { return vtx.size(); }
+};
+
+/** The prepared filter data of a block on disk, kept for the most recently         Подготовленные данные фильтрации блока на диске, сохраняемые для недавно
+ *  filtered blocks                                                                 фильтрованных блоков */
+boost::shared_ptr<const CFilterableBlock> GetFilterableBlock(const CBlockIndex* pindex);
+
+
+
+/** Transaction sent in full inside a compact block: the coinbase and the           Транзакция, пересылаемая целиком внутри компактного блока: coinbase и
+ * transfer transactions, which no peer can have in its memory pool.                переносящие транзакции, которых не может быть в пуле памяти пиров.
+ */
+class CPrefilledTransaction
+{
+public:
+    unsigned int nIndex;        // position in the block                            позиция в блоке
+    CTransaction tx;
+
+    CPrefilledTransaction() { nIndex = 0; }
+    CPrefilledTransaction(unsigned int nIndexIn, const CTransaction& txIn) : nIndex(nIndexIn), tx(txIn) { }
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(VARINT(nIndex));
+        READWRITE(tx);
+    )
+};
+
+/** Used to relay blocks as header + 6 byte short transaction ids, so that          Используется для передачи блоков, как заголовок + 6-байтовые короткие id
+ * peers can rebuild them from their memory pools ("cmpctblock").                   транзакций, чтобы пиры восстанавливали их из своих пулов памяти ("cmpctblock").
+ */
+class CCompactBlock
+{
+public:
+    static const unsigned int SHORTTXID_SIZE = 6;
+
+    CBlockHeader header;
+    uint64 nNonce;                                  // salts the short ids           "соль" коротких id
+    std::vector<uint64> vShortTxID;                 // not prefilled, in block order  не переданные целиком, в порядке блока
+    std::vector<CPrefilledTransaction> vPrefilled;  // by increasing nIndex           по возрастанию nIndex
+
+    CCompactBlock() { nNonce = 0; nKey0 = 0; nKey1 = 0; }
+
+    // Create from a CBlock, prefilling the coinbase and transfer transactions     Создаётся из CBlock, coinbase и переносящие транзакции передаются целиком
+    CCompactBlock(const CBlock& block);
+
+    unsigned int GetTxCount() const { return vShortTxID.size() + vPrefilled.size(); }
+
+    // SipHash of the txid keyed by header and nonce, truncated to 48 bits        SipHash от txid с ключом из заголовка и nonce, усечённый до 48 бит
+    uint64 GetShortTxID(const uint256& hash) const;
+
+    // Transactions a peer cannot have in its memory pool                          Транзакции, которых не может быть в пуле памяти пира
+    static bool IsPrefilled(const CTransaction& tx);
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(header);
+        READWRITE(nNonce);
+        std::vector<unsigned char> vBytes;
+        if (fRead) {
+            READWRITE(vBytes);
+            if (vBytes.size() % SHORTTXID_SIZE != 0)
+                throw std::ios_base::failure("CCompactBlock::Unserialize() : bad short id data");
+            CCompactBlock &us = *(const_cast<CCompactBlock*>(this));
+            us.vShortTxID.assign(vBytes.size() / SHORTTXID_SIZE, 0);
+            for (unsigned int p = 0; p < vBytes.size(); p++)
+                us.vShortTxID[p / SHORTTXID_SIZE] |= (uint64)vBytes[p] << (8 * (p % SHORTTXID_SIZE));
+            us.SetShortTxIDKey();
+        } else {
+            vBytes.resize(vShortTxID.size() * SHORTTXID_SIZE);
+            for (unsigned int p = 0; p < vBytes.size(); p++)
+                vBytes[p] = (vShortTxID[p / SHORTTXID_SIZE] >> (8 * (p % SHORTTXID_SIZE))) & 0xff;
+            READWRITE(vBytes);
+        }
+        READWRITE(vPrefilled);
+    )
+
+private:
+    // SipHash key derived from header and nonce                                    Ключ SipHash, полученный из заголовка и nonce
+    uint64 nKey0;
+    uint64 nKey1;
+
+    void SetShortTxIDKey();
+};
+
+/** Block being rebuilt from a compact block and the memory pool                   Блок, восстанавливаемый из компактного блока и пула памяти */
+class CPartialBlock
+{
+public:
+    CBlockHeader header;
+    std::vector<CTransaction> vtx;
+    std::vector<bool> vHave;
+    unsigned int nFromPool;     // transactions found in the memory pool             транзакций, найденных в пуле памяти
+    int64 nTimeReceived;        // microseconds, when the compact block arrived     микросекунды, когда пришёл компактный блок
+
+    CPartialBlock() { nFromPool = 0; nTimeReceived = 0; }
+
+    // Place the prefilled and memory pool transactions; false if the compact      Расставить переданные целиком транзакции и транзакции из пула памяти;
+    // block is malformed. Short ids matching more than one transaction stay        false, если компактный блок испорчен. Короткие id, совпавшие с несколькими
+    // missing and are asked for.                                                  транзакциями, остаются недостающими и запрашиваются.
+    bool Init(const CCompactBlock& cmpctblock, CTxMemPool& pool);
+
+    // Positions of the transactions still missing                                 Позиции всё ещё недостающих транзакций
+    std::vector<unsigned int> GetMissing() const;
+
+    // Put the missing transactions in place and check the merkle root; false      Поставить недостающие транзакции на место и проверить корень Меркля; false,
+    // if they don't fit, then the full block has to be downloaded                  если они не подходят, тогда нужно загрузить полный блок
+    bool Fill(const std::vector<CTransaction>& vtxMissing, CBlock& block) const;
+};
+
+/** "getblocktxn": transactions of a compact block missing from the memory pool    "getblocktxn": транзакции компактного блока, которых нет в пуле памяти */
+class CBlockTxRequest
+{
+public:
+    uint256 hashBlock;
+    std::vector<unsigned int> vIndex;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vIndex);
+    )
+};
+
+/** "blocktxn": answer to "getblocktxn", transactions in the order asked for        "blocktxn": ответ на "getblocktxn", транзакции в запрошенном порядке */
+class CBlockTxResponse
+{
+public:
+    uint256 hashBlock;
+    std::vector<CTransaction> vtx;
+
+    IMPLEMENT_SERIALIZE
+    (
+        READWRITE(hashBlock);
+        READWRITE(vtx);
+    )
+};
+
 #endif
@@ -55,12 +55,12 @@ void SHA256Transform(void* pstate, void* pinput, const void* pinit)
 class COrphan
 {
 public:
-    CTransaction* ptx;
+    const CTransaction* ptx;
     set<uint256> setDependsOn;
     double dPriority;
     double dFeePerKb;
 
-    COrphan(CTransaction* ptxIn)
+    COrphan(const CTransaction* ptxIn)
     {
         ptx = ptxIn;
         dPriority = dFeePerKb = 0;
@@ -80,7 +80,7 @@ uint64 nLastBlockTx = 0;
 uint64 nLastBlockSize = 0;
 
 // We want to sort transactions by priority and fee, so:                            Мы хотим, отсортировать транзакции по приоритету и комиссии, так:
-typedef boost::tuple<double, double, CTransaction*> TxPriority;
+typedef boost::tuple<double, double, const CTransaction*> TxPriority;
 class TxPriorityCompare
 {
     bool byFee;
@@ -162,61 +162,34 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
         vector<TxHashPriority> vecTxHashPriority;                               ////////// новое //////////
         vecTxHashPriority.reserve(mempool.mapTx.size());                        ////////// новое ////////// а это надо?
 
-        for (map<uint256, CTransaction>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
+        for (map<uint256, CTxMemPoolEntry>::iterator mi = mempool.mapTx.begin(); mi != mempool.mapTx.end(); ++mi)
         {
-            CTransaction& tx = (*mi).second;
+            const CTxMemPoolEntry& entry = (*mi).second;
+            const CTransaction& tx = entry.GetTx();
             if (tx.IsCoinBase() || !IsFinalTx(tx))
                 continue;
 
+            // Fee, size and priority were found when it entered the pool; only the         Комиссия, размер и приоритет найдены при попадании в пул; ищутся
+            // pool transactions it has to wait for are looked for                          только транзакции пула, которых она должна ждать
             COrphan* porphan = NULL;
-            double dPriority = 0;
-            int64 nTotalIn = 0;
-            bool fMissingInputs = false;
             BOOST_FOREACH(const CTxIn& txin, tx.vin)
             {
-                // Read prev transaction                                            Чтение предыдущей транзакции
-                if (!view.HaveCoins(txin.prevout.hash))
-                {
-                    // This should never happen; all transactions in the memory     Это должно никогда не случаться; все транзакции в пуле памяти
-                    // pool should connect to either transactions in the chain      должны подключаться к любой транзакции в цепочке
-                    // or other transactions in the memory pool.                    или другим транзакциям в пуле памяти.
-                    if (!mempool.mapTx.count(txin.prevout.hash))
-                    {
-                        printf("ERROR: mempool transaction missing input\n");
-                        if (fDebug) assert("mempool transaction missing input" == 0);
-                        fMissingInputs = true;
-                        if (porphan)
-                            vOrphan.pop_back();
-                        break;
-                    }
-
-                    // Has to wait for dependencies                                 Должен ждать зависимостей
-                    if (!porphan)
-                    {
-                        // Use list for automatic deletion                          Использует список для автоматического удаления
-                        vOrphan.push_back(COrphan(&tx));
-                        porphan = &vOrphan.back();
-                    }
-                    mapDependers[txin.prevout.hash].push_back(porphan);
-                    porphan->setDependsOn.insert(txin.prevout.hash);
-                    nTotalIn += mempool.mapTx[txin.prevout.hash].vout[txin.prevout.n].nValue;
+                if (!mempool.mapTx.count(txin.prevout.hash))
                     continue;
-                }
-                const CCoins &coins = view.GetCoins(txin.prevout.hash);
-
-                int64 nValueIn = coins.vout[txin.prevout.n].nValue;
-                nTotalIn += nValueIn;
 
-                int nConf = pindexPrev->nHeight - coins.nHeight + 1;
-
-                dPriority += (double)nValueIn * nConf;
+                // Has to wait for dependencies                                     Должен ждать зависимостей
+                if (!porphan)
+                {
+                    // Use list for automatic deletion                              Использует список для автоматического удаления
+                    vOrphan.push_back(COrphan(&tx));
+                    porphan = &vOrphan.back();
+                }
+                mapDependers[txin.prevout.hash].push_back(porphan);
+                porphan->setDependsOn.insert(txin.prevout.hash);
             }
 
-            if (fMissingInputs) continue;
-
             // Priority(приоритет) is sum(valuein * age) / txsize
-            unsigned int nTxSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
-            dPriority /= nTxSize;
+            double dPriority = entry.GetPriority(pindexPrev->nHeight);
 
             // This is a more accurate fee-per-kilobyte than is used by the client code, because the
             // client code rounds up the size to the nearest 1K. That's good, because it gives an
@@ -224,7 +197,7 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
             //                  Это более точное плата-за-килобайт, чем используемая клиентским кодом, так как
             //                  код клиента округляет размер до ближайшего 1K. Это хорошо, потому что это дает
             //                  стимул для создания меньших транзакций.
-            double dFeePerKb =  double(nTotalIn-GetValueOut(tx)) / (double(nTxSize)/1000.0);
+            double dFeePerKb = entry.GetFeePerKb();
 
             if (porphan)
             {
@@ -232,7 +205,7 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
                 porphan->dFeePerKb = dFeePerKb;
             }
             else
-                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &(*mi).second));
+                vecPriority.push_back(TxPriority(dPriority, dFeePerKb, &tx));
         }
 
         // Collect transactions into block                                          Собрать транзакции в блок
@@ -327,7 +300,7 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
             // Take highest priority transaction off the priority queue:            Брать наивысший приоритет транзакции вне очереди приоритета:
             double dPriority = vecPriority.front().get<0>();
             double dFeePerKb = vecPriority.front().get<1>();
-            CTransaction& tx = *(vecPriority.front().get<2>());
+            const CTransaction& tx = *(vecPriority.front().get<2>());
 
             std::pop_heap(vecPriority.begin(), vecPriority.end(), comparer);    //     одно           удаление элемента из кучи
             vecPriority.pop_back();                                             //   удаление         удаление последнего элемента вектора
@@ -538,32 +511,22 @@ CBlockTemplate* CreateNewBlock(CReserveKey& reservekey)
         pblocktemplate->vTxSigOps[0] = GetLegacySigOpCount(pblock->vtx[0]);
 
 
-        CBigNum maxBigNum = CBigNum(~uint256(0));
         BOOST_FOREACH(CTransaction& tx, pblock->vtx)
         {
             if (!tx.IsCoinBase())
             {
-                TransM trM;
-                BOOST_FOREACH(const CTxIn& txin, tx.vin)
-                    trM.vinM.push_back(CTxIn(txin.prevout.hash, txin.prevout.n));
-
-                BOOST_FOREACH (const CTxOut& out, tx.vout)
-                    trM.voutM.push_back(CTxOut(out.nValue, CScript()));
-
-                int txBl = abs(tx.tBlock);
-                if (txBl >= pindexPrev->nHeight)            // здесь pindexPrev = pindexBest
-                    txBl = pindexPrev->nHeight - TX_TBLOCK; // TX_TBLOCK от pindexBest (bool CWallet::CreateTransaction)
-
-                trM.hashBlock = vBlockIndexByHeight[txBl]->GetBlockHash();
-
-                uint256 HashTr = SerializeHash(trM);
-                if (txBl > HEIGHT_OTHER_ALGO)
-                    lyra2TDC(BEGIN(HashTr), BEGIN(HashTr), 32);
-                else
-                    lyra2re2_hashTX(BEGIN(HashTr), BEGIN(HashTr), 32);
-
-                CBigNum bntx = CBigNum(HashTr);
-                pblocktemplate->sumTrDif += (maxBigNum / bntx) / (pindexPrev->nHeight - txBl);   // защита от 51% с использованием майнингхешей транзакций ссылающихся на более старые блоки
+                // the mining hash kept in the pool holds while the block it refers to is     хэш добычи из пула верен, пока блок, на который он ссылается,
+                // the same, by height and by hash (a reorganization replaces it)             тот же по высоте и по хэшу (реорганизация его заменяет)
+                int txBl = GetTxMiningBlock(tx, pindexPrev->nHeight);                       // здесь pindexPrev = pindexBest
+                uint256 hashMining = 0;
+                map<uint256, CTxMemPoolEntry>::const_iterator mi = mempool.mapTx.find(tx.GetHash());
+                if (mi != mempool.mapTx.end() && (*mi).second.nMiningBlock == txBl &&
+                    (*mi).second.hashMiningBlock == GetTxMiningBlockHash(txBl))
+                    hashMining = (*mi).second.hashMining;
+                if (hashMining == 0)
+                    hashMining = GetTxMiningHash(tx, pindexPrev->nHeight);
+
+                pblocktemplate->sumTrDif += CBigNum(GetTxMiningWork(hashMining, txBl, pindexPrev->nHeight));   // защита от 51% с использованием майнингхешей транзакций ссылающихся на более старые блоки
             }
         }
 
@@ -49,6 +49,7 @@ static bool vfReachable[NET_MAX] = {};
 static bool vfLimited[NET_MAX] = {};
 static CNode* pnodeLocalHost = NULL;
 static CNode* pnodeSync = NULL;
+static int64 nSyncStartTime = 0;
 uint64 nLocalHostNonce = 0;
 static std::vector<SOCKET> vhListenSocket;
 CAddrMan addrman;
@@ -56,8 +57,10 @@ int nMaxConnections = 125;
 
 vector<CNode*> vNodes;
 CCriticalSection cs_vNodes;
-map<CInv, CDataStream> mapRelay;
+map<CInv, CSharedTxRef> mapRelay;
 deque<pair<int64, CInv> > vRelayExpiration;
+size_t nRelayCacheSize = 0;
+size_t nMaxRelayCacheSize = DEFAULT_RELAY_CACHE_SIZE << 20;
 CCriticalSection cs_mapRelay;
 limitedmap<CInv, int64> mapAlreadyAskedFor(MAX_INV_SZ);
 
@@ -489,10 +492,7 @@ CNode* ConnectNode(CAddress addrConnect, const char *pszDest)
         CNode* pnode = new CNode(hSocket, addrConnect, pszDest ? pszDest : "", false);
         pnode->AddRef();
 
-        {
-            LOCK(cs_vNodes);
-            vNodes.push_back(pnode);
-        }
+        AddConnectedNode(pnode);
 
         pnode->nTimeConnected = GetTime();
         return pnode;
@@ -515,7 +515,7 @@ void CNode::CloseSocketDisconnect()
 
     // in case this fails, we'll empty the recv buffer when the CNode is deleted    в случае, если это не удается, мы очистим recv буфер когда CNode будет удалён
     TRY_LOCK(cs_vRecvMsg, lockRecv);
-    if (lockRecv)
+    if (lockRecv && !fRecvPreparing)
         vRecvMsg.clear();
 
     // if this was the sync node, we'll need a new one                              Если это был узел синхронизации, нам понадобится один новый
@@ -607,15 +607,34 @@ void CNode::copyStats(CNodeStats &stats)
     X(fInbound);
     X(nStartingHeight);
     X(nMisbehavior);
-    X(nSendBytes);
-    X(nRecvBytes);
     stats.fSyncNode = (this == pnodeSync);
+    // one lock at a time, so the order against the message handler doesn't matter   по одной блокировке за раз, чтобы порядок относительно обработчика сообщений не имел значения
+    {
+        // kept by SendMessages and the socket thread                               ведутся SendMessages и потоком сокетов
+        LOCK(cs_vSend);
+        X(nSendBytes);
+        X(nStalls);
+        X(nTxMissed);
+        stats.nSendQueue = nSendSize;
+        for (int i = 0; i < SEND_CLASSES; i++)
+            stats.vSendQueue[i] = vSendSize[i];
+    }
+    {
+        // kept by ProcessMessages and the socket thread                            ведутся ProcessMessages и потоком сокетов
+        LOCK(cs_vRecvMsg);
+        X(nRecvBytes);
+        X(nBlockLatency);
+        stats.nRecvQueue = vRecvMsg.size();
+        X(nMsgProcessed);
+        X(nProcessTime);
+    }
 }
 #undef X
 
 // requires(требуется) LOCK(cs_vRecvMsg)
 bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
 {
+    bool fComplete = false;
     while (nBytes > 0) {
 
         // get current incomplete message, or create a new one                      получить текущее неполное сообщение, или создать новое
@@ -635,10 +654,17 @@ bool CNode::ReceiveMsgBytes(const char *pch, unsigned int nBytes)
         if (handled < 0)
                 return false;
 
+        if (msg.complete())
+            fComplete = true;
+
         pch += handled;
         nBytes -= handled;
     }
 
+    // a complete message is waiting for the message handler                        полное сообщение ждёт обработчика сообщений
+    if (fComplete)
+        WakeMessageHandler();
+
     return true;
 }
 
@@ -693,23 +719,89 @@ int CNetMessage::readData(const char *pch, unsigned int nBytes)
 
 
 
+int GetSendClass(const CSerializeData& msg)
+{
+    if (msg.size() < CMessageHeader::HEADER_SIZE)
+        return SEND_CONTROL;
+    char pchCommand[CMessageHeader::COMMAND_SIZE + 1] = {};
+    memcpy(pchCommand, &msg[MESSAGE_START_SIZE], CMessageHeader::COMMAND_SIZE);
+    string strCommand(pchCommand);
+
+    if (strCommand == "headers" || strCommand == "cmpctblock" || strCommand == "blocktxn")
+        return SEND_ANNOUNCE;
+    if (strCommand == "block" || strCommand == "merkleblock")
+        return SEND_BLOCK;
+    if (strCommand == "tx")
+        return SEND_TX;
+    if (strCommand == "inv")
+    {
+        // an inv that starts with a block announces blocks, the others relay       inv, начинающийся с блока, объявляет блоки, остальные ретранслируют
+        // transactions                                                             транзакции
+        CDataStream ss(msg.begin() + CMessageHeader::HEADER_SIZE, msg.end(), SER_NETWORK, PROTOCOL_VERSION);
+        try {
+            unsigned int nCount = ReadCompactSize(ss);
+            int nType;
+            if (nCount > 0 && ss.size() >= sizeof(nType)) {
+                ss >> nType;
+                if (nType == MSG_BLOCK)
+                    return SEND_ANNOUNCE;
+            }
+        } catch (std::exception &e) {
+        }
+        return SEND_TX;
+    }
+    return SEND_CONTROL;
+}
+
+int GetReplySendClass(const string& strCommand)
+{
+    // "mempool" answers with up to MAX_INV_SZ transaction invs                      "mempool" отвечает до MAX_INV_SZ inv транзакций
+    if (strCommand == "mempool")
+        return SEND_TX;
+    return SEND_CONTROL;
+}
+
+const char* GetSendClassName(int nClass)
+{
+    switch (nClass)
+    {
+    case SEND_CONTROL:  return "control";
+    case SEND_ANNOUNCE: return "announce";
+    case SEND_BLOCK:    return "block";
+    case SEND_TX:       return "tx";
+    }
+    return "unknown";
+}
+
+// Send the queued messages, the most urgent class first. A message that was       Отправить сообщения из очереди, сначала самый срочный класс. Сообщение, отправка
+// started is always finished before another one, the stream can't interleave     которого началась, всегда завершается раньше другого, поток не может чередоваться
 // requires(требуется) LOCK(cs_vSend)
 void SocketSendData(CNode *pnode)
 {
-    std::deque<CSerializeData>::iterator it = pnode->vSendMsg.begin();
-
-    while (it != pnode->vSendMsg.end()) {
-        const CSerializeData &data = *it;
+    unsigned int nFullBefore = 0;
+    for (int i = 0; i < SEND_CLASSES; i++)
+        if (pnode->IsSendFull(i))
+            nFullBefore |= 1 << i;
+
+    while (pnode->nSendSize > 0) {
+        int nClass = pnode->nSendClass;
+        if (pnode->nSendOffset == 0)
+            for (nClass = 0; pnode->vSendMsg[nClass].empty(); nClass++)
+                ;
+        std::deque<CSerializeData> &queue = pnode->vSendMsg[nClass];
+        const CSerializeData &data = queue.front();
         assert(data.size() > pnode->nSendOffset);
         int nBytes = send(pnode->hSocket, &data[pnode->nSendOffset], data.size() - pnode->nSendOffset, MSG_NOSIGNAL | MSG_DONTWAIT);
         if (nBytes > 0) {
             pnode->nLastSend = GetTime();
             pnode->nSendBytes += nBytes;
             pnode->nSendOffset += nBytes;
+            pnode->nSendClass = nClass;
             if (pnode->nSendOffset == data.size()) {
                 pnode->nSendOffset = 0;
                 pnode->nSendSize -= data.size();
-                it++;
+                pnode->vSendSize[nClass] -= data.size();
+                queue.pop_front();
             } else {
                 // could not send full message; stop sending more                   Не удалось отправить сообщение полностью; остановить отправку
                 break;
@@ -729,83 +821,265 @@ void SocketSendData(CNode *pnode)
         }
     }
 
-    if (it == pnode->vSendMsg.end()) {
+    if (pnode->nSendSize == 0)
         assert(pnode->nSendOffset == 0);
-        assert(pnode->nSendSize == 0);
-    }
-    pnode->vSendMsg.erase(pnode->vSendMsg.begin(), it);
+
+    // ProcessMessages stops while a send queue is full; let it resume              ProcessMessages останавливается, пока очередь отправки полна; даём ему продолжить
+    for (int i = 0; i < SEND_CLASSES; i++)
+        if ((nFullBefore & (1 << i)) && !pnode->IsSendFull(i))
+        {
+            WakeMessageHandler();
+            break;
+        }
 }
 
 static list<CNode*> vNodesDisconnected;
 
-void ThreadSocketHandler()
+// Nodes that still have to be added to the socket event loop (protected by cs_vNodes)   Узлы, которые ещё нужно добавить в цикл событий сокетов (защищено cs_vNodes)
+static vector<CNode*> vNodesNew;
+
+// Pipe used to interrupt the wait of the socket event loop                     Канал, используемый для прерывания ожидания цикла событий сокетов
+static int hWakeupPipe[2] = { -1, -1 };
+
+void AddConnectedNode(CNode *pnode)
 {
-    unsigned int nPrevNodeCount = 0;
-    while (true)
     {
-        //
-        // Disconnect nodes                                                         Отключаем узлы
-        //
+        LOCK(cs_vNodes);
+        vNodes.push_back(pnode);
+        vNodesNew.push_back(pnode);
+    }
+    WakeupSocketHandler();
+}
+
+void WakeupSocketHandler()
+{
+#ifndef WIN32
+    if (hWakeupPipe[1] != -1) {
+        char ch = 0;
+        // a full pipe means a wakeup is pending already                          полный канал означает, что пробуждение уже ожидается
+        if (write(hWakeupPipe[1], &ch, 1) < 0 && errno != EAGAIN)
+            printf("WakeupSocketHandler() : write failed, error %d\n", errno);
+    }
+#endif
+}
+
+// Disconnect unused nodes and delete the disconnected ones nobody uses anymore   Отключить неиспользуемые узлы и удалить отключенные, которые больше никто не использует
+static void DisconnectNodes(set<CNode*> &setPending)
+{
+    LOCK(cs_vNodes);
+    // Disconnect unused nodes                                                  Отключите неиспользуемые узлы
+    vector<CNode*> vNodesCopy = vNodes;
+    BOOST_FOREACH(CNode* pnode, vNodesCopy)
+    {
+        if (pnode->fDisconnect ||
+            (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
         {
-            LOCK(cs_vNodes);
-            // Disconnect unused nodes                                              Отключите неиспользуемые узлы
-            vector<CNode*> vNodesCopy = vNodes;
-            BOOST_FOREACH(CNode* pnode, vNodesCopy)
-            {
-                if (pnode->fDisconnect ||
-                    (pnode->GetRefCount() <= 0 && pnode->vRecvMsg.empty() && pnode->nSendSize == 0 && pnode->ssSend.empty()))
-                {
-                    // remove from vNodes                                           удаляем из vNodes
-                    vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
+            // remove from vNodes                                               удаляем из vNodes
+            vNodes.erase(remove(vNodes.begin(), vNodes.end(), pnode), vNodes.end());
 
-                    // release outbound grant (if any)                              выпускаем исходящий грант,субсидию,дар (если таковые имеются)
-                    pnode->grantOutbound.Release();
+            // release outbound grant (if any)                                  выпускаем исходящий грант,субсидию,дар (если таковые имеются)
+            pnode->grantOutbound.Release();
 
-                    // close socket and cleanup                                     закрыть сокет и очистить
-                    pnode->CloseSocketDisconnect();
-                    pnode->Cleanup();
+            // close socket and cleanup (this also drops it from epoll)         закрыть сокет и очистить (это также убирает его из epoll)
+            pnode->CloseSocketDisconnect();
+            pnode->Cleanup();
 
-                    // hold in disconnected pool until all refs are released        держать в отключенном бассейне, пока все refs освобождаются
-                    if (pnode->fNetworkNode || pnode->fInbound)
-                        pnode->Release();
-                    vNodesDisconnected.push_back(pnode);
-                }
-            }
+            // hold in disconnected pool until all refs are released            держать в отключенном бассейне, пока все refs освобождаются
+            if (pnode->fNetworkNode || pnode->fInbound)
+                pnode->Release();
+            vNodesDisconnected.push_back(pnode);
+        }
+    }
 
-            // Delete disconnected nodes                                            Удаляем отключенные узлы
-            list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
-            BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+    // Delete disconnected nodes                                                Удаляем отключенные узлы
+    list<CNode*> vNodesDisconnectedCopy = vNodesDisconnected;
+    BOOST_FOREACH(CNode* pnode, vNodesDisconnectedCopy)
+    {
+        // wait until threads are done using it                                 ждать, пока потоки не закончат его использование
+        if (pnode->GetRefCount() <= 0)
+        {
+            bool fDelete = false;
             {
-                // wait until threads are done using it                             ждать, пока потоки не закончат его использование
-                if (pnode->GetRefCount() <= 0)
+                TRY_LOCK(pnode->cs_vSend, lockSend);
+                if (lockSend)
                 {
-                    bool fDelete = false;
-                    {
-                        TRY_LOCK(pnode->cs_vSend, lockSend);
-                        if (lockSend)
-                        {
-                            TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                            if (lockRecv)
-                            {
-                                TRY_LOCK(pnode->cs_inventory, lockInv);
-                                if (lockInv)
-                                    fDelete = true;
-                            }
-                        }
-                    }
-                    if (fDelete)
+                    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                    if (lockRecv)
                     {
-                        vNodesDisconnected.remove(pnode);
-                        delete pnode;
+                        TRY_LOCK(pnode->cs_inventory, lockInv);
+                        if (lockInv)
+                            fDelete = true;
                     }
                 }
             }
+            // the message handling forgets it first                                обработка сообщений сначала забывает его
+            if (fDelete)
+            {
+                boost::optional<bool> fFinalized = g_signals.FinalizeNode(pnode);
+                if (fFinalized && !*fFinalized)
+                    fDelete = false;
+            }
+            if (fDelete)
+            {
+                vNodesDisconnected.remove(pnode);
+                vNodesNew.erase(remove(vNodesNew.begin(), vNodesNew.end(), pnode), vNodesNew.end());
+                setPending.erase(pnode);
+                delete pnode;
+            }
+        }
+    }
+}
+
+// Accept one connection on a listening socket; false if there was none         Принять одно подключение на слушающем сокете; false, если его не было
+static bool AcceptConnection(SOCKET hListenSocket)
+{
+#ifdef USE_IPV6
+    struct sockaddr_storage sockaddr;
+#else
+    struct sockaddr sockaddr;
+#endif
+    socklen_t len = sizeof(sockaddr);
+    SOCKET hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
+    CAddress addr;
+    int nInbound = 0;
+
+    if (hSocket != INVALID_SOCKET)
+        if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
+            printf("Warning: Unknown socket family\n");
+
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodes)
+            if (pnode->fInbound)
+                nInbound++;
+    }
+
+    if (hSocket == INVALID_SOCKET)
+    {
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK)
+            printf("socket error accept failed: %d\n", nErr);
+        return false;
+    }
+    else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
+    {
+        {
+            LOCK(cs_setservAddNodeAddresses);
+            if (!setservAddNodeAddresses.count(addr))
+                closesocket(hSocket);
         }
-        if (vNodes.size() != nPrevNodeCount)
+    }
+    else if (CNode::IsBanned(addr))
+    {
+        printf("connection from %s dropped (banned)\n", addr.ToString().c_str());
+        closesocket(hSocket);
+    }
+    else
+    {
+        printf("accepted connection %s\n", addr.ToString().c_str());
+        CNode* pnode = new CNode(hSocket, addr, "", true);
+        pnode->AddRef();
+        AddConnectedNode(pnode);
+    }
+    return true;
+}
+
+// Whether the receive buffer of the node can take more data (requires cs_vRecvMsg)   Может ли буфер приёма узла принять ещё данные (требует cs_vRecvMsg)
+static bool NodeCanReceive(CNode *pnode)
+{
+    return pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
+           pnode->GetTotalRecvSize() <= ReceiveFloodSize();
+}
+
+// Read once from the socket of the node (requires cs_vRecvMsg). Returns false   Прочитать один раз из сокета узла (требует cs_vRecvMsg). Возвращает false,
+// when nothing more can be read: the socket is drained, closed or failed.       когда больше ничего нельзя прочитать: сокет опустошён, закрыт или в ошибке.
+static bool ReceiveFromNode(CNode *pnode)
+{
+    // typical socket buffer is 8K-64K                                          стандартный буфер сокета 8K-64K
+    char pchBuf[0x10000];
+    int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
+    if (nBytes > 0)
+    {
+        if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
+            pnode->CloseSocketDisconnect();
+        pnode->nLastRecv = GetTime();
+        pnode->nRecvBytes += nBytes;
+        return pnode->hSocket != INVALID_SOCKET;
+    }
+    else if (nBytes == 0)
+    {
+        // socket closed gracefully                                             сокет закрыт корректно(изящно)
+        if (!pnode->fDisconnect)
+            printf("socket closed\n");
+        pnode->CloseSocketDisconnect();
+    }
+    else if (nBytes < 0)
+    {
+        // error
+        int nErr = WSAGetLastError();
+        if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
         {
-            nPrevNodeCount = vNodes.size();
-            uiInterface.NotifyNumConnectionsChanged(vNodes.size());
+            if (!pnode->fDisconnect)
+                printf("socket recv error %d\n", nErr);
+            pnode->CloseSocketDisconnect();
         }
+    }
+    return false;
+}
+
+// Inactivity checking                                                          Проверка бездействия
+static void CheckNodeInactivity(CNode *pnode)
+{
+    {
+        LOCK(pnode->cs_vSend);
+        if (pnode->nSendSize == 0)
+            pnode->nLastSendEmpty = GetTime();
+    }
+    if (GetTime() - pnode->nTimeConnected > 60)
+    {
+        if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
+        {
+            printf("socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0);
+            pnode->fDisconnect = true;
+        }
+        else if (GetTime() - pnode->nLastSend > 90*60 && GetTime() - pnode->nLastSendEmpty > 90*60)
+        {
+            printf("socket not sending\n");
+            pnode->fDisconnect = true;
+        }
+        else if (GetTime() - pnode->nLastRecv > 90*60)
+        {
+            printf("socket inactivity timeout\n");
+            pnode->fDisconnect = true;
+        }
+    }
+}
+
+static void NotifyNumConnections(unsigned int &nPrevNodeCount)
+{
+    if (vNodes.size() != nPrevNodeCount)
+    {
+        nPrevNodeCount = vNodes.size();
+        uiInterface.NotifyNumConnectionsChanged(vNodes.size());
+    }
+}
+
+static void ThreadSocketHandlerSelect()
+{
+    unsigned int nPrevNodeCount = 0;
+    set<CNode*> setPending;
+    while (true)
+    {
+        //
+        // Disconnect nodes                                                         Отключаем узлы
+        //
+        DisconnectNodes(setPending);
+        {
+            // select() looks at every node anyway                                  select() всё равно просматривает все узлы
+            LOCK(cs_vNodes);
+            vNodesNew.clear();
+        }
+        NotifyNumConnections(nPrevNodeCount);
 
 
         //
@@ -856,16 +1130,14 @@ void ThreadSocketHandler()
                 // * We process a message in the buffer (message handler thread).             * Мы обрабатываем сообщение в буфере (поток обработки сообщения)
                 {
                     TRY_LOCK(pnode->cs_vSend, lockSend);
-                    if (lockSend && !pnode->vSendMsg.empty()) {
+                    if (lockSend && pnode->nSendSize > 0) {
                         FD_SET(pnode->hSocket, &fdsetSend);
                         continue;
                     }
                 }
                 {
                     TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                    if (lockRecv && (
-                        pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete() ||
-                        pnode->GetTotalRecvSize() <= ReceiveFloodSize()))
+                    if (lockRecv && NodeCanReceive(pnode))
                         FD_SET(pnode->hSocket, &fdsetRecv);
                 }
             }
@@ -894,59 +1166,8 @@ void ThreadSocketHandler()
         // Accept new connections                                                   Принять новые подключения
         //
         BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
-        if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
-        {
-#ifdef USE_IPV6
-            struct sockaddr_storage sockaddr;
-#else
-            struct sockaddr sockaddr;
-#endif
-            socklen_t len = sizeof(sockaddr);
-            SOCKET hSocket = accept(hListenSocket, (struct sockaddr*)&sockaddr, &len);
-            CAddress addr;
-            int nInbound = 0;
-
-            if (hSocket != INVALID_SOCKET)
-                if (!addr.SetSockAddr((const struct sockaddr*)&sockaddr))
-                    printf("Warning: Unknown socket family\n");
-
-            {
-                LOCK(cs_vNodes);
-                BOOST_FOREACH(CNode* pnode, vNodes)
-                    if (pnode->fInbound)
-                        nInbound++;
-            }
-
-            if (hSocket == INVALID_SOCKET)
-            {
-                int nErr = WSAGetLastError();
-                if (nErr != WSAEWOULDBLOCK)
-                    printf("socket error accept failed: %d\n", nErr);
-            }
-            else if (nInbound >= nMaxConnections - MAX_OUTBOUND_CONNECTIONS)
-            {
-                {
-                    LOCK(cs_setservAddNodeAddresses);
-                    if (!setservAddNodeAddresses.count(addr))
-                        closesocket(hSocket);
-                }
-            }
-            else if (CNode::IsBanned(addr))
-            {
-                printf("connection from %s dropped (banned)\n", addr.ToString().c_str());
-                closesocket(hSocket);
-            }
-            else
-            {
-                printf("accepted connection %s\n", addr.ToString().c_str());
-                CNode* pnode = new CNode(hSocket, addr, "", true);
-                pnode->AddRef();
-                {
-                    LOCK(cs_vNodes);
-                    vNodes.push_back(pnode);
-                }
-            }
-        }
+            if (hListenSocket != INVALID_SOCKET && FD_ISSET(hListenSocket, &fdsetRecv))
+                AcceptConnection(hListenSocket);
 
 
         //
@@ -972,38 +1193,7 @@ void ThreadSocketHandler()
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
                 if (lockRecv)
-                {
-                    {
-                        // typical socket buffer is 8K-64K                          стандартный буфер сокета 8K-64K
-                        char pchBuf[0x10000];
-                        int nBytes = recv(pnode->hSocket, pchBuf, sizeof(pchBuf), MSG_DONTWAIT);
-                        if (nBytes > 0)
-                        {
-                            if (!pnode->ReceiveMsgBytes(pchBuf, nBytes))
-                                pnode->CloseSocketDisconnect();
-                            pnode->nLastRecv = GetTime();
-                            pnode->nRecvBytes += nBytes;
-                        }
-                        else if (nBytes == 0)
-                        {
-                            // socket closed gracefully                             сокет закрыт корректно(изящно)
-                            if (!pnode->fDisconnect)
-                                printf("socket closed\n");
-                            pnode->CloseSocketDisconnect();
-                        }
-                        else if (nBytes < 0)
-                        {
-                            // error
-                            int nErr = WSAGetLastError();
-                            if (nErr != WSAEWOULDBLOCK && nErr != WSAEMSGSIZE && nErr != WSAEINTR && nErr != WSAEINPROGRESS)
-                            {
-                                if (!pnode->fDisconnect)
-                                    printf("socket recv error %d\n", nErr);
-                                pnode->CloseSocketDisconnect();
-                            }
-                        }
-                    }
-                }
+                    ReceiveFromNode(pnode);
             }
 
             //
@@ -1018,29 +1208,7 @@ void ThreadSocketHandler()
                     SocketSendData(pnode);
             }
 
-            //
-            // Inactivity checking                                                  Проверка бездействия
-            //
-            if (pnode->vSendMsg.empty())
-                pnode->nLastSendEmpty = GetTime();
-            if (GetTime() - pnode->nTimeConnected > 60)
-            {
-                if (pnode->nLastRecv == 0 || pnode->nLastSend == 0)
-                {
-                    printf("socket no message in first 60 seconds, %d %d\n", pnode->nLastRecv != 0, pnode->nLastSend != 0);
-                    pnode->fDisconnect = true;
-                }
-                else if (GetTime() - pnode->nLastSend > 90*60 && GetTime() - pnode->nLastSendEmpty > 90*60)
-                {
-                    printf("socket not sending\n");
-                    pnode->fDisconnect = true;
-                }
-                else if (GetTime() - pnode->nLastRecv > 90*60)
-                {
-                    printf("socket inactivity timeout\n");
-                    pnode->fDisconnect = true;
-                }
-            }
+            CheckNodeInactivity(pnode);
         }
         {
             LOCK(cs_vNodes);
@@ -1052,6 +1220,200 @@ void ThreadSocketHandler()
     }
 }
 
+#ifdef USE_EPOLL
+// epoll user data of the sockets that do not belong to a node                   пользовательские данные epoll для сокетов, не принадлежащих узлу
+static char chEpollListen;
+static char chEpollWakeup;
+
+// Serve the readiness of one node that the event loop knows of. Returns true if    Обслужить готовность одного узла, известную циклу событий. Возвращает true, если
+// the node has to be looked at again without a new event (a lock was busy, or     к узлу нужно вернуться без нового события (блокировка была занята, или
+// its receive buffer is full and waits for the message handler).                 его буфер приёма полон и ждёт обработчика сообщений).
+static bool ServiceNodeEpoll(CNode *pnode)
+{
+    bool fSendQueued = false;
+    {
+        TRY_LOCK(pnode->cs_vSend, lockSend);
+        if (!lockSend)
+            return true;
+        pnode->fSendPending = false;
+        if (pnode->fPollSend && pnode->nSendSize > 0) {
+            SocketSendData(pnode);
+            // the kernel buffer is full; the next EPOLLOUT edge brings us back      буфер ядра полон; следующий фронт EPOLLOUT вернёт нас обратно
+            if (pnode->nSendSize > 0)
+                pnode->fPollSend = false;
+        }
+        fSendQueued = pnode->nSendSize > 0;
+    }
+    if (pnode->hSocket == INVALID_SOCKET)
+        return false;
+
+    // as in the select() loop, drain the send queue before receiving more        как и в цикле select(), освобождаем очередь отправки, прежде чем получать ещё
+    if (!pnode->fPollRecv || fSendQueued)
+        return false;
+    TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+    if (!lockRecv)
+        return true;
+    // edge-triggered: read until the socket is drained                          по фронту: читаем, пока сокет не опустеет
+    while (true) {
+        if (!NodeCanReceive(pnode))
+            return true;
+        if (!ReceiveFromNode(pnode))
+            break;
+    }
+    pnode->fPollRecv = false;
+    return false;
+}
+
+static void ThreadSocketHandlerEpoll(int hEpoll)
+{
+    unsigned int nPrevNodeCount = 0;
+    int64 nLastInactivityCheck = 0;
+
+    // nodes with readiness that could not be used up yet                           узлы с готовностью, которую ещё не удалось использовать
+    set<CNode*> setPending;
+
+    struct epoll_event ev;
+    BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket) {
+        memset(&ev, 0, sizeof(ev));
+        ev.events = EPOLLIN | EPOLLET;
+        ev.data.ptr = &chEpollListen;
+        if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, hListenSocket, &ev) != 0)
+            printf("ThreadSocketHandler() : epoll_ctl failed for listening socket, error %d\n", errno);
+    }
+    memset(&ev, 0, sizeof(ev));
+    ev.events = EPOLLIN | EPOLLET;
+    ev.data.ptr = &chEpollWakeup;
+    if (hWakeupPipe[0] != -1 && epoll_ctl(hEpoll, EPOLL_CTL_ADD, hWakeupPipe[0], &ev) != 0)
+        printf("ThreadSocketHandler() : epoll_ctl failed for wakeup pipe, error %d\n", errno);
+
+    std::vector<struct epoll_event> vEvents(256);
+    bool fAccept = true;
+    while (true)
+    {
+        DisconnectNodes(setPending);
+        NotifyNumConnections(nPrevNodeCount);
+
+        // Register the nodes connected since the last round                        Регистрируем узлы, подключённые после прошлого прохода
+        vector<CNode*> vNew;
+        {
+            LOCK(cs_vNodes);
+            vNew.swap(vNodesNew);
+        }
+        BOOST_FOREACH(CNode* pnode, vNew)
+        {
+            if (pnode->hSocket == INVALID_SOCKET)
+                continue;
+            memset(&ev, 0, sizeof(ev));
+            ev.events = EPOLLIN | EPOLLOUT | EPOLLRDHUP | EPOLLET;
+            ev.data.ptr = pnode;
+            if (epoll_ctl(hEpoll, EPOLL_CTL_ADD, pnode->hSocket, &ev) != 0) {
+                printf("ThreadSocketHandler() : epoll_ctl failed for %s, error %d\n", pnode->addrName.c_str(), errno);
+                pnode->fDisconnect = true;
+                continue;
+            }
+            // anything that happened before the registration has no edge          у того, что случилось до регистрации, нет фронта
+            pnode->fPollRecv = true;
+            pnode->fPollSend = true;
+            setPending.insert(pnode);
+        }
+
+        int nEvents = epoll_wait(hEpoll, &vEvents[0], vEvents.size(), setPending.empty() ? 50 : 10);
+        boost::this_thread::interruption_point();
+        if (nEvents < 0) {
+            if (errno != EINTR)
+                printf("socket epoll_wait error %d\n", errno);
+            nEvents = 0;
+        }
+
+        for (int i = 0; i < nEvents; i++)
+        {
+            void *pdata = vEvents[i].data.ptr;
+            if (pdata == &chEpollWakeup) {
+                char pchBuf[64];
+                while (read(hWakeupPipe[0], pchBuf, sizeof(pchBuf)) > 0) {}
+                // pick up the nodes that queued data to send                       подобрать узлы, поставившие данные в очередь на отправку
+                LOCK(cs_vNodes);
+                BOOST_FOREACH(CNode* pnode, vNodes) {
+                    LOCK(pnode->cs_vSend);
+                    if (pnode->fSendPending)
+                        setPending.insert(pnode);
+                }
+                continue;
+            }
+            if (pdata == &chEpollListen) {
+                fAccept = true;
+                continue;
+            }
+            CNode *pnode = (CNode*)pdata;
+            if (vEvents[i].events & (EPOLLIN | EPOLLRDHUP | EPOLLHUP | EPOLLERR))
+                pnode->fPollRecv = true;
+            if (vEvents[i].events & EPOLLOUT)
+                pnode->fPollSend = true;
+            setPending.insert(pnode);
+        }
+
+        //
+        // Accept new connections                                                   Принять новые подключения
+        //
+        if (fAccept) {
+            fAccept = false;
+            BOOST_FOREACH(SOCKET hListenSocket, vhListenSocket)
+                while (hListenSocket != INVALID_SOCKET && AcceptConnection(hListenSocket))
+                    boost::this_thread::interruption_point();
+        }
+
+        //
+        // Service the sockets that became ready                                    Обслуживание сокетов, ставших готовыми
+        //
+        vector<CNode*> vReady(setPending.begin(), setPending.end());
+        BOOST_FOREACH(CNode* pnode, vReady)
+        {
+            boost::this_thread::interruption_point();
+            if (pnode->hSocket == INVALID_SOCKET || !ServiceNodeEpoll(pnode))
+                setPending.erase(pnode);
+        }
+
+        if (GetTime() != nLastInactivityCheck)
+        {
+            nLastInactivityCheck = GetTime();
+            LOCK(cs_vNodes);
+            BOOST_FOREACH(CNode* pnode, vNodes)
+                CheckNodeInactivity(pnode);
+        }
+    }
+}
+#endif
+
+void ThreadSocketHandler()
+{
+#ifndef WIN32
+    if (hWakeupPipe[0] == -1) {
+        if (pipe(hWakeupPipe) != 0) {
+            printf("ThreadSocketHandler() : pipe failed, error %d\n", errno);
+            hWakeupPipe[0] = hWakeupPipe[1] = -1;
+        } else {
+            fcntl(hWakeupPipe[0], F_SETFL, O_NONBLOCK);
+            fcntl(hWakeupPipe[1], F_SETFL, O_NONBLOCK);
+        }
+    }
+#endif
+#ifdef USE_EPOLL
+    if (GetBoolArg("-epoll", true)) {
+        int hEpoll = epoll_create(256);
+        if (hEpoll != -1) {
+            try {
+                ThreadSocketHandlerEpoll(hEpoll);
+            } catch (...) {
+                close(hEpoll);
+                throw;
+            }
+        } else
+            printf("ThreadSocketHandler() : epoll_create failed, error %d; using select()\n", errno);
+    }
+#endif
+    ThreadSocketHandlerSelect();
+}
+
 
 
 
@@ -1455,10 +1817,19 @@ bool OpenNetworkConnection(const CAddress& addrConnect, CSemaphoreGrant *grantOu
 }
 
 
-// for now, use a very simple selection metric: the node from which we received     на данный момент, использовать очень простой выбор метрики:
-// most recently                                                                    узел из которого мы получили совсем недавно
+// Prefer the node that answers block requests fastest. Nodes not measured yet     Предпочесть узел, быстрее всех отвечающий на запросы блоков. Ещё не измеренные
+// count as half the slow latency, every stall costs as much as a slow node         считаются как половина медленной задержки, каждое зависание стоит как медленный узел
 double static NodeSyncScore(const CNode *pnode) {
-    return -pnode->nLastRecv;
+    int64 nLatency = pnode->nBlockLatency >= 0 ? pnode->nBlockLatency : SYNC_SLOW_LATENCY / 2;
+    return -(double)nLatency - (double)pnode->nStalls * SYNC_SLOW_LATENCY;
+}
+
+// check preconditions for allowing a sync                                          проверить предпосылки для возможности синхронизации
+bool static NodeCanSync(const CNode *pnode) {
+    return !pnode->fClient && !pnode->fOneShot &&
+           !pnode->fDisconnect && pnode->fSuccessfullyConnected &&
+           (pnode->nStartingHeight > (nBestHeight - 144)) &&
+           (pnode->nVersion < NOBLKS_VERSION_START || pnode->nVersion >= NOBLKS_VERSION_END);
 }
 
 void static StartSync(const vector<CNode*> &vNodes) {
@@ -1467,11 +1838,7 @@ void static StartSync(const vector<CNode*> &vNodes) {
 
     // Iterate over all nodes                                                       перебор всех узлов
     BOOST_FOREACH(CNode* pnode, vNodes) {
-        // check preconditions for allowing a sync                                  проверить предпосылки для возможности синхронизации
-        if (!pnode->fClient && !pnode->fOneShot &&
-            !pnode->fDisconnect && pnode->fSuccessfullyConnected &&
-            (pnode->nStartingHeight > (nBestHeight - 144)) &&
-            (pnode->nVersion < NOBLKS_VERSION_START || pnode->nVersion >= NOBLKS_VERSION_END)) {
+        if (NodeCanSync(pnode)) {
             // if ok, compare node's score with the best so far                     если ОК, сравнить оценку узла с лучшими до сих пор
             double dScore = NodeSyncScore(pnode);
             if (pnodeNewSync == NULL || dScore > dBestScore) {
@@ -1484,14 +1851,60 @@ void static StartSync(const vector<CNode*> &vNodes) {
     if (pnodeNewSync) {
         pnodeNewSync->fStartSync = true;
         pnodeSync = pnodeNewSync;
+        nSyncStartTime = GetTime();
     }
 }
 
+// The sync node let a request time out since it was chosen, or another peer        Узел синхронизации допустил истечение запроса с момента выбора, или другой пир
+// answers block requests many times faster                                         отвечает на запросы блоков во много раз быстрее
+bool static SyncNodeStalled(const vector<CNode*> &vNodes) {
+    if (pnodeSync->nStallTime > nSyncStartTime)
+        return true;
+    if (pnodeSync->nBlockLatency <= SYNC_SLOW_LATENCY)
+        return false;
+    BOOST_FOREACH(CNode* pnode, vNodes)
+        if (pnode != pnodeSync && NodeCanSync(pnode) &&
+            pnode->nBlockLatency >= 0 && pnode->nBlockLatency * 4 < pnodeSync->nBlockLatency)
+            return true;
+    return false;
+}
+
+// Wakeup of the message handler                                                   Пробуждение обработчика сообщений
+static boost::mutex mutexMsgProc;
+static boost::condition_variable condMsgProc;
+static bool fMsgProcWake = false;
+
+void WakeMessageHandler()
+{
+    {
+        boost::unique_lock<boost::mutex> lock(mutexMsgProc);
+        fMsgProcWake = true;
+    }
+    condMsgProc.notify_one();
+}
+
+bool NodeHasMessages(CNode *pnode)
+{
+    if (!pnode->vRecvGetData.empty() && !pnode->IsSendFull(GetInvSendClass(pnode->vRecvGetData.front())))
+        return true;
+    if (pnode->vRecvMsg.empty() || !pnode->vRecvMsg.front().complete())
+        return false;
+    return pnode->CanProcessMessage(pnode->vRecvMsg.front());
+}
+
 void ThreadMessageHandler()
 {
     SetThreadPriority(THREAD_PRIORITY_BELOW_NORMAL);
+    int64 nLastFullPass = 0;
     while (true)
     {
+        // Every 100ms all nodes get SendMessages (trickle, pings, addr relay),     Каждые 100мс все узлы получают SendMessages (trickle, пинги, ретрансляция адресов),
+        // in between only the nodes that received messages or queued inventory     в промежутках только узлы, получившие сообщения или поставившие инвентарь в очередь
+        bool fFullPass = GetTimeMillis() - nLastFullPass >= 100;
+        if (fFullPass)
+            nLastFullPass = GetTimeMillis();
+        bool fMoreWork = false;
+        bool fLockBusy = false;
         bool fHaveSyncNode = false;
 
         vector<CNode*> vNodesCopy;
@@ -1505,12 +1918,58 @@ void ThreadMessageHandler()
             }
         }
 
+        // Give up on a stalled or slow sync node, the best of the others takes over   Отказаться от зависшего или медленного узла синхронизации, лучший из остальных перенимает
+        if (fHaveSyncNode && fFullPass && SyncNodeStalled(vNodesCopy)) {
+            printf("sync node %s stalled (latency %"PRI64d"ms, %u stalls), switching\n",
+                   pnodeSync->addrName.c_str(), pnodeSync->nBlockLatency / 1000, pnodeSync->nStalls);
+            pnodeSync = NULL;
+            fHaveSyncNode = false;
+        }
         if (!fHaveSyncNode)
             StartSync(vNodesCopy);
 
+        // Prepare the new complete messages of all nodes at once: checksums,       Подготовить новые полные сообщения всех узлов сразу: контрольные суммы,
+        // deserialization and context-free checks run in parallel without          десериализация и контекстно-независимые проверки выполняются параллельно без
+        // cs_main, so a big block from one peer does not hold up the others.       cs_main, так что большой блок одного пира не задерживает остальных.
+        // Each node is locked only while its messages are collected: the socket     Каждый узел блокируется только на время сбора его сообщений: поток
+        // thread only appends to vRecvMsg and fills its last, incomplete message,    сокетов лишь добавляет в vRecvMsg и заполняет последнее неполное сообщение,
+        // and fRecvPreparing keeps CloseSocketDisconnect from clearing it.          а fRecvPreparing не даёт CloseSocketDisconnect очистить его.
+        {
+            vector<CNode*> vPreparing;
+            vector<CNetMessage*> vPrepare;
+            BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            {
+                if (pnode->fDisconnect)
+                    continue;
+                TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
+                if (!lockRecv)
+                    continue;
+                size_t nPrepare = vPrepare.size();
+                BOOST_FOREACH(CNetMessage& msg, pnode->vRecvMsg)
+                {
+                    if (!msg.complete())
+                        break;
+                    if (!msg.fPrepared)
+                        vPrepare.push_back(&msg);
+                }
+                if (vPrepare.size() > nPrepare) {
+                    pnode->fRecvPreparing = true;
+                    vPreparing.push_back(pnode);
+                }
+            }
+            if (!vPrepare.empty())
+                g_signals.PrepareMessages(vPrepare);
+            BOOST_FOREACH(CNode* pnode, vPreparing)
+            {
+                LOCK(pnode->cs_vRecvMsg);
+                pnode->fRecvPreparing = false;
+            }
+        }
+        boost::this_thread::interruption_point();
+
         // Poll the connected nodes for messages                                    Опрос подключенных узлов для сообщений
         CNode* pnodeTrickle = NULL;
-        if (!vNodesCopy.empty())
+        if (fFullPass && !vNodesCopy.empty())
             pnodeTrickle = vNodesCopy[GetRand(vNodesCopy.size())];
         BOOST_FOREACH(CNode* pnode, vNodesCopy)
         {
@@ -1518,19 +1977,41 @@ void ThreadMessageHandler()
                 continue;
 
             // Receive messages                                                     Получение сообщений
+            bool fProcessed = false;
             {
                 TRY_LOCK(pnode->cs_vRecvMsg, lockRecv);
-                if (lockRecv)
+                if (!lockRecv)
+                    fLockBusy = true; // the socket thread is receiving, look again soon   поток сокетов принимает, вскоре посмотреть ещё раз
+                else if (NodeHasMessages(pnode))
+                {
+                    fProcessed = true;
                     if (!g_signals.ProcessMessages(pnode))
                         pnode->CloseSocketDisconnect();
+                    if (!pnode->fDisconnect && NodeHasMessages(pnode))
+                        fMoreWork = true;
+                }
             }
             boost::this_thread::interruption_point();
 
             // Send messages                                                        Отправка сообщений
+            bool fSendWake;
+            {
+                LOCK(pnode->cs_inventory);
+                fSendWake = pnode->fSendWake;
+            }
+            if (fFullPass || fProcessed || fSendWake)
             {
                 TRY_LOCK(pnode->cs_vSend, lockSend);
                 if (lockSend)
+                {
+                    {
+                        LOCK(pnode->cs_inventory);
+                        pnode->fSendWake = false;
+                    }
                     g_signals.SendMessages(pnode, pnode == pnodeTrickle);
+                }
+                else if (fSendWake)
+                    fLockBusy = true;
             }
             boost::this_thread::interruption_point();
         }
@@ -1541,7 +2022,18 @@ void ThreadMessageHandler()
                 pnode->Release();
         }
 
-        MilliSleep(100);
+        // Sleep until a message arrives, inventory is queued or the next full pass   Спать, пока не придёт сообщение, не появится инвентарь или следующий полный проход
+        boost::unique_lock<boost::mutex> lock(mutexMsgProc);
+        if (!fMoreWork)
+        {
+            // a busy node lock is tried again after a moment instead of spinning on it   занятая блокировка узла пробуется снова через мгновение, а не в цикле
+            int64 nWait = std::max(nLastFullPass + 100 - GetTimeMillis(), (int64)0);
+            if (fLockBusy)
+                nWait = std::min(nWait, (int64)1);
+            boost::system_time timeout = boost::get_system_time() + boost::posix_time::milliseconds(nWait);
+            while (!fMsgProcWake && condMsgProc.timed_wait(lock, timeout)) {}
+        }
+        fMsgProcWake = false;
     }
 }
 
@@ -1804,29 +2296,67 @@ instance_of_cnetcleanup;
 
 
 
-void RelayTransaction(const CTransaction& tx, const uint256& hash)
+CSharedTx::CSharedTx(const CTransaction& txIn) : tx(txIn), hash(txIn.GetHash())
 {
     CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
-    ss.reserve(10000);
+    ss.reserve(::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
     ss << tx;
-    RelayTransaction(tx, hash, ss);
+    MakeMessage(&ss[0], &ss[0] + ss.size());
 }
 
-void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataStream& ss)
+CSharedTx::CSharedTx(const CTransaction& txIn, const CDataStream& ssPayload) : tx(txIn), hash(txIn.GetHash())
 {
+    // the payload may hold more than the transaction                               данные могут содержать больше, чем транзакцию
+    unsigned int nSize = std::min((unsigned int)ssPayload.size(), ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION));
+    MakeMessage(&ssPayload[0], &ssPayload[0] + nSize);
+}
+
+// Build the "tx" message around the serialized transaction                         Построить сообщение "tx" вокруг сериализованной транзакции
+void CSharedTx::MakeMessage(const char* pbegin, const char* pend)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss.reserve(CMessageHeader::HEADER_SIZE + (pend - pbegin));
+    ss << CMessageHeader("tx", pend - pbegin);
+    ss.write(pbegin, pend - pbegin);
+    uint256 hashMsg = Hash(pbegin, pend);
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hashMsg, sizeof(nChecksum));
+    memcpy((char*)&ss[CMessageHeader::CHECKSUM_OFFSET], &nChecksum, sizeof(nChecksum));
+    ss.GetAndClear(msg);
+}
+
+void RelayTransaction(const CTransaction& tx, const uint256& hash)
+{
+    RelayTransaction(CSharedTxRef(new CSharedTx(tx)));
+}
+
+void RelayTransaction(const CSharedTxRef& ptx)
+{
+    const CTransaction& tx = ptx->tx;
+    const uint256& hash = ptx->hash;
     CInv inv(MSG_TX, hash);
     {
         LOCK(cs_mapRelay);
-        // Expire old relay messages                                                Срок действия ретрансляции старых сообщений
-        while (!vRelayExpiration.empty() && vRelayExpiration.front().first < GetTime())
+        // Expire old relay messages, and the oldest ones while over budget          Срок действия старых сообщений ретрансляции, и самых старых, пока бюджет превышен
+        while (!vRelayExpiration.empty() &&
+               (vRelayExpiration.front().first < GetTime() || nRelayCacheSize + ptx->msg.size() > nMaxRelayCacheSize))
         {
-            mapRelay.erase(vRelayExpiration.front().second);
+            map<CInv, CSharedTxRef>::iterator mi = mapRelay.find(vRelayExpiration.front().second);
+            if (mi != mapRelay.end())
+            {
+                nRelayCacheSize -= mi->second->msg.size();
+                mapRelay.erase(mi);
+            }
             vRelayExpiration.pop_front();
         }
 
-        // Save original serialized message so newer versions are preserved         записать оригинал сериализованного сообщения как новую версию сохранения
-        mapRelay.insert(std::make_pair(inv, ss));
-        vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        // Keep the message as it was received so newer versions are preserved;     Хранить сообщение как оно было принято, чтобы сохранились новые версии;
+        // it shares the transaction with the memory pool                           оно разделяет транзакцию с пулом памяти
+        if (nRelayCacheSize + ptx->msg.size() <= nMaxRelayCacheSize && mapRelay.insert(std::make_pair(inv, ptx)).second)
+        {
+            nRelayCacheSize += ptx->msg.size();
+            vRelayExpiration.push_back(std::make_pair(GetTime() + 15 * 60, inv));
+        }
     }
     LOCK(cs_vNodes);
     BOOST_FOREACH(CNode* pnode, vNodes)
@@ -8,6 +8,7 @@
 #include <deque>
 #include <boost/array.hpp>
 #include <boost/foreach.hpp>
+#include <boost/shared_ptr.hpp>
 #include <boost/signals2/signal.hpp>
 #include <openssl/rand.h>
 
@@ -15,18 +16,64 @@
 #include <arpa/inet.h>
 #endif
 
-#include "mruset.h"
 #include "limitedmap.h"
+#include "mruset.h"
 #include "netbase.h"
 #include "protocol.h"
 #include "addrman.h"
 #include "hash.h"
 #include "bloom.h"
+#include "core.h"
 
 /** The maximum number of entries in an 'inv' protocol message                  Максимальное количество записей в 'inv' протоколА сообщений */
 static const unsigned int MAX_INV_SZ = 50000;
+/** Seconds a peer that is ahead of us may leave "getblocks"/"getheaders" unanswered     Секунд, которые опережающий нас пир может не отвечать на "getblocks"/"getheaders" */
+static const int64 SYNC_RESPONSE_TIMEOUT = 60;
+/** Average block response time (microseconds) above which a much faster peer takes      Среднее время ответа на блоки (микросекунды), выше которого гораздо более быстрый пир
+ *  over the sync                                                                         перенимает синхронизацию */
+static const int64 SYNC_SLOW_LATENCY = 10 * 1000000;
+/** Number of recent inventory hashes remembered per peer as known to it            Количество последних хешей инвентаря, запоминаемых для каждого пира как известные ему */
+static const unsigned int INVENTORY_KNOWN_SIZE = 10000;
+
+/** Classes of outgoing messages, in order of priority. Each class has its own      Классы исходящих сообщений, в порядке приоритета. У каждого класса своя
+ *  send queue of up to SendBufferSize() bytes                                      очередь отправки до SendBufferSize() байт */
+enum
+{
+    SEND_CONTROL,       // handshake, pings, requests, addresses                    рукопожатие, пинги, запросы, адреса
+    SEND_ANNOUNCE,      // block announcements, headers, compact blocks             объявления блоков, заголовки, компактные блоки
+    SEND_BLOCK,         // block data                                               данные блоков
+    SEND_TX,            // transaction relay                                        ретрансляция транзакций
+
+    SEND_CLASSES
+};
+
+/** Default byte budget of the relay cache, in megabytes                            Бюджет байтов кэша ретрансляции по умолчанию, в мегабайтах */
+static const unsigned int DEFAULT_RELAY_CACHE_SIZE = 16;
+
+/** A transaction kept in memory once and shared by the memory pool, the relay       Транзакция, хранящаяся в памяти один раз и разделяемая пулом памяти, кэшем
+ *  cache and the orphan pool. It never changes, so its "tx" message is made         ретрансляции и пулом сирот. Она никогда не меняется, поэтому её сообщение "tx"
+ *  once and sent to every peer as it is                                             создаётся один раз и отправляется каждому пиру как есть */
+class CSharedTx
+{
+public:
+    const CTransaction tx;
+    const uint256 hash;
+    CSerializeData msg;     // complete "tx" message with size and checksum       полное сообщение "tx" с размером и контрольной суммой
+
+    explicit CSharedTx(const CTransaction& txIn);
+    // from the payload of a received "tx" message, which isn't serialized again    из данных принятого сообщения "tx", которые не сериализуются повторно
+    CSharedTx(const CTransaction& txIn, const CDataStream& ssPayload);
+
+    unsigned int GetTxSize() const { return msg.size() - CMessageHeader::HEADER_SIZE; }
+
+private:
+    void MakeMessage(const char* pbegin, const char* pend);
+};
+typedef boost::shared_ptr<const CSharedTx> CSharedTxRef;
 
 class CNode;
+class CNetMessage;
+class CPreparedMessage;
 class CBlockIndex;
 extern int nBestHeight;
 
@@ -48,12 +95,33 @@ bool BindListenPort(const CService &bindAddr, std::string& strError=REF(std::str
 void StartNode(boost::thread_group& threadGroup);
 bool StopNode();
 void SocketSendData(CNode *pnode);
+void AddConnectedNode(CNode *pnode);
+void WakeupSocketHandler();
+void ThreadSocketHandler();
+void WakeMessageHandler();
+/** Whether ProcessMessages has something to do for the node (requires cs_vRecvMsg)
+ *                  Есть ли у ProcessMessages работа для узла (требует cs_vRecvMsg) */
+bool NodeHasMessages(CNode *pnode);
+/** Send class of a serialized message, from its command and contents
+ *                  Класс отправки сериализованного сообщения, по его команде и содержимому */
+int GetSendClass(const CSerializeData& msg);
+/** Name of a send class
+ *                  Имя класса отправки */
+const char* GetSendClassName(int nClass);
+/** Send class of the reply to a "getdata" request
+ *                  Класс отправки ответа на запрос "getdata" */
+inline int GetInvSendClass(const CInv& inv) { return inv.type == MSG_TX ? SEND_TX : SEND_BLOCK; }
+/** Send class the handler of a command pushes its reply to
+ *                  Класс отправки, в который обработчик команды кладёт свой ответ */
+int GetReplySendClass(const std::string& strCommand);
 
 // Signals for message handling                                                 Сигналы для обработки сообщений
 struct CNodeSignals
 {
+    boost::signals2::signal<void (const std::vector<CNetMessage*>&)> PrepareMessages;
     boost::signals2::signal<bool (CNode*)> ProcessMessages;
     boost::signals2::signal<bool (CNode*, bool)> SendMessages;
+    boost::signals2::signal<bool (CNode*)> FinalizeNode;
 };
 
 CNodeSignals& GetNodeSignals();
@@ -92,8 +160,10 @@ extern int nMaxConnections;
 
 extern std::vector<CNode*> vNodes;
 extern CCriticalSection cs_vNodes;
-extern std::map<CInv, CDataStream> mapRelay;
+extern std::map<CInv, CSharedTxRef> mapRelay;
 extern std::deque<std::pair<int64, CInv> > vRelayExpiration;
+extern size_t nRelayCacheSize;
+extern size_t nMaxRelayCacheSize;
 extern CCriticalSection cs_mapRelay;
 extern limitedmap<CInv, int64> mapAlreadyAskedFor;
 
@@ -119,6 +189,14 @@ public:
     uint64 nSendBytes;
     uint64 nRecvBytes;
     bool fSyncNode;
+    int64 nBlockLatency;
+    unsigned int nStalls;
+    unsigned int nTxMissed;
+    unsigned int nRecvQueue;
+    uint64 nSendQueue;
+    uint64 vSendQueue[SEND_CLASSES];
+    uint64 nMsgProcessed;
+    int64 nProcessTime;
 };
 
 
@@ -135,11 +213,16 @@ public:
     CDataStream vRecv;              // received message data                        полученные данные сообщения
     unsigned int nDataPos;
 
+    // memory only, set once the message went through PrepareMessages             только в памяти, устанавливается после прохождения сообщения через PrepareMessages
+    bool fPrepared;
+    boost::shared_ptr<CPreparedMessage> pprepared;
+
     CNetMessage(int nTypeIn, int nVersionIn) : hdrbuf(nTypeIn, nVersionIn), vRecv(nTypeIn, nVersionIn) {
         hdrbuf.resize(24);
         in_data = false;
         nHdrPos = 0;
         nDataPos = 0;
+        fPrepared = false;
     }
 
     bool complete() const
@@ -173,16 +256,34 @@ public:
     CDataStream ssSend;
     size_t nSendSize; // total size of all vSendMsg entries                         Общий размер всех vSendMsg записей
     size_t nSendOffset; // offset inside the first vSendMsg already sent            смещение внутри первой vSendMsg уже отправленной
+    int nSendClass;   // class of the message being sent when nSendOffset > 0     класс отправляемого сообщения, когда nSendOffset > 0
     uint64 nSendBytes;
-    std::deque<CSerializeData> vSendMsg;
+    std::deque<CSerializeData> vSendMsg[SEND_CLASSES];
+    size_t vSendSize[SEND_CLASSES];
     CCriticalSection cs_vSend;
 
     std::deque<CInv> vRecvGetData;
     std::deque<CNetMessage> vRecvMsg;
     CCriticalSection cs_vRecvMsg;
+    // complete messages are being prepared without the lock, keep them (cs_vRecvMsg)   полные сообщения готовятся без блокировки, сохранить их (cs_vRecvMsg)
+    bool fRecvPreparing;
     uint64 nRecvBytes;
     int nRecvVersion;
 
+    // socket readiness seen by the event loop (socket thread only)                 готовность сокета, замеченная циклом событий (только поток сокетов)
+    bool fPollRecv;
+    bool fPollSend;
+
+    // queued data is left for the socket thread, which was woken for it (cs_vSend)   данные в очереди оставлены потоку сокетов, который разбужен для них (cs_vSend)
+    bool fSendPending;
+
+    // inventory was queued, SendMessages should look at this node soon (cs_inventory)   инвентарь поставлен в очередь, SendMessages должен вскоре посмотреть на этот узел (cs_inventory)
+    bool fSendWake;
+
+    // message processing statistics (cs_vRecvMsg)                                 статистика обработки сообщений (cs_vRecvMsg)
+    uint64 nMsgProcessed;
+    int64 nProcessTime;         // microseconds spent in ProcessMessage             микросекунд, проведённых в ProcessMessage
+
     int64 nLastSend;
     int64 nLastRecv;
     int64 nLastSendEmpty;
@@ -220,8 +321,30 @@ public:
     CBlockIndex* pindexLastGetBlocksBegin;
     uint256 hashLastGetBlocksEnd;
     int nStartingHeight;
+    int nHeadersHeight;         // height of the last header the node sent us      высота последнего заголовка, присланного нам узлом
+    bool fHeadersUnserved;      // it didn't serve blocks of its headers, "getblocks" only   он не отдал блоки своих заголовков, только "getblocks"
     bool fStartSync;
 
+    // block download performance, kept by the message handler thread              производительность загрузки блоков, ведётся потоком обработчика сообщений
+    // nBlockLatency under cs_vRecvMsg, nStalls and nTxMissed under cs_vSend        nBlockLatency под cs_vRecvMsg, nStalls и nTxMissed под cs_vSend
+    std::map<uint256, int64> mapBlocksAsked;   // blocks asked for with "getdata", when (microseconds)    блоки, запрошенные через "getdata", когда (микросекунды)
+    int64 nSyncAskTime;         // unanswered "getblocks"/"getheaders" sent at (microseconds), or 0      неотвеченный "getblocks"/"getheaders" отправлен в (микросекунды), или 0
+    int64 nBlockLatency;        // average response time to block requests (microseconds), -1 unknown    среднее время ответа на запросы блоков (микросекунды), -1 неизвестно
+    int64 nStallTime;           // last time a request to the node timed out, or 0                         последний раз, когда запрос к узлу истёк, или 0
+    unsigned int nStalls;       // requests that timed out                                                 запросов, истёкших по времени
+
+    // transaction download, kept by the message handler thread                    загрузка транзакций, ведётся потоком обработчика сообщений
+    std::map<uint256, int64> mapTxAsked;       // transactions asked for with "getdata", when (microseconds)   транзакции, запрошенные через "getdata", когда (микросекунды)
+    unsigned int nTxMissed;     // rounds of transaction requests in a row that timed out                  раундов запросов транзакций подряд, истёкших по времени
+    int64 nTxMissTime;          // when the last missed round was counted (microseconds), under cs_vSend   когда был засчитан последний пропущенный раунд (микросекунды), под cs_vSend
+
+    // compact block relay, negotiated with "sendcmpct"                             ретрансляция компактных блоков, согласуется через "sendcmpct"
+    bool fCompactBlocks;        // peer understands "cmpctblock"/"getblocktxn"      пир понимает "cmpctblock"/"getblocktxn"
+    bool fCompactAnnounce;      // peer wants new blocks pushed as "cmpctblock"     пир хочет получать новые блоки сразу как "cmpctblock"
+    bool fFastRelay;            // peer accepts blocks not connected yet ("sendfast")   пир принимает ещё не подключённые блоки ("sendfast")
+    bool fFastRelayOffered;     // we told the peer "sendfast"                      мы сказали пиру "sendfast"
+    mruset<uint256> setFastRelayed;     // blocks the peer relayed before connecting them ("fastblock")   блоки, ретранслированные пиром до их подключения ("fastblock")
+
     // flood relay                                                                  ретрансляция флуда
     std::vector<CAddress> vAddrToSend;
     std::set<CAddress> setAddrKnown;
@@ -229,16 +352,23 @@ public:
     std::set<uint256> setKnown;
 
     // inventory based relay                                                        инвентаризация базовой ретрансляция
-    mruset<CInv> setInventoryKnown;
+    CRollingBloomFilter filterInventoryKnown;   // hashes of tx and block invs    хеши inv транзакций и блоков
     std::vector<CInv> vInventoryToSend;
     CCriticalSection cs_inventory;
     std::multimap<int64, CInv> mapAskFor;
 
-    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : ssSend(SER_NETWORK, MIN_PROTO_VERSION)
+    CNode(SOCKET hSocketIn, CAddress addrIn, std::string addrNameIn = "", bool fInboundIn=false) : ssSend(SER_NETWORK, MIN_PROTO_VERSION), filterInventoryKnown(INVENTORY_KNOWN_SIZE, 0.000001)
     {
         nServices = 0;
         hSocket = hSocketIn;
         nRecvVersion = MIN_PROTO_VERSION;
+        fRecvPreparing = false;
+        fPollRecv = false;
+        fPollSend = false;
+        fSendPending = false;
+        fSendWake = false;
+        nMsgProcessed = 0;
+        nProcessTime = 0;
         nLastSend = 0;
         nLastRecv = 0;
         nSendBytes = 0;
@@ -258,15 +388,30 @@ public:
         nRefCount = 0;
         nSendSize = 0;
         nSendOffset = 0;
+        nSendClass = SEND_CONTROL;
+        for (int i = 0; i < SEND_CLASSES; i++)
+            vSendSize[i] = 0;
         hashContinue = 0;
         pindexLastGetBlocksBegin = 0;
         hashLastGetBlocksEnd = 0;
         nStartingHeight = -1;
+        nHeadersHeight = -1;
+        fHeadersUnserved = false;
         fStartSync = false;
+        nSyncAskTime = 0;
+        nBlockLatency = -1;
+        nStallTime = 0;
+        nStalls = 0;
+        nTxMissed = 0;
+        nTxMissTime = 0;
+        fCompactBlocks = false;
+        fCompactAnnounce = false;
+        fFastRelay = false;
+        fFastRelayOffered = false;
+        setFastRelayed.max_size(16);
         fGetAddr = false;
         nMisbehavior = 0;
         fRelayTxes = false;
-        setInventoryKnown.max_size(SendBufferSize() / 1000);
         pfilter = NULL;
 
         // Be shy and don't send version until we hear                              Быть застенчивым(отступать) и не отправлять версию, до тех пор, пока мы слушаем
@@ -349,7 +494,7 @@ public:
     {
         {
             LOCK(cs_inventory);
-            setInventoryKnown.insert(inv);
+            filterInventoryKnown.insert(inv.hash);
         }
     }
 
@@ -357,15 +502,24 @@ public:
     {
         {
             LOCK(cs_inventory);
-            if (!setInventoryKnown.count(inv))
-                vInventoryToSend.push_back(inv);
+            if (filterInventoryKnown.contains(inv.hash))
+                return;
+            vInventoryToSend.push_back(inv);
+            fSendWake = true;
         }
+        WakeMessageHandler();
     }
 
     void AskFor(const CInv& inv)
     {
         // We're using mapAskFor as a priority queue,                               Мы используем mapAskFor как приоритетную очередьб
         // the key is the earliest time the request can be sent                     ключом является самое раннее время, когда запрос может быть отправлен
+        if (inv.type == MSG_TX)
+        {
+            // transactions: every announcer is queued, SendMessages picks one       транзакции: ставится в очередь каждый объявивший, SendMessages выбирает одного
+            mapAskFor.insert(std::make_pair((GetTime() - 1) * 1000000, inv));
+            return;
+        }
         int64 nRequestTime;
         limitedmap<CInv, int64>::const_iterator it = mapAlreadyAskedFor.find(inv);
         if (it != mapAlreadyAskedFor.end())
@@ -415,7 +569,8 @@ public:
     }
 
     // TODO: Document the postcondition of this function.  Is cs_vSend locked?      Документируйте выходное условие этой функции. cs_vSend заблокирован?
-    void EndMessage() UNLOCK_FUNCTION(cs_vSend)
+    // nClass -1 takes the send class from the message itself                       nClass -1 берёт класс отправки из самого сообщения
+    void EndMessage(int nClass = -1) UNLOCK_FUNCTION(cs_vSend)
     {
         if (mapArgs.count("-dropmessagestest") && GetRand(atoi(mapArgs["-dropmessagestest"])) == 0)
         {
@@ -442,15 +597,64 @@ public:
             printf("(%d bytes)\n", nSize);
         }
 
-        std::deque<CSerializeData>::iterator it = vSendMsg.insert(vSendMsg.end(), CSerializeData());
-        ssSend.GetAndClear(*it);
+        CSerializeData msg;
+        ssSend.GetAndClear(msg);
+        QueueSendData(msg, nClass);
+
+        LEAVE_CRITICAL_SECTION(cs_vSend);
+    }
+
+    // Queue a complete message whose header already holds size and checksum       Поставить в очередь полное сообщение, заголовок которого уже содержит размер и контрольную сумму
+    void PushRawMessage(const CSerializeData& msg)
+    {
+        LOCK(cs_vSend);
+        if (fDebug)
+            printf("sending: raw (%"PRIszu" bytes)\n", msg.size());
+
+        CSerializeData msgCopy(msg);
+        QueueSendData(msgCopy, -1);
+    }
+
+    // Move a message into the queue of its send class (requires cs_vSend)         Переместить сообщение в очередь его класса отправки (требует cs_vSend)
+    void QueueSendData(CSerializeData& msg, int nClass)
+    {
+        if (nClass < 0)
+            nClass = GetSendClass(msg);
+        bool fWasEmpty = (nSendSize == 0);
+        std::deque<CSerializeData>::iterator it = vSendMsg[nClass].insert(vSendMsg[nClass].end(), CSerializeData());
+        (*it).swap(msg);
         nSendSize += (*it).size();
+        vSendSize[nClass] += (*it).size();
 
         // If write queue empty, attempt "optimistic write"                         Если очереди записи пуста, попробовать "оптимистическую запись"
-        if (it == vSendMsg.begin())
+        if (fWasEmpty)
             SocketSendData(this);
 
-        LEAVE_CRITICAL_SECTION(cs_vSend);
+        // what is left needs the socket thread, which may be waiting for events    остаток требует потока сокетов, который может ждать событий
+        // of other sockets                                                         других сокетов
+        if (nSendSize > 0 && !fSendPending) {
+            fSendPending = true;
+            WakeupSocketHandler();
+        }
+    }
+
+    // Whether the queue of a send class is full, what would go there has to wait   Полна ли очередь класса отправки, то, что пошло бы туда, должно подождать
+    bool IsSendFull(int nClass) const
+    {
+        return vSendSize[nClass] >= SendBufferSize();
+    }
+
+    // New messages are processed while their replies can be queued and the        Новые сообщения обрабатываются, пока их ответы можно поставить в очередь,
+    // requests waiting for "getdata" stay bounded                                  а запросы, ожидающие "getdata", остаются ограниченными
+    bool CanProcessMessages() const
+    {
+        return !IsSendFull(SEND_CONTROL) && !IsSendFull(SEND_ANNOUNCE) && vRecvGetData.size() < MAX_INV_SZ;
+    }
+
+    // A message whose reply goes to a full class waits for that class to drain     Сообщение, ответ на которое идёт в полный класс, ждёт, пока класс освободится
+    bool CanProcessMessage(const CNetMessage& msg) const
+    {
+        return CanProcessMessages() && !IsSendFull(GetReplySendClass(msg.hdr.GetCommand()));
     }
 
     void PushVersion();
@@ -486,6 +690,23 @@ public:
         }
     }
 
+    // Push a message into the given send class, to keep it in order with others   Поместить сообщение в данный класс отправки, чтобы сохранить его порядок с другими
+    template<typename T1>
+    void PushMessageClass(int nClass, const char* pszCommand, const T1& a1)
+    {
+        try
+        {
+            BeginMessage(pszCommand);
+            ssSend << a1;
+            EndMessage(nClass);
+        }
+        catch (...)
+        {
+            AbortMessage();
+            throw;
+        }
+    }
+
     template<typename T1, typename T2>
     void PushMessage(const char* pszCommand, const T1& a1, const T2& a2)
     {
@@ -643,8 +864,7 @@ public:
 
 
 
-class CTransaction;
 void RelayTransaction(const CTransaction& tx, const uint256& hash);
-void RelayTransaction(const CTransaction& tx, const uint256& hash, const CDataStream& ss);
+void RelayTransaction(const CSharedTxRef& ptx);
 
 #endif
@@ -133,6 +133,8 @@ enum
     // Nodes may always request a MSG_FILTERED_BLOCK in a getdata, however,             Узлы могут всегда просить MSG_FILTERED_BLOCK в getdata, однако,
     // MSG_FILTERED_BLOCK should not appear in any invs except as a part of getdata.    MSG_FILTERED_BLOCK не должен появиться ни в каком invs кроме как часть getdata
     MSG_FILTERED_BLOCK,
+    // Asked for in a getdata from peers that sent "sendcmpct", answered with "cmpctblock"   Запрашивается в getdata у пиров, приславших "sendcmpct", ответ - "cmpctblock"
+    MSG_CMPCT_BLOCK,
 };
 
 #endif // __INCLUDED_PROTOCOL_H__
@@ -4,6 +4,7 @@
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 
 #include "main.h"
+#include "txdb.h"
 #include "bitcoinrpc.h"
 
 using namespace json_spirit;
@@ -121,10 +122,45 @@ Value settxfee(const Array& params, bool fHelp)
 
 Value getrawmempool(const Array& params, bool fHelp)
 {
-    if (fHelp || params.size() != 0)
+    if (fHelp || params.size() > 1)
         throw runtime_error(
-            "getrawmempool\n"
-            "Returns all transaction ids in memory pool.");
+            "getrawmempool [verbose=false]\n"
+            "Returns all transaction ids in memory pool.\n"
+            "If verbose is true, returns an Object with information about each transaction,\n"
+            "in the order of what they add to the proof of work of the next block, the most first.");
+
+    bool fVerbose = false;
+    if (params.size() > 0)
+        fVerbose = params[0].get_bool();
+
+    if (fVerbose)
+    {
+        LOCK(mempool.cs);
+        Object o;
+        for (set<pair<uint256, uint256> >::const_reverse_iterator it = mempool.setByMiningWork.rbegin(); it != mempool.setByMiningWork.rend(); ++it)
+        {
+            const CTxMemPoolEntry& entry = mempool.mapTx.find(it->second)->second;
+            Object info;
+            info.push_back(Pair("size", (int)entry.nTxSize));
+            info.push_back(Pair("fee", ValueFromAmount(entry.nFee)));
+            info.push_back(Pair("time", (boost::int64_t)entry.nTime));
+            info.push_back(Pair("height", entry.nHeight));
+            info.push_back(Pair("startingpriority", entry.GetPriority(entry.nHeight)));
+            info.push_back(Pair("currentpriority", entry.GetPriority(nBestHeight)));
+            info.push_back(Pair("descendantfees", ValueFromAmount(entry.nFeesWithDescendants)));
+            info.push_back(Pair("descendantsize", (boost::int64_t)entry.nSizeWithDescendants));
+            info.push_back(Pair("mininghash", entry.hashMining.GetHex()));
+            info.push_back(Pair("miningwork", entry.nMiningWork.GetHex()));
+            Array depends;
+            set<uint256> setDepends;
+            BOOST_FOREACH(const CTxIn& txin, entry.GetTx().vin)
+                if (mempool.exists(txin.prevout.hash) && setDepends.insert(txin.prevout.hash).second)
+                    depends.push_back(txin.prevout.hash.ToString());
+            info.push_back(Pair("depends", depends));
+            o.push_back(Pair(it->second.ToString(), info));
+        }
+        return o;
+    }
 
     vector<uint256> vtxid;
     mempool.queryHashes(vtxid);
@@ -190,10 +226,16 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
     if (fHelp || params.size() != 0)
         throw runtime_error(
             "gettxoutsetinfo\n"
-            "Returns statistics about the unspent transaction output set.");
+            "Returns statistics about the unspent transaction output set.\n"
+            "hash_serialized is a multiset hash of the entries: it does not depend on their order, so it can be\n"
+            "compared between nodes at the same block.");
 
     Object ret;
 
+    // Write the cache first, so the statistics include the latest blocks          Сначала записать кэш, чтобы статистика учитывала последние блоки
+    if (!pcoinsTip->Flush())
+        throw JSONRPCError(RPC_DATABASE_ERROR, "Failed to write to coin database");
+
     CCoinsStats stats;
     if (pcoinsTip->GetStats(stats)) {
         ret.push_back(Pair("height", (boost::int64_t)stats.nHeight));
@@ -201,12 +243,55 @@ Value gettxoutsetinfo(const Array& params, bool fHelp)
         ret.push_back(Pair("transactions", (boost::int64_t)stats.nTransactions));
         ret.push_back(Pair("txouts", (boost::int64_t)stats.nTransactionOutputs));
         ret.push_back(Pair("bytes_serialized", (boost::int64_t)stats.nSerializedSize));
-        ret.push_back(Pair("hash_serialized", stats.hashSerialized.GetHex()));
+        ret.push_back(Pair("hash_serialized", stats.hashSet.GetHex()));
         ret.push_back(Pair("total_amount", ValueFromAmount(stats.nTotalAmount)));
     }
     return ret;
 }
 
+Value getcoinscacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getcoinscacheinfo\n"
+            "Returns the state of the in-memory coins cache and of its background writes.");
+
+    Object ret;
+    ret.push_back(Pair("transactions", (boost::int64_t)pcoinsTip->GetCacheSize()));
+    ret.push_back(Pair("bytes", (boost::int64_t)pcoinsTip->DynamicMemoryUsage()));
+    ret.push_back(Pair("bytes_limit", (boost::int64_t)nCoinCacheUsage));
+    if (pcoinsFlush) {
+        CCoinsFlushStats stats = pcoinsFlush->GetFlushStats();
+        ret.push_back(Pair("flushes", (boost::int64_t)stats.nFlushes));
+        ret.push_back(Pair("writing", stats.fWriting));
+        ret.push_back(Pair("last_write_ms", 0.001 * stats.nWriteLast));
+        ret.push_back(Pair("last_stall_ms", 0.001 * stats.nStallLast));
+        ret.push_back(Pair("max_stall_ms", 0.001 * stats.nStallMax));
+        ret.push_back(Pair("total_stall_ms", 0.001 * stats.nStallTotal));
+    }
+    return ret;
+}
+
+Value getsigcacheinfo(const Array& params, bool fHelp)
+{
+    if (fHelp || params.size() != 0)
+        throw runtime_error(
+            "getsigcacheinfo\n"
+            "Returns the state of the cache of verified signatures and its hit rate.");
+
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    Object ret;
+    ret.push_back(Pair("entries", (boost::int64_t)stats.nEntries));
+    ret.push_back(Pair("capacity", (boost::int64_t)stats.nCapacity));
+    ret.push_back(Pair("bytes", (boost::int64_t)(stats.nCapacity * sizeof(uint256))));
+    ret.push_back(Pair("hits", (boost::int64_t)stats.nHits));
+    ret.push_back(Pair("misses", (boost::int64_t)stats.nMisses));
+    ret.push_back(Pair("hitrate", stats.nHits + stats.nMisses ? (double)stats.nHits / (stats.nHits + stats.nMisses) : 0.0));
+    ret.push_back(Pair("inserts", (boost::int64_t)stats.nInserts));
+    ret.push_back(Pair("evictions", (boost::int64_t)stats.nEvictions));
+    return ret;
+}
+
 Value gettxout(const Array& params, bool fHelp)
 {
     if (fHelp || params.size() < 2 || params.size() > 3)
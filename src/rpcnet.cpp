@@ -23,13 +23,25 @@ static void CopyNodeStats(std::vector<CNodeStats>& vstats)
 {
     vstats.clear();
 
-    LOCK(cs_vNodes);
-    vstats.reserve(vNodes.size());
-    BOOST_FOREACH(CNode* pnode, vNodes) {
+    // copyStats waits for the node locks, which must not happen under cs_vNodes   copyStats ждёт блокировок узла, что недопустимо под cs_vNodes
+    vector<CNode*> vNodesCopy;
+    {
+        LOCK(cs_vNodes);
+        vNodesCopy = vNodes;
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            pnode->AddRef();
+    }
+    vstats.reserve(vNodesCopy.size());
+    BOOST_FOREACH(CNode* pnode, vNodesCopy) {
         CNodeStats stats;
         pnode->copyStats(stats);
         vstats.push_back(stats);
     }
+    {
+        LOCK(cs_vNodes);
+        BOOST_FOREACH(CNode* pnode, vNodesCopy)
+            pnode->Release();
+    }
 }
 
 Value getpeerinfo(const Array& params, bool fHelp)
@@ -59,6 +71,18 @@ Value getpeerinfo(const Array& params, bool fHelp)
         obj.push_back(Pair("inbound", stats.fInbound));
         obj.push_back(Pair("startingheight", stats.nStartingHeight));
         obj.push_back(Pair("banscore", stats.nMisbehavior));
+        obj.push_back(Pair("recvqueue", (boost::int64_t)stats.nRecvQueue));
+        obj.push_back(Pair("sendqueue", (boost::int64_t)stats.nSendQueue));
+        Object sendqueueclass;
+        for (int i = 0; i < SEND_CLASSES; i++)
+            sendqueueclass.push_back(Pair(GetSendClassName(i), (boost::int64_t)stats.vSendQueue[i]));
+        obj.push_back(Pair("sendqueueclass", sendqueueclass));
+        obj.push_back(Pair("msgprocessed", (boost::int64_t)stats.nMsgProcessed));
+        obj.push_back(Pair("processtime", (boost::int64_t)(stats.nProcessTime / 1000)));
+        if (stats.nBlockLatency >= 0)
+            obj.push_back(Pair("blocklatency", (boost::int64_t)(stats.nBlockLatency / 1000)));
+        obj.push_back(Pair("stalls", (boost::int64_t)stats.nStalls));
+        obj.push_back(Pair("txmissed", (boost::int64_t)stats.nTxMissed));
         if (stats.fSyncNode)
             obj.push_back(Pair("syncnode", true));
 
@@ -3,7 +3,8 @@
 // Distributed under the MIT/X11 software license, see the accompanying
 // file COPYING or http://www.opensource.org/licenses/mit-license.php.
 #include <boost/foreach.hpp>
-#include <boost/tuple/tuple.hpp>
+#include <openssl/rand.h>
+#include <openssl/sha.h>
 
 using namespace std;
 using namespace boost;
@@ -1034,64 +1035,181 @@ uint256 SignatureHash(CScript scriptCode, const CTransaction& txTo, unsigned int
 // Valid signature cache, to avoid doing expensive ECDSA signature checking         Действительная подпись кэша, чтобы не делать дорогую проверку ECDSA подписи
 // twice for every transaction (once when accepted into memory pool, and            дважды для каждой транзакции (один раз, когда приняты в пул памяти и снова
 // again when accepted into the block chain)                                        когда приняты в цепь боков)
+//
+// An entry is SHA256(salt, signature hash, signature, public key), with a salt     Запись - SHA256(соль, хэш подписи, подпись, открытый ключ), с солью,
+// random per process, so nobody can tell where an entry goes. The table is split   случайной для процесса, чтобы никто не знал, куда попадёт запись. Таблица
+// into shards of their own lock, chosen by the entry, so the script check          разбита на части со своей блокировкой, выбираемые по записи, так что потоки
+// threads hardly ever wait for each other. In a shard an entry can take one of     проверки скриптов почти никогда не ждут друг друга. В части запись может занять
+// WAYS slots; a new one pushes an old one to another of its slots (cuckoo          одну из WAYS ячеек; новая сдвигает старую в другую из её ячеек (кукушкино
+// hashing), and the last one pushed is dropped after MAX_KICKS moves.              хэширование), а последняя сдвинутая выбрасывается после MAX_KICKS сдвигов.
 
 class CSignatureCache
 {
 private:
-     // sigdata_type is (signature hash, signature, public key):                    (хэш подписи, подпись, открытый ключ)
-    typedef boost::tuple<uint256, std::vector<unsigned char>, CPubKey> sigdata_type;
-    std::set< sigdata_type> setValid;
-    boost::shared_mutex cs_sigcache;
+    static const unsigned int SHARDS = 32;
+    static const unsigned int WAYS = 4;
+    static const unsigned int MAX_KICKS = 16;
+
+    struct CShard
+    {
+        boost::mutex cs;
+        std::vector<uint256> vTable;        // 0 is an empty slot                   0 - пустая ячейка
+        uint64 nUsed;
+        uint64 nHits;
+        uint64 nMisses;
+        uint64 nInserts;
+        uint64 nEvictions;
+
+        CShard() : nUsed(0), nHits(0), nMisses(0), nInserts(0), nEvictions(0) {}
+    };
+
+    CShard vShard[SHARDS];
+    SHA256_CTX ctxSalted;                   // the salt already hashed               соль уже захэширована
+
+    static unsigned int GetWord(const uint256& entry, unsigned int n)
+    {
+        unsigned int nWord;
+        memcpy(&nWord, entry.begin() + 4 * n, sizeof(nWord));
+        return nWord;
+    }
+
+    CShard& GetShard(const uint256& entry)
+    {
+        return vShard[GetWord(entry, 0) % SHARDS];
+    }
+
+    // slot n of the entry in its shard                                         ячейка n записи в её части
+    static unsigned int GetSlot(const CShard& shard, const uint256& entry, unsigned int n)
+    {
+        return GetWord(entry, n + 1) % shard.vTable.size();
+    }
 
 public:
-    bool
-    Get(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    CSignatureCache()
     {
-        boost::shared_lock<boost::shared_mutex> lock(cs_sigcache);
+        // a whole block of salt, hashed once                                   целый блок соли, хэшируемый один раз
+        unsigned char pchSalt[64];
+        RAND_bytes(pchSalt, sizeof(pchSalt));
+        SHA256_Init(&ctxSalted);
+        SHA256_Update(&ctxSalted, pchSalt, sizeof(pchSalt));
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        std::set<sigdata_type>::iterator mi = setValid.find(k);
-        if (mi != setValid.end())
-            return true;
-        return false;
+    void Resize(uint64 nBytes)
+    {
+        uint64 nSlots = nBytes / sizeof(uint256) / SHARDS;
+        for (unsigned int i = 0; i < SHARDS; i++)
+        {
+            boost::mutex::scoped_lock lock(vShard[i].cs);
+            vShard[i].vTable.assign(nSlots >= WAYS ? nSlots : 0, uint256(0));
+            vShard[i].nUsed = 0;
+        }
     }
 
-    void Set(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey)
+    uint256 GetEntry(const uint256 &hash, const std::vector<unsigned char>& vchSig, const CPubKey& pubKey) const
     {
-        // DoS prevention: limit cache size to less than 10MB                       DoS предотвращение: ограничить размер кэша до менее чем 10 МБ
-        // (~200 bytes per cache entry times 50,000 entries)                        (~200 байт на запись кэша из 50,000 записей)
-        // Since there are a maximum of 20,000 signature operations per block       Поскольку есть более 20,000 операций подписи на каждый блок
-        // 50,000 is a reasonable default.                                          50,000 является разумным значением по умолчанию
-        int64 nMaxCacheSize = GetArg("-maxsigcachesize", 50000);
-        if (nMaxCacheSize <= 0) return;
+        SHA256_CTX ctx = ctxSalted;
+        SHA256_Update(&ctx, hash.begin(), sizeof(hash));
+        SHA256_Update(&ctx, vchSig.empty() ? NULL : &vchSig[0], vchSig.size());
+        SHA256_Update(&ctx, pubKey.begin(), pubKey.size());
+        uint256 entry;
+        SHA256_Final(entry.begin(), &ctx);
+        return entry;
+    }
 
-        boost::unique_lock<boost::shared_mutex> lock(cs_sigcache);
+    // fErase: a hit won't be asked for again                                   fErase: попадание больше не понадобится
+    bool Get(const uint256 &entry, bool fErase)
+    {
+        CShard& shard = GetShard(entry);
+        boost::mutex::scoped_lock lock(shard.cs);
+        if (shard.vTable.empty())
+            return false;
+        for (unsigned int n = 0; n < WAYS; n++)
+        {
+            uint256 &slot = shard.vTable[GetSlot(shard, entry, n)];
+            if (slot == entry)
+            {
+                if (fErase)
+                {
+                    slot = 0;
+                    shard.nUsed--;
+                }
+                shard.nHits++;
+                return true;
+            }
+        }
+        shard.nMisses++;
+        return false;
+    }
 
-        while (static_cast<int64>(setValid.size()) > nMaxCacheSize)
+    void Set(const uint256 &entry)
+    {
+        CShard& shard = GetShard(entry);
+        boost::mutex::scoped_lock lock(shard.cs);
+        if (shard.vTable.empty())
+            return;
+        for (unsigned int n = 0; n < WAYS; n++)
+            if (shard.vTable[GetSlot(shard, entry, n)] == entry)
+                return;
+        shard.nInserts++;
+
+        uint256 entryMove = entry;
+        unsigned int nSlot = GetSlot(shard, entryMove, 0);
+        for (unsigned int nKick = 0; nKick <= MAX_KICKS; nKick++)
         {
-            // Evict a random entry. Random because that helps                      Исключить случайную запись. Случайная, потому что это помогает мешать
-            // foil would-be DoS attackers who might try to pre-generate            потенциальным DoS нападающим, которые могут попытаться заранее создать
-            // and re-use a set of valid signatures just-slightly-greater           и повторно использовать набор действительных подписей только чуть больше,
-            // than our cache size.                                                 чем наш размер кэша
-            uint256 randomHash = GetRandHash();
-            std::vector<unsigned char> unused;
-            std::set<sigdata_type>::iterator it =
-                setValid.lower_bound(sigdata_type(randomHash, unused, unused));
-            if (it == setValid.end())
-                it = setValid.begin();
-            setValid.erase(*it);
+            for (unsigned int n = 0; n < WAYS; n++)
+            {
+                uint256 &slot = shard.vTable[GetSlot(shard, entryMove, n)];
+                if (slot == 0)
+                {
+                    slot = entryMove;
+                    shard.nUsed++;
+                    return;
+                }
+            }
+            // every slot taken: push out the one in the next slot              все ячейки заняты: вытолкнуть запись из следующей ячейки
+            unsigned int nNext = 0;
+            for (unsigned int n = 0; n < WAYS; n++)
+                if (GetSlot(shard, entryMove, n) == nSlot)
+                    nNext = (n + 1) % WAYS;
+            nSlot = GetSlot(shard, entryMove, nNext);
+            std::swap(entryMove, shard.vTable[nSlot]);
         }
+        // the last one pushed out has nowhere to go                             последней вытолкнутой некуда деться
+        shard.nEvictions++;
+    }
 
-        sigdata_type k(hash, vchSig, pubKey);
-        setValid.insert(k);
+    CSignatureCacheStats GetStats()
+    {
+        CSignatureCacheStats stats;
+        for (unsigned int i = 0; i < SHARDS; i++)
+        {
+            boost::mutex::scoped_lock lock(vShard[i].cs);
+            stats.nHits += vShard[i].nHits;
+            stats.nMisses += vShard[i].nMisses;
+            stats.nInserts += vShard[i].nInserts;
+            stats.nEvictions += vShard[i].nEvictions;
+            stats.nEntries += vShard[i].nUsed;
+            stats.nCapacity += vShard[i].vTable.size();
+        }
+        return stats;
     }
 };
 
+static CSignatureCache signatureCache;
+
+void InitSignatureCache(uint64 nBytes)
+{
+    signatureCache.Resize(nBytes);
+}
+
+CSignatureCacheStats GetSignatureCacheStats()
+{
+    return signatureCache.GetStats();
+}
+
 bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubKey, const CScript &scriptCode,
               const CTransaction& txTo, unsigned int nIn, int nHashType, int flags)
 {
-    static CSignatureCache signatureCache;
-
     CPubKey pubkey(vchPubKey);
     if (!pubkey.IsValid())
         return false;
@@ -1107,14 +1225,15 @@ bool CheckSig(vector<unsigned char> vchSig, const vector<unsigned char> &vchPubK
 
     uint256 sighash = SignatureHash(scriptCode, txTo, nIn, nHashType);
 
-    if (signatureCache.Get(sighash, vchSig, pubkey))
+    uint256 entry = signatureCache.GetEntry(sighash, vchSig, pubkey);
+    if (signatureCache.Get(entry, flags & SCRIPT_VERIFY_CACHEERASE))
         return true;
 
     if (!pubkey.Verify(sighash, vchSig))
         return false;
 
     if (!(flags & SCRIPT_VERIFY_NOCACHE))
-        signatureCache.Set(sighash, vchSig, pubkey);
+        signatureCache.Set(entry);
 
     return true;
 }
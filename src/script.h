@@ -35,8 +35,29 @@ enum
     SCRIPT_VERIFY_P2SH      = (1U << 0),
     SCRIPT_VERIFY_STRICTENC = (1U << 1),
     SCRIPT_VERIFY_NOCACHE   = (1U << 2),
+    SCRIPT_VERIFY_CACHEERASE = (1U << 3),   // a signature found in the cache won't be checked again
 };
 
+/** Default for -sigcachesize, megabytes of signature cache */
+static const unsigned int DEFAULT_SIGCACHE_SIZE = 32;
+
+/** Signature cache counters since start */
+struct CSignatureCacheStats
+{
+    uint64 nHits;
+    uint64 nMisses;
+    uint64 nInserts;
+    uint64 nEvictions;      // valid signatures pushed out for lack of room
+    uint64 nEntries;
+    uint64 nCapacity;
+
+    CSignatureCacheStats() : nHits(0), nMisses(0), nInserts(0), nEvictions(0), nEntries(0), nCapacity(0) {}
+};
+
+/** Size the signature cache to nBytes, 0 turns it off */
+void InitSignatureCache(uint64 nBytes);
+CSignatureCacheStats GetSignatureCacheStats();
+
 enum txnouttype
 {
     TX_NONSTANDARD,
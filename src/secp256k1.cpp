@@ -0,0 +1,1320 @@
+// Copyright (c) 2009-2013 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+
+#include <limits.h>
+#include <stdlib.h>
+#include <string.h>
+#include <algorithm>
+#include <string>
+
+#include <openssl/crypto.h>
+#include <openssl/sha.h>
+
+#include "secp256k1.h"
+
+
+// anonymous namespace with the field, scalar and group arithmetic              анонимное пространство имён с арифметикой поля, скаляров и группы
+namespace {
+
+// Numbers are fixed arrays of limbs, least significant first. Loops run        Числа - массивы слов фиксированной длины, младшее первым. Циклы
+// over all limbs and choices are made with masks, so the time spent on a       проходят все слова, а выбор делается масками, так что время работы
+// secret does not depend on its value.                                         с секретом не зависит от его значения.
+#if defined(__SIZEOF_INT128__)
+typedef unsigned long long limb_t;
+typedef unsigned __int128 dlimb_t;
+#else
+typedef unsigned int limb_t;
+typedef unsigned long long dlimb_t;
+#endif
+
+const int LIMB_BITS = 8 * sizeof(limb_t);
+const int LIMB_BYTES = sizeof(limb_t);
+const int LIMBS = 256 / LIMB_BITS;
+const int MAX_LIMBS = 2 * LIMBS + 8;
+
+// Windows of the multiplications                                               Окна умножений
+const int WINDOW_A = 5;                 // odd multiples of a point: 8           нечётные кратные точки: 8
+const int WINDOW_G = 8;                 // odd multiples of G, precomputed: 64   нечётные кратные G, заранее: 64
+const int WNAF_BITS = 257;
+
+limb_t AddLimbs(limb_t *r, const limb_t *a, const limb_t *b, int n)
+{
+    limb_t c = 0;
+    for (int i = 0; i < n; i++)
+    {
+        dlimb_t t = (dlimb_t)a[i] + b[i] + c;
+        r[i] = (limb_t)t;
+        c = (limb_t)(t >> LIMB_BITS);
+    }
+    return c;
+}
+
+limb_t SubLimbs(limb_t *r, const limb_t *a, const limb_t *b, int n)
+{
+    limb_t c = 0;
+    for (int i = 0; i < n; i++)
+    {
+        dlimb_t t = (dlimb_t)a[i] - b[i] - c;
+        r[i] = (limb_t)t;
+        c = (limb_t)(t >> (2 * LIMB_BITS - 1));
+    }
+    return c;
+}
+
+// r (na + nb limbs) = a * b                                                    r (na + nb слов) = a * b
+void MulLimbs(limb_t *r, const limb_t *a, int na, const limb_t *b, int nb)
+{
+    for (int i = 0; i < na + nb; i++)
+        r[i] = 0;
+    for (int i = 0; i < na; i++)
+    {
+        limb_t c = 0;
+        for (int j = 0; j < nb; j++)
+        {
+            dlimb_t t = (dlimb_t)a[i] * b[j] + r[i + j] + c;
+            r[i + j] = (limb_t)t;
+            c = (limb_t)(t >> LIMB_BITS);
+        }
+        r[i + nb] = c;
+    }
+}
+
+// r = a if fFlag (0 or 1), without a branch                                    r = a если fFlag (0 или 1), без ветвления
+void MoveLimbs(limb_t *r, const limb_t *a, int n, limb_t fFlag)
+{
+    limb_t nMask = (limb_t)0 - fFlag;
+    for (int i = 0; i < n; i++)
+        r[i] = (r[i] & ~nMask) | (a[i] & nMask);
+}
+
+limb_t IsZeroLimbs(const limb_t *a, int n)
+{
+    limb_t z = 0;
+    for (int i = 0; i < n; i++)
+        z |= a[i];
+    return (limb_t)1 ^ ((z | ((limb_t)0 - z)) >> (LIMB_BITS - 1));
+}
+
+unsigned int GetBits(const limb_t *a, int nOffset, int nCount)
+{
+    unsigned int n = 0;
+    for (int i = 0; i < nCount; i++)
+        if (nOffset + i < 256)
+            n |= (unsigned int)((a[(nOffset + i) / LIMB_BITS] >> ((nOffset + i) % LIMB_BITS)) & 1) << i;
+    return n;
+}
+
+void LimbsFromBytes(limb_t *r, const unsigned char *p32)
+{
+    for (int i = 0; i < LIMBS; i++)
+        r[i] = 0;
+    for (int k = 0; k < 32; k++)
+        r[k / LIMB_BYTES] |= (limb_t)p32[31 - k] << (8 * (k % LIMB_BYTES));
+}
+
+void LimbsToBytes(unsigned char *p32, const limb_t *a)
+{
+    for (int k = 0; k < 32; k++)
+        p32[31 - k] = (unsigned char)(a[k / LIMB_BYTES] >> (8 * (k % LIMB_BYTES)));
+}
+
+void LimbsFromUint256(limb_t *r, const uint256 &n)
+{
+    for (int i = 0; i < LIMBS; i++)
+        r[i] = 0;
+    for (int k = 0; k < 32; k++)
+        r[k / LIMB_BYTES] |= (limb_t)n.begin()[k] << (8 * (k % LIMB_BYTES));
+}
+
+// A modulus m = 2^256 - c with c small, so 2^256 folds into c                  Модуль m = 2^256 - c с малым c, так что 2^256 сворачивается в c
+struct CModulus
+{
+    limb_t m[LIMBS];
+    limb_t c[LIMBS];
+    int nc;
+    int nRounds;
+
+    void Set(const uint256 &hashModulus)
+    {
+        LimbsFromUint256(m, hashModulus);
+        limb_t zero[LIMBS] = {0};
+        SubLimbs(c, zero, m, LIMBS);
+        nc = LIMBS;
+        while (nc > 1 && c[nc - 1] == 0)
+            nc--;
+        // each fold leaves about as many bits above 2^256 as c has more than   каждая свёртка оставляет над 2^256 примерно на столько битов больше,
+        // 256 - (bits above 2^256); the last one takes the final carry         сколько у c сверх 256 - (биты над 2^256); последняя забирает перенос
+        int nBitsC = 256;
+        while (nBitsC > 0 && !GetBits(c, nBitsC - 1, 1))
+            nBitsC--;
+        nRounds = 1;
+        for (int nExcess = 256; nExcess + nBitsC >= 255; nExcess += nBitsC + 1 - 256)
+            nRounds++;
+        nRounds++;
+    }
+
+    // r = t mod m, t of nt limbs                                               r = t mod m, t из nt слов
+    void Reduce(limb_t *r, const limb_t *t, int nt) const
+    {
+        limb_t u[MAX_LIMBS], v[MAX_LIMBS];
+        int nu = nt;
+        memcpy(u, t, nt * sizeof(limb_t));
+        for (int nRound = 0; nRound < nRounds; nRound++)
+        {
+            int nh = nu - LIMBS;
+            int nv = std::max(nh + nc, LIMBS) + 1;
+            memset(v, 0, nv * sizeof(limb_t));
+            memcpy(v, u, LIMBS * sizeof(limb_t));
+            for (int i = 0; i < nh; i++)
+            {
+                limb_t carry = 0;
+                int j = 0;
+                for (; j < nc; j++)
+                {
+                    dlimb_t x = (dlimb_t)u[LIMBS + i] * c[j] + v[i + j] + carry;
+                    v[i + j] = (limb_t)x;
+                    carry = (limb_t)(x >> LIMB_BITS);
+                }
+                for (; i + j < nv; j++)
+                {
+                    dlimb_t x = (dlimb_t)v[i + j] + carry;
+                    v[i + j] = (limb_t)x;
+                    carry = (limb_t)(x >> LIMB_BITS);
+                }
+            }
+            memcpy(u, v, nv * sizeof(limb_t));
+            nu = nv;
+        }
+        // below 2^256 now, which is less than 2m                               теперь меньше 2^256, что меньше 2m
+        limb_t s[LIMBS];
+        limb_t nBorrow = SubLimbs(s, u, m, LIMBS);
+        MoveLimbs(u, s, LIMBS, 1 - nBorrow);
+        memcpy(r, u, LIMBS * sizeof(limb_t));
+    }
+
+    void Add(limb_t *r, const limb_t *a, const limb_t *b) const
+    {
+        limb_t t[LIMBS], s[LIMBS];
+        limb_t nCarry = AddLimbs(t, a, b, LIMBS);
+        limb_t nBorrow = SubLimbs(s, t, m, LIMBS);
+        MoveLimbs(t, s, LIMBS, nCarry | (1 - nBorrow));
+        memcpy(r, t, sizeof(t));
+    }
+
+    void Sub(limb_t *r, const limb_t *a, const limb_t *b) const
+    {
+        limb_t t[LIMBS], s[LIMBS];
+        limb_t nBorrow = SubLimbs(t, a, b, LIMBS);
+        AddLimbs(s, t, m, LIMBS);
+        MoveLimbs(t, s, LIMBS, nBorrow);
+        memcpy(r, t, sizeof(t));
+    }
+
+    void Mul(limb_t *r, const limb_t *a, const limb_t *b) const
+    {
+        limb_t t[2 * LIMBS];
+        MulLimbs(t, a, LIMBS, b, LIMBS);
+        Reduce(r, t, 2 * LIMBS);
+    }
+
+    void MulInt(limb_t *r, const limb_t *a, limb_t n) const
+    {
+        limb_t t[LIMBS + 1];
+        MulLimbs(t, a, LIMBS, &n, 1);
+        Reduce(r, t, LIMBS + 1);
+    }
+
+    // Set from 32 bytes, returns whether the number was m or more (and reduced) Установить из 32 байт, возвращает было ли число не меньше m (и приведено)
+    bool SetBytes(limb_t *r, const unsigned char *p32) const
+    {
+        limb_t t[LIMBS], s[LIMBS];
+        LimbsFromBytes(t, p32);
+        limb_t nBorrow = SubLimbs(s, t, m, LIMBS);
+        MoveLimbs(t, s, LIMBS, 1 - nBorrow);
+        memcpy(r, t, sizeof(t));
+        return nBorrow == 0;
+    }
+};
+
+CModulus modP;                          // field: p = 2^256 - 2^32 - 977         поле: p = 2^256 - 2^32 - 977
+CModulus modN;                          // scalars: group order n                скаляры: порядок группы n
+
+// p = 2^256 - C with C of 33 bits, so folding what is above 2^256 takes       p = 2^256 - C с C из 33 бит, так что свёртка того, что выше 2^256,
+// one or two multiplications per limb                                          занимает одно-два умножения на слово
+#if defined(__SIZEOF_INT128__)
+const int FIELD_NC = 1;
+const limb_t FIELD_C[FIELD_NC] = {0x1000003D1ULL};
+#else
+const int FIELD_NC = 2;
+const limb_t FIELD_C[FIELD_NC] = {0x3D1, 1};
+#endif
+
+// r = v + top 2^256 mod p, top of FIELD_NC limbs and below 2^64               r = v + top 2^256 mod p, top из FIELD_NC слов и меньше 2^64
+inline void FieldFold(limb_t *r, const limb_t *v, const limb_t *top)
+{
+    // column sums stay within two limbs for a C this small                     суммы по столбцам умещаются в два слова при столь малом C
+    limb_t w[LIMBS], s[LIMBS];
+    limb_t carry = 0;
+    for (int k = 0; k < LIMBS; k++)
+    {
+        dlimb_t x = (dlimb_t)v[k] + carry;
+        for (int j = 0; j < FIELD_NC; j++)
+            if (k - j >= 0 && k - j < FIELD_NC)
+                x += (dlimb_t)top[k - j] * FIELD_C[j];
+        w[k] = (limb_t)x;
+        carry = (limb_t)(x >> LIMB_BITS);
+    }
+    // after a carry w is small, so adding C once more cannot carry again       после переноса w мало, так что ещё одно добавление C не даст переноса
+    limb_t nTop = carry;
+    carry = 0;
+    for (int k = 0; k < LIMBS; k++)
+    {
+        dlimb_t x = (dlimb_t)w[k] + carry;
+        if (k < FIELD_NC)
+            x += (dlimb_t)nTop * FIELD_C[k];
+        w[k] = (limb_t)x;
+        carry = (limb_t)(x >> LIMB_BITS);
+    }
+    limb_t nBorrow = SubLimbs(s, w, modP.m, LIMBS);
+    MoveLimbs(w, s, LIMBS, 1 - nBorrow);
+    memcpy(r, w, LIMBS * sizeof(limb_t));
+}
+
+inline void FieldReduceWide(limb_t *r, const limb_t *t)
+{
+    limb_t v[LIMBS + FIELD_NC];
+    limb_t carry = 0;
+    for (int k = 0; k < LIMBS + FIELD_NC; k++)
+    {
+        dlimb_t x = (dlimb_t)(k < LIMBS ? t[k] : 0) + carry;
+        for (int j = 0; j < FIELD_NC; j++)
+            if (k - j >= 0 && k - j < LIMBS)
+                x += (dlimb_t)t[LIMBS + k - j] * FIELD_C[j];
+        v[k] = (limb_t)x;
+        carry = (limb_t)(x >> LIMB_BITS);
+    }
+    FieldFold(r, v, v + LIMBS);
+}
+
+inline void FieldMulLimbs(limb_t *r, const limb_t *a, const limb_t *b)
+{
+    limb_t t[2 * LIMBS];
+    MulLimbs(t, a, LIMBS, b, LIMBS);
+    FieldReduceWide(r, t);
+}
+
+inline void FieldSqrLimbs(limb_t *r, const limb_t *a)
+{
+    // the products a[i] a[j], i < j, twice, then the squares                   произведения a[i] a[j], i < j, дважды, затем квадраты
+    limb_t t[2 * LIMBS] = {0};
+    for (int i = 0; i < LIMBS; i++)
+    {
+        limb_t carry = 0;
+        for (int j = i + 1; j < LIMBS; j++)
+        {
+            dlimb_t x = (dlimb_t)a[i] * a[j] + t[i + j] + carry;
+            t[i + j] = (limb_t)x;
+            carry = (limb_t)(x >> LIMB_BITS);
+        }
+        t[i + LIMBS] = carry;
+    }
+    for (int i = 2 * LIMBS - 1; i > 0; i--)
+        t[i] = (t[i] << 1) | (t[i - 1] >> (LIMB_BITS - 1));
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++)
+    {
+        dlimb_t x = (dlimb_t)a[i] * a[i] + t[2 * i] + carry;
+        t[2 * i] = (limb_t)x;
+        x = (dlimb_t)t[2 * i + 1] + (limb_t)(x >> LIMB_BITS);
+        t[2 * i + 1] = (limb_t)x;
+        carry = (limb_t)(x >> LIMB_BITS);
+    }
+    FieldReduceWide(r, t);
+}
+
+inline void FieldMulIntLimbs(limb_t *r, const limb_t *a, limb_t n)
+{
+    limb_t v[LIMBS], top[FIELD_NC] = {0};
+    limb_t carry = 0;
+    for (int i = 0; i < LIMBS; i++)
+    {
+        dlimb_t x = (dlimb_t)a[i] * n + carry;
+        v[i] = (limb_t)x;
+        carry = (limb_t)(x >> LIMB_BITS);
+    }
+    top[0] = carry;
+    FieldFold(r, v, top);
+}
+
+inline void ScalarMulLimbs(limb_t *r, const limb_t *a, const limb_t *b) { modN.Mul(r, a, b); }
+
+// r = a^e for a public e, in the same steps for every a                       r = a^e для открытого e, одними и теми же шагами для любого a
+template<void (*Mul)(limb_t *, const limb_t *, const limb_t *)>
+void PowLimbs(limb_t *r, const limb_t *a, const limb_t *e)
+{
+    limb_t vTable[16][LIMBS];
+    memset(vTable[0], 0, sizeof(vTable[0]));
+    vTable[0][0] = 1;
+    for (int i = 1; i < 16; i++)
+        Mul(vTable[i], vTable[i - 1], a);
+    limb_t t[LIMBS];
+    memcpy(t, vTable[0], sizeof(t));
+    for (int i = 252; i >= 0; i -= 4)
+    {
+        for (int j = 0; j < 4; j++)
+            Mul(t, t, t);
+        Mul(t, t, vTable[GetBits(e, i, 4)]);
+    }
+    memcpy(r, t, sizeof(t));
+    OPENSSL_cleanse(vTable, sizeof(vTable));
+}
+
+// r = a^-1 = a^(m-2) (a != 0)                                                  r = a^-1 = a^(m-2) (a != 0)
+template<void (*Mul)(limb_t *, const limb_t *, const limb_t *)>
+void InvLimbs(limb_t *r, const limb_t *a, const CModulus &mod)
+{
+    limb_t e[LIMBS], two[LIMBS] = {2};
+    SubLimbs(e, mod.m, two, LIMBS);
+    PowLimbs<Mul>(r, a, e);
+}
+
+struct CFieldElem
+{
+    limb_t d[LIMBS];
+};
+
+struct CScalar
+{
+    limb_t d[LIMBS];
+};
+
+inline void FieldAdd(CFieldElem &r, const CFieldElem &a, const CFieldElem &b) { modP.Add(r.d, a.d, b.d); }
+inline void FieldSub(CFieldElem &r, const CFieldElem &a, const CFieldElem &b) { modP.Sub(r.d, a.d, b.d); }
+inline void FieldMul(CFieldElem &r, const CFieldElem &a, const CFieldElem &b) { FieldMulLimbs(r.d, a.d, b.d); }
+inline void FieldSqr(CFieldElem &r, const CFieldElem &a) { FieldSqrLimbs(r.d, a.d); }
+inline void FieldMulInt(CFieldElem &r, const CFieldElem &a, limb_t n) { FieldMulIntLimbs(r.d, a.d, n); }
+inline void FieldInv(CFieldElem &r, const CFieldElem &a) { InvLimbs<FieldMulLimbs>(r.d, a.d, modP); }
+inline bool FieldIsZero(const CFieldElem &a) { return IsZeroLimbs(a.d, LIMBS); }
+inline bool FieldIsOdd(const CFieldElem &a) { return a.d[0] & 1; }
+inline bool FieldEqual(const CFieldElem &a, const CFieldElem &b) { return memcmp(a.d, b.d, sizeof(a.d)) == 0; }
+
+inline void FieldSetInt(CFieldElem &r, limb_t n)
+{
+    memset(r.d, 0, sizeof(r.d));
+    r.d[0] = n;
+}
+
+inline void FieldNeg(CFieldElem &r, const CFieldElem &a)
+{
+    CFieldElem zero;
+    FieldSetInt(zero, 0);
+    FieldSub(r, zero, a);
+}
+
+// Field element from 32 bytes, false if not below p                            Элемент поля из 32 байт, false если не меньше p
+inline bool FieldSetBytes(CFieldElem &r, const unsigned char *p32) { return !modP.SetBytes(r.d, p32); }
+
+// r = sqrt(a) if a is a square: p = 3 mod 4, so a^((p+1)/4)                    r = sqrt(a) если a - квадрат: p = 3 mod 4, поэтому a^((p+1)/4)
+bool FieldSqrt(CFieldElem &r, const CFieldElem &a);
+
+inline void ScalarAdd(CScalar &r, const CScalar &a, const CScalar &b) { modN.Add(r.d, a.d, b.d); }
+inline void ScalarMul(CScalar &r, const CScalar &a, const CScalar &b) { modN.Mul(r.d, a.d, b.d); }
+inline void ScalarInv(CScalar &r, const CScalar &a) { InvLimbs<ScalarMulLimbs>(r.d, a.d, modN); }
+inline bool ScalarIsZero(const CScalar &a) { return IsZeroLimbs(a.d, LIMBS); }
+inline bool ScalarSetBytes(CScalar &r, const unsigned char *p32) { return modN.SetBytes(r.d, p32); }
+
+inline void ScalarNeg(CScalar &r, const CScalar &a)
+{
+    limb_t zero[LIMBS] = {0};
+    modN.Sub(r.d, zero, a.d);
+}
+
+// x / 2 mod n                                                                  x / 2 mod n
+void ScalarHalf(limb_t *x)
+{
+    limb_t t[LIMBS];
+    limb_t nCarry = 0;
+    if (x[0] & 1)
+        nCarry = AddLimbs(x, x, modN.m, LIMBS);
+    memcpy(t, x, sizeof(t));
+    for (int i = 0; i < LIMBS; i++)
+        x[i] = (t[i] >> 1) | (i + 1 < LIMBS ? t[i + 1] << (LIMB_BITS - 1) : nCarry << (LIMB_BITS - 1));
+}
+
+// r = a^-1 (a != 0) by the binary extended Euclid, for public a only:          r = a^-1 (a != 0) бинарным расширенным Евклидом, только для открытых a:
+// its running time depends on a, but it is far faster than a power            время работы зависит от a, но это гораздо быстрее возведения в степень
+void ScalarInvVar(CScalar &r, const CScalar &a)
+{
+    // x1 a = u, x2 a = v (mod n)
+    limb_t u[LIMBS], v[LIMBS], x1[LIMBS] = {1}, x2[LIMBS] = {0}, one[LIMBS] = {1};
+    memcpy(u, a.d, sizeof(u));
+    memcpy(v, modN.m, sizeof(v));
+    while (memcmp(u, one, sizeof(u)) != 0 && memcmp(v, one, sizeof(v)) != 0)
+    {
+        while (!(u[0] & 1))
+        {
+            for (int i = 0; i < LIMBS; i++)
+                u[i] = (u[i] >> 1) | (i + 1 < LIMBS ? u[i + 1] << (LIMB_BITS - 1) : 0);
+            ScalarHalf(x1);
+        }
+        while (!(v[0] & 1))
+        {
+            for (int i = 0; i < LIMBS; i++)
+                v[i] = (v[i] >> 1) | (i + 1 < LIMBS ? v[i + 1] << (LIMB_BITS - 1) : 0);
+            ScalarHalf(x2);
+        }
+        limb_t t[LIMBS];
+        if (!SubLimbs(t, u, v, LIMBS))
+        {
+            memcpy(u, t, sizeof(u));
+            modN.Sub(x1, x1, x2);
+        }
+        else
+        {
+            SubLimbs(v, v, u, LIMBS);
+            modN.Sub(x2, x2, x1);
+        }
+    }
+    memcpy(r.d, memcmp(u, one, sizeof(u)) == 0 ? x1 : x2, sizeof(r.d));
+}
+
+// Affine point, never infinity                                                 Аффинная точка, никогда не бесконечность
+struct CGe
+{
+    CFieldElem x, y;
+};
+
+// Jacobian point (x = X/Z^2, y = Y/Z^3), public data only                      Точка в координатах Якоби (x = X/Z^2, y = Y/Z^3), только открытые данные
+struct CGej
+{
+    CFieldElem x, y, z;
+    bool fInfinity;
+};
+
+// Projective point (x = X/Z, y = Y/Z) for the complete formulas                Проективная точка (x = X/Z, y = Y/Z) для полных формул
+struct CGep
+{
+    CFieldElem x, y, z;
+};
+
+// Curve constants and precomputed multiples of G                               Константы кривой и заранее вычисленные кратные G
+struct CCurve
+{
+    CGe G;
+    CFieldElem feBeta;                  // beta^3 = 1 mod p: lambda (x,y) = (beta x,y)  beta^3 = 1 mod p: lambda (x,y) = (beta x,y)
+    CFieldElem feExpSqrt;               // (p+1)/4
+    CFieldElem feNMinusP;               // p - n: r + n is a valid x below it    p - n: r + n - допустимый x ниже него
+    CScalar scLambda, scMinusLambda;
+    CScalar scMinusB1, scMinusB2;       // lattice basis of the split            базис решётки для разложения
+    CScalar scG1, scG2;                 // round(2^384 b2 / n), round(-2^384 b1 / n)
+    CGe vPreG[1 << (WINDOW_G - 2)];     // G, 3G, 5G, ...
+    CGe vPreGLambda[1 << (WINDOW_G - 2)];
+    CGe vGen[64][16];                   // j 16^i G, for the secrets             j 16^i G, для секретов
+
+    CCurve();
+};
+
+CCurve curve;
+
+bool FieldSqrt(CFieldElem &r, const CFieldElem &a)
+{
+    CFieldElem t, t2;
+    PowLimbs<FieldMulLimbs>(t.d, a.d, curve.feExpSqrt.d);
+    FieldSqr(t2, t);
+    r = t;
+    return FieldEqual(t2, a);
+}
+
+// y^2 = x^3 + 7
+void CurveRhs(CFieldElem &r, const CFieldElem &x)
+{
+    CFieldElem t, seven;
+    FieldSqr(t, x);
+    FieldMul(t, t, x);
+    FieldSetInt(seven, 7);
+    FieldAdd(r, t, seven);
+}
+
+// Point with the given x and parity of y                                       Точка с данным x и чётностью y
+bool GeSetX(CGe &r, const CFieldElem &x, bool fOdd)
+{
+    CFieldElem y2;
+    CurveRhs(y2, x);
+    if (!FieldSqrt(r.y, y2))
+        return false;
+    r.x = x;
+    if (FieldIsOdd(r.y) != fOdd)
+        FieldNeg(r.y, r.y);
+    return true;
+}
+
+void GejSetGe(CGej &r, const CGe &a)
+{
+    r.x = a.x;
+    r.y = a.y;
+    FieldSetInt(r.z, 1);
+    r.fInfinity = false;
+}
+
+void GeSetGej(CGe &r, const CGej &a)
+{
+    CFieldElem zi, zi2, zi3;
+    FieldInv(zi, a.z);
+    FieldSqr(zi2, zi);
+    FieldMul(zi3, zi2, zi);
+    FieldMul(r.x, a.x, zi2);
+    FieldMul(r.y, a.y, zi3);
+}
+
+// Affine forms of n points at once, with one inversion                         Аффинные формы n точек сразу, одним обращением
+void GeSetGejAll(CGe *r, const CGej *a, int n)
+{
+    std::vector<CFieldElem> vProd(n);
+    vProd[0] = a[0].z;
+    for (int i = 1; i < n; i++)
+        FieldMul(vProd[i], vProd[i - 1], a[i].z);
+    CFieldElem inv;
+    FieldInv(inv, vProd[n - 1]);
+    for (int i = n - 1; i >= 0; i--)
+    {
+        CFieldElem zi, zi2, zi3;
+        if (i > 0)
+        {
+            FieldMul(zi, inv, vProd[i - 1]);
+            FieldMul(inv, inv, a[i].z);
+        }
+        else
+            zi = inv;
+        FieldSqr(zi2, zi);
+        FieldMul(zi3, zi2, zi);
+        FieldMul(r[i].x, a[i].x, zi2);
+        FieldMul(r[i].y, a[i].y, zi3);
+    }
+}
+
+void GejDouble(CGej &r, const CGej &a)
+{
+    if (a.fInfinity)
+    {
+        r = a;
+        return;
+    }
+    // dbl-2009-l
+    CFieldElem A, B, C, D, E, F, t, X3, Y3, Z3;
+    FieldSqr(A, a.x);
+    FieldSqr(B, a.y);
+    FieldSqr(C, B);
+    FieldAdd(t, a.x, B);
+    FieldSqr(t, t);
+    FieldSub(t, t, A);
+    FieldSub(t, t, C);
+    FieldAdd(D, t, t);
+    FieldMulInt(E, A, 3);
+    FieldSqr(F, E);
+    FieldMul(Z3, a.y, a.z);
+    FieldAdd(Z3, Z3, Z3);
+    FieldSub(X3, F, D);
+    FieldSub(X3, X3, D);
+    FieldSub(t, D, X3);
+    FieldMul(Y3, E, t);
+    FieldMulInt(t, C, 8);
+    FieldSub(Y3, Y3, t);
+    r.x = X3;
+    r.y = Y3;
+    r.z = Z3;
+    r.fInfinity = false;
+}
+
+void GejAdd(CGej &r, const CGej &a, const CGej &b)
+{
+    if (a.fInfinity)
+    {
+        r = b;
+        return;
+    }
+    if (b.fInfinity)
+    {
+        r = a;
+        return;
+    }
+    CFieldElem z1z1, z2z2, u1, u2, s1, s2, h, rr;
+    FieldSqr(z1z1, a.z);
+    FieldSqr(z2z2, b.z);
+    FieldMul(u1, a.x, z2z2);
+    FieldMul(u2, b.x, z1z1);
+    FieldMul(s1, a.y, z2z2);
+    FieldMul(s1, s1, b.z);
+    FieldMul(s2, b.y, z1z1);
+    FieldMul(s2, s2, a.z);
+    FieldSub(h, u2, u1);
+    FieldSub(rr, s2, s1);
+    if (FieldIsZero(h))
+    {
+        if (FieldIsZero(rr))
+            GejDouble(r, a);
+        else
+            r.fInfinity = true;
+        return;
+    }
+    CFieldElem h2, h3, u1h2, t, X3, Y3, Z3;
+    FieldSqr(h2, h);
+    FieldMul(h3, h2, h);
+    FieldMul(u1h2, u1, h2);
+    FieldSqr(X3, rr);
+    FieldSub(X3, X3, h3);
+    FieldSub(X3, X3, u1h2);
+    FieldSub(X3, X3, u1h2);
+    FieldSub(t, u1h2, X3);
+    FieldMul(Y3, rr, t);
+    FieldMul(t, s1, h3);
+    FieldSub(Y3, Y3, t);
+    FieldMul(Z3, a.z, b.z);
+    FieldMul(Z3, Z3, h);
+    r.x = X3;
+    r.y = Y3;
+    r.z = Z3;
+    r.fInfinity = false;
+}
+
+void GejAddGe(CGej &r, const CGej &a, const CGe &b)
+{
+    if (a.fInfinity)
+    {
+        GejSetGe(r, b);
+        return;
+    }
+    CFieldElem z1z1, u2, s2, h, rr;
+    FieldSqr(z1z1, a.z);
+    FieldMul(u2, b.x, z1z1);
+    FieldMul(s2, b.y, z1z1);
+    FieldMul(s2, s2, a.z);
+    FieldSub(h, u2, a.x);
+    FieldSub(rr, s2, a.y);
+    if (FieldIsZero(h))
+    {
+        if (FieldIsZero(rr))
+            GejDouble(r, a);
+        else
+            r.fInfinity = true;
+        return;
+    }
+    CFieldElem h2, h3, u1h2, t, X3, Y3, Z3;
+    FieldSqr(h2, h);
+    FieldMul(h3, h2, h);
+    FieldMul(u1h2, a.x, h2);
+    FieldSqr(X3, rr);
+    FieldSub(X3, X3, h3);
+    FieldSub(X3, X3, u1h2);
+    FieldSub(X3, X3, u1h2);
+    FieldSub(t, u1h2, X3);
+    FieldMul(Y3, rr, t);
+    FieldMul(t, a.y, h3);
+    FieldSub(Y3, Y3, t);
+    FieldMul(Z3, a.z, h);
+    r.x = X3;
+    r.y = Y3;
+    r.z = Z3;
+    r.fInfinity = false;
+}
+
+// Complete mixed addition for a = 0 (Renes, Costello, Batina 2015, alg. 8):    Полное смешанное сложение для a = 0 (Renes, Costello, Batina 2015, алг. 8):
+// right for every a, including the point at infinity, with no branches        верно для любого a, включая бесконечно удалённую точку, без ветвлений
+void GepAddGe(CGep &r, const CGep &a, const CGe &b)
+{
+    CFieldElem t0, t1, t2, t3, t4, X3, Y3, Z3;
+    FieldMul(t0, a.x, b.x);
+    FieldMul(t1, a.y, b.y);
+    FieldAdd(t3, b.x, b.y);
+    FieldAdd(t4, a.x, a.y);
+    FieldMul(t3, t3, t4);
+    FieldAdd(t4, t0, t1);
+    FieldSub(t3, t3, t4);
+    FieldMul(t4, b.y, a.z);
+    FieldAdd(t4, t4, a.y);
+    FieldMul(Y3, b.x, a.z);
+    FieldAdd(Y3, Y3, a.x);
+    FieldAdd(X3, t0, t0);
+    FieldAdd(t0, X3, t0);
+    FieldMulInt(t2, a.z, 21);
+    FieldAdd(Z3, t1, t2);
+    FieldSub(t1, t1, t2);
+    FieldMulInt(Y3, Y3, 21);
+    FieldMul(X3, t4, Y3);
+    FieldMul(t2, t3, t1);
+    FieldSub(X3, t2, X3);
+    FieldMul(Y3, Y3, t0);
+    FieldMul(t1, t1, Z3);
+    FieldAdd(Y3, t1, Y3);
+    FieldMul(t0, t0, t3);
+    FieldMul(Z3, Z3, t4);
+    FieldAdd(Z3, Z3, t0);
+    r.x = X3;
+    r.y = Y3;
+    r.z = Z3;
+}
+
+// k G for a secret k: one complete addition per 4 bits, the table entry       k G для секретного k: одно полное сложение на 4 бита, элемент таблицы
+// picked by scanning all of them                                               выбирается просмотром всех
+void EcmultGen(CGe &r, const CScalar &k)
+{
+    CGep R;
+    FieldSetInt(R.x, 0);
+    FieldSetInt(R.y, 1);
+    FieldSetInt(R.z, 0);
+    for (int i = 0; i < 64; i++)
+    {
+        unsigned int nDigit = GetBits(k.d, 4 * i, 4);
+        CGe P = curve.vGen[i][1];
+        for (unsigned int j = 2; j < 16; j++)
+        {
+            limb_t fEqual = (limb_t)(((j ^ nDigit) - 1) >> 31);
+            MoveLimbs(P.x.d, curve.vGen[i][j].x.d, LIMBS, fEqual);
+            MoveLimbs(P.y.d, curve.vGen[i][j].y.d, LIMBS, fEqual);
+        }
+        CGep T;
+        GepAddGe(T, R, P);
+        limb_t fNonZero = 1 - (limb_t)((nDigit - 1) >> 31);
+        MoveLimbs(R.x.d, T.x.d, LIMBS, fNonZero);
+        MoveLimbs(R.y.d, T.y.d, LIMBS, fNonZero);
+        MoveLimbs(R.z.d, T.z.d, LIMBS, fNonZero);
+    }
+    CFieldElem zi;
+    FieldInv(zi, R.z);
+    FieldMul(r.x, R.x, zi);
+    FieldMul(r.y, R.y, zi);
+    OPENSSL_cleanse(&R, sizeof(R));
+}
+
+// k = k1 + k2 lambda (mod n), with k1 and k2 of about 128 bits either sign     k = k1 + k2 lambda (mod n), где k1 и k2 около 128 бит любого знака
+void ScalarSplitLambda(CScalar &k1, CScalar &k2, const CScalar &k)
+{
+    CScalar c1, c2;
+    const CScalar *vpg[2] = {&curve.scG1, &curve.scG2};
+    CScalar *vpc[2] = {&c1, &c2};
+    for (int n = 0; n < 2; n++)
+    {
+        // c = round(k g / 2^384)
+        limb_t t[2 * LIMBS];
+        MulLimbs(t, k.d, LIMBS, vpg[n]->d, LIMBS);
+        limb_t round[LIMBS] = {0};
+        round[0] = (t[383 / LIMB_BITS] >> (383 % LIMB_BITS)) & 1;
+        limb_t hi[LIMBS] = {0};
+        for (int i = 384 / LIMB_BITS; i < 2 * LIMBS; i++)
+            hi[i - 384 / LIMB_BITS] = t[i];
+        AddLimbs(vpc[n]->d, hi, round, LIMBS);
+    }
+    ScalarMul(c1, c1, curve.scMinusB1);
+    ScalarMul(c2, c2, curve.scMinusB2);
+    ScalarAdd(k2, c1, c2);
+    CScalar t;
+    ScalarMul(t, k2, curve.scMinusLambda);
+    ScalarAdd(k1, t, k);
+}
+
+// Width-w NAF: odd digits below 2^(w-1) in magnitude, w-1 zeros after each;    NAF ширины w: нечётные цифры по модулю меньше 2^(w-1), после каждой w-1 нулей;
+// a scalar above n/2 is taken as negative. Returns the number of digits        скаляр больше n/2 считается отрицательным. Возвращает число цифр
+int ScalarWnaf(int *pnWnaf, const CScalar &a, int w)
+{
+    CScalar s = a;
+    int nSign = 1;
+    if (GetBits(s.d, 255, 1))
+    {
+        ScalarNeg(s, s);
+        nSign = -1;
+    }
+    memset(pnWnaf, 0, WNAF_BITS * sizeof(int));
+    int nLast = -1;
+    int nBit = 0;
+    int nCarry = 0;
+    while (nBit < WNAF_BITS)
+    {
+        if ((int)GetBits(s.d, nBit, 1) == nCarry)
+        {
+            nBit++;
+            continue;
+        }
+        int nNow = std::min(w, WNAF_BITS - nBit);
+        int nWord = (int)GetBits(s.d, nBit, nNow) + nCarry;
+        nCarry = (nWord >> (w - 1)) & 1;
+        nWord -= nCarry << w;
+        pnWnaf[nBit] = nSign * nWord;
+        nLast = nBit;
+        nBit += nNow;
+    }
+    return nLast + 1;
+}
+
+// r = na A + ng G for public scalars: both split by the endomorphism, four     r = na A + ng G для открытых скаляров: оба разложены эндоморфизмом, четыре
+// half-length NAFs share one chain of doublings (Strauss)                      NAF половинной длины делят одну цепочку удвоений (Штраус)
+void Ecmult(CGej &r, const CGe &A, const CScalar &na, const CScalar &ng)
+{
+    const int nPreA = 1 << (WINDOW_A - 2);
+    CGej vPreA[nPreA], vPreALambda[nPreA];
+    CGej A2;
+    GejSetGe(vPreA[0], A);
+    GejDouble(A2, vPreA[0]);
+    for (int i = 1; i < nPreA; i++)
+        GejAdd(vPreA[i], vPreA[i - 1], A2);
+    for (int i = 0; i < nPreA; i++)
+    {
+        vPreALambda[i] = vPreA[i];
+        FieldMul(vPreALambda[i].x, vPreA[i].x, curve.feBeta);
+    }
+
+    CScalar na1, na2, ng1, ng2;
+    ScalarSplitLambda(na1, na2, na);
+    ScalarSplitLambda(ng1, ng2, ng);
+    int vWnafA1[WNAF_BITS], vWnafA2[WNAF_BITS], vWnafG1[WNAF_BITS], vWnafG2[WNAF_BITS];
+    int nBits = ScalarWnaf(vWnafA1, na1, WINDOW_A);
+    nBits = std::max(nBits, ScalarWnaf(vWnafA2, na2, WINDOW_A));
+    nBits = std::max(nBits, ScalarWnaf(vWnafG1, ng1, WINDOW_G));
+    nBits = std::max(nBits, ScalarWnaf(vWnafG2, ng2, WINDOW_G));
+
+    r.fInfinity = true;
+    for (int i = nBits - 1; i >= 0; i--)
+    {
+        GejDouble(r, r);
+        int n;
+        if ((n = vWnafA1[i]) != 0)
+        {
+            CGej P = vPreA[(abs(n) - 1) / 2];
+            if (n < 0)
+                FieldNeg(P.y, P.y);
+            GejAdd(r, r, P);
+        }
+        if ((n = vWnafA2[i]) != 0)
+        {
+            CGej P = vPreALambda[(abs(n) - 1) / 2];
+            if (n < 0)
+                FieldNeg(P.y, P.y);
+            GejAdd(r, r, P);
+        }
+        if ((n = vWnafG1[i]) != 0)
+        {
+            CGe P = curve.vPreG[(abs(n) - 1) / 2];
+            if (n < 0)
+                FieldNeg(P.y, P.y);
+            GejAddGe(r, r, P);
+        }
+        if ((n = vWnafG2[i]) != 0)
+        {
+            CGe P = curve.vPreGLambda[(abs(n) - 1) / 2];
+            if (n < 0)
+                FieldNeg(P.y, P.y);
+            GejAddGe(r, r, P);
+        }
+    }
+}
+
+CCurve::CCurve()
+{
+    modP.Set(uint256("0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEFFFFFC2F"));
+    modN.Set(uint256("0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141"));
+
+    LimbsFromUint256(G.x.d, uint256("0x79BE667EF9DCBBAC55A06295CE870B07029BFCDB2DCE28D959F2815B16F81798"));
+    LimbsFromUint256(G.y.d, uint256("0x483ADA7726A3C4655DA4FBFC0E1108A8FD17B448A68554199C47D08FFB10D4B8"));
+    LimbsFromUint256(feBeta.d, uint256("0x7AE96A2B657C07106E64479EAC3434E99CF0497512F58995C1396C28719501EE"));
+    LimbsFromUint256(scLambda.d, uint256("0x5363AD4CC05C30E0A5261C028812645A122E22EA20816678DF02967C1B23BD72"));
+    LimbsFromUint256(scMinusB1.d, uint256("0x00000000000000000000000000000000E4437ED6010E88286F547FA90ABFE4C3"));
+    LimbsFromUint256(scMinusB2.d, uint256("0xFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFE8A280AC50774346DD765CDA83DB1562C"));
+    LimbsFromUint256(scG1.d, uint256("0x3086D221A7D46BCDE86C90E49284EB153DAA8A1471E8CA7FE893209A45DBB031"));
+    LimbsFromUint256(scG2.d, uint256("0xE4437ED6010E88286F547FA90ABFE4C4221208AC9DF506C61571B4AE8AC47F71"));
+    ScalarNeg(scMinusLambda, scLambda);
+
+    limb_t one[LIMBS] = {1};
+    AddLimbs(feExpSqrt.d, modP.m, one, LIMBS);
+    for (int i = 0; i < LIMBS; i++)
+        feExpSqrt.d[i] = (feExpSqrt.d[i] >> 2) | (i + 1 < LIMBS ? feExpSqrt.d[i + 1] << (LIMB_BITS - 2) : 0);
+    SubLimbs(feNMinusP.d, modP.m, modN.m, LIMBS);
+
+    // odd multiples of G and of lambda G                                       нечётные кратные G и lambda G
+    const int nPreG = 1 << (WINDOW_G - 2);
+    std::vector<CGej> vPre(nPreG);
+    CGej G2;
+    GejSetGe(vPre[0], G);
+    GejDouble(G2, vPre[0]);
+    for (int i = 1; i < nPreG; i++)
+        GejAdd(vPre[i], vPre[i - 1], G2);
+    GeSetGejAll(vPreG, &vPre[0], nPreG);
+    for (int i = 0; i < nPreG; i++)
+    {
+        FieldMul(vPreGLambda[i].x, vPreG[i].x, feBeta);
+        vPreGLambda[i].y = vPreG[i].y;
+    }
+
+    // j 16^i G; the unused j = 0 column holds 16^i G                           j 16^i G; неиспользуемый столбец j = 0 содержит 16^i G
+    std::vector<CGej> vGenj(64 * 16);
+    CGej base;
+    GejSetGe(base, G);
+    for (int i = 0; i < 64; i++)
+    {
+        vGenj[16 * i] = base;
+        vGenj[16 * i + 1] = base;
+        for (int j = 2; j < 16; j++)
+            GejAdd(vGenj[16 * i + j], vGenj[16 * i + j - 1], base);
+        for (int j = 0; j < 4; j++)
+            GejDouble(base, base);
+    }
+    GeSetGejAll(&vGen[0][0], &vGenj[0], 64 * 16);
+}
+
+bool ParsePubKey(CGe &r, const unsigned char *pch, unsigned int nSize)
+{
+    if (nSize == 33 && (pch[0] == 0x02 || pch[0] == 0x03))
+    {
+        CFieldElem x;
+        if (!FieldSetBytes(x, pch + 1))
+            return false;
+        return GeSetX(r, x, pch[0] == 0x03);
+    }
+    if (nSize == 65 && (pch[0] == 0x04 || pch[0] == 0x06 || pch[0] == 0x07))
+    {
+        if (!FieldSetBytes(r.x, pch + 1) || !FieldSetBytes(r.y, pch + 33))
+            return false;
+        // hybrid keys carry the parity of y in the first byte too              гибридные ключи несут чётность y ещё и в первом байте
+        if (pch[0] != 0x04 && FieldIsOdd(r.y) != (pch[0] == 0x07))
+            return false;
+        CFieldElem y2, rhs;
+        FieldSqr(y2, r.y);
+        CurveRhs(rhs, r.x);
+        return FieldEqual(y2, rhs);
+    }
+    return false;
+}
+
+void SerializePubKey(const CGe &a, bool fCompressed, unsigned char *pch, unsigned int &nSize)
+{
+    LimbsToBytes(pch + 1, a.x.d);
+    if (fCompressed)
+    {
+        pch[0] = FieldIsOdd(a.y) ? 0x03 : 0x02;
+        nSize = 33;
+    }
+    else
+    {
+        pch[0] = 0x04;
+        LimbsToBytes(pch + 33, a.y.d);
+        nSize = 65;
+    }
+}
+
+// r and s from 64 bytes, both in 1..n-1                                         r и s из 64 байт, оба в 1..n-1
+bool ParseRS(CScalar &r, CScalar &s, const unsigned char *p64)
+{
+    if (ScalarSetBytes(r, p64) || ScalarSetBytes(s, p64 + 32))
+        return false;
+    return !ScalarIsZero(r) && !ScalarIsZero(s);
+}
+
+void ScalarSetHash(CScalar &r, const uint256 &hash)
+{
+    ScalarSetBytes(r, hash.begin());
+}
+
+// BER identifier at pchSig[nPos]: class and constructed bits in nIdent, tag      Идентификатор BER в pchSig[nPos]: биты класса и составного типа в nIdent,
+// number in nTag. The high tag number form is base 128 in the following bytes,   номер тега в nTag. Старшая форма номера тега - по основанию 128 в следующих
+// leading zero digits allowed, as OpenSSL's ASN1_get_object reads it             байтах, ведущие нули допустимы, как читает ASN1_get_object OpenSSL
+bool ParseTag(const unsigned char *pchSig, unsigned int nEnd, unsigned int &nPos, unsigned int &nIdent, unsigned int &nTag)
+{
+    if (nPos >= nEnd)
+        return false;
+    nIdent = pchSig[nPos] & 0xe0;
+    nTag = pchSig[nPos++] & 0x1f;
+    if (nTag != 0x1f)
+        return true;
+    nTag = 0;
+    do {
+        if (nPos >= nEnd || nTag > (INT_MAX >> 7))
+            return false;
+        nTag = (nTag << 7) | (pchSig[nPos] & 0x7f);
+    } while (pchSig[nPos++] & 0x80);
+    return true;
+}
+
+// BER length at pchSig[nPos], short or long form, of contents that end by nEnd;  Длина BER в pchSig[nPos], короткая или длинная форма, содержимого до nEnd;
+// nLen = -1 for indefinite. As OpenSSL 1.0.2's asn1_get_length, no more length   nLen = -1 для неопределённой. Как asn1_get_length OpenSSL 1.0.2, не больше
+// bytes than a long holds, leading zeros counted                                 байт длины, чем вмещает long, ведущие нули считаются
+bool ParseLength(const unsigned char *pchSig, unsigned int nEnd, unsigned int &nPos, int &nLen)
+{
+    if (nPos >= nEnd)
+        return false;
+    unsigned int nLenByte = pchSig[nPos++];
+    if (nLenByte == 0x80)
+    {
+        nLen = -1;
+        return true;
+    }
+    unsigned long long nValue = nLenByte;
+    if (nLenByte & 0x80)
+    {
+        nLenByte -= 0x80;
+        if (nLenByte > sizeof(long) || nLenByte > nEnd - nPos)
+            return false;
+        nValue = 0;
+        while (nLenByte-- > 0)
+        {
+            nValue = (nValue << 8) | pchSig[nPos++];
+            if (nValue > nEnd - nPos)
+                return false;
+        }
+    }
+    if (nValue > nEnd - nPos)
+        return false;
+    nLen = (int)nValue;
+    return true;
+}
+
+// Point of a multiset element: the first SHA256(hash || counter) that is the     Точка элемента мультимножества: первый SHA256(hash || counter), который
+// x of a point, with even y                                                     является x точки, с чётным y
+void MultisetPoint(CGe &r, const uint256 &hash)
+{
+    unsigned char pchData[36], pchX[32];
+    memcpy(pchData, hash.begin(), 32);
+    for (unsigned int nCounter = 0; ; nCounter++)
+    {
+        for (int i = 0; i < 4; i++)
+            pchData[32 + i] = nCounter >> (8 * i);
+        SHA256(pchData, sizeof(pchData), pchX);
+        CFieldElem x;
+        if (FieldSetBytes(x, pchX) && GeSetX(r, x, false))
+            return;
+    }
+}
+
+}; // end of anonymous namespace                                                конец анонимному пространству имён
+
+namespace Secp256k1
+{
+
+void GetPubKey(const unsigned char *pchKey, bool fCompressed, unsigned char *pchPubKey, unsigned int &nSize)
+{
+    CScalar d;
+    ScalarSetBytes(d, pchKey);
+    CGe P;
+    EcmultGen(P, d);
+    SerializePubKey(P, fCompressed, pchPubKey, nSize);
+    OPENSSL_cleanse(&d, sizeof(d));
+}
+
+bool IsValidPubKey(const unsigned char *pchPubKey, unsigned int nSize)
+{
+    CGe P;
+    return ParsePubKey(P, pchPubKey, nSize);
+}
+
+bool Decompress(const unsigned char *pchPubKey, unsigned int nSize, unsigned char *pchOut)
+{
+    CGe P;
+    if (!ParsePubKey(P, pchPubKey, nSize))
+        return false;
+    unsigned int nSizeOut;
+    SerializePubKey(P, false, pchOut, nSizeOut);
+    return true;
+}
+
+bool ParseSignature(const unsigned char *pchSig, unsigned int nSize, unsigned char *p64)
+{
+    // As d2i_ECDSA_SIG of OpenSSL 1.0.2 and before decodes it, which validated   Как раскодирует d2i_ECDSA_SIG OpenSSL 1.0.2 и ранее, проверивший цепь;
+    // the chain; the consensus has no strict DER rule. High tag number forms,    в консенсусе нет правила строгого DER. Старшие формы номера тега, длины BER
+    // BER lengths and padded numbers are fine, whatever follows the SEQUENCE is  и дополненные числа допустимы, всё после SEQUENCE игнорируется, но
+    // ignored, but the SEQUENCE holds exactly two primitive INTEGERs. The bytes  SEQUENCE содержит ровно два простых INTEGER. Байты числа - его величина
+    // of a number are its magnitude (BN_bin2bn), the sign bit is not looked at.  (BN_bin2bn), на бит знака не смотрят.
+    unsigned int nPos = 0, nIdent, nTag;
+    int nSeqLen;
+    if (!ParseTag(pchSig, nSize, nPos, nIdent, nTag) || nIdent != 0x20 || nTag != 0x10 ||
+        !ParseLength(pchSig, nSize, nPos, nSeqLen))
+        return false;
+    // an indefinite SEQUENCE may run to the end                                 неопределённая SEQUENCE может идти до конца
+    unsigned int nSeqEnd = nSeqLen < 0 ? nSize : nPos + nSeqLen;
+    for (int i = 0; i < 2; i++)
+    {
+        int nIntLen;
+        if (!ParseTag(pchSig, nSeqEnd, nPos, nIdent, nTag) || nIdent != 0 || nTag != 0x02 ||
+            !ParseLength(pchSig, nSeqEnd, nPos, nIntLen) || nIntLen < 0)
+            return false;
+        const unsigned char *p = pchSig + nPos;
+        unsigned int nLen = nIntLen;
+        nPos += nLen;
+        while (nLen > 0 && p[0] == 0)
+        {
+            p++;
+            nLen--;
+        }
+        // 2^256 and above is beyond n                                          2^256 и больше - за пределами n
+        if (nLen > 32)
+            return false;
+        memset(p64 + 32 * i, 0, 32 - nLen);
+        memcpy(p64 + 32 * i + 32 - nLen, p, nLen);
+    }
+    // an indefinite SEQUENCE ends with end-of-contents                         неопределённая SEQUENCE заканчивается end-of-contents
+    if (nSeqLen < 0)
+        return nPos + 2 <= nSize && pchSig[nPos] == 0 && pchSig[nPos + 1] == 0;
+    return nPos == nSeqEnd;
+}
+
+void EncodeSignature(const unsigned char *p64, std::vector<unsigned char>& vchSig)
+{
+    vchSig.clear();
+    vchSig.push_back(0x30);
+    vchSig.push_back(0);
+    for (int i = 0; i < 2; i++)
+    {
+        const unsigned char *p = p64 + 32 * i;
+        unsigned int nLen = 32;
+        while (nLen > 1 && p[32 - nLen] == 0)
+            nLen--;
+        bool fPad = p[32 - nLen] & 0x80;
+        vchSig.push_back(0x02);
+        vchSig.push_back(nLen + fPad);
+        if (fPad)
+            vchSig.push_back(0);
+        vchSig.insert(vchSig.end(), p + 32 - nLen, p + 32);
+    }
+    vchSig[1] = vchSig.size() - 2;
+}
+
+bool Sign(const unsigned char *pchKey, const uint256 &hash, const unsigned char *pchNonce, unsigned char *p64, int &nRecId)
+{
+    CScalar d, k, e, r, s, t;
+    bool fOk = !ScalarSetBytes(d, pchKey) && !ScalarIsZero(d) &&
+               !ScalarSetBytes(k, pchNonce) && !ScalarIsZero(k);
+    if (fOk)
+    {
+        // R = k G, r = x(R) mod n, s = (e + r d) / k
+        CGe R;
+        EcmultGen(R, k);
+        unsigned char pchX[32];
+        LimbsToBytes(pchX, R.x.d);
+        bool fOverflow = ScalarSetBytes(r, pchX);
+        nRecId = (fOverflow ? 2 : 0) | (FieldIsOdd(R.y) ? 1 : 0);
+        ScalarSetHash(e, hash);
+        ScalarMul(t, r, d);
+        ScalarAdd(t, t, e);
+        ScalarInv(k, k);
+        ScalarMul(s, t, k);
+        fOk = !ScalarIsZero(r) && !ScalarIsZero(s);
+        LimbsToBytes(p64, r.d);
+        LimbsToBytes(p64 + 32, s.d);
+        OPENSSL_cleanse(&R, sizeof(R));
+    }
+    OPENSSL_cleanse(&d, sizeof(d));
+    OPENSSL_cleanse(&k, sizeof(k));
+    OPENSSL_cleanse(&t, sizeof(t));
+    return fOk;
+}
+
+bool Verify(const unsigned char *pchPubKey, unsigned int nPubKeySize, const uint256 &hash, const unsigned char *pchSig, unsigned int nSigSize)
+{
+    unsigned char p64[64];
+    CScalar r, s;
+    if (!ParseSignature(pchSig, nSigSize, p64) || !ParseRS(r, s, p64))
+        return false;
+    CGe Q;
+    if (!ParsePubKey(Q, pchPubKey, nPubKeySize))
+        return false;
+
+    // R = (e/s) G + (r/s) Q
+    CScalar e, sn, u1, u2;
+    ScalarSetHash(e, hash);
+    ScalarInvVar(sn, s);
+    ScalarMul(u1, e, sn);
+    ScalarMul(u2, r, sn);
+    CGej R;
+    Ecmult(R, Q, u2, u1);
+    if (R.fInfinity)
+        return false;
+
+    // x(R) mod n == r, compared without leaving Jacobian coordinates:          x(R) mod n == r, сравнение без выхода из координат Якоби:
+    // X == r Z^2, or (r + n) Z^2 when r + n is still below p                   X == r Z^2, или (r + n) Z^2 когда r + n всё ещё меньше p
+    CFieldElem xr, zz, t;
+    memcpy(xr.d, r.d, sizeof(xr.d));
+    FieldSqr(zz, R.z);
+    FieldMul(t, xr, zz);
+    if (FieldEqual(t, R.x))
+        return true;
+    limb_t u[LIMBS];
+    if (!SubLimbs(u, xr.d, curve.feNMinusP.d, LIMBS))
+        return false;
+    AddLimbs(xr.d, xr.d, modN.m, LIMBS);
+    FieldMul(t, xr, zz);
+    return FieldEqual(t, R.x);
+}
+
+bool Recover(const uint256 &hash, const unsigned char *p64, int nRecId, bool fCompressed, unsigned char *pchPubKey, unsigned int &nSize)
+{
+    CScalar r, s;
+    if (nRecId < 0 || nRecId > 3 || !ParseRS(r, s, p64))
+        return false;
+
+    // x(R) = r + j n, below p                                                  x(R) = r + j n, меньше p
+    CFieldElem x;
+    memcpy(x.d, r.d, sizeof(x.d));
+    if (nRecId & 2)
+    {
+        limb_t u[LIMBS];
+        if (!SubLimbs(u, x.d, curve.feNMinusP.d, LIMBS))
+            return false;
+        AddLimbs(x.d, x.d, modN.m, LIMBS);
+    }
+    CGe R;
+    if (!GeSetX(R, x, nRecId & 1))
+        return false;
+
+    // Q = (s R - e G) / r
+    CScalar e, rn, u1, u2;
+    ScalarSetHash(e, hash);
+    ScalarInvVar(rn, r);
+    ScalarMul(u1, e, rn);
+    ScalarNeg(u1, u1);
+    ScalarMul(u2, s, rn);
+    CGej Qj;
+    Ecmult(Qj, R, u2, u1);
+    if (Qj.fInfinity)
+        return false;
+    CGe Q;
+    GeSetGej(Q, Qj);
+    SerializePubKey(Q, fCompressed, pchPubKey, nSize);
+    return true;
+}
+
+bool MultisetUpdate(unsigned char *p64, const std::vector<uint256> &vAdd, const std::vector<uint256> &vRemove)
+{
+    static const unsigned char pchEmpty[64] = {0};
+    CGej sum;
+    sum.fInfinity = true;
+    if (memcmp(p64, pchEmpty, 64) != 0)
+    {
+        unsigned char pchPoint[65];
+        pchPoint[0] = 0x04;
+        memcpy(pchPoint + 1, p64, 64);
+        CGe A;
+        if (!ParsePubKey(A, pchPoint, sizeof(pchPoint)))
+            return false;
+        GejSetGe(sum, A);
+    }
+    CGe P;
+    for (unsigned int i = 0; i < vAdd.size(); i++)
+    {
+        MultisetPoint(P, vAdd[i]);
+        GejAddGe(sum, sum, P);
+    }
+    for (unsigned int i = 0; i < vRemove.size(); i++)
+    {
+        MultisetPoint(P, vRemove[i]);
+        FieldNeg(P.y, P.y);
+        GejAddGe(sum, sum, P);
+    }
+    if (sum.fInfinity)
+    {
+        memset(p64, 0, 64);
+        return true;
+    }
+    CGe A;
+    GeSetGej(A, sum);
+    LimbsToBytes(p64, A.x.d);
+    LimbsToBytes(p64 + 32, A.y.d);
+    return true;
+}
+
+}
@@ -0,0 +1,52 @@
+// Copyright (c) 2009-2013 The Bitcoin developers
+// Distributed under the MIT/X11 software license, see the accompanying
+// file COPYING or http://www.opensource.org/licenses/mit-license.php.
+#ifndef BITCOIN_SECP256K1_H
+#define BITCOIN_SECP256K1_H
+
+#include <vector>
+
+#include "uint256.h"
+
+/** ECDSA over secp256k1 without OpenSSL's generic EC code.                     ECDSA на secp256k1 без общего EC-кода OpenSSL.
+ * Secrets are 32-byte big-endian numbers, public keys are SEC1 points and      Секреты - 32-байтные числа big-endian, публичные ключи - точки SEC1,
+ * signatures DER, as OpenSSL has them. r and s travel as 64 bytes r || s.      подписи - DER, как у OpenSSL. r и s передаются как 64 байта r || s.
+ * Work on secrets takes the same time whatever their value; verification       Работа с секретами не зависит по времени от их значения; проверка
+ * and key recovery only see public data and take the fast paths.               и восстановление ключа видят только открытые данные и идут быстрым путём.
+ */
+namespace Secp256k1
+{
+    // Serialized public key of a valid secret, 33 or 65 bytes                   Сериализованный публичный ключ верного секрета, 33 или 65 байт
+    void GetPubKey(const unsigned char *pchKey, bool fCompressed, unsigned char *pchPubKey, unsigned int &nSize);
+
+    // Whether OpenSSL's o2i_ECPublicKey would accept the public key             Принял бы o2i_ECPublicKey из OpenSSL этот публичный ключ
+    bool IsValidPubKey(const unsigned char *pchPubKey, unsigned int nSize);
+
+    // Uncompressed form (65 bytes) of a valid public key                        Несжатая форма (65 байт) верного публичного ключа
+    bool Decompress(const unsigned char *pchPubKey, unsigned int nSize, unsigned char *pchOut);
+
+    // r and s of a signature as OpenSSL's ECDSA_verify decoded it before         r и s подписи, как её раскодировал ECDSA_verify из OpenSSL до
+    // 1.0.0p/1.0.1k: BER, data after it ignored                                  1.0.0p/1.0.1k: BER, данные после неё игнорируются
+    bool ParseSignature(const unsigned char *pchSig, unsigned int nSize, unsigned char *p64);
+
+    // DER encoding of r and s                                                   DER-кодирование r и s
+    void EncodeSignature(const unsigned char *p64, std::vector<unsigned char>& vchSig);
+
+    // Sign with a secret and a one-time nonce, false if the nonce is unusable   Подписать секретом и одноразовым числом, false если число не годится
+    // nRecId: which of the four candidate keys Recover has to pick              nRecId: какой из четырёх ключей-кандидатов выбрать Recover
+    bool Sign(const unsigned char *pchKey, const uint256 &hash, const unsigned char *pchNonce, unsigned char *p64, int &nRecId);
+
+    // Check a DER signature of hash against a serialized public key             Проверить DER-подпись hash по сериализованному публичному ключу
+    bool Verify(const unsigned char *pchPubKey, unsigned int nPubKeySize, const uint256 &hash, const unsigned char *pchSig, unsigned int nSigSize);
+
+    // Public key that produced the signature r || s of hash (SEC1 4.1.6)         Публичный ключ, давший подпись r || s для hash (SEC1 4.1.6)
+    bool Recover(const uint256 &hash, const unsigned char *p64, int nRecId, bool fCompressed, unsigned char *pchPubKey, unsigned int &nSize);
+
+    // Multiset hash (ECMH): every element maps to a curve point and a set is      Хеш мультимножества (ECMH): каждый элемент отображается в точку кривой,
+    // the sum of its points, so elements come and go in any order. Unlike a       а множество - сумма его точек, поэтому элементы приходят и уходят в любом
+    // sum of hashes, two sets with the same sum are as hard to find as a          порядке. В отличие от суммы хешей, два множества с одной суммой найти
+    // discrete logarithm. p64 holds x || y of the sum, zeros for the empty set.    так же трудно, как дискретный логарифм. p64 - x || y суммы, нули для пустого.
+    bool MultisetUpdate(unsigned char *p64, const std::vector<uint256> &vAdd, const std::vector<uint256> &vRemove);
+}
+
+#endif
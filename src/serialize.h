@@ -1236,6 +1236,59 @@ public:
     }
 };
 
+/** Read-only stream over a span of memory (e.g. a mapped block file), which        Поток только для чтения поверх участка памяти (например, отображённого файла блоков),
+ *  deserializes in place, without copying the data into a buffer first.             который десериализует на месте, без предварительного копирования данных в буфер.
+ *  The memory must outlive the stream.                                               Память должна жить дольше потока.
+ */
+class CMemoryReader
+{
+private:
+    const char* pbegin;
+    const char* pend;
+    const char* pcur;
+
+public:
+    int nType;
+    int nVersion;
+
+    CMemoryReader(const char* pbeginIn, const char* pendIn, int nTypeIn, int nVersionIn) :
+        pbegin(pbeginIn), pend(pendIn), pcur(pbeginIn), nType(nTypeIn), nVersion(nVersionIn) {}
+
+    void SetType(int n)          { nType = n; }
+    int GetType()                { return nType; }
+    void SetVersion(int n)       { nVersion = n; }
+    int GetVersion()             { return nVersion; }
+
+    size_t size() const          { return pend - pcur; }
+    bool empty() const           { return pcur == pend; }
+    size_t GetPos() const        { return pcur - pbegin; }
+
+    CMemoryReader& read(char* pch, size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pcur))
+            throw std::ios_base::failure("CMemoryReader::read : end of data");
+        memcpy(pch, pcur, nSize);
+        pcur += nSize;
+        return (*this);
+    }
+
+    CMemoryReader& ignore(size_t nSize)
+    {
+        if (nSize > (size_t)(pend - pcur))
+            throw std::ios_base::failure("CMemoryReader::ignore : end of data");
+        pcur += nSize;
+        return (*this);
+    }
+
+    template<typename T>
+    CMemoryReader& operator>>(T& obj)
+    {
+        // Unserialize from this stream                                             ансериализовать из этого потока
+        ::Unserialize(*this, obj, nType, nVersion);
+        return (*this);
+    }
+};
+
 /** Wrapper around a FILE* that implements a ring buffer to                         Оболочка вокруг FILE*, реализующая кольцевой буфер для десериализации
  *  deserialize from. It guarantees the ability to rewind                           Это гарантирует возможность перемотки на заданное количество байт
  *  a given number of bytes. */
@@ -125,4 +125,14 @@ void LeaveCritical()
     pop_lock();
 }
 
+void AssertLockHeldInternal(const char* pszName, const char* pszFile, int nLine, void* cs)
+{
+    if (lockstack.get() != NULL)
+        BOOST_FOREACH(const PAIRTYPE(void*, CLockLocation)& i, (*lockstack))
+            if (i.first == cs)
+                return;
+    fprintf(stderr, "Assertion failed: lock %s not held in %s:%i\n", pszName, pszFile, nLine);
+    abort();
+}
+
 #endif /* DEBUG_LOCKORDER */
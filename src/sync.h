@@ -85,10 +85,14 @@ typedef AnnotatedMixin<boost::mutex> CWaitableCriticalSection;
 #ifdef DEBUG_LOCKORDER
 void EnterCritical(const char* pszName, const char* pszFile, int nLine, void* cs, bool fTry = false);
 void LeaveCritical();
+void AssertLockHeldInternal(const char* pszName, const char* pszFile, int nLine, void* cs);
 #else
 void static inline EnterCritical(const char* pszName, const char* pszFile, int nLine, void* cs, bool fTry = false) {}
 void static inline LeaveCritical() {}
+void static inline AssertLockHeldInternal(const char* pszName, const char* pszFile, int nLine, void* cs) {}
 #endif
+// Abort if the calling thread doesn't hold cs (checked with DEBUG_LOCKORDER)   Прервать, если вызывающий поток не держит cs (проверяется с DEBUG_LOCKORDER)
+#define AssertLockHeld(cs) AssertLockHeldInternal(#cs, __FILE__, __LINE__, &cs)
 
 #ifdef DEBUG_LOCKCONTENTION
 void PrintLockContention(const char* pszName, const char* pszFile, int nLine);
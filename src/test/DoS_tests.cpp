@@ -17,10 +17,11 @@
 #include <stdint.h>
 
 // Tests this internal-to-main.cpp method:
-extern bool AddOrphanTx(const CDataStream& vMsg);
-extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans);
-extern std::map<uint256, CDataStream*> mapOrphanTransactions;
-extern std::map<uint256, std::map<uint256, CDataStream*> > mapOrphanTransactionsByPrev;
+extern bool AddOrphanTx(const CSharedTxRef& ptx, CNode* pfrom = NULL);
+extern unsigned int LimitOrphanTxSize(unsigned int nMaxOrphans, size_t nMaxBytes = MAX_ORPHAN_TRANSACTIONS_SIZE);
+extern std::map<uint256, COrphanTx> mapOrphanTransactions;
+extern std::map<COutPoint, std::set<uint256> > mapOrphanTransactionsByPrev;
+extern size_t nOrphanTransactionsSize;
 
 CService ip(uint32_t i)
 {
@@ -134,14 +135,11 @@ BOOST_AUTO_TEST_CASE(DoS_checknbits)
 
 CTransaction RandomOrphan()
 {
-    std::map<uint256, CDataStream*>::iterator it;
+    std::map<uint256, COrphanTx>::iterator it;
     it = mapOrphanTransactions.lower_bound(GetRandHash());
     if (it == mapOrphanTransactions.end())
         it = mapOrphanTransactions.begin();
-    const CDataStream* pvMsg = it->second;
-    CTransaction tx;
-    CDataStream(*pvMsg) >> tx;
-    return tx;
+    return it->second.ptx->tx;
 }
 
 BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
@@ -163,9 +161,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        AddOrphanTx(ds);
+        AddOrphanTx(CSharedTxRef(new CSharedTx(tx)));
     }
 
     // ... and 50 that depend on other orphans:
@@ -182,9 +178,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
         SignSignature(keystore, txPrev, tx, 0);
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        AddOrphanTx(ds);
+        AddOrphanTx(CSharedTxRef(new CSharedTx(tx)));
     }
 
     // This really-big orphan should be ignored:
@@ -208,9 +202,7 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
         for (unsigned int j = 1; j < tx.vin.size(); j++)
             tx.vin[j].scriptSig = tx.vin[0].scriptSig;
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        BOOST_CHECK(!AddOrphanTx(ds));
+        BOOST_CHECK(!AddOrphanTx(CSharedTxRef(new CSharedTx(tx))));
     }
 
     // Test LimitOrphanTxSize() function:
@@ -221,6 +213,48 @@ BOOST_AUTO_TEST_CASE(DoS_mapOrphans)
     LimitOrphanTxSize(0);
     BOOST_CHECK(mapOrphanTransactions.empty());
     BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK_EQUAL(nOrphanTransactionsSize, 0U);
+}
+
+BOOST_AUTO_TEST_CASE(DoS_mapOrphansByPeer)
+{
+    CNode node1(INVALID_SOCKET, CAddress(), "", true);
+    CNode node2(INVALID_SOCKET, CAddress(), "", true);
+
+    // node1 floods, node2 sends a few; both spend outputs of one parent
+    uint256 hashParent = GetRandHash();
+    std::vector<uint256> vHash2;
+    size_t nSize1 = 0;
+    for (int i = 0; i < 60; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashParent, i);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1*CENT;
+        CSharedTxRef ptx(new CSharedTx(tx));
+        BOOST_CHECK(AddOrphanTx(ptx, i < 50 ? &node1 : &node2));
+        if (i < 50)
+            nSize1 += ptx->GetTxSize();
+        else
+            vHash2.push_back(ptx->hash);
+    }
+    BOOST_CHECK_EQUAL(mapOrphanTransactionsByPrev.size(), 60U);
+    BOOST_CHECK_EQUAL(mapOrphanTransactionsByPrev[COutPoint(hashParent, 55)].count(vHash2[5]), 1U);
+
+    // over the byte budget, the flooding peer loses its orphans first
+    LimitOrphanTxSize(MAX_ORPHAN_TRANSACTIONS, nOrphanTransactionsSize - nSize1 / 2);
+    BOOST_CHECK(mapOrphanTransactions.size() < 60);
+    BOOST_FOREACH(const uint256& hash, vHash2)
+        BOOST_CHECK(mapOrphanTransactions.count(hash));
+
+    // a peer that goes away takes its orphans with it
+    BOOST_CHECK(FinalizeNode(&node1));
+    BOOST_CHECK_EQUAL(mapOrphanTransactions.size(), 10U);
+    BOOST_CHECK(FinalizeNode(&node2));
+    BOOST_CHECK(mapOrphanTransactions.empty());
+    BOOST_CHECK(mapOrphanTransactionsByPrev.empty());
+    BOOST_CHECK_EQUAL(nOrphanTransactionsSize, 0U);
 }
 
 BOOST_AUTO_TEST_CASE(DoS_checkSig)
@@ -247,9 +281,7 @@ BOOST_AUTO_TEST_CASE(DoS_checkSig)
         tx.vout[0].nValue = 1*CENT;
         tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
 
-        CDataStream ds(SER_DISK, CLIENT_VERSION);
-        ds << tx;
-        AddOrphanTx(ds);
+        AddOrphanTx(CSharedTxRef(new CSharedTx(tx)));
     }
 
     // Create a transaction that depends on orphans:
@@ -299,15 +331,15 @@ BOOST_AUTO_TEST_CASE(DoS_checkSig)
     BOOST_CHECK(!VerifySignature(CCoins(orphans[1], MEMPOOL_HEIGHT), tx, 1, flags, SIGHASH_ALL));
     std::swap(tx.vin[0].scriptSig, tx.vin[1].scriptSig);
 
-    // Exercise -maxsigcachesize code:
-    mapArgs["-maxsigcachesize"] = "10";
-    // Generate a new, different signature for vin[0] to trigger cache clear:
+    // Exercise a signature cache of a few entries per shard:
+    InitSignatureCache(4096);
+    // Generate a new, different signature for vin[0] to trigger eviction:
     CScript oldSig = tx.vin[0].scriptSig;
     BOOST_CHECK(SignSignature(keystore, orphans[0], tx, 0));
     BOOST_CHECK(tx.vin[0].scriptSig != oldSig);
     for (unsigned int j = 0; j < tx.vin.size(); j++)
         BOOST_CHECK(VerifySignature(CCoins(orphans[j], MEMPOOL_HEIGHT), tx, j, flags, SIGHASH_ALL));
-    mapArgs.erase("-maxsigcachesize");
+    InitSignatureCache(DEFAULT_SIGCACHE_SIZE << 20);
 
     LimitOrphanTxSize(0);
 }
@@ -6,6 +6,7 @@
 #include "key.h"
 #include "base58.h"
 #include "main.h"
+#include "mruset.h"
 
 using namespace std;
 using namespace boost::tuples;
@@ -443,4 +444,183 @@ BOOST_AUTO_TEST_CASE(merkle_block_4_test_update_none)
     BOOST_CHECK(!filter.contains(COutPoint(uint256("0x02981fa052f0481dbc5868f4fc2166035a10f27a03cfd2de67326471df5bc041"), 0)));
 }
 
+static vector<unsigned char> RandBytes(unsigned int nSize)
+{
+    vector<unsigned char> vch;
+    while (vch.size() < nSize)
+    {
+        uint256 hash = GetRandHash();
+        vch.insert(vch.end(), hash.begin(), hash.end());
+    }
+    vch.resize(nSize);
+    return vch;
+}
+
+// Block of nTx transactions, each spending the pay-to-pubkey output of the previous one
+static CBlock MakeFilterBlock(unsigned int nTx)
+{
+    CBlock block;
+    uint256 hashPrev = GetRandHash();
+    for (unsigned int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(hashPrev, 1);
+        tx.vin[0].scriptSig = CScript() << RandBytes(72) << RandBytes(33);
+        tx.vout.resize(2);
+        tx.vout[0].nValue = 1000 + i;
+        tx.vout[0].scriptPubKey = CScript() << OP_DUP << OP_HASH160 << RandBytes(20) << OP_EQUALVERIFY << OP_CHECKSIG;
+        tx.vout[1].nValue = 2000 + i;
+        tx.vout[1].scriptPubKey = CScript() << RandBytes(33) << OP_CHECKSIG;
+        block.vtx.push_back(tx);
+        hashPrev = tx.GetHash();
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+// Filter matching a few outputs and an input of the block
+static CBloomFilter MakeBlockFilter(const CBlock& block, unsigned char nFlags)
+{
+    CBloomFilter filter(10, 0.000001, 0, nFlags);
+    vector<unsigned char> vch;
+    CScript::const_iterator pc;
+    opcodetype opcode;
+    for (unsigned int i = 10; i < block.vtx.size(); i += 97)
+    {
+        pc = block.vtx[i].vout[i % 2].scriptPubKey.begin();
+        while (block.vtx[i].vout[i % 2].scriptPubKey.GetOp(pc, opcode, vch) && vch.empty()) ;
+        filter.insert(vch);
+    }
+    pc = block.vtx[5].vin[0].scriptSig.begin();
+    block.vtx[5].vin[0].scriptSig.GetOp(pc, opcode, vch);
+    filter.insert(vch);
+    filter.insert(block.vtx[3].GetHash());
+    return filter;
+}
+
+BOOST_AUTO_TEST_CASE(merkle_block_prepared)
+{
+    const unsigned int nTx = 2000;
+    const unsigned int nPeers = 20;
+    CBlock block = MakeFilterBlock(nTx);
+    CBlock blockCopy = block;
+    CFilterableBlock prepared(blockCopy);
+    BOOST_CHECK(prepared.vtx == block.vtx);
+
+    // the same matches, tree and filter updates as from the block itself
+    const unsigned char vFlags[] = { BLOOM_UPDATE_NONE, BLOOM_UPDATE_ALL, BLOOM_UPDATE_P2PUBKEY_ONLY };
+    for (unsigned int n = 0; n < sizeof(vFlags); n++)
+    {
+        CBloomFilter filter1 = MakeBlockFilter(block, vFlags[n]);
+        CBloomFilter filter2 = filter1;
+        CMerkleBlock merkleBlock1(block, filter1);
+        CMerkleBlock merkleBlock2(prepared, filter2);
+        BOOST_CHECK(merkleBlock1.vMatchedTxn == merkleBlock2.vMatchedTxn);
+        BOOST_CHECK(merkleBlock1.vMatchedTxn.size() >= 22U);
+
+        CDataStream ss1(SER_NETWORK, PROTOCOL_VERSION), ss2(SER_NETWORK, PROTOCOL_VERSION);
+        ss1 << merkleBlock1 << filter1;
+        ss2 << merkleBlock2 << filter2;
+        BOOST_CHECK(ss1.str() == ss2.str());
+
+        vector<uint256> vMatched;
+        BOOST_CHECK(merkleBlock2.txn.ExtractMatches(vMatched) == block.hashMerkleRoot);
+    }
+    // chained spends are followed only when outpoints are added
+    CBloomFilter filterNone = MakeBlockFilter(block, BLOOM_UPDATE_NONE);
+    CBloomFilter filterP2PK = MakeBlockFilter(block, BLOOM_UPDATE_P2PUBKEY_ONLY);
+    BOOST_CHECK(CMerkleBlock(prepared, filterP2PK).vMatchedTxn.size() > CMerkleBlock(prepared, filterNone).vMatchedTxn.size());
+
+    // many peers filtering the same block: from the block, or prepared once
+    int64 nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < nPeers; i++)
+    {
+        CBloomFilter filter = MakeBlockFilter(block, BLOOM_UPDATE_ALL);
+        CMerkleBlock merkleBlock(block, filter);
+    }
+    int64 nBlock = GetTimeMicros() - nStart;
+    nStart = GetTimeMicros();
+    blockCopy = block;
+    CFilterableBlock prepared2(blockCopy);
+    for (unsigned int i = 0; i < nPeers; i++)
+    {
+        CBloomFilter filter = MakeBlockFilter(block, BLOOM_UPDATE_ALL);
+        CMerkleBlock merkleBlock(prepared2, filter);
+    }
+    int64 nPrepared = GetTimeMicros() - nStart;
+    printf("merkle_block_prepared: %u peers x %u transactions: from block %"PRI64d"us, prepared %"PRI64d"us (%"PRIszu" bytes of elements)\n",
+           nPeers, nTx, nBlock, nPrepared, prepared2.elements.GetMemoryUsage());
+}
+
+BOOST_AUTO_TEST_CASE(rolling_bloom)
+{
+    CRollingBloomFilter rb(100, 0.01);
+    vector<uint256> vHash;
+    for (int i = 0; i < 400; i++)
+        vHash.push_back(GetRandHash());
+
+    // the last 100 inserted are always there
+    for (int i = 0; i < 400; i++)
+    {
+        rb.insert(vHash[i]);
+        BOOST_CHECK(!rb.insert(vHash[i]));
+        for (int j = max(0, i - 99); j <= i; j++)
+            BOOST_CHECK(rb.contains(vHash[j]));
+    }
+
+    // the oldest ones are forgotten, with few false positives
+    int nFound = 0;
+    for (int i = 0; i < 100; i++)
+        if (rb.contains(vHash[i]))
+            nFound++;
+    BOOST_CHECK(nFound < 10);
+    int nFalse = 0;
+    for (int i = 0; i < 10000; i++)
+        if (rb.contains(GetRandHash()))
+            nFalse++;
+    BOOST_CHECK(nFalse < 300);
+
+    rb.reset();
+    BOOST_CHECK(!rb.contains(vHash[399]));
+}
+
+// Per-peer inventory tracking: rolling filter against the mruset it replaces
+BOOST_AUTO_TEST_CASE(rolling_bloom_benchmark)
+{
+    const unsigned int nInv = 200000;
+    vector<CInv> vInv;
+    for (unsigned int i = 0; i < nInv; i++)
+        vInv.push_back(CInv(MSG_TX, GetRandHash()));
+
+    // each inv is inserted once and looked up three times, as for relay to a peer
+    int64 nStart = GetTimeMicros();
+    mruset<CInv> setKnown(INVENTORY_KNOWN_SIZE);
+    unsigned int nSetHits = 0;
+    for (unsigned int i = 0; i < nInv; i++)
+    {
+        nSetHits += setKnown.count(vInv[i]) + setKnown.count(vInv[i / 2]);
+        setKnown.insert(vInv[i]);
+        nSetHits += setKnown.count(vInv[i]);
+    }
+    int64 nSet = GetTimeMicros() - nStart;
+
+    nStart = GetTimeMicros();
+    CRollingBloomFilter filterKnown(INVENTORY_KNOWN_SIZE, 0.000001);
+    unsigned int nFilterHits = 0;
+    for (unsigned int i = 0; i < nInv; i++)
+    {
+        nFilterHits += filterKnown.contains(vInv[i].hash) + filterKnown.contains(vInv[i / 2].hash);
+        filterKnown.insert(vInv[i].hash);
+        nFilterHits += filterKnown.contains(vInv[i].hash);
+    }
+    int64 nFilter = GetTimeMicros() - nStart;
+
+    // the filter remembers at least as much as the set
+    BOOST_CHECK(nFilterHits >= nSetHits);
+    size_t nSetMemory = setKnown.size() * (sizeof(CInv) * 2 + 4 * sizeof(void*));
+    printf("rolling_bloom_benchmark: %u invs, window %u: mruset %"PRI64d"us (~%"PRIszu" bytes), rolling bloom %"PRI64d"us (%"PRIszu" bytes)\n",
+           nInv, INVENTORY_KNOWN_SIZE, nSet, nSetMemory, nFilter, filterKnown.GetMemoryUsage());
+}
+
 BOOST_AUTO_TEST_SUITE_END()
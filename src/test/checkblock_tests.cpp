@@ -61,4 +61,175 @@ BOOST_AUTO_TEST_CASE(May15)
     SetMockTime(0);
 }
 
+static CBlock
+make_block(unsigned int nTx)
+{
+    CBlock block;
+    block.nTime = 1368576000;
+    for (unsigned int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1000 + i;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        if (i == 0)
+            tx.vin[0].scriptSig = CScript() << OP_0 << OP_0;    // coinbase
+        else
+            tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        block.vtx.push_back(tx);
+    }
+    return block;
+}
+
+BOOST_AUTO_TEST_CASE(CheckBlock_parallel)
+{
+    // Enough transactions for the checks to be spread over the block check threads
+    CBlock block = make_block(500);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    std::vector<uint256> vMerkleTree = block.vMerkleTree;
+
+    CValidationState state;
+    BOOST_CHECK(CheckBlock(block, state, false, true));
+    BOOST_CHECK(state.IsValid());
+    BOOST_CHECK(block.vMerkleTree == vMerkleTree);
+    // Only a check that skipped nothing is remembered
+    BOOST_CHECK(!block.fChecked);
+
+    // Wrong merkle root
+    CBlock blockBadRoot = block;
+    blockBadRoot.hashMerkleRoot = 0;
+    CValidationState stateBadRoot;
+    int nDoS = 0;
+    BOOST_CHECK(!CheckBlock(blockBadRoot, stateBadRoot, false, true));
+    BOOST_CHECK(stateBadRoot.IsInvalid(nDoS) && nDoS == 100);
+
+    // A bad transaction in the middle of the block gets its own DoS score
+    CBlock blockBadTx = block;
+    blockBadTx.vtx[250].vout[0].nValue = -1;
+    blockBadTx.hashMerkleRoot = blockBadTx.BuildMerkleTree();
+    CValidationState stateBadTx;
+    nDoS = 0;
+    BOOST_CHECK(!CheckBlock(blockBadTx, stateBadTx, false, true));
+    BOOST_CHECK(stateBadTx.IsInvalid(nDoS) && nDoS == 100);
+
+    // Duplicate transactions
+    CBlock blockDup = block;
+    blockDup.vtx[2] = blockDup.vtx[1];
+    blockDup.hashMerkleRoot = blockDup.BuildMerkleTree();
+    CValidationState stateDup;
+    BOOST_CHECK(!CheckBlock(blockDup, stateDup, false, true));
+
+    // Deserializing a block forgets about earlier checks
+    block.fChecked = true;
+    CDataStream ss(SER_DISK, CLIENT_VERSION);
+    ss << block;
+    ss >> block;
+    BOOST_CHECK(!block.fChecked);
+}
+
+// Wire form of a message, received into a CNetMessage
+static void
+receive_message(CNetMessage& msg, const char* pszCommand, const CDataStream& ssPayload, bool fBadChecksum)
+{
+    CMessageHeader hdr(pszCommand, ssPayload.size());
+    uint256 hash = Hash(ssPayload.begin(), ssPayload.end());
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    if (fBadChecksum)
+        hdr.nChecksum ^= 1;
+    CDataStream ssWire(SER_NETWORK, PROTOCOL_VERSION);
+    ssWire << hdr;
+    ssWire += ssPayload;
+    int nHeader = msg.readHeader(&ssWire[0], ssWire.size());
+    BOOST_REQUIRE(nHeader > 0);
+    BOOST_REQUIRE(msg.readData(&ssWire[nHeader], ssWire.size() - nHeader) == (int)ssWire.size() - nHeader);
+    BOOST_REQUIRE(msg.complete());
+}
+
+BOOST_AUTO_TEST_CASE(CheckBlock_prepared)
+{
+    CBlock block = make_block(100);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    CDataStream ssBlock(SER_NETWORK, PROTOCOL_VERSION);
+    ssBlock << block;
+    CTransaction tx = block.vtx[1];
+    CDataStream ssTx(SER_NETWORK, PROTOCOL_VERSION);
+    ssTx << tx;
+
+    CNetMessage msgBlock(SER_NETWORK, PROTOCOL_VERSION), msgTx(SER_NETWORK, PROTOCOL_VERSION), msgBad(SER_NETWORK, PROTOCOL_VERSION);
+    receive_message(msgBlock, "block", ssBlock, false);
+    receive_message(msgTx, "tx", ssTx, false);
+    receive_message(msgBad, "tx", ssTx, true);
+
+    std::vector<CNetMessage*> vMsgs;
+    vMsgs.push_back(&msgBlock);
+    vMsgs.push_back(&msgTx);
+    vMsgs.push_back(&msgBad);
+    PrepareMessages(vMsgs);
+
+    BOOST_FOREACH(CNetMessage* pmsg, vMsgs)
+        BOOST_CHECK(pmsg->fPrepared && pmsg->pprepared);
+
+    // The block was deserialized and its transactions checked
+    CPreparedMessage& preparedBlock = *msgBlock.pprepared;
+    BOOST_CHECK(preparedBlock.fChecksumOk && preparedBlock.fDeserialized);
+    BOOST_CHECK(preparedBlock.block.GetBlockHeader().hashMerkleRoot == block.hashMerkleRoot);
+    BOOST_CHECK(preparedBlock.block.hashTxChecked == block.hashMerkleRoot);
+    BOOST_CHECK(preparedBlock.block.vMerkleTree == block.vMerkleTree);
+    BOOST_CHECK(!preparedBlock.block.fChecked);
+
+    BOOST_CHECK(msgTx.pprepared->fChecksumOk && msgTx.pprepared->fDeserialized);
+    BOOST_CHECK(msgTx.pprepared->tx.GetHash() == tx.GetHash());
+
+    // Nothing is deserialized from a message that fails its checksum
+    BOOST_CHECK(!msgBad.pprepared->fChecksumOk && !msgBad.pprepared->fDeserialized);
+
+    // A block whose transactions changed along with the merkle root is checked again
+    CBlock blockBadTx = preparedBlock.block;
+    blockBadTx.vtx[50].vout[0].nValue = -1;
+    blockBadTx.hashMerkleRoot = blockBadTx.BuildMerkleTree();
+    CValidationState state;
+    BOOST_CHECK(!CheckBlock(blockBadTx, state, false, true));
+}
+
+BOOST_AUTO_TEST_CASE(BlockMessageCache)
+{
+    CBlock block = make_block(20);
+    block.hashMerkleRoot = block.BuildMerkleTree();
+
+    // A ready to send message: header with command, size and checksum, then the block
+    boost::shared_ptr<const CSerializeData> pmsg = MakeBlockMessage(block);
+    BOOST_REQUIRE(pmsg && pmsg->size() > (size_t)CMessageHeader::HEADER_SIZE);
+    CNetMessage msg(SER_NETWORK, PROTOCOL_VERSION);
+    int nHeader = msg.readHeader(&(*pmsg)[0], pmsg->size());
+    BOOST_REQUIRE(nHeader == CMessageHeader::HEADER_SIZE);
+    msg.readData(&(*pmsg)[nHeader], pmsg->size() - nHeader);
+    BOOST_CHECK(msg.complete());
+    BOOST_CHECK(msg.hdr.GetCommand() == "block");
+    uint256 hash = Hash(msg.vRecv.begin(), msg.vRecv.end());
+    BOOST_CHECK(memcmp(&hash, &msg.hdr.nChecksum, sizeof(msg.hdr.nChecksum)) == 0);
+    CBlock blockRead;
+    msg.vRecv >> blockRead;
+    BOOST_CHECK(blockRead.BuildMerkleTree() == block.hashMerkleRoot);
+
+    // Least recently used messages go first once the size limit is reached
+    CBlockMessageCache cache(pmsg->size() * 2);
+    uint256 hash1 = 1, hash2 = 2, hash3 = 3;
+    cache.Put(hash1, pmsg);
+    cache.Put(hash2, pmsg);
+    BOOST_CHECK(cache.GetSize() == pmsg->size() * 2);
+    BOOST_CHECK(cache.Get(hash1) == pmsg);
+    cache.Put(hash3, pmsg);
+    BOOST_CHECK(cache.Get(hash1) == pmsg);
+    BOOST_CHECK(!cache.Get(hash2));
+    BOOST_CHECK(cache.Get(hash3) == pmsg);
+    BOOST_CHECK(cache.GetSize() == pmsg->size() * 2);
+
+    cache.SetMaxSize(pmsg->size());
+    BOOST_CHECK(cache.Get(hash3) == pmsg);
+    BOOST_CHECK(!cache.Get(hash1));
+    cache.Clear();
+    BOOST_CHECK(cache.GetSize() == 0 && !cache.Get(hash3));
+}
+
 BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,378 @@
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "txdb.h"
+#include "util.h"
+
+using namespace std;
+
+// Coins view that counts the lookups reaching it
+class CCoinsViewCounter : public CCoinsView
+{
+public:
+    std::map<uint256, CCoins> mapCoins;
+    unsigned int nGet;
+    unsigned int nBatch;
+    unsigned int nWritten;
+    bool fFail;
+
+    CCoinsViewCounter() : nGet(0), nBatch(0), nWritten(0), fFail(false) {}
+
+    bool GetCoins(const uint256 &txid, CCoins &coins)
+    {
+        nGet++;
+        std::map<uint256, CCoins>::const_iterator it = mapCoins.find(txid);
+        if (it == mapCoins.end())
+            return false;
+        coins = it->second;
+        return true;
+    }
+
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins)
+    {
+        nBatch++;
+        CCoinsView::GetCoinsBatch(vTxid, vCoins);
+    }
+
+    bool HaveCoins(const uint256 &txid) { return mapCoins.count(txid) > 0; }
+
+    bool BatchWrite(CCoinsMap &mapWrite, CBlockIndex *pindex)
+    {
+        if (fFail)
+            return false;
+        for (CCoinsMap::const_iterator it = mapWrite.begin(); it != mapWrite.end(); it++)
+        {
+            if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+                continue;
+            nWritten++;
+            if (it->second.coins.IsPruned())
+                mapCoins.erase(it->first);
+            else
+                mapCoins[it->first] = it->second.coins;
+        }
+        return true;
+    }
+};
+
+static CCoins RandomCoins(int nHeight)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    tx.vout.resize(1 + GetRandInt(3));
+    for (unsigned int i = 0; i < tx.vout.size(); i++)
+    {
+        tx.vout[i].nValue = 1 + GetRandInt(100000);
+        tx.vout[i].scriptPubKey = CScript() << OP_TRUE;
+    }
+    return CCoins(tx, nHeight);
+}
+
+// Coin database whose running totals can be thrown away
+class CCoinsViewDBTest : public CCoinsViewDB
+{
+public:
+    CCoinsViewDBTest() : CCoinsViewDB(1 << 20, true) {}
+
+    void ResetStats()
+    {
+        LOCK(cs_stats);
+        fStats = false;
+    }
+};
+
+static void CheckStatsEqual(const CCoinsStats &a, const CCoinsStats &b)
+{
+    BOOST_CHECK_EQUAL(a.nTransactions, b.nTransactions);
+    BOOST_CHECK_EQUAL(a.nTransactionOutputs, b.nTransactionOutputs);
+    BOOST_CHECK_EQUAL(a.nSerializedSize, b.nSerializedSize);
+    BOOST_CHECK_EQUAL(a.nTotalAmount, b.nTotalAmount);
+    BOOST_CHECK(a.hashSet == b.hashSet);
+}
+
+BOOST_AUTO_TEST_SUITE(coins_tests)
+
+BOOST_AUTO_TEST_CASE(coins_prefetch)
+{
+    CCoinsViewCounter base;
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 50; i++)
+    {
+        uint256 txid = GetRandHash();
+        base.mapCoins[txid] = RandomCoins(i);
+        vTxid.push_back(txid);
+    }
+    uint256 txidMissing = GetRandHash();
+    vTxid.push_back(txidMissing);
+
+    CCoinsViewCache cache(base);
+    cache.Prefetch(vTxid);
+    BOOST_CHECK_EQUAL(base.nBatch, 1U);
+    unsigned int nGet = base.nGet;
+
+    // Everything that exists is served from the cache now
+    for (int i = 0; i < 50; i++)
+    {
+        BOOST_CHECK(cache.HaveCoins(vTxid[i]));
+        BOOST_CHECK(cache.GetCoins(vTxid[i]) == base.mapCoins[vTxid[i]]);
+    }
+    BOOST_CHECK_EQUAL(base.nGet, nGet);
+
+    // Missing entries are not cached as if they existed
+    BOOST_CHECK(!cache.HaveCoins(txidMissing));
+    BOOST_CHECK_EQUAL(base.nGet, nGet + 1);
+
+    // A second prefetch of the same txids only asks for the missing one
+    cache.Prefetch(vTxid);
+    BOOST_CHECK_EQUAL(base.nBatch, 2U);
+    BOOST_CHECK_EQUAL(base.nGet, nGet + 2);
+
+    // A cache on top of a cache prefetches through it
+    CCoinsViewCache cache2(cache);
+    std::vector<CCoins> vCoins;
+    cache2.GetCoinsBatch(vTxid, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), vTxid.size());
+    for (int i = 0; i < 50; i++)
+        BOOST_CHECK(vCoins[i] == base.mapCoins[vTxid[i]]);
+    BOOST_CHECK(vCoins[50].IsPruned());
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_batch)
+{
+    CCoinsViewDB db(1 << 20, true);
+    std::map<uint256, CCoins> mapCoins;
+    CCoinsMap mapWrite;
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 200; i++)
+    {
+        uint256 txid = GetRandHash();
+        mapCoins[txid] = RandomCoins(i);
+        mapWrite[txid].coins = mapCoins[txid];
+        mapWrite[txid].flags = CCoinsCacheEntry::DIRTY;
+        vTxid.push_back(txid);
+        if (i % 10 == 0)
+            vTxid.push_back(GetRandHash());
+    }
+    // entries that are not dirty are not written
+    uint256 txidClean = GetRandHash();
+    mapWrite[txidClean].coins = RandomCoins(0);
+    BOOST_CHECK(db.BatchWrite(mapWrite, NULL));
+    BOOST_CHECK(!db.HaveCoins(txidClean));
+
+    std::vector<CCoins> vCoins;
+    db.GetCoinsBatch(vTxid, vCoins);
+    BOOST_CHECK_EQUAL(vCoins.size(), vTxid.size());
+    for (unsigned int i = 0; i < vTxid.size(); i++)
+    {
+        if (mapCoins.count(vTxid[i]))
+            BOOST_CHECK(vCoins[i] == mapCoins[vTxid[i]]);
+        else
+            BOOST_CHECK(vCoins[i].IsPruned());
+    }
+}
+
+// Memory held by the CCoins of the given txids in a cache
+static size_t CacheUsage(CCoinsViewCache &cache, const std::vector<uint256> &vTxid)
+{
+    size_t nUsage = 0;
+    BOOST_FOREACH(const uint256 &txid, vTxid)
+    {
+        CCoins coins;
+        if (cache.GetCoins(txid, coins))
+            nUsage += coins.DynamicMemoryUsage();
+    }
+    return nUsage;
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_flags)
+{
+    CCoinsViewCounter base;
+    uint256 txidRead = GetRandHash();
+    uint256 txidSpent = GetRandHash();
+    base.mapCoins[txidRead] = RandomCoins(1);
+    base.mapCoins[txidSpent] = RandomCoins(2);
+
+    CCoinsViewCache cache(base);
+    size_t nUsage = cache.DynamicMemoryUsage();
+
+    // Reading does not make an entry dirty, but it takes memory
+    BOOST_CHECK(cache.HaveCoins(txidRead));
+    BOOST_CHECK(cache.HaveCoins(txidSpent));
+    BOOST_CHECK(cache.DynamicMemoryUsage() > nUsage);
+    nUsage = cache.DynamicMemoryUsage();
+
+    // Spending everything releases the outputs
+    {
+        CCoinsModifier coins(cache, txidSpent);
+        for (unsigned int i = 0; i < coins->vout.size(); i++)
+            BOOST_CHECK(coins->Spend(i));
+    }
+    BOOST_CHECK(cache.GetCoins(txidSpent).IsPruned());
+    BOOST_CHECK(cache.DynamicMemoryUsage() < nUsage);
+    nUsage = cache.DynamicMemoryUsage();
+
+    uint256 txidNew = GetRandHash();
+    {
+        CCoinsModifier coins(cache, txidNew);
+        *coins = RandomCoins(3);
+    }
+    BOOST_CHECK(cache.DynamicMemoryUsage() > nUsage);
+
+    // Only the modified entries are written
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK_EQUAL(base.nWritten, 2U);
+    BOOST_CHECK(base.mapCoins.count(txidRead));
+    BOOST_CHECK(!base.mapCoins.count(txidSpent));
+    BOOST_CHECK(base.mapCoins.count(txidNew));
+    BOOST_CHECK_EQUAL(cache.GetCacheSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(coins_cache_child)
+{
+    CCoinsViewCounter base;
+    CCoinsViewCache parent(base);
+    std::vector<uint256> vTxid;
+    for (int i = 0; i < 20; i++)
+    {
+        uint256 txid = GetRandHash();
+        base.mapCoins[txid] = RandomCoins(i);
+        vTxid.push_back(txid);
+    }
+
+    // A child cache spends everything in the base and creates a new output
+    // that it spends again; the parent only learns about the real changes
+    CCoinsViewCache child(parent, true);
+    BOOST_FOREACH(const uint256 &txid, vTxid)
+    {
+        CCoinsModifier coins(child, txid);
+        BOOST_CHECK(coins->Spend(0));
+    }
+    uint256 txidTemp = GetRandHash();
+    {
+        CCoinsModifier coins(child, txidTemp);
+        *coins = RandomCoins(30);
+        for (unsigned int i = 0; i < coins->vout.size(); i++)
+            BOOST_CHECK(coins->Spend(i));
+    }
+    BOOST_CHECK(child.Flush());
+    BOOST_CHECK_EQUAL(parent.GetCacheSize(), vTxid.size());
+
+    // The memory accounting of the parent covers its content
+    std::vector<uint256> vAll(vTxid);
+    vAll.push_back(txidTemp);
+    BOOST_CHECK(parent.DynamicMemoryUsage() >= CacheUsage(parent, vAll));
+
+    BOOST_CHECK(parent.Flush());
+    BOOST_CHECK_EQUAL(base.nWritten, vTxid.size());
+    BOOST_FOREACH(const uint256 &txid, vTxid)
+        BOOST_CHECK(!base.mapCoins[txid].IsAvailable(0));
+    BOOST_CHECK(!base.mapCoins.count(txidTemp));
+}
+
+BOOST_AUTO_TEST_CASE(coins_background_flush)
+{
+    CCoinsViewCounter base;
+    CCoinsViewBackgroundFlush flush(base);
+    CCoinsViewCache cache(flush);
+
+    uint256 txid = GetRandHash();
+    CCoins coinsNew = RandomCoins(1);
+    {
+        CCoinsModifier coins(cache, txid);
+        *coins = coinsNew;
+    }
+    BOOST_CHECK(cache.Flush());
+
+    // The batch is readable while (or after) it is written
+    CCoins coins;
+    BOOST_CHECK(cache.GetCoins(txid, coins));
+    BOOST_CHECK(coins == coinsNew);
+
+    BOOST_CHECK(flush.Sync());
+    BOOST_CHECK(base.mapCoins[txid] == coinsNew);
+    CCoinsFlushStats stats = flush.GetFlushStats();
+    BOOST_CHECK_EQUAL(stats.nFlushes, 1U);
+    BOOST_CHECK(!stats.fWriting);
+
+    // A failed write is reported to the next flush
+    base.fFail = true;
+    {
+        CCoinsModifier coins(cache, GetRandHash());
+        *coins = RandomCoins(2);
+    }
+    BOOST_CHECK(cache.Flush());
+    BOOST_CHECK(!flush.Sync());
+    {
+        CCoinsModifier coins(cache, GetRandHash());
+        *coins = RandomCoins(3);
+    }
+    BOOST_CHECK(!cache.Flush());
+}
+
+BOOST_AUTO_TEST_CASE(coins_db_stats)
+{
+    CCoinsViewDBTest db;
+    CBlockIndex *pindex = pindexGenesisBlock;
+    std::map<uint256, CCoins> mapOld;
+    CCoinsMap mapWrite;
+    for (int i = 0; i < 50; i++)
+    {
+        uint256 txid = GetRandHash();
+        mapOld[txid] = RandomCoins(i);
+        mapWrite[txid].coins = mapOld[txid];
+        mapWrite[txid].flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+    }
+    BOOST_CHECK(db.BatchWrite(mapWrite, pindex));
+    CCoinsStats statsBefore;
+    BOOST_CHECK(db.GetStats(statsBefore));
+    BOOST_CHECK_EQUAL(statsBefore.nTransactions, 50U);
+
+    // Spend some outputs, prune some entries and add new ones
+    mapWrite.clear();
+    int n = 0;
+    for (std::map<uint256, CCoins>::const_iterator it = mapOld.begin(); it != mapOld.end(); it++, n++)
+    {
+        CCoinsCacheEntry &entry = mapWrite[it->first];
+        entry.coins = it->second;
+        entry.flags = CCoinsCacheEntry::DIRTY;
+        if (n % 3 == 0)
+            entry.coins.Spend(0);
+        else if (n % 3 == 1)
+            for (unsigned int i = 0; i < entry.coins.vout.size(); i++)
+                entry.coins.Spend(i);
+    }
+    std::vector<uint256> vNew;
+    for (int i = 0; i < 10; i++)
+    {
+        vNew.push_back(GetRandHash());
+        CCoinsCacheEntry &entry = mapWrite[vNew.back()];
+        entry.coins = RandomCoins(100 + i);
+        entry.flags = CCoinsCacheEntry::DIRTY | CCoinsCacheEntry::FRESH;
+    }
+    BOOST_CHECK(db.BatchWrite(mapWrite, pindex));
+    CCoinsStats statsAfter;
+    BOOST_CHECK(db.GetStats(statsAfter));
+
+    // The running totals match a full scan
+    db.ResetStats();
+    CCoinsStats statsScan;
+    BOOST_CHECK(db.GetStats(statsScan));
+    CheckStatsEqual(statsAfter, statsScan);
+
+    // Writing the old versions back and removing the new entries, as a
+    // disconnect does, restores the totals
+    mapWrite.clear();
+    for (std::map<uint256, CCoins>::const_iterator it = mapOld.begin(); it != mapOld.end(); it++)
+    {
+        mapWrite[it->first].coins = it->second;
+        mapWrite[it->first].flags = CCoinsCacheEntry::DIRTY;
+    }
+    BOOST_FOREACH(const uint256 &txid, vNew)
+        mapWrite[txid].flags = CCoinsCacheEntry::DIRTY;
+    BOOST_CHECK(db.BatchWrite(mapWrite, pindex));
+    CCoinsStats statsUndo;
+    BOOST_CHECK(db.GetStats(statsUndo));
+    CheckStatsEqual(statsUndo, statsBefore);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
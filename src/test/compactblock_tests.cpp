@@ -0,0 +1,222 @@
+//
+// Compact block relay: short ids, reconstruction from the memory pool
+//
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "main.h"
+#include "hash.h"
+#include "util.h"
+
+using namespace std;
+
+// Block with a coinbase, a transfer transaction and nTx-2 ordinary transactions
+static CBlock MakeBlock(unsigned int nTx)
+{
+    CBlock block;
+    block.nTime = 1368576000;
+    block.nBits = 0x1d00ffff;
+    for (unsigned int i = 0; i < nTx; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = 1000 + i;
+        tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+        if (i == 1)
+            tx.vin[0].scriptSig = CScript() << OP_0 << OP_0;    // transfer transaction
+        if (i != 0)
+            tx.vin[0].prevout = COutPoint(GetRandHash(), i);
+        block.vtx.push_back(tx);
+    }
+    block.hashMerkleRoot = block.BuildMerkleTree();
+    return block;
+}
+
+// Memory pool holding every nth ordinary transaction of the block plus unrelated ones
+static void FillPool(CTxMemPool& pool, const CBlock& block, unsigned int nSkip)
+{
+    for (unsigned int i = 2; i < block.vtx.size(); i++)
+    {
+        if (nSkip && i % nSkip == 0)
+            continue;
+        CTransaction tx = block.vtx[i];
+        pool.addUnchecked(tx.GetHash(), tx);
+    }
+    for (unsigned int i = 0; i < 100; i++)
+    {
+        CTransaction tx;
+        tx.vin.resize(1);
+        tx.vin[0].prevout = COutPoint(GetRandHash(), 0);
+        tx.vout.resize(1);
+        tx.vout[0].nValue = i;
+        pool.addUnchecked(tx.GetHash(), tx);
+    }
+}
+
+template<typename T>
+static void RoundTrip(const T& objIn, T& objOut)
+{
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << objIn;
+    ss >> objOut;
+    BOOST_CHECK(ss.empty());
+}
+
+BOOST_AUTO_TEST_SUITE(compactblock_tests)
+
+BOOST_AUTO_TEST_CASE(siphash)
+{
+    // reference vector from the SipHash paper, message 00 01 .. 1f
+    uint256 val;
+    for (int i = 0; i < 32; i++)
+        val.begin()[i] = i;
+    BOOST_CHECK_EQUAL(SipHashUint256(0x0706050403020100ULL, 0x0F0E0D0C0B0A0908ULL, val), 0x7127512f72f27cceULL);
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_serialize)
+{
+    CBlock block = MakeBlock(50);
+    CCompactBlock cmpctblock(block);
+    BOOST_CHECK_EQUAL(cmpctblock.GetTxCount(), 50U);
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilled.size(), 2U);
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilled[0].nIndex, 0U);
+    BOOST_CHECK_EQUAL(cmpctblock.vPrefilled[1].nIndex, 1U);
+
+    CCompactBlock cmpctblock2;
+    RoundTrip(cmpctblock, cmpctblock2);
+    BOOST_CHECK(cmpctblock2.header.GetHash() == block.GetHash());
+    BOOST_CHECK(cmpctblock2.vShortTxID == cmpctblock.vShortTxID);
+    BOOST_CHECK_EQUAL(cmpctblock2.vPrefilled.size(), 2U);
+    BOOST_CHECK(cmpctblock2.vPrefilled[1].tx == block.vtx[1]);
+    // the key is rebuilt from header and nonce on the receiving side
+    BOOST_CHECK_EQUAL(cmpctblock2.GetShortTxID(block.vtx[7].GetHash()), cmpctblock.vShortTxID[5]);
+    BOOST_CHECK(cmpctblock.vShortTxID[5] <= 0xffffffffffffULL);
+    BOOST_CHECK_EQUAL(::GetSerializeSize(cmpctblock, SER_NETWORK, PROTOCOL_VERSION),
+                      ::GetSerializeSize(block.GetBlockHeader(), SER_NETWORK, PROTOCOL_VERSION) + 8 +
+                      GetSizeOfCompactSize(48 * CCompactBlock::SHORTTXID_SIZE) + 48 * CCompactBlock::SHORTTXID_SIZE +
+                      1 + 2 + ::GetSerializeSize(block.vtx[0], SER_NETWORK, PROTOCOL_VERSION) + ::GetSerializeSize(block.vtx[1], SER_NETWORK, PROTOCOL_VERSION));
+
+    // short id data that is not a whole number of ids is rejected
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << block.GetBlockHeader() << cmpctblock.nNonce << vector<unsigned char>(7) << vector<CPrefilledTransaction>();
+    BOOST_CHECK_THROW(ss >> cmpctblock2, std::ios_base::failure);
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_malformed)
+{
+    CBlock block = MakeBlock(10);
+    CTxMemPool pool;
+    CPartialBlock partial;
+
+    CCompactBlock cmpctblock(block);
+    cmpctblock.vPrefilled[1].nIndex = 10;
+    BOOST_CHECK(!partial.Init(cmpctblock, pool));
+
+    cmpctblock = CCompactBlock(block);
+    swap(cmpctblock.vPrefilled[0], cmpctblock.vPrefilled[1]);
+    BOOST_CHECK(!partial.Init(cmpctblock, pool));
+
+    cmpctblock = CCompactBlock(block);
+    cmpctblock.vShortTxID.clear();
+    cmpctblock.vPrefilled.clear();
+    BOOST_CHECK(!partial.Init(cmpctblock, pool));
+
+    // wrong transactions in "blocktxn" don't match the merkle root
+    cmpctblock = CCompactBlock(block);
+    BOOST_CHECK(partial.Init(cmpctblock, pool));
+    vector<CTransaction> vtx(block.vtx.begin() + 2, block.vtx.end());
+    CBlock blockOut;
+    BOOST_CHECK(partial.Fill(vtx, blockOut));
+    swap(vtx[0], vtx[1]);
+    BOOST_CHECK(!partial.Fill(vtx, blockOut));
+    vtx.pop_back();
+    BOOST_CHECK(!partial.Fill(vtx, blockOut));
+}
+
+BOOST_AUTO_TEST_CASE(compactblock_collision)
+{
+    CBlock block = MakeBlock(10);
+    CCompactBlock cmpctblock(block);
+
+    // the same short id twice in the block: both positions are asked for
+    cmpctblock.vShortTxID[3] = cmpctblock.vShortTxID[2];
+    CTxMemPool pool;
+    FillPool(pool, block, 0);
+    CPartialBlock partial;
+    BOOST_CHECK(partial.Init(cmpctblock, pool));
+    vector<unsigned int> vMissing = partial.GetMissing();
+    BOOST_REQUIRE_EQUAL(vMissing.size(), 2U);
+    BOOST_CHECK_EQUAL(vMissing[0], 4U);
+    BOOST_CHECK_EQUAL(vMissing[1], 5U);
+
+    vector<CTransaction> vtx;
+    BOOST_FOREACH(unsigned int nIndex, vMissing)
+        vtx.push_back(block.vtx[nIndex]);
+    CBlock blockOut;
+    BOOST_CHECK(partial.Fill(vtx, blockOut));
+    BOOST_CHECK(blockOut.GetHash() == block.GetHash());
+}
+
+// Several receiving nodes, each with its own memory pool, rebuild one block
+BOOST_AUTO_TEST_CASE(compactblock_reconstruct)
+{
+    const unsigned int nTx = 2000;
+    CBlock block = MakeBlock(nTx);
+    unsigned int nBlockSize = ::GetSerializeSize(block, SER_NETWORK, PROTOCOL_VERSION);
+
+    int64 nStart = GetTimeMicros();
+    CCompactBlock cmpctblock(block);
+    CDataStream ssCmpct(SER_NETWORK, PROTOCOL_VERSION);
+    ssCmpct << cmpctblock;
+    int64 nBuild = GetTimeMicros() - nStart;
+
+    // nSkip: every nSkip-th transaction is missing from the node's pool
+    const unsigned int vSkip[] = { 0, 100, 10, 2 };
+    for (unsigned int n = 0; n < sizeof(vSkip) / sizeof(vSkip[0]); n++)
+    {
+        CTxMemPool pool;
+        FillPool(pool, block, vSkip[n]);
+
+        nStart = GetTimeMicros();
+        CCompactBlock cmpctblockRecv;
+        CDataStream(ssCmpct) >> cmpctblockRecv;
+        CPartialBlock partial;
+        BOOST_REQUIRE(partial.Init(cmpctblockRecv, pool));
+
+        // "getblocktxn" / "blocktxn" round trip for what is missing
+        CBlockTxRequest req;
+        req.hashBlock = cmpctblockRecv.header.GetHash();
+        req.vIndex = partial.GetMissing();
+        CBlockTxRequest reqRecv;
+        RoundTrip(req, reqRecv);
+        CBlockTxResponse resp;
+        resp.hashBlock = reqRecv.hashBlock;
+        BOOST_FOREACH(unsigned int nIndex, reqRecv.vIndex)
+            resp.vtx.push_back(block.vtx[nIndex]);
+        CBlockTxResponse respRecv;
+        RoundTrip(resp, respRecv);
+
+        CBlock blockOut;
+        BOOST_CHECK(partial.Fill(respRecv.vtx, blockOut));
+        int64 nRebuild = GetTimeMicros() - nStart;
+        BOOST_CHECK(blockOut.GetHash() == block.GetHash());
+        BOOST_CHECK(blockOut.hashMerkleRoot == block.hashMerkleRoot);
+
+        unsigned int nExpected = nTx - 2;
+        if (vSkip[n])
+            for (unsigned int i = 2; i < nTx; i++)
+                if (i % vSkip[n] == 0)
+                    nExpected--;
+        BOOST_CHECK_EQUAL(partial.nFromPool, nExpected);
+        BOOST_CHECK_EQUAL(reqRecv.vIndex.size(), nTx - 2 - nExpected);
+
+        unsigned int nBytes = ssCmpct.size() + ::GetSerializeSize(req, SER_NETWORK, PROTOCOL_VERSION) +
+                              ::GetSerializeSize(resp, SER_NETWORK, PROTOCOL_VERSION);
+        BOOST_CHECK(nBytes < nBlockSize);
+        printf("compactblock_reconstruct: node %u: %u/%u transactions from pool (%.1f%%), %u of %u bytes, build %"PRI64d"us, rebuild %"PRI64d"us\n",
+               n, partial.nFromPool, nTx - 2, 100.0 * partial.nFromPool / (nTx - 2), nBytes, nBlockSize, nBuild, nRebuild);
+    }
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -0,0 +1,211 @@
+//
+// Headers-first synchronization: header chain, parallel block download
+//
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+// Chain of nCount headers on top of pindexPrev, each with the required nBits and a
+// hash within the bound a header can be checked against
+static vector<CBlockHeader> MakeHeaders(CBlockIndex* pindexPrev, unsigned int nCount)
+{
+    vector<CBlockHeader> vHeaders;
+    vector<uint256> vHash(nCount);
+    vector<CBlockIndex*> vIndex;
+    for (unsigned int i = 0; i < nCount; i++)
+    {
+        CBlockHeader header;
+        header.nVersion = CBlockHeader::CURRENT_VERSION;
+        header.hashPrevBlock = pindexPrev->GetBlockHash();
+        header.hashMerkleRoot = GetRandHash();
+        header.nTime = pindexPrev->nTime + 60;
+        header.nBits = GetNextWorkRequired(pindexPrev, &header);
+        header.nNonce = 0;
+        uint256 hashBound = GetProofOfWorkBound(header.nBits);
+        while ((vHash[i] = header.GetHashFork(pindexPrev->nHeight + 1)) > hashBound)
+            header.nNonce++;
+        vHeaders.push_back(header);
+
+        // index entry of the header, for the difficulty of the next one
+        CBlockIndex* pindex = new CBlockIndex(header);
+        pindex->phashBlock = &vHash[i];
+        pindex->pprev = pindexPrev;
+        pindex->nHeight = pindexPrev->nHeight + 1;
+        vIndex.push_back(pindex);
+        pindexPrev = pindex;
+    }
+    BOOST_FOREACH(CBlockIndex* pindex, vIndex)
+        delete pindex;
+    return vHeaders;
+}
+
+BOOST_AUTO_TEST_SUITE(headerssync_tests)
+
+BOOST_AUTO_TEST_CASE(headerssync_process)
+{
+    const int nHeight = nBestHeight;
+
+    // headers that don't connect are ignored without penalty
+    vector<CBlockHeader> vHeaders = MakeHeaders(pindexBest, 10);
+    vector<CBlockHeader> vLoose(vHeaders.begin() + 1, vHeaders.end());
+    CValidationState state;
+    int nDoS = 0;
+    BOOST_CHECK(!ProcessHeaders(state, NULL, vLoose));
+    BOOST_CHECK(!state.IsInvalid(nDoS));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight);
+
+    // a header with the wrong difficulty is rejected, the ones before it are taken
+    vector<CBlockHeader> vBad = vHeaders;
+    vBad[5].nBits ^= 1;
+    state = CValidationState();
+    BOOST_CHECK(!ProcessHeaders(state, NULL, vBad));
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 5);
+
+    // so is a header whose hash is beyond any relaxation of nBits
+    vBad = vHeaders;
+    while (vBad[5].GetHashFork(nHeight + 6) <= GetProofOfWorkBound(vBad[5].nBits))
+        vBad[5].nNonce++;
+    state = CValidationState();
+    BOOST_CHECK(!ProcessHeaders(state, NULL, vBad));
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 5);
+
+    // the whole chain extends the header chain, known headers are skipped
+    state = CValidationState();
+    BOOST_CHECK(ProcessHeaders(state, NULL, vHeaders));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 10);
+    BOOST_CHECK(ProcessHeaders(state, NULL, vHeaders));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 10);
+
+    // a shorter branch doesn't replace it, nor does a longer one before its blocks arrive
+    vector<CBlockHeader> vBranch = MakeHeaders(pindexBest, 3);
+    BOOST_CHECK(ProcessHeaders(state, NULL, vBranch));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 10);
+    vBranch = MakeHeaders(pindexBest, 12);
+    BOOST_CHECK(ProcessHeaders(state, NULL, vBranch));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 10);
+
+    // headers out of order are rejected
+    vector<CBlockHeader> vSwapped = MakeHeaders(pindexBest, 4);
+    swap(vSwapped[1], vSwapped[2]);
+    state = CValidationState();
+    BOOST_CHECK(!ProcessHeaders(state, NULL, vSwapped));
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 20);
+
+    // too many headers in one message
+    state = CValidationState();
+    BOOST_CHECK(!ProcessHeaders(state, NULL, vector<CBlockHeader>(MAX_HEADERS_RESULTS + 1)));
+    BOOST_CHECK(state.IsInvalid(nDoS) && nDoS == 20);
+
+    ClearHeaderChain();
+}
+
+BOOST_AUTO_TEST_CASE(headerssync_download)
+{
+    const int nHeight = nBestHeight;
+    vector<CBlockHeader> vHeaders = MakeHeaders(pindexBest, 12);
+    CValidationState state;
+    BOOST_CHECK(ProcessHeaders(state, NULL, vHeaders));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 12);
+
+    // two peers share the header chain, the second one only has part of it
+    CNode node1(INVALID_SOCKET, CAddress(), "", true);
+    CNode node2(INVALID_SOCKET, CAddress(), "", true);
+    node1.nStartingHeight = nHeight + 12;
+    node2.nStartingHeight = nHeight + 8;
+
+    vector<CInv> vInv1, vInv2;
+    FindBlocksToDownload(&node1, 5, vInv1);
+    FindBlocksToDownload(&node2, 5, vInv2);
+    BOOST_CHECK_EQUAL(vInv1.size(), 5U);
+    BOOST_CHECK_EQUAL(vInv2.size(), 3U);
+
+    // nothing is asked for twice, the limit per peer holds
+    set<uint256> setAsked;
+    BOOST_FOREACH(const CInv& inv, vInv1)
+        BOOST_CHECK(setAsked.insert(inv.hash).second);
+    BOOST_FOREACH(const CInv& inv, vInv2)
+        BOOST_CHECK(setAsked.insert(inv.hash).second);
+    vector<CInv> vMore;
+    FindBlocksToDownload(&node1, 5, vMore);
+    BOOST_CHECK(vMore.empty());
+    FindBlocksToDownload(&node1, 10, vMore);
+    BOOST_CHECK_EQUAL(vMore.size(), 4U);
+    BOOST_FOREACH(const CInv& inv, vMore)
+        BOOST_CHECK(setAsked.insert(inv.hash).second);
+    BOOST_CHECK_EQUAL(setAsked.size(), 12U);
+    BOOST_CHECK(vInv1[0].type == MSG_BLOCK);
+    BOOST_CHECK(vInv1[0].hash == vHeaders[0].GetHashFork(nHeight + 1));
+
+    ClearHeaderChain();
+}
+
+BOOST_AUTO_TEST_CASE(headerssync_unserved)
+{
+    const int nHeight = nBestHeight;
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    vector<CBlockHeader> vHeaders = MakeHeaders(pindexBest, 6);
+    CValidationState state;
+    BOOST_CHECK(ProcessHeaders(state, &node, vHeaders));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight + 6);
+    vector<CInv> vInv;
+    FindBlocksToDownload(&node, 2, vInv);
+    BOOST_CHECK_EQUAL(vInv.size(), 2U);
+
+    // the peer that sent the headers doesn't serve their blocks: its headers go
+    SetMockTime(GetTime() + BLOCK_DOWNLOAD_TIMEOUT + 1);
+    vInv.clear();
+    FindBlocksToDownload(&node, 2, vInv);
+    SetMockTime(0);
+    BOOST_CHECK(node.fHeadersUnserved);
+    BOOST_CHECK(vInv.empty());
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight);
+
+    // and it is synchronized with "getblocks" from now on
+    BOOST_CHECK(ProcessHeaders(state, &node, vHeaders));
+    BOOST_CHECK_EQUAL(GetBestHeaderHeight(), nHeight);
+
+    ClearHeaderChain();
+}
+
+BOOST_AUTO_TEST_CASE(headerssync_stall)
+{
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    node.nVersion = PROTOCOL_VERSION;
+    node.fClient = true;    // no downloads along the header chain
+    node.nStartingHeight = GetBestHeaderHeight() + 100;
+
+    // a block not delivered in time is a stall, the other request stays
+    uint256 hash1 = GetRandHash(), hash2 = GetRandHash();
+    int64 nNow = GetTimeMicros();
+    node.mapBlocksAsked[hash1] = nNow - (BLOCK_DOWNLOAD_TIMEOUT + 1) * 1000000;
+    node.mapBlocksAsked[hash2] = nNow - 1000;
+    BOOST_CHECK(SendMessages(&node, false));
+    BOOST_CHECK_EQUAL(node.nStalls, 1U);
+    BOOST_CHECK(node.nStallTime != 0);
+    BOOST_CHECK_EQUAL(node.mapBlocksAsked.size(), 1U);
+    BOOST_CHECK(node.mapBlocksAsked.count(hash2));
+
+    // an unanswered "getheaders" from a peer that is ahead is a stall too
+    node.nSyncAskTime = nNow - (SYNC_RESPONSE_TIMEOUT + 1) * 1000000;
+    BOOST_CHECK(SendMessages(&node, false));
+    BOOST_CHECK_EQUAL(node.nStalls, 2U);
+    BOOST_CHECK_EQUAL(node.nSyncAskTime, 0);
+
+    // but not from one that has nothing newer
+    node.nStartingHeight = 0;
+    node.nSyncAskTime = nNow - (SYNC_RESPONSE_TIMEOUT + 1) * 1000000;
+    BOOST_CHECK(SendMessages(&node, false));
+    BOOST_CHECK_EQUAL(node.nStalls, 2U);
+
+    ClearHeaderChain();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
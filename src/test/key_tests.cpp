@@ -135,6 +135,14 @@ BOOST_AUTO_TEST_CASE(key_test1)
         BOOST_CHECK(rkey2  == pubkey2);
         BOOST_CHECK(rkey1C == pubkey1C);
         BOOST_CHECK(rkey2C == pubkey2C);
+
+        // recid 3 and headers out of range are refused
+        vector<unsigned char> csignBad(csign1C);
+        csignBad[0] = 27 + 3 + 4;
+        BOOST_CHECK(!rkey1C.RecoverCompact(hashMsg, csignBad));
+        BOOST_CHECK(!pubkey1C.VerifyCompact(hashMsg, csignBad));
+        csignBad[0] = 26;
+        BOOST_CHECK(!rkey1C.RecoverCompact(hashMsg, csignBad));
     }
 }
 
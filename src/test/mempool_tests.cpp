@@ -0,0 +1,302 @@
+//
+// Memory pool entries: package accounting, eviction by fee rate, persistence, batch acceptance
+//
+#include <boost/test/unit_test.hpp>
+#include <boost/filesystem.hpp>
+
+#include "keystore.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+// Transaction spending output n of prevout hash, or an unknown coin
+static CSharedTxRef MakeTx(const uint256& hashPrev, unsigned int n)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(hashPrev == 0 ? GetRandHash() : hashPrev, n);
+    tx.vout.resize(2);
+    tx.vout[0].nValue = 1000;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    tx.vout[1].nValue = 2000;
+    tx.vout[1].scriptPubKey = CScript() << OP_TRUE;
+    return CSharedTxRef(new CSharedTx(tx));
+}
+
+// Signed transaction spending output n of txPrev to key
+static CTransaction Spend(const CTransaction& txPrev, unsigned int n, const CKey& key, const CKeyStore& keystore)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(txPrev.GetHash(), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = txPrev.vout[n].nValue - CENT;
+    tx.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    BOOST_CHECK(SignSignature(keystore, txPrev, tx, 0));
+    return tx;
+}
+
+static CTxMemPoolEntry MakeEntry(const CSharedTxRef& ptx, int64 nFee)
+{
+    return CTxMemPoolEntry(ptx, nFee, 0, 0, nBestHeight, GetTime());
+}
+
+BOOST_AUTO_TEST_SUITE(mempool_tests)
+
+BOOST_AUTO_TEST_CASE(mempool_packages)
+{
+    CTxMemPool pool;
+    CSharedTxRef ptxParent = MakeTx(0, 0);
+    CSharedTxRef ptxChild = MakeTx(ptxParent->hash, 0);
+    CSharedTxRef ptxGrandChild = MakeTx(ptxChild->hash, 1);
+    unsigned int nSize = ptxParent->GetTxSize();
+
+    BOOST_CHECK(pool.addUnchecked(MakeEntry(ptxParent, 100)));
+    BOOST_CHECK(!pool.addUnchecked(MakeEntry(ptxParent, 100)));
+    BOOST_CHECK(pool.addUnchecked(MakeEntry(ptxChild, 10000)));
+    BOOST_CHECK(pool.addUnchecked(MakeEntry(ptxGrandChild, 1000)));
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), 3U * nSize);
+
+    // the fees of the descendants count for the parent
+    const CTxMemPoolEntry& parent = pool.mapTx.find(ptxParent->hash)->second;
+    BOOST_CHECK_EQUAL(parent.nFeesWithDescendants, 11100);
+    BOOST_CHECK_EQUAL(parent.nSizeWithDescendants, (int64)(3 * nSize));
+    BOOST_CHECK_EQUAL(parent.nCountWithDescendants, 3);
+    BOOST_CHECK_EQUAL(parent.GetDescendantScore(), 11100.0 / (3 * nSize));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxChild->hash)->second.nFeesWithDescendants, 11000);
+
+    // the grandchild alone pays less than the parent with its package
+    BOOST_CHECK((*pool.setByScore.begin())->GetHash() == ptxGrandChild->hash);
+    BOOST_CHECK_EQUAL(pool.setByMiningWork.size(), 3U);
+
+    // removed from a block: the parent goes, the children stay
+    pool.remove(ptxParent->tx);
+    BOOST_CHECK_EQUAL(pool.size(), 2U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxChild->hash)->second.nFeesWithDescendants, 11000);
+
+    // back after a reorganization: the children join its package again
+    BOOST_CHECK(pool.addUnchecked(MakeEntry(ptxParent, 100)));
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxParent->hash)->second.nFeesWithDescendants, 11100);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxParent->hash)->second.nCountWithDescendants, 3);
+
+    // the child goes with its descendant, the parent's package shrinks
+    pool.remove(ptxChild->tx, true);
+    BOOST_CHECK_EQUAL(pool.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxParent->hash)->second.nFeesWithDescendants, 100);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxParent->hash)->second.nSizeWithDescendants, (int64)nSize);
+    BOOST_CHECK_EQUAL(pool.mapTx.find(ptxParent->hash)->second.nCountWithDescendants, 1);
+    BOOST_CHECK_EQUAL(pool.setByScore.size(), 1U);
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), nSize);
+
+    pool.clear();
+    BOOST_CHECK(pool.setByScore.empty());
+    BOOST_CHECK(pool.setByMiningWork.empty());
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), 0U);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_trim)
+{
+    CTxMemPool pool;
+    CSharedTxRef ptxLow = MakeTx(0, 0);
+    CSharedTxRef ptxLowChild = MakeTx(ptxLow->hash, 0);
+    CSharedTxRef ptxMid = MakeTx(0, 0);
+    CSharedTxRef ptxHigh = MakeTx(0, 0);
+    CSharedTxRef ptxPoor = MakeTx(0, 0);
+    CSharedTxRef ptxPoorChild = MakeTx(ptxPoor->hash, 0);
+    unsigned int nSize = ptxLow->GetTxSize();
+
+    pool.addUnchecked(MakeEntry(ptxLow, 500));
+    pool.addUnchecked(MakeEntry(ptxLowChild, 1500));
+    pool.addUnchecked(MakeEntry(ptxMid, 5000));
+    pool.addUnchecked(MakeEntry(ptxHigh, 12000));
+    // a child paying for its parent keeps the parent
+    pool.addUnchecked(MakeEntry(ptxPoor, 0));
+    pool.addUnchecked(MakeEntry(ptxPoorChild, 20000));
+    BOOST_CHECK_EQUAL(pool.size(), 6U);
+
+    // nothing to do under the limit
+    BOOST_CHECK_EQUAL(pool.TrimToSize(6 * nSize), 0U);
+
+    // the lowest package goes as a whole, although the child alone pays more
+    BOOST_CHECK_EQUAL(pool.TrimToSize(5 * nSize), 2U);
+    BOOST_CHECK(!pool.exists(ptxLow->hash));
+    BOOST_CHECK(!pool.exists(ptxLowChild->hash));
+    BOOST_CHECK_EQUAL(pool.GetTotalTxSize(), 4U * nSize);
+
+    BOOST_CHECK_EQUAL(pool.TrimToSize(3 * nSize), 1U);
+    BOOST_CHECK(!pool.exists(ptxMid->hash));
+    BOOST_CHECK(pool.exists(ptxHigh->hash));
+    BOOST_CHECK(pool.exists(ptxPoor->hash));
+    BOOST_CHECK(pool.exists(ptxPoorChild->hash));
+    BOOST_CHECK_EQUAL(pool.mapNextTx.size(), 3U);
+
+    // what comes next pays more than the evicted package and the relay fee
+    int64 nMinFee = 5000 + CTransaction::nMinRelayTxFee * nSize / 1000;
+    int64 nRollingMinFee = pool.GetRollingMinFee(nSize);
+    BOOST_CHECK(nRollingMinFee >= nMinFee - 1 && nRollingMinFee <= nMinFee);
+
+    // and it decays, faster with the pool far from full
+    SetMockTime(GetTime() + ROLLING_FEE_HALFLIFE / 4);
+    nRollingMinFee = pool.GetRollingMinFee(nSize);
+    BOOST_CHECK(nRollingMinFee >= nMinFee / 2 - 1 && nRollingMinFee <= nMinFee / 2);
+    SetMockTime(GetTime() + ROLLING_FEE_HALFLIFE);
+    BOOST_CHECK_EQUAL(pool.GetRollingMinFee(nSize), 0);
+    SetMockTime(0);
+}
+
+BOOST_AUTO_TEST_CASE(mempool_persist)
+{
+    mempool.clear();
+    CSharedTxRef ptxParent = MakeTx(0, 0);
+    CSharedTxRef ptxChild = MakeTx(ptxParent->hash, 0);
+    CSharedTxRef ptxGrandChild = MakeTx(ptxChild->hash, 0);
+    CSharedTxRef ptxOther = MakeTx(0, 0);
+    // added children first, as after a reorganization
+    CSharedTxRef vptx[] = { ptxGrandChild, ptxOther, ptxChild, ptxParent };
+    for (unsigned int i = 0; i < 4; i++)
+    {
+        CTxMemPoolEntry entry(vptx[i], 1000 * i, 0, 0, 100 + i, 1368576000 + i);
+        entry.hashMining = vptx[i]->hash;
+        BOOST_CHECK(mempool.addUnchecked(entry));
+    }
+    BOOST_CHECK(DumpMempool());
+    boost::filesystem::path path = GetDataDir() / "mempool.dat";
+    BOOST_REQUIRE(boost::filesystem::exists(path));
+
+    // parents come before their children, the entries keep time and mining hash
+    {
+        CAutoFile filein = CAutoFile(fopen(path.string().c_str(), "rb"), SER_DISK, CLIENT_VERSION);
+        unsigned char pchMagic[4];
+        int nVersion;
+        uint64 nCount;
+        filein >> FLATDATA(pchMagic) >> nVersion >> nCount;
+        BOOST_CHECK_EQUAL(nCount, 4U);
+        map<uint256, unsigned int> mapPos;
+        for (unsigned int i = 0; i < nCount; i++)
+        {
+            CTransaction tx;
+            int64 nTime, nFee;
+            int nHeight;
+            uint256 hashMining;
+            filein >> tx >> nTime >> nFee >> nHeight >> hashMining;
+            const CTxMemPoolEntry& entry = mempool.mapTx.find(tx.GetHash())->second;
+            BOOST_CHECK_EQUAL(nTime, entry.nTime);
+            BOOST_CHECK_EQUAL(nFee, entry.nFee);
+            BOOST_CHECK_EQUAL(nHeight, entry.nHeight);
+            BOOST_CHECK(hashMining == tx.GetHash());
+            mapPos[tx.GetHash()] = i;
+        }
+        BOOST_CHECK(mapPos[ptxParent->hash] < mapPos[ptxChild->hash]);
+        BOOST_CHECK(mapPos[ptxChild->hash] < mapPos[ptxGrandChild->hash]);
+    }
+
+    // read back: the file is fine, the transactions have no coins here
+    mempool.clear();
+    BOOST_CHECK(LoadMempool());
+    BOOST_CHECK_EQUAL(mempool.size(), 0U);
+
+    // a damaged file is not used
+    {
+        FILE* file = fopen(path.string().c_str(), "r+b");
+        BOOST_REQUIRE(file);
+        fseek(file, 20, SEEK_SET);
+        int c = fgetc(file);
+        fseek(file, 20, SEEK_SET);
+        fputc(c ^ 0xff, file);
+        fclose(file);
+    }
+    BOOST_CHECK(!LoadMempool());
+    boost::filesystem::remove(path);
+    BOOST_CHECK(!LoadMempool());
+}
+
+BOOST_AUTO_TEST_CASE(mempool_batch)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+
+    // coins to spend, in the chain
+    CTransaction txFund;
+    txFund.vin.resize(1);
+    txFund.vin[0].prevout = COutPoint(GetRandHash(), 0);
+    txFund.vout.resize(4);
+    for (unsigned int i = 0; i < txFund.vout.size(); i++)
+    {
+        txFund.vout[i].nValue = COIN;
+        txFund.vout[i].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+    }
+    pcoinsTip->SetCoins(txFund.GetHash(), CCoins(txFund, nBestHeight));
+
+    CTransaction txA = Spend(txFund, 0, key, keystore);
+    CTransaction txChild = Spend(txA, 0, key, keystore);
+    CTransaction txBad = Spend(txFund, 1, key, keystore);
+    txBad.vin[0].scriptSig[6] ^= 0x01;     // inside the signature, still DER
+    CTransaction txBadChild = Spend(txBad, 0, key, keystore);
+    CTransaction txConflict = Spend(txFund, 0, key, keystore);
+    txConflict.vout[0].nValue -= CENT;
+    BOOST_CHECK(SignSignature(keystore, txFund, txConflict, 0));
+    CTransaction txOther = Spend(txFund, 2, key, keystore);
+
+    vector<CTxMemPoolAccept> vAccept;
+    CTransaction vtx[] = { txA, txChild, txBad, txBadChild, txConflict, txOther };
+    for (unsigned int i = 0; i < 6; i++)
+        vAccept.push_back(CTxMemPoolAccept(CSharedTxRef(new CSharedTx(vtx[i]))));
+    {
+        LOCK(cs_main);
+        BOOST_CHECK_EQUAL(mempool.acceptBatch(vAccept, false), 3U);
+    }
+
+    // a child in the same batch is accepted with its parent
+    BOOST_CHECK(vAccept[0].fAccepted && mempool.exists(txA.GetHash()));
+    BOOST_CHECK(vAccept[1].fAccepted && mempool.exists(txChild.GetHash()));
+    BOOST_CHECK_EQUAL(vAccept[1].nFee, CENT);
+    BOOST_CHECK(vAccept[5].fAccepted && mempool.exists(txOther.GetHash()));
+
+    // the bad signature is found among the others, its child misses its input
+    int nDoS = 0;
+    BOOST_CHECK(!vAccept[2].fAccepted);
+    BOOST_CHECK(vAccept[2].state.IsInvalid(nDoS) && nDoS == 100);
+    BOOST_CHECK(!vAccept[3].fAccepted && vAccept[3].fMissingInputs);
+    BOOST_CHECK(!vAccept[3].state.IsInvalid(nDoS));
+
+    // a double spend inside the batch is dropped without penalty
+    BOOST_CHECK(!vAccept[4].fAccepted && !vAccept[4].fMissingInputs);
+    BOOST_CHECK(!vAccept[4].state.IsInvalid(nDoS));
+
+    // the single transaction path goes the same way
+    CValidationState state;
+    bool fMissingInputs = false;
+    {
+        LOCK(cs_main);
+        BOOST_CHECK(mempool.accept(state, Spend(txFund, 3, key, keystore), false, &fMissingInputs));
+        BOOST_CHECK(!mempool.accept(state, txBadChild, false, &fMissingInputs));
+    }
+    BOOST_CHECK(fMissingInputs);
+    BOOST_CHECK_EQUAL(mempool.size(), 4U);
+
+    mempool.clear();
+    pcoinsTip->SetCoins(txFund.GetHash(), CCoins());
+}
+
+BOOST_AUTO_TEST_CASE(mempool_mining_work)
+{
+    CTransaction tx;
+    tx.tBlock = 50;
+    BOOST_CHECK_EQUAL(GetTxMiningBlock(tx, 100), 50);
+    // a transaction referring to the tip or later refers to the block before it, as in the miner
+    BOOST_CHECK_EQUAL(GetTxMiningBlock(tx, 50), 50 - (int)TX_TBLOCK);
+    tx.tBlock = -120;
+    BOOST_CHECK_EQUAL(GetTxMiningBlock(tx, 100), 100 - (int)TX_TBLOCK);
+
+    // the older the block it refers to, the less it adds
+    uint256 hashMining = uint256("0x0000ffff00000000000000000000000000000000000000000000000000000000");
+    CBigNum bnWork = CBigNum(~uint256(0)) / CBigNum(hashMining);
+    BOOST_CHECK(GetTxMiningWork(hashMining, 99, 100) == bnWork.getuint256());
+    BOOST_CHECK(GetTxMiningWork(hashMining, 96, 100) == (bnWork / 4).getuint256());
+    BOOST_CHECK(GetTxMiningWork(0, 99, 100) == 0);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
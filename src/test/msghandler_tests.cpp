@@ -0,0 +1,84 @@
+//
+// Message handler wakeups: queued inventory and nodes with work waiting
+//
+#include <boost/test/unit_test.hpp>
+
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+// Serialized header of a message without payload
+static string EmptyMessage(const char* pszCommand)
+{
+    CMessageHeader hdr(pszCommand, 0);
+    uint256 hash = Hash(pszCommand, pszCommand);
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    return ss.str();
+}
+
+BOOST_AUTO_TEST_SUITE(msghandler_tests)
+
+BOOST_AUTO_TEST_CASE(msghandler_send_wake)
+{
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    BOOST_CHECK(!node.fSendWake);
+
+    // inventory the peer knows already is not queued and wakes nobody
+    CInv invKnown(MSG_TX, GetRandHash());
+    node.AddInventoryKnown(invKnown);
+    node.PushInventory(invKnown);
+    BOOST_CHECK(!node.fSendWake);
+    BOOST_CHECK(node.vInventoryToSend.empty());
+
+    // new inventory asks SendMessages to look at the node
+    CInv inv(MSG_TX, GetRandHash());
+    node.PushInventory(inv);
+    BOOST_CHECK(node.fSendWake);
+    BOOST_CHECK_EQUAL(node.vInventoryToSend.size(), 1U);
+}
+
+BOOST_AUTO_TEST_CASE(msghandler_has_messages)
+{
+    CNode node(INVALID_SOCKET, CAddress(), "", true);
+    LOCK(node.cs_vRecvMsg);
+    BOOST_CHECK(!NodeHasMessages(&node));
+
+    // a message counts once it is complete
+    string strPing = EmptyMessage("ping");
+    BOOST_CHECK(node.ReceiveMsgBytes(strPing.data(), 10));
+    BOOST_CHECK(!NodeHasMessages(&node));
+    BOOST_CHECK(node.ReceiveMsgBytes(strPing.data() + 10, strPing.size() - 10));
+    BOOST_CHECK(NodeHasMessages(&node));
+
+    // it waits while the class of its reply is full
+    node.vSendSize[SEND_CONTROL] = SendBufferSize();
+    BOOST_CHECK(!NodeHasMessages(&node));
+    node.vSendSize[SEND_CONTROL] = 0;
+    node.vSendSize[SEND_BLOCK] = SendBufferSize();
+    BOOST_CHECK(NodeHasMessages(&node));
+    node.vSendSize[SEND_BLOCK] = 0;
+
+    // "mempool" replies with transaction invs
+    node.vRecvMsg.clear();
+    string strMempool = EmptyMessage("mempool");
+    BOOST_CHECK(node.ReceiveMsgBytes(strMempool.data(), strMempool.size()));
+    BOOST_CHECK(NodeHasMessages(&node));
+    node.vSendSize[SEND_TX] = SendBufferSize();
+    BOOST_CHECK(!NodeHasMessages(&node));
+    node.vSendSize[SEND_TX] = 0;
+
+    // a waiting "getdata" request counts while its send class has room
+    node.vRecvMsg.clear();
+    BOOST_CHECK(!NodeHasMessages(&node));
+    node.vRecvGetData.push_back(CInv(MSG_BLOCK, GetRandHash()));
+    BOOST_CHECK(NodeHasMessages(&node));
+    node.vSendSize[SEND_BLOCK] = SendBufferSize();
+    BOOST_CHECK(!NodeHasMessages(&node));
+    node.vSendSize[SEND_BLOCK] = 0;
+    node.vRecvGetData.clear();
+}
+
+BOOST_AUTO_TEST_SUITE_END()
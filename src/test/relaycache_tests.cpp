@@ -0,0 +1,106 @@
+//
+// Shared transactions: one copy for memory pool, relay cache and orphans
+//
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+static CTransaction MakeTx(unsigned int n)
+{
+    CTransaction tx;
+    tx.vin.resize(1);
+    tx.vin[0].prevout = COutPoint(GetRandHash(), n);
+    tx.vout.resize(1);
+    tx.vout[0].nValue = 1000 + n;
+    tx.vout[0].scriptPubKey = CScript() << OP_TRUE;
+    return tx;
+}
+
+BOOST_AUTO_TEST_SUITE(relaycache_tests)
+
+BOOST_AUTO_TEST_CASE(relaycache_message)
+{
+    CTransaction tx = MakeTx(0);
+    CSharedTx stx(tx);
+    unsigned int nSize = ::GetSerializeSize(tx, SER_NETWORK, PROTOCOL_VERSION);
+    BOOST_CHECK(stx.hash == tx.GetHash());
+    BOOST_CHECK_EQUAL(stx.GetTxSize(), nSize);
+
+    // the message is a valid "tx" message carrying the transaction
+    CDataStream ss(stx.msg.begin(), stx.msg.end(), SER_NETWORK, PROTOCOL_VERSION);
+    CMessageHeader hdr;
+    ss >> hdr;
+    BOOST_CHECK(hdr.IsValid());
+    BOOST_CHECK_EQUAL(hdr.GetCommand(), "tx");
+    BOOST_CHECK_EQUAL(hdr.nMessageSize, nSize);
+    uint256 hash = Hash(ss.begin(), ss.end());
+    unsigned int nChecksum = 0;
+    memcpy(&nChecksum, &hash, sizeof(nChecksum));
+    BOOST_CHECK_EQUAL(hdr.nChecksum, nChecksum);
+    CTransaction tx2;
+    ss >> tx2;
+    BOOST_CHECK(tx2 == tx);
+
+    // a received payload is used as it is, without what follows the transaction
+    CDataStream ssPayload(SER_NETWORK, PROTOCOL_VERSION);
+    ssPayload << tx << (uint64)0;
+    CSharedTx stx2(tx, ssPayload);
+    BOOST_CHECK(stx2.msg == stx.msg);
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_shared)
+{
+    CTxMemPool pool;
+    CSharedTxRef ptx(new CSharedTx(MakeTx(1)));
+    pool.addUnchecked(ptx);
+    BOOST_CHECK(pool.get(ptx->hash) == ptx);
+    BOOST_CHECK(&pool.lookup(ptx->hash) == &ptx->tx);
+    BOOST_CHECK(pool.mapNextTx[ptx->tx.vin[0].prevout].ptx == &ptx->tx);
+    BOOST_CHECK(!pool.get(GetRandHash()));
+
+    pool.remove(ptx->tx);
+    BOOST_CHECK(ptx.unique());
+}
+
+BOOST_AUTO_TEST_CASE(relaycache_budget)
+{
+    size_t nMaxSaved = nMaxRelayCacheSize;
+    {
+        LOCK(cs_mapRelay);
+        mapRelay.clear();
+        vRelayExpiration.clear();
+        nRelayCacheSize = 0;
+    }
+
+    // room for three transactions: older ones go first
+    vector<CSharedTxRef> vtx;
+    for (unsigned int i = 0; i < 5; i++)
+        vtx.push_back(CSharedTxRef(new CSharedTx(MakeTx(i))));
+    nMaxRelayCacheSize = 3 * vtx[0]->msg.size() + 10;
+    for (unsigned int i = 0; i < vtx.size(); i++)
+        RelayTransaction(vtx[i]);
+    {
+        LOCK(cs_mapRelay);
+        BOOST_CHECK_EQUAL(mapRelay.size(), 3U);
+        BOOST_CHECK(nRelayCacheSize <= nMaxRelayCacheSize);
+        BOOST_CHECK(!mapRelay.count(CInv(MSG_TX, vtx[0]->hash)));
+        BOOST_CHECK(!mapRelay.count(CInv(MSG_TX, vtx[1]->hash)));
+        BOOST_CHECK(mapRelay[CInv(MSG_TX, vtx[4]->hash)] == vtx[4]);
+    }
+
+    // a transaction larger than the whole budget isn't kept
+    nMaxRelayCacheSize = 10;
+    RelayTransaction(vtx[0]);
+    {
+        LOCK(cs_mapRelay);
+        BOOST_CHECK(mapRelay.empty());
+        BOOST_CHECK_EQUAL(nRelayCacheSize, 0U);
+    }
+    nMaxRelayCacheSize = nMaxSaved;
+}
+
+BOOST_AUTO_TEST_SUITE_END()
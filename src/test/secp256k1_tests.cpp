@@ -0,0 +1,377 @@
+//
+// Native secp256k1: agreement with OpenSSL on keys, signatures and parsing
+//
+#include <boost/test/unit_test.hpp>
+
+#include <openssl/bn.h>
+#include <openssl/ec.h>
+#include <openssl/ecdsa.h>
+#include <openssl/obj_mac.h>
+#include <openssl/opensslv.h>
+
+#include "secp256k1.h"
+#include "util.h"
+
+using namespace std;
+
+// OpenSSL key with a fresh secret, its 32 secret bytes and serialized public key
+static EC_KEY* NewKey(unsigned char *pchKey, vector<unsigned char>& vchPubKey, bool fCompressed)
+{
+    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    BOOST_REQUIRE(pkey != NULL);
+    BOOST_REQUIRE(EC_KEY_generate_key(pkey));
+    const BIGNUM *bn = EC_KEY_get0_private_key(pkey);
+    int nBytes = BN_num_bytes(bn);
+    memset(pchKey, 0, 32);
+    BN_bn2bin(bn, &pchKey[32 - nBytes]);
+    EC_KEY_set_conv_form(pkey, fCompressed ? POINT_CONVERSION_COMPRESSED : POINT_CONVERSION_UNCOMPRESSED);
+    vchPubKey.resize(i2o_ECPublicKey(pkey, NULL));
+    unsigned char *pbegin = &vchPubKey[0];
+    i2o_ECPublicKey(pkey, &pbegin);
+    return pkey;
+}
+
+static bool OpenSSLVerify(const vector<unsigned char>& vchPubKey, const uint256& hash, const vector<unsigned char>& vchSig)
+{
+    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    const unsigned char *pbegin = &vchPubKey[0];
+    bool fOk = o2i_ECPublicKey(&pkey, &pbegin, vchPubKey.size()) &&
+               ECDSA_verify(0, (const unsigned char*)&hash, sizeof(hash), &vchSig[0], vchSig.size(), pkey) == 1;
+    EC_KEY_free(pkey);
+    return fOk;
+}
+
+static bool OpenSSLValidPubKey(const vector<unsigned char>& vchPubKey)
+{
+    EC_KEY *pkey = EC_KEY_new_by_curve_name(NID_secp256k1);
+    const unsigned char *pbegin = &vchPubKey[0];
+    bool fOk = o2i_ECPublicKey(&pkey, &pbegin, vchPubKey.size()) != NULL;
+    EC_KEY_free(pkey);
+    return fOk;
+}
+
+static bool NativeVerify(const vector<unsigned char>& vchPubKey, const uint256& hash, const vector<unsigned char>& vchSig)
+{
+    return Secp256k1::Verify(&vchPubKey[0], vchPubKey.size(), hash, &vchSig[0], vchSig.size());
+}
+
+static void Sign(const unsigned char *pchKey, const uint256& hash, unsigned char *p64, int& nRecId)
+{
+    uint256 nonce;
+    do {
+        nonce = GetRandHash();
+    } while (!Secp256k1::Sign(pchKey, hash, (const unsigned char*)&nonce, p64, nRecId));
+}
+
+BOOST_AUTO_TEST_SUITE(secp256k1_tests)
+
+BOOST_AUTO_TEST_CASE(secp256k1_pubkey)
+{
+    // the secret 1 gives the generator
+    unsigned char pchOne[32] = {0};
+    pchOne[31] = 1;
+    unsigned char pch[65];
+    unsigned int nSize;
+    Secp256k1::GetPubKey(pchOne, true, pch, nSize);
+    BOOST_CHECK_EQUAL(HexStr(pch, pch + nSize), "0279be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+
+    // random secrets give what OpenSSL gives, in both forms
+    for (int i = 0; i < 20; i++)
+    {
+        bool fCompressed = i & 1;
+        unsigned char pchKey[32];
+        vector<unsigned char> vchPubKey;
+        EC_KEY_free(NewKey(pchKey, vchPubKey, fCompressed));
+        Secp256k1::GetPubKey(pchKey, fCompressed, pch, nSize);
+        BOOST_CHECK(vector<unsigned char>(pch, pch + nSize) == vchPubKey);
+        BOOST_CHECK(Secp256k1::IsValidPubKey(&vchPubKey[0], vchPubKey.size()));
+
+        // decompression matches the uncompressed key
+        unsigned char pchFull[65];
+        BOOST_CHECK(Secp256k1::Decompress(&vchPubKey[0], vchPubKey.size(), pchFull));
+        Secp256k1::GetPubKey(pchKey, false, pch, nSize);
+        BOOST_CHECK(memcmp(pch, pchFull, 65) == 0);
+
+        // hybrid keys: only the prefix with the right parity of y
+        vector<unsigned char> vchHybrid(pchFull, pchFull + 65);
+        vchHybrid[0] = 6 + (pchFull[64] & 1);
+        BOOST_CHECK(Secp256k1::IsValidPubKey(&vchHybrid[0], 65));
+        BOOST_CHECK(OpenSSLValidPubKey(vchHybrid));
+        vchHybrid[0] ^= 1;
+        BOOST_CHECK(!Secp256k1::IsValidPubKey(&vchHybrid[0], 65));
+        BOOST_CHECK(!OpenSSLValidPubKey(vchHybrid));
+
+        // off the curve
+        vector<unsigned char> vchBad(pchFull, pchFull + 65);
+        vchBad[64] ^= 1;
+        BOOST_CHECK(!Secp256k1::IsValidPubKey(&vchBad[0], 65));
+        BOOST_CHECK(!OpenSSLValidPubKey(vchBad));
+    }
+
+    // x not below p, wrong sizes and prefixes
+    vector<unsigned char> vchBad = ParseHex("02fffffffffffffffffffffffffffffffffffffffffffffffffffffffefffffc2f");
+    BOOST_CHECK(!Secp256k1::IsValidPubKey(&vchBad[0], vchBad.size()));
+    BOOST_CHECK(!OpenSSLValidPubKey(vchBad));
+    vchBad = ParseHex("0579be667ef9dcbbac55a06295ce870b07029bfcdb2dce28d959f2815b16f81798");
+    BOOST_CHECK(!Secp256k1::IsValidPubKey(&vchBad[0], vchBad.size()));
+    vchBad.resize(32);
+    vchBad[0] = 2;
+    BOOST_CHECK(!Secp256k1::IsValidPubKey(&vchBad[0], vchBad.size()));
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_sign_verify)
+{
+    for (int i = 0; i < 20; i++)
+    {
+        unsigned char pchKey[32];
+        vector<unsigned char> vchPubKey;
+        EC_KEY *pkey = NewKey(pchKey, vchPubKey, i & 1);
+        uint256 hash = GetRandHash();
+
+        // native signatures verify with OpenSSL and natively
+        unsigned char p64[64];
+        int nRecId;
+        Sign(pchKey, hash, p64, nRecId);
+        vector<unsigned char> vchSig;
+        Secp256k1::EncodeSignature(p64, vchSig);
+        BOOST_CHECK(OpenSSLVerify(vchPubKey, hash, vchSig));
+        BOOST_CHECK(NativeVerify(vchPubKey, hash, vchSig));
+        BOOST_CHECK(!NativeVerify(vchPubKey, GetRandHash(), vchSig));
+
+        unsigned char p64Parsed[64];
+        BOOST_CHECK(Secp256k1::ParseSignature(&vchSig[0], vchSig.size(), p64Parsed));
+        BOOST_CHECK(memcmp(p64, p64Parsed, 64) == 0);
+
+        // OpenSSL signatures verify natively
+        vector<unsigned char> vchSig2(ECDSA_size(pkey));
+        unsigned int nSize = vchSig2.size();
+        BOOST_REQUIRE(ECDSA_sign(0, (const unsigned char*)&hash, sizeof(hash), &vchSig2[0], &nSize, pkey));
+        vchSig2.resize(nSize);
+        BOOST_CHECK(NativeVerify(vchPubKey, hash, vchSig2));
+        vchSig2[vchSig2.size() - 1] ^= 1;
+        BOOST_CHECK(!NativeVerify(vchPubKey, hash, vchSig2));
+
+        // the public key is recovered from r, s and the recovery id
+        unsigned char pch[65];
+        BOOST_CHECK(Secp256k1::Recover(hash, p64, nRecId, i & 1, pch, nSize));
+        BOOST_CHECK(vector<unsigned char>(pch, pch + nSize) == vchPubKey);
+        BOOST_CHECK(!Secp256k1::Recover(hash, p64, 4, i & 1, pch, nSize));
+        if (Secp256k1::Recover(hash, p64, nRecId ^ 1, i & 1, pch, nSize))
+            BOOST_CHECK(vector<unsigned char>(pch, pch + nSize) != vchPubKey);
+
+        EC_KEY_free(pkey);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_der)
+{
+    unsigned char pchKey[32];
+    vector<unsigned char> vchPubKey;
+    EC_KEY_free(NewKey(pchKey, vchPubKey, true));
+    uint256 hash = GetRandHash();
+    unsigned char p64[64];
+    int nRecId;
+    vector<unsigned char> vchSig;
+    do {
+        Sign(pchKey, hash, p64, nRecId);
+        Secp256k1::EncodeSignature(p64, vchSig);
+    } while (vchSig[3] != 32 || (vchSig[4] & 0x80)); // plain 32-byte r, to edit below
+
+    // what OpenSSL accepted before 1.0.0p/1.0.1k is accepted: padding, long form lengths,
+    // indefinite length, trailing data; the chain was validated by such builds
+    vector<unsigned char> vchPadded(vchSig);
+    vchPadded.insert(vchPadded.begin() + 4, 0);
+    vchPadded[1]++;
+    vchPadded[3]++;
+    BOOST_CHECK(NativeVerify(vchPubKey, hash, vchPadded));
+
+    vector<unsigned char> vchLongForm(vchSig);
+    vchLongForm.insert(vchLongForm.begin() + 3, 0x00);
+    vchLongForm.insert(vchLongForm.begin() + 3, 0x82);
+    vchLongForm[1] += 2;
+    vchLongForm.insert(vchLongForm.begin() + 1, 0x81);
+    BOOST_CHECK(NativeVerify(vchPubKey, hash, vchLongForm));
+
+    vector<unsigned char> vchIndefinite(vchSig);
+    vchIndefinite[1] = 0x80;
+    vchIndefinite.push_back(0);
+    vchIndefinite.push_back(0);
+    BOOST_CHECK(NativeVerify(vchPubKey, hash, vchIndefinite));
+    vchIndefinite.pop_back();
+    BOOST_CHECK(!NativeVerify(vchPubKey, hash, vchIndefinite));
+
+    vector<unsigned char> vchTrailing(vchSig);
+    vchTrailing.push_back(0);
+    BOOST_CHECK(NativeVerify(vchPubKey, hash, vchTrailing));
+
+    // and what it rejected is rejected: a SEQUENCE not holding exactly two INTEGERs,
+    // truncation; a number with the sign bit set is read as another magnitude
+    vector<unsigned char> vchNegative(vchSig);
+    vchNegative[4] |= 0x80;
+    BOOST_CHECK(!NativeVerify(vchPubKey, hash, vchNegative));
+    BOOST_CHECK(!OpenSSLVerify(vchPubKey, hash, vchNegative));
+
+    vector<unsigned char> vchExtra(vchSig);
+    vchExtra.push_back(0);
+    vchExtra[1]++;
+    BOOST_CHECK(!NativeVerify(vchPubKey, hash, vchExtra));
+    BOOST_CHECK(!OpenSSLVerify(vchPubKey, hash, vchExtra));
+
+    vector<unsigned char> vchShort(vchSig.begin(), vchSig.end() - 1);
+    BOOST_CHECK(!NativeVerify(vchPubKey, hash, vchShort));
+    BOOST_CHECK(!OpenSSLVerify(vchPubKey, hash, vchShort));
+
+    // what OpenSSL accepts is accepted: s and n - s both verify
+    BIGNUM *bnN = NULL;
+    BOOST_REQUIRE(BN_hex2bn(&bnN, "FFFFFFFFFFFFFFFFFFFFFFFFFFFFFFFEBAAEDCE6AF48A03BBFD25E8CD0364141"));
+    BIGNUM *bnS = BN_bin2bn(&p64[32], 32, NULL);
+    BOOST_REQUIRE(BN_sub(bnS, bnN, bnS));
+    unsigned char p64High[64];
+    memcpy(p64High, p64, 32);
+    memset(&p64High[32], 0, 32);
+    BN_bn2bin(bnS, &p64High[64 - BN_num_bytes(bnS)]);
+    BN_free(bnS);
+    BN_free(bnN);
+    vector<unsigned char> vchHigh;
+    Secp256k1::EncodeSignature(p64High, vchHigh);
+    BOOST_CHECK(NativeVerify(vchPubKey, hash, vchHigh));
+    BOOST_CHECK(OpenSSLVerify(vchPubKey, hash, vchHigh));
+}
+
+// Encodings d2i_ECDSA_SIG of OpenSSL 1.0.2 accepts or not, with r = s = 1 when it does
+static const struct {
+    const char* pszSig;
+    bool fValid;
+} vDerCases[] = {
+    { "3006020101020101", true },
+    { "300602810101020101", false },                   // INTEGER beyond the SEQUENCE
+    { "3009028101010282000101", true },                // long form lengths, leading zero
+    { "300a02840000000101020101", true },              // four length bytes
+    { "300f028900000000000000000101020101", false },     // more length bytes than a long, zeros counted
+    { "300702020001020101", true },                    // padded number
+    { "3080020101020101" "0000", true },               // indefinite, end-of-contents
+    { "3080020101020101", false },                     // indefinite without end-of-contents
+    { "300602010102010100", true },                    // data after the SEQUENCE
+    { "300702010102010100", false },                   // data inside the SEQUENCE
+    { "30071f020101020101", true },                    // high tag number form INTEGER
+    { "30081f80020101020101", true },                  // ... with a leading zero digit
+    { "3f1006020101020101", true },                    // high tag number form SEQUENCE
+    { "1f1006020101020101", false },                   // primitive SEQUENCE
+    { "3006420101020101", false },                     // INTEGER of another class
+    { "30082203020101020101", false },                 // constructed INTEGER
+    { "3006028001020101", false },                     // indefinite INTEGER
+    { "3003020101", false },                           // one INTEGER
+    { "3009020101020101020101", false },               // three INTEGERs
+    { "3106020101020101", false },                     // SET
+};
+
+BOOST_AUTO_TEST_CASE(secp256k1_der_openssl)
+{
+    for (unsigned int i = 0; i < sizeof(vDerCases) / sizeof(vDerCases[0]); i++)
+    {
+        vector<unsigned char> vchSig = ParseHex(vDerCases[i].pszSig);
+        unsigned char p64[64];
+        bool fValid = Secp256k1::ParseSignature(&vchSig[0], vchSig.size(), p64);
+        BOOST_CHECK_MESSAGE(fValid == vDerCases[i].fValid, vDerCases[i].pszSig);
+        if (fValid)
+            for (int j = 0; j < 64; j++)
+                BOOST_CHECK_EQUAL(p64[j], (j == 31 || j == 63) ? 1 : 0);
+
+#if OPENSSL_VERSION_NUMBER < 0x10100000L
+        // later versions skip the leading zeros of a length before counting its bytes,
+        // and OpenSSL 3 decodes signatures as strict DER
+        const unsigned char *pbegin = &vchSig[0];
+        ECDSA_SIG *sig = d2i_ECDSA_SIG(NULL, &pbegin, vchSig.size());
+        BOOST_CHECK_MESSAGE((sig != NULL) == fValid, vDerCases[i].pszSig);
+        if (sig != NULL && fValid)
+            BOOST_CHECK(BN_is_one(sig->r) && BN_is_one(sig->s));
+        ECDSA_SIG_free(sig);
+#endif
+    }
+
+    // a number with the sign bit set is its magnitude, as BN_bin2bn reads it
+    vector<unsigned char> vchSig = ParseHex("3006020181020101");
+    unsigned char p64[64];
+    BOOST_CHECK(Secp256k1::ParseSignature(&vchSig[0], vchSig.size(), p64));
+    BOOST_CHECK_EQUAL(p64[31], 0x81);
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_r_above_n)
+{
+    // x(R) = n + 2, so r = 2 and the signature only verifies through r + n; the keys
+    // come from Q = (s R - e G) / r for both parities of R (recid 2 and 3)
+    vector<unsigned char> vchRS = ParseHex(
+        "0000000000000000000000000000000000000000000000000000000000000002"
+        "4b6e1a3f2d9c8e7b6a5f4e3d2c1b0a99887766554433221100ffeeddccbbaa99");
+    vector<unsigned char> vchHash = ParseHex("2f0b1c4d5e6f708192a3b4c5d6e7f8091a2b3c4d5e6f708192a3b4c5d6e7f809");
+    uint256 hash;
+    memcpy(hash.begin(), &vchHash[0], 32);
+    const char* pszPubKey[2] = {
+        "0212a696914c767c9a968685d18570c932052708a1da878c5360f7c85135e97928",
+        "02643269bf56b791923445c6ce954b385c093ada4e6a7490d6ff1c3bcfc956d235"
+    };
+
+    vector<unsigned char> vchSig;
+    Secp256k1::EncodeSignature(&vchRS[0], vchSig);
+    for (int i = 0; i < 2; i++)
+    {
+        vector<unsigned char> vchPubKey = ParseHex(pszPubKey[i]);
+        BOOST_CHECK(NativeVerify(vchPubKey, hash, vchSig));
+        BOOST_CHECK(OpenSSLVerify(vchPubKey, hash, vchSig));
+        BOOST_CHECK(!NativeVerify(vchPubKey, GetRandHash(), vchSig));
+
+        unsigned char pch[65];
+        unsigned int nSize;
+        BOOST_CHECK(Secp256k1::Recover(hash, &vchRS[0], 2 + i, true, pch, nSize));
+        BOOST_CHECK(vector<unsigned char>(pch, pch + nSize) == vchPubKey);
+        // recid 0 and 1 take R at x = 2 instead
+        if (Secp256k1::Recover(hash, &vchRS[0], i, true, pch, nSize))
+            BOOST_CHECK(vector<unsigned char>(pch, pch + nSize) != vchPubKey);
+    }
+}
+
+BOOST_AUTO_TEST_CASE(secp256k1_multiset)
+{
+    vector<uint256> vHash, vNone;
+    for (int i = 0; i < 5; i++)
+        vHash.push_back(GetRandHash());
+
+    // the same elements in a different order give the same sum
+    unsigned char pchSet[64], pchReverse[64], pchEmpty[64];
+    memset(pchSet, 0, 64);
+    memset(pchReverse, 0, 64);
+    memset(pchEmpty, 0, 64);
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchSet, vHash, vNone));
+    vector<uint256> vReverse(vHash.rbegin(), vHash.rend());
+    for (unsigned int i = 0; i < vReverse.size(); i++)
+        BOOST_CHECK(Secp256k1::MultisetUpdate(pchReverse, vector<uint256>(1, vReverse[i]), vNone));
+    BOOST_CHECK(memcmp(pchSet, pchReverse, 64) == 0);
+    BOOST_CHECK(memcmp(pchSet, pchEmpty, 64) != 0);
+
+    // removing an element undoes adding it, down to the empty set
+    unsigned char pchPart[64];
+    memset(pchPart, 0, 64);
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchPart, vector<uint256>(vHash.begin() + 1, vHash.end()), vNone));
+    unsigned char pchRemoved[64];
+    memcpy(pchRemoved, pchSet, 64);
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchRemoved, vNone, vector<uint256>(1, vHash[0])));
+    BOOST_CHECK(memcmp(pchRemoved, pchPart, 64) == 0);
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchRemoved, vNone, vector<uint256>(vHash.begin() + 1, vHash.end())));
+    BOOST_CHECK(memcmp(pchRemoved, pchEmpty, 64) == 0);
+
+    // an element counts as often as it was added
+    unsigned char pchTwice[64];
+    memset(pchTwice, 0, 64);
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchTwice, vector<uint256>(2, vHash[0]), vNone));
+    BOOST_CHECK(memcmp(pchTwice, pchEmpty, 64) != 0);
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchTwice, vNone, vector<uint256>(1, vHash[0])));
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchPart, vNone, vector<uint256>(vHash.begin() + 1, vHash.end())));
+    BOOST_CHECK(Secp256k1::MultisetUpdate(pchPart, vector<uint256>(1, vHash[0]), vNone));
+    BOOST_CHECK(memcmp(pchTwice, pchPart, 64) == 0);
+
+    // a sum that is not on the curve is refused
+    pchSet[63] ^= 1;
+    BOOST_CHECK(!Secp256k1::MultisetUpdate(pchSet, vNone, vNone));
+}
+
+BOOST_AUTO_TEST_SUITE_END()
@@ -42,4 +42,32 @@ BOOST_AUTO_TEST_CASE(varints)
 
 }
 
+BOOST_AUTO_TEST_CASE(memory_reader)
+{
+    CDataStream ss(SER_DISK, 0);
+    vector<unsigned char> vch(1000, 0x5a);
+    string str = "block";
+    ss << 12345 << vch << str << VARINT(987654321);
+
+    // reads the same values as the stream, without taking a copy
+    CMemoryReader reader(&ss[0], &ss[0] + ss.size(), SER_DISK, 0);
+    int n = 0;
+    vector<unsigned char> vchRead;
+    string strRead;
+    reader >> n >> vchRead >> strRead;
+    BOOST_CHECK(n == 12345 && vchRead == vch && strRead == str);
+    BOOST_CHECK(reader.GetPos() == ss.size() - ::GetSerializeSize(VARINT(987654321), 0, 0));
+    int j = 0;
+    reader >> VARINT(j);
+    BOOST_CHECK(j == 987654321 && reader.empty());
+
+    // reading past the end fails instead of running off the span
+    BOOST_CHECK_THROW(reader >> n, std::ios_base::failure);
+    CMemoryReader reader2(&ss[0], &ss[0] + ss.size(), SER_DISK, 0);
+    reader2.ignore(sizeof(int));
+    reader2 >> vchRead;
+    BOOST_CHECK(vchRead == vch);
+    BOOST_CHECK_THROW(reader2.ignore(ss.size()), std::ios_base::failure);
+}
+
 BOOST_AUTO_TEST_SUITE_END()
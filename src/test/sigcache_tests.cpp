@@ -0,0 +1,161 @@
+//
+// Signature cache: hits, erase on block connect, eviction, concurrent lookups
+//
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include "keystore.h"
+#include "main.h"
+#include "util.h"
+
+using namespace std;
+
+// Transactions spending to and from key, nCount of them, leaving the signature
+// cache empty (signing verifies through it)
+static void MakeSpends(const CKey& key, unsigned int nCount, vector<CTransaction>& vtxFrom, vector<CTransaction>& vtxTo)
+{
+    CBasicKeyStore keystore;
+    keystore.AddKey(key);
+    for (unsigned int i = 0; i < nCount; i++)
+    {
+        CTransaction txFrom;
+        txFrom.vout.resize(1);
+        txFrom.vout[0].nValue = i + 1;
+        txFrom.vout[0].scriptPubKey.SetDestination(key.GetPubKey().GetID());
+
+        CTransaction txTo;
+        txTo.vin.resize(1);
+        txTo.vin[0].prevout = COutPoint(txFrom.GetHash(), 0);
+        txTo.vout.resize(1);
+        txTo.vout[0].nValue = i + 1;
+        BOOST_CHECK(SignSignature(keystore, txFrom, txTo, 0));
+        vtxFrom.push_back(txFrom);
+        vtxTo.push_back(txTo);
+    }
+    InitSignatureCache(DEFAULT_SIGCACHE_SIZE << 20);
+}
+
+static bool Verify(const CTransaction& txFrom, const CTransaction& txTo, unsigned int flags)
+{
+    return VerifyScript(txTo.vin[0].scriptSig, txFrom.vout[0].scriptPubKey, txTo, 0, flags, 0);
+}
+
+static void VerifyMany(const vector<CTransaction>* pvtxFrom, const vector<CTransaction>* pvtxTo, unsigned int nRounds, bool* pfOk)
+{
+    for (unsigned int n = 0; n < nRounds; n++)
+        for (unsigned int i = 0; i < pvtxTo->size(); i++)
+            if (!Verify((*pvtxFrom)[i], (*pvtxTo)[i], SCRIPT_VERIFY_NONE))
+                *pfOk = false;
+}
+
+BOOST_AUTO_TEST_SUITE(sigcache_tests)
+
+BOOST_AUTO_TEST_CASE(sigcache_hits)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    vector<CTransaction> vtxFrom, vtxTo;
+    MakeSpends(key, 2, vtxFrom, vtxTo);
+
+    // the first check fills the cache, the next one hits
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    BOOST_CHECK(Verify(vtxFrom[0], vtxTo[0], SCRIPT_VERIFY_NONE));
+    BOOST_CHECK(Verify(vtxFrom[0], vtxTo[0], SCRIPT_VERIFY_NONE));
+    CSignatureCacheStats stats2 = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats2.nMisses - stats.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats2.nHits - stats.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats2.nInserts - stats.nInserts, 1U);
+    BOOST_CHECK_EQUAL(stats2.nEntries - stats.nEntries, 1U);
+
+    // connecting a block uses the entry up
+    BOOST_CHECK(Verify(vtxFrom[0], vtxTo[0], SCRIPT_VERIFY_NOCACHE | SCRIPT_VERIFY_CACHEERASE));
+    BOOST_CHECK(Verify(vtxFrom[0], vtxTo[0], SCRIPT_VERIFY_NOCACHE));
+    stats = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.nHits - stats2.nHits, 1U);
+    BOOST_CHECK_EQUAL(stats.nMisses - stats2.nMisses, 1U);
+    BOOST_CHECK_EQUAL(stats.nEntries, stats2.nEntries - 1);
+
+    // the same signature for another transaction is not a hit
+    CTransaction txOther = vtxTo[1];
+    txOther.vin[0].scriptSig = vtxTo[0].vin[0].scriptSig;
+    BOOST_CHECK(Verify(vtxFrom[0], vtxTo[0], SCRIPT_VERIFY_NONE));
+    BOOST_CHECK(!Verify(vtxFrom[1], txOther, SCRIPT_VERIFY_NONE));
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_evict)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    vector<CTransaction> vtxFrom, vtxTo;
+    MakeSpends(key, 300, vtxFrom, vtxTo);
+
+    // room for 128 signatures: the table fills up, older ones get pushed out
+    InitSignatureCache(128 * sizeof(uint256));
+    for (unsigned int i = 0; i < vtxTo.size(); i++)
+        BOOST_CHECK(Verify(vtxFrom[i], vtxTo[i], SCRIPT_VERIFY_NONE));
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats.nCapacity, 128U);
+    BOOST_CHECK(stats.nEntries <= stats.nCapacity);
+    BOOST_CHECK(stats.nEntries > 64U);
+    BOOST_CHECK(stats.nEvictions > 0U);
+
+    // the most recent ones are mostly still there
+    unsigned int nHits = 0;
+    for (unsigned int i = vtxTo.size() - 20; i < vtxTo.size(); i++)
+    {
+        uint64 nBefore = GetSignatureCacheStats().nHits;
+        BOOST_CHECK(Verify(vtxFrom[i], vtxTo[i], SCRIPT_VERIFY_NOCACHE));
+        nHits += GetSignatureCacheStats().nHits - nBefore;
+    }
+    BOOST_CHECK(nHits >= 10);
+
+    // turned off
+    InitSignatureCache(0);
+    BOOST_CHECK(Verify(vtxFrom[0], vtxTo[0], SCRIPT_VERIFY_NONE));
+    BOOST_CHECK_EQUAL(GetSignatureCacheStats().nEntries, 0U);
+
+    InitSignatureCache(DEFAULT_SIGCACHE_SIZE << 20);
+}
+
+BOOST_AUTO_TEST_CASE(sigcache_benchmark)
+{
+    CKey key;
+    key.MakeNewKey(true);
+    vector<CTransaction> vtxFrom, vtxTo;
+    MakeSpends(key, 200, vtxFrom, vtxTo);
+
+    // verification without the cache
+    int64 nStart = GetTimeMicros();
+    for (unsigned int i = 0; i < vtxTo.size(); i++)
+        BOOST_CHECK(Verify(vtxFrom[i], vtxTo[i], SCRIPT_VERIFY_NOCACHE));
+    int64 nVerify = GetTimeMicros() - nStart;
+
+    // lookups from several threads at once, as the script check threads do
+    const unsigned int nThreads = 4, nRounds = 20;
+    bool fFill = true;
+    VerifyMany(&vtxFrom, &vtxTo, 1, &fFill);
+    BOOST_CHECK(fFill);
+    CSignatureCacheStats stats = GetSignatureCacheStats();
+    bool vfOk[nThreads];
+    nStart = GetTimeMicros();
+    boost::thread_group threads;
+    for (unsigned int i = 0; i < nThreads; i++)
+    {
+        vfOk[i] = true;
+        threads.create_thread(boost::bind(&VerifyMany, &vtxFrom, &vtxTo, nRounds, &vfOk[i]));
+    }
+    threads.join_all();
+    int64 nCached = GetTimeMicros() - nStart;
+    for (unsigned int i = 0; i < nThreads; i++)
+        BOOST_CHECK(vfOk[i]);
+    CSignatureCacheStats stats2 = GetSignatureCacheStats();
+    BOOST_CHECK_EQUAL(stats2.nHits - stats.nHits, (uint64)nThreads * nRounds * vtxTo.size());
+    BOOST_CHECK_EQUAL(stats2.nMisses, stats.nMisses);
+
+    printf("sigcache_benchmark: %u verifications %"PRI64d"us (%.1f/s), %u cached lookups on %u threads %"PRI64d"us (%.1f/s)\n",
+           (unsigned int)vtxTo.size(), nVerify, 1000000.0 * vtxTo.size() / nVerify,
+           nThreads * nRounds * (unsigned int)vtxTo.size(), nThreads, nCached, 1000000.0 * nThreads * nRounds * vtxTo.size() / nCached);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
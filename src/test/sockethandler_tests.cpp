@@ -0,0 +1,207 @@
+//
+// Socket event loop tests and localhost benchmark
+//
+#include <boost/test/unit_test.hpp>
+#include <boost/foreach.hpp>
+#include <boost/thread.hpp>
+
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+#ifndef WIN32
+
+// Peer ends of the socket pairs and the nodes serving the other ends
+struct SocketHandlerSetup
+{
+    vector<int> vPeer;
+    vector<CNode*> vTestNodes;
+
+    void AddNodes(int nNodes)
+    {
+        for (int i = 0; i < nNodes; i++)
+        {
+            int fds[2];
+            BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+            fcntl(fds[0], F_SETFL, O_NONBLOCK);
+            CNode* pnode = new CNode(fds[0], CAddress(), "test", true);
+            // one reference for the connection, one for the test
+            pnode->AddRef();
+            pnode->AddRef();
+            vPeer.push_back(fds[1]);
+            vTestNodes.push_back(pnode);
+            AddConnectedNode(pnode);
+        }
+    }
+
+    // number of nodes that received nMessages complete messages
+    int CountReceived(unsigned int nMessages)
+    {
+        int nDone = 0;
+        BOOST_FOREACH(CNode* pnode, vTestNodes)
+        {
+            LOCK(pnode->cs_vRecvMsg);
+            if (pnode->vRecvMsg.size() == nMessages && pnode->vRecvMsg.back().complete())
+                nDone++;
+        }
+        return nDone;
+    }
+
+    // let the running handler disconnect and delete the nodes
+    bool ReleaseNodes()
+    {
+        BOOST_FOREACH(CNode* pnode, vTestNodes)
+        {
+            pnode->fDisconnect = true;
+            pnode->Release();
+        }
+        vTestNodes.clear();
+        for (int64 nStart = GetTimeMillis(); GetTimeMillis() - nStart < 5000; MilliSleep(1))
+        {
+            LOCK(cs_vNodes);
+            if (vNodes.empty())
+                return true;
+        }
+        return false;
+    }
+
+    ~SocketHandlerSetup()
+    {
+        BOOST_FOREACH(int fd, vPeer)
+            if (fd != -1)
+                close(fd);
+    }
+};
+
+// Serialized header of a message without payload
+static string EmptyMessage(const char* pszCommand)
+{
+    CMessageHeader hdr(pszCommand, 0);
+    uint256 hash = Hash(pszCommand, pszCommand);
+    memcpy(&hdr.nChecksum, &hash, sizeof(hdr.nChecksum));
+    CDataStream ss(SER_NETWORK, PROTOCOL_VERSION);
+    ss << hdr;
+    return ss.str();
+}
+
+// Time in milliseconds until every node received nMessages sent by its peer, -1 on timeout
+static int64 RunSocketHandler(bool fEpoll, int nNodes, int nMessages)
+{
+    mapArgs["-epoll"] = fEpoll ? "1" : "0";
+    SocketHandlerSetup setup;
+    boost::thread thread(&ThreadSocketHandler);
+
+    // nodes appear while the handler is waiting, so the wakeup has to work
+    MilliSleep(20);
+    setup.AddNodes(nNodes);
+
+    string strData;
+    for (int i = 0; i < nMessages; i++)
+        strData += EmptyMessage("ping");
+
+    int64 nStart = GetTimeMillis();
+    BOOST_FOREACH(int fd, setup.vPeer)
+        BOOST_REQUIRE(send(fd, strData.data(), strData.size(), MSG_NOSIGNAL) == (int)strData.size());
+    int64 nElapsed = -1;
+    while (GetTimeMillis() - nStart < 10000)
+    {
+        if (setup.CountReceived(nMessages) == nNodes)
+        {
+            nElapsed = GetTimeMillis() - nStart;
+            break;
+        }
+        MilliSleep(1);
+    }
+
+    // a peer that goes away is noticed
+    close(setup.vPeer[0]);
+    setup.vPeer[0] = -1;
+    int64 nClosed = GetTimeMillis();
+    while (setup.vTestNodes[0]->hSocket != INVALID_SOCKET && GetTimeMillis() - nClosed < 5000)
+        MilliSleep(1);
+    BOOST_CHECK(setup.vTestNodes[0]->hSocket == INVALID_SOCKET);
+
+    BOOST_CHECK(setup.ReleaseNodes());
+    thread.interrupt();
+    thread.join();
+    mapArgs.erase("-epoll");
+    return nElapsed;
+}
+
+BOOST_AUTO_TEST_SUITE(sockethandler_tests)
+
+BOOST_AUTO_TEST_CASE(sockethandler_deliver)
+{
+    BOOST_CHECK(RunSocketHandler(true, 4, 3) >= 0);
+    BOOST_CHECK(RunSocketHandler(false, 4, 3) >= 0);
+}
+
+BOOST_AUTO_TEST_CASE(sockethandler_priority)
+{
+    int fds[2];
+    BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+    fcntl(fds[0], F_SETFL, O_NONBLOCK);
+    CNode* pnode = new CNode(fds[0], CAddress(), "test", true);
+
+    // transaction relay fills the socket buffer, the rest waits in the queues
+    const unsigned int nTx = 100;
+    for (unsigned int i = 0; i < nTx; i++)
+        pnode->PushMessage("tx", vector<unsigned char>(20000));
+    pnode->PushMessage("inv", vector<CInv>(1, CInv(MSG_TX, GetRandHash())));
+    pnode->PushMessage("inv", vector<CInv>(1, CInv(MSG_BLOCK, GetRandHash())));
+    pnode->PushMessage("ping", (uint64)1);
+    BOOST_CHECK(pnode->vSendSize[SEND_TX] > 0);
+    BOOST_CHECK_EQUAL(pnode->vSendMsg[SEND_ANNOUNCE].size(), 1U);
+    BOOST_CHECK_EQUAL(pnode->vSendMsg[SEND_CONTROL].size(), 1U);
+
+    // the message in progress is finished, then the most urgent class goes first
+    vector<string> vCommands;
+    string strBuf;
+    for (int64 nStart = GetTimeMillis(); vCommands.size() < nTx + 3 && GetTimeMillis() - nStart < 10000; )
+    {
+        {
+            LOCK(pnode->cs_vSend);
+            SocketSendData(pnode);
+        }
+        char buf[65536];
+        int nBytes = recv(fds[1], buf, sizeof(buf), MSG_DONTWAIT);
+        if (nBytes > 0)
+            strBuf.append(buf, nBytes);
+        while (strBuf.size() >= CMessageHeader::HEADER_SIZE)
+        {
+            unsigned int nSize;
+            memcpy(&nSize, &strBuf[CMessageHeader::MESSAGE_SIZE_OFFSET], sizeof(nSize));
+            if (strBuf.size() < CMessageHeader::HEADER_SIZE + nSize)
+                break;
+            vCommands.push_back(string(strBuf.c_str() + MESSAGE_START_SIZE, strnlen(strBuf.c_str() + MESSAGE_START_SIZE, CMessageHeader::COMMAND_SIZE)));
+            strBuf.erase(0, CMessageHeader::HEADER_SIZE + nSize);
+        }
+    }
+    BOOST_REQUIRE_EQUAL(vCommands.size(), nTx + 3);
+    unsigned int nPing = find(vCommands.begin(), vCommands.end(), "ping") - vCommands.begin();
+    unsigned int nInv = find(vCommands.begin(), vCommands.end(), "inv") - vCommands.begin();
+    BOOST_CHECK(nPing < nInv);
+    BOOST_CHECK(nInv < nTx);
+    BOOST_CHECK_EQUAL(vCommands.back(), "inv");
+    BOOST_CHECK_EQUAL(pnode->nSendSize, 0U);
+
+    delete pnode;
+    close(fds[1]);
+}
+
+BOOST_AUTO_TEST_CASE(sockethandler_benchmark)
+{
+    const int nNodes = 200;
+    const int nMessages = 50;
+    int64 nEpoll = RunSocketHandler(true, nNodes, nMessages);
+    int64 nSelect = RunSocketHandler(false, nNodes, nMessages);
+    BOOST_CHECK(nEpoll >= 0);
+    BOOST_CHECK(nSelect >= 0);
+    printf("sockethandler_benchmark: %d nodes x %d messages: event loop %"PRI64d"ms, select %"PRI64d"ms\n",
+           nNodes, nMessages, nEpoll, nSelect);
+}
+
+BOOST_AUTO_TEST_SUITE_END()
+
+#endif
@@ -28,7 +28,9 @@ struct TestingSetup {
         mapArgs["-datadir"] = pathTemp.string();
         pblocktree = new CBlockTreeDB(1 << 20, true);
         pcoinsdbview = new CCoinsViewDB(1 << 23, true);
-        pcoinsTip = new CCoinsViewCache(*pcoinsdbview);
+        pcoinsFlush = new CCoinsViewBackgroundFlush(*pcoinsdbview);
+        pcoinsTip = new CCoinsViewCache(*pcoinsFlush);
+        InitSignatureCache(DEFAULT_SIGCACHE_SIZE << 20);
         InitBlockIndex();
         bool fFirstRun;
         pwalletMain = new CWallet("wallet.dat");
@@ -37,6 +39,12 @@ struct TestingSetup {
         nScriptCheckThreads = 3;
         for (int i=0; i < nScriptCheckThreads-1; i++)
             threadGroup.create_thread(&ThreadScriptCheck);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadCoinsFetch);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadMessagePrepare);
+        for (int i=0; i < nScriptCheckThreads-1; i++)
+            threadGroup.create_thread(&ThreadHeaderCheck);
     }
     ~TestingSetup()
     {
@@ -45,6 +53,7 @@ struct TestingSetup {
         delete pwalletMain;
         pwalletMain = NULL;
         delete pcoinsTip;
+        delete pcoinsFlush;
         delete pcoinsdbview;
         delete pblocktree;
         bitdb.Flush(true);
@@ -0,0 +1,152 @@
+//
+// Transaction download: one announcer at a time, per-peer limit, timeouts
+//
+#include <boost/test/unit_test.hpp>
+
+#include "main.h"
+#include "net.h"
+#include "util.h"
+
+using namespace std;
+
+extern map<uint256, pair<CNode*, int64> > mapTxInFlight;
+
+static void ForgetRequests(CNode* pnode)
+{
+    for (map<uint256, pair<CNode*, int64> >::iterator mi = mapTxInFlight.begin(); mi != mapTxInFlight.end(); )
+    {
+        if ((*mi).second.first == pnode)
+            mapTxInFlight.erase(mi++);
+        else
+            mi++;
+    }
+}
+
+#ifndef WIN32
+// Node on one end of a socket pair: its getdata sends succeed, so only the
+// request logic can disconnect it
+struct PairedNode
+{
+    int hPeer;
+    CNode* pnode;
+
+    PairedNode()
+    {
+        int fds[2];
+        BOOST_REQUIRE(socketpair(AF_UNIX, SOCK_STREAM, 0, fds) == 0);
+        fcntl(fds[0], F_SETFL, O_NONBLOCK);
+        hPeer = fds[1];
+        pnode = new CNode(fds[0], CAddress(), "", true);
+        pnode->nVersion = PROTOCOL_VERSION;
+        pnode->fClient = true;
+    }
+
+    ~PairedNode()
+    {
+        delete pnode;
+        close(hPeer);
+    }
+};
+#endif
+
+BOOST_AUTO_TEST_SUITE(txrequest_tests)
+
+BOOST_AUTO_TEST_CASE(txrequest_announcers)
+{
+    CNode node1(INVALID_SOCKET, CAddress(), "", true);
+    CNode node2(INVALID_SOCKET, CAddress(), "", true);
+    node1.nVersion = node2.nVersion = PROTOCOL_VERSION;
+    node1.fClient = node2.fClient = true;
+
+    // both announce, only the first one is asked
+    CInv inv(MSG_TX, GetRandHash());
+    node1.AskFor(inv);
+    node2.AskFor(inv);
+    BOOST_CHECK(SendMessages(&node1, false));
+    BOOST_CHECK(SendMessages(&node2, false));
+    BOOST_CHECK(node1.mapTxAsked.count(inv.hash));
+    BOOST_CHECK(node2.mapTxAsked.empty());
+    BOOST_REQUIRE_EQUAL(node2.mapAskFor.size(), 1U);
+    BOOST_CHECK((*node2.mapAskFor.begin()).first > GetTimeMicros());
+
+    // a second announcement by the peer asked doesn't ask again
+    node1.AskFor(inv);
+    BOOST_CHECK(SendMessages(&node1, false));
+    BOOST_CHECK(node1.mapAskFor.empty());
+    BOOST_CHECK_EQUAL(node1.mapTxAsked.size(), 1U);
+
+    // the first one doesn't deliver in time, the second one is next
+    node1.mapTxAsked[inv.hash] -= (TX_REQUEST_TIMEOUT + 1) * 1000000;
+    mapTxInFlight[inv.hash].second -= (TX_REQUEST_TIMEOUT + 1) * 1000000;
+    BOOST_CHECK(SendMessages(&node1, false));
+    BOOST_CHECK(node1.mapTxAsked.empty());
+    BOOST_CHECK_EQUAL(node1.nTxMissed, 1U);
+    BOOST_CHECK(!mapTxInFlight.count(inv.hash));
+
+    node2.mapAskFor.clear();
+    node2.mapAskFor.insert(make_pair(0, inv));
+    BOOST_CHECK(SendMessages(&node2, false));
+    BOOST_CHECK(node2.mapTxAsked.count(inv.hash));
+    BOOST_CHECK(mapTxInFlight[inv.hash].first == &node2);
+
+    ForgetRequests(&node1);
+    ForgetRequests(&node2);
+}
+
+#ifndef WIN32
+BOOST_AUTO_TEST_CASE(txrequest_limit)
+{
+    PairedNode paired;
+    CNode& node = *paired.pnode;
+
+    // one batch up to the limit, the rest waits
+    for (unsigned int i = 0; i < MAX_TX_IN_FLIGHT + 50; i++)
+        node.AskFor(CInv(MSG_TX, GetRandHash()));
+    BOOST_CHECK(SendMessages(&node, false));
+    BOOST_CHECK_EQUAL(node.mapTxAsked.size(), MAX_TX_IN_FLIGHT);
+    BOOST_CHECK_EQUAL(node.mapAskFor.size(), 50U);
+
+    // none of them delivered: room for the rest, one missed round
+    for (map<uint256, int64>::iterator it = node.mapTxAsked.begin(); it != node.mapTxAsked.end(); it++)
+        (*it).second -= (TX_REQUEST_TIMEOUT + 1) * 1000000;
+    BOOST_CHECK(SendMessages(&node, false));
+    BOOST_CHECK_EQUAL(node.nTxMissed, 1U);
+    BOOST_CHECK(!node.fDisconnect);
+    BOOST_CHECK_EQUAL(node.mapTxAsked.size(), 50U);
+    BOOST_CHECK(node.mapAskFor.empty());
+
+    // the next batch times out right after: still the same round
+    for (map<uint256, int64>::iterator it = node.mapTxAsked.begin(); it != node.mapTxAsked.end(); it++)
+        (*it).second -= (TX_REQUEST_TIMEOUT + 1) * 1000000;
+    BOOST_CHECK(SendMessages(&node, false));
+    BOOST_CHECK_EQUAL(node.nTxMissed, 1U);
+    BOOST_CHECK(!node.fDisconnect);
+    BOOST_CHECK(node.mapTxAsked.empty());
+
+    ForgetRequests(&node);
+}
+
+BOOST_AUTO_TEST_CASE(txrequest_missed_rounds)
+{
+    PairedNode paired;
+    CNode& node = *paired.pnode;
+
+    // MAX_TX_MISSED rounds in a row without an answer drop the peer
+    for (unsigned int i = 0; i < MAX_TX_MISSED; i++)
+    {
+        BOOST_CHECK(!node.fDisconnect);
+        node.AskFor(CInv(MSG_TX, GetRandHash()));
+        BOOST_CHECK(SendMessages(&node, false));
+        BOOST_REQUIRE_EQUAL(node.mapTxAsked.size(), 1U);
+        (*node.mapTxAsked.begin()).second -= (TX_REQUEST_TIMEOUT + 1) * 1000000;
+        node.nTxMissTime -= (TX_REQUEST_TIMEOUT + 1) * 1000000;
+        BOOST_CHECK(SendMessages(&node, false));
+        BOOST_CHECK_EQUAL(node.nTxMissed, i + 1);
+    }
+    BOOST_CHECK(node.fDisconnect);
+
+    ForgetRequests(&node);
+}
+#endif
+
+BOOST_AUTO_TEST_SUITE_END()
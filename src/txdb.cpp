@@ -7,6 +7,8 @@
 #include "main.h"
 #include "hash.h"
 #include "chainparams.h"
+#include "checkqueue.h"
+#include "secp256k1.h"
 
 using namespace std;
 
@@ -21,17 +23,119 @@ void static BatchWriteHashBestChain(CLevelDBBatch &batch, const uint256 &hash) {
     batch.Write('B', hash);
 }
 
-CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe) {
+// Hash of one coin database entry, an element of CCoinsRunningStats::pchSet        Хеш одной записи базы данных монет, элемент CCoinsRunningStats::pchSet
+uint256 static GetCoinsEntryHash(const uint256 &txid, const CCoins &coins) {
+    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
+    ss << txid;
+    ss << VARINT(coins.nVersion);
+    ss << (coins.fCoinBase ? 'c' : 'n');
+    ss << VARINT(coins.nHeight);
+    for (unsigned int i=0; i<coins.vout.size(); i++) {
+        const CTxOut &out = coins.vout[i];
+        if (!out.IsNull()) {
+            ss << VARINT(i+1);
+            ss << out;
+        }
+    }
+    ss << VARINT(0);
+    return ss.GetHash();
+}
+
+void CCoinsRunningStats::Add(const uint256 &txid, const CCoins &coins) {
+    nTransactions++;
+    BOOST_FOREACH(const CTxOut &out, coins.vout) {
+        if (!out.IsNull()) {
+            nTransactionOutputs++;
+            nTotalAmount += out.nValue;
+        }
+    }
+    nSerializedSize += 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+    vSetAdd.push_back(GetCoinsEntryHash(txid, coins));
+    if (vSetAdd.size() >= 4096)
+        Finish();
+}
+
+void CCoinsRunningStats::Remove(const uint256 &txid, const CCoins &coins) {
+    nTransactions--;
+    BOOST_FOREACH(const CTxOut &out, coins.vout) {
+        if (!out.IsNull()) {
+            nTransactionOutputs--;
+            nTotalAmount -= out.nValue;
+        }
+    }
+    nSerializedSize -= 32 + ::GetSerializeSize(coins, SER_DISK, CLIENT_VERSION);
+    vSetRemove.push_back(GetCoinsEntryHash(txid, coins));
+    if (vSetRemove.size() >= 4096)
+        Finish();
+}
+
+bool CCoinsRunningStats::Finish() {
+    bool fOk = Secp256k1::MultisetUpdate(pchSet, vSetAdd, vSetRemove);
+    vSetAdd.clear();
+    vSetRemove.clear();
+    return fOk;
+}
+
+uint256 CCoinsRunningStats::GetSetHash() const {
+    return Hash(BEGIN(pchSet), END(pchSet));
+}
+
+CCoinsViewDB::CCoinsViewDB(size_t nCacheSize, bool fMemory, bool fWipe) : db(GetDataDir() / "chainstate", nCacheSize, fMemory, fWipe), fStats(false) {
+    // the totals are only trusted if they were written together with the          итогам доверяем, только если они записаны вместе с
+    // current best block; an empty database starts from zero                      текущим лучшим блоком; пустая база данных начинается с нуля
+    uint256 hashBest;
+    if (!db.Read('B', hashBest))
+        fStats = !db.Exists('S');
+    else
+        fStats = db.Read('S', runningstats) && runningstats.hashBlock == hashBest;
 }
 
 bool CCoinsViewDB::GetCoins(const uint256 &txid, CCoins &coins) { 
     return db.Read(make_pair('c', txid), coins); 
 }
 
+static CCheckQueue<CCoinsFetch> coinsfetchqueue(16);
+
+void ThreadCoinsFetch() {
+    RenameThread("TDC-coinsfetch");
+    coinsfetchqueue.Thread();
+}
+
+bool CCoinsFetch::operator()() const {
+    try {
+        if (!pdb->Read(make_pair('c', *ptxid), *pcoins))
+            *pcoins = CCoins();
+    } catch (std::exception &e) {
+        // leave it to the caller to repeat the read and report the error         повтор чтения и сообщение об ошибке оставляем вызывающему
+        return false;
+    }
+    return true;
+}
+
+void CCoinsViewDB::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins) {
+    vCoins.clear();
+    vCoins.resize(vTxid.size());
+    if (nScriptCheckThreads && vTxid.size() > 1) {
+        std::vector<CCoinsFetch> vFetch;
+        vFetch.reserve(vTxid.size());
+        for (unsigned int i = 0; i < vTxid.size(); i++)
+            vFetch.push_back(CCoinsFetch(db, vTxid[i], vCoins[i]));
+        CCheckQueueControl<CCoinsFetch> control(&coinsfetchqueue);
+        control.Add(vFetch);
+        if (control.Wait())
+            return;
+    }
+    for (unsigned int i = 0; i < vTxid.size(); i++)
+        if (!GetCoins(vTxid[i], vCoins[i]))
+            vCoins[i] = CCoins();
+}
+
 bool CCoinsViewDB::SetCoins(const uint256 &txid, const CCoins &coins) {
-    CLevelDBBatch batch;
-    BatchWriteCoins(batch, txid, coins);
-    return db.WriteBatch(batch);
+    CCoinsMap mapCoins;
+    CCoinsCacheEntry &entry = mapCoins[txid];
+    entry.coins = coins;
+    entry.flags = CCoinsCacheEntry::DIRTY;
+    return BatchWrite(mapCoins, NULL);
 }
 
 bool CCoinsViewDB::HaveCoins(const uint256 &txid) {
@@ -49,21 +153,217 @@ CBlockIndex *CCoinsViewDB::GetBestBlock() {
 }
 
 bool CCoinsViewDB::SetBestBlock(CBlockIndex *pindex) {
-    CLevelDBBatch batch;
-    BatchWriteHashBestChain(batch, pindex->GetBlockHash()); 
-    return db.WriteBatch(batch);
+    CCoinsMap mapCoins;
+    return BatchWrite(mapCoins, pindex);
 }
 
-bool CCoinsViewDB::BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex) {
-    printf("Committing %u changed transactions to coin database...\n", (unsigned int)mapCoins.size());
+bool CCoinsViewDB::BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex) {
+    LOCK(cs_stats);
+    // work on a copy of the totals, so a failed write leaves them alone            работаем с копией итогов, чтобы неудачная запись их не затронула
+    CCoinsRunningStats statsNew = runningstats;
 
     CLevelDBBatch batch;
-    for (std::map<uint256, CCoins>::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++)
-        BatchWriteCoins(batch, it->first, it->second);
-    if (pindex)
+    unsigned int nChanged = 0;
+    for (CCoinsMap::const_iterator it = mapCoins.begin(); it != mapCoins.end(); it++) {
+        if (!(it->second.flags & CCoinsCacheEntry::DIRTY))
+            continue;
+        // created and spent again since the last flush: not in the database      создана и снова потрачена после последнего сброса: в базе данных её нет
+        if ((it->second.flags & CCoinsCacheEntry::FRESH) && it->second.coins.IsPruned())
+            continue;
+        if (fStats) {
+            // replace the contribution of the stored version; a disconnected       заменяем вклад сохранённой версии; отключённый
+            // block is undone the same way, as it writes the old versions back     блок откатывается так же, так как он записывает старые версии обратно
+            CCoins coinsOld;
+            if (!(it->second.flags & CCoinsCacheEntry::FRESH) && db.Read(make_pair('c', it->first), coinsOld))
+                statsNew.Remove(it->first, coinsOld);
+            if (!it->second.coins.IsPruned())
+                statsNew.Add(it->first, it->second.coins);
+        }
+        BatchWriteCoins(batch, it->first, it->second.coins);
+        nChanged++;
+    }
+    printf("Committing %u changed transactions (out of %u cached) to coin database...\n", nChanged, (unsigned int)mapCoins.size());
+
+    if (pindex) {
         BatchWriteHashBestChain(batch, pindex->GetBlockHash());
+        statsNew.hashBlock = pindex->GetBlockHash();
+    }
+    if (fStats) {
+        if (!statsNew.Finish())
+            return error("%s() : corrupt coin set hash", __PRETTY_FUNCTION__);
+        batch.Write('S', statsNew);
+    }
+
+    if (!db.WriteBatch(batch))
+        return false;
+    runningstats = statsNew;
+    return true;
+}
+
+CCoinsViewBackgroundFlush::CCoinsViewBackgroundFlush(CCoinsView &viewIn) : CCoinsViewBacked(viewIn), pindexWriting(NULL), fWriting(false), fFailed(false), fQuit(false),
+    threadWriter(boost::bind(&CCoinsViewBackgroundFlush::ThreadWrite, this)) {
+}
+
+CCoinsViewBackgroundFlush::~CCoinsViewBackgroundFlush() {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        fQuit = true;
+    }
+    condWriter.notify_all();
+    // the writer finishes the batch in flight before it exits                      писатель завершает находящийся в пути пакет перед выходом
+    threadWriter.join();
+}
+
+void CCoinsViewBackgroundFlush::ThreadWrite() {
+    RenameThread("TDC-coinsflush");
+    boost::unique_lock<boost::mutex> lock(mutex);
+    while (true) {
+        while (!fWriting && !fQuit)
+            condWriter.wait(lock);
+        if (!fWriting)
+            return;
+
+        // nobody modifies mapWriting while fWriting is set, so it can be read     пока установлен fWriting, mapWriting никто не меняет, поэтому его можно
+        // without the lock                                                         читать без блокировки
+        lock.unlock();
+        int64 nStart = GetTimeMicros();
+        bool fOk = false;
+        try {
+            fOk = base->BatchWrite(mapWriting, pindexWriting);
+        } catch (std::exception &e) {
+            printf("ERROR: CCoinsViewBackgroundFlush : %s\n", e.what());
+        }
+        int64 nTime = GetTimeMicros() - nStart;
+        lock.lock();
+
+        if (!fOk)
+            fFailed = true;
+        mapWriting.clear();
+        pindexWriting = NULL;
+        fWriting = false;
+        flushstats.nWriteLast = nTime;
+        condIdle.notify_all();
+    }
+}
 
-    return db.WriteBatch(batch);
+void CCoinsViewBackgroundFlush::WaitIdle(boost::unique_lock<boost::mutex> &lock) {
+    while (fWriting)
+        condIdle.wait(lock);
+}
+
+bool CCoinsViewBackgroundFlush::GetCoins(const uint256 &txid, CCoins &coins) {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapWriting.find(txid);
+            if (it != mapWriting.end()) {
+                if (it->second.coins.IsPruned())
+                    return false;
+                coins = it->second.coins;
+                return true;
+            }
+        }
+    }
+    return base->GetCoins(txid, coins);
+}
+
+void CCoinsViewBackgroundFlush::GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins) {
+    vCoins.clear();
+    vCoins.resize(vTxid.size());
+    std::vector<uint256> vMissing;
+    std::vector<unsigned int> vPos;
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        for (unsigned int i = 0; i < vTxid.size(); i++) {
+            CCoinsMap::const_iterator it = fWriting ? mapWriting.find(vTxid[i]) : mapWriting.end();
+            if (it != mapWriting.end()) {
+                vCoins[i] = it->second.coins;
+            } else {
+                vMissing.push_back(vTxid[i]);
+                vPos.push_back(i);
+            }
+        }
+    }
+    if (vMissing.empty())
+        return;
+    std::vector<CCoins> vFound;
+    base->GetCoinsBatch(vMissing, vFound);
+    for (unsigned int i = 0; i < vMissing.size(); i++)
+        vFound[i].swap(vCoins[vPos[i]]);
+}
+
+bool CCoinsViewBackgroundFlush::SetCoins(const uint256 &txid, const CCoins &coins) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitIdle(lock);
+    return base->SetCoins(txid, coins);
+}
+
+bool CCoinsViewBackgroundFlush::HaveCoins(const uint256 &txid) {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting) {
+            CCoinsMap::const_iterator it = mapWriting.find(txid);
+            if (it != mapWriting.end())
+                return !it->second.coins.IsPruned();
+        }
+    }
+    return base->HaveCoins(txid);
+}
+
+CBlockIndex *CCoinsViewBackgroundFlush::GetBestBlock() {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        if (fWriting && pindexWriting)
+            return pindexWriting;
+    }
+    return base->GetBestBlock();
+}
+
+bool CCoinsViewBackgroundFlush::SetBestBlock(CBlockIndex *pindex) {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitIdle(lock);
+    return base->SetBestBlock(pindex);
+}
+
+bool CCoinsViewBackgroundFlush::BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex) {
+    int64 nStart = GetTimeMicros();
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitIdle(lock);
+    int64 nStall = GetTimeMicros() - nStart;
+    flushstats.nStallLast = nStall;
+    flushstats.nStallTotal += nStall;
+    flushstats.nStallMax = std::max(flushstats.nStallMax, nStall);
+    if (fFailed)
+        return false;
+
+    // hand the map over; the caller is left with our empty one                     передаём таблицу; вызывающему остаётся наша пустая
+    mapWriting.swap(mapCoins);
+    pindexWriting = pindex;
+    fWriting = true;
+    flushstats.nFlushes++;
+    condWriter.notify_one();
+    return true;
+}
+
+bool CCoinsViewBackgroundFlush::GetStats(CCoinsStats &stats) {
+    {
+        boost::unique_lock<boost::mutex> lock(mutex);
+        WaitIdle(lock);
+    }
+    return base->GetStats(stats);
+}
+
+bool CCoinsViewBackgroundFlush::Sync() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    WaitIdle(lock);
+    return !fFailed;
+}
+
+CCoinsFlushStats CCoinsViewBackgroundFlush::GetFlushStats() {
+    boost::unique_lock<boost::mutex> lock(mutex);
+    CCoinsFlushStats ret = flushstats;
+    ret.fWriting = fWriting;
+    return ret;
 }
 
 CBlockTreeDB::CBlockTreeDB(size_t nCacheSize, bool fMemory, bool fWipe) : CLevelDB(GetDataDir() / "blocks" / "index", nCacheSize, fMemory, fWipe) {
@@ -113,53 +413,57 @@ bool CBlockTreeDB::ReadLastBlockFile(int &nFile) {
 }
 
 bool CCoinsViewDB::GetStats(CCoinsStats &stats) {
-    leveldb::Iterator *pcursor = db.NewIterator();
-    pcursor->SeekToFirst();
+    // the best block is read under the same lock the writer holds, so it        лучший блок читается под той же блокировкой, что держит писатель, поэтому
+    // belongs to the totals below                                                он соответствует итогам ниже
+    LOCK(cs_stats);
+    CBlockIndex *pindexBest = GetBestBlock();
+    if (pindexBest == NULL)
+        return false;
 
-    CHashWriter ss(SER_GETHASH, PROTOCOL_VERSION);
-    stats.hashBlock = GetBestBlock()->GetBlockHash();
-    ss << stats.hashBlock;
-    int64 nTotalAmount = 0;
-    while (pcursor->Valid()) {
-        boost::this_thread::interruption_point();
-        try {
-            leveldb::Slice slKey = pcursor->key();
-            CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
-            char chType;
-            ssKey >> chType;
-            if (chType == 'c') {
-                leveldb::Slice slValue = pcursor->value();
-                CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
-                CCoins coins;
-                ssValue >> coins;
-                uint256 txhash;
-                ssKey >> txhash;
-                ss << txhash;
-                ss << VARINT(coins.nVersion);
-                ss << (coins.fCoinBase ? 'c' : 'n'); 
-                ss << VARINT(coins.nHeight);
-                stats.nTransactions++;
-                for (unsigned int i=0; i<coins.vout.size(); i++) {
-                    const CTxOut &out = coins.vout[i];
-                    if (!out.IsNull()) {
-                        stats.nTransactionOutputs++;
-                        ss << VARINT(i+1);
-                        ss << out;
-                        nTotalAmount += out.nValue;
-                    }
+    if (!fStats) {
+        // first use on a database without totals: count everything once          первое использование на базе данных без итогов: один раз пересчитываем всё
+        CCoinsRunningStats statsScan;
+        leveldb::Iterator *pcursor = db.NewIterator();
+        pcursor->SeekToFirst();
+        while (pcursor->Valid()) {
+            boost::this_thread::interruption_point();
+            try {
+                leveldb::Slice slKey = pcursor->key();
+                CDataStream ssKey(slKey.data(), slKey.data()+slKey.size(), SER_DISK, CLIENT_VERSION);
+                char chType;
+                ssKey >> chType;
+                if (chType == 'c') {
+                    leveldb::Slice slValue = pcursor->value();
+                    CDataStream ssValue(slValue.data(), slValue.data()+slValue.size(), SER_DISK, CLIENT_VERSION);
+                    CCoins coins;
+                    ssValue >> coins;
+                    uint256 txhash;
+                    ssKey >> txhash;
+                    statsScan.Add(txhash, coins);
                 }
-                stats.nSerializedSize += 32 + slValue.size();
-                ss << VARINT(0);
+                pcursor->Next();
+            } catch (std::exception &e) {
+                delete pcursor;
+                return error("%s() : deserialize error", __PRETTY_FUNCTION__);
             }
-            pcursor->Next();
-        } catch (std::exception &e) {
-            return error("%s() : deserialize error", __PRETTY_FUNCTION__);
         }
+        delete pcursor;
+        if (!statsScan.Finish())
+            return false;
+        statsScan.hashBlock = pindexBest->GetBlockHash();
+        if (!db.Write('S', statsScan))
+            return false;
+        runningstats = statsScan;
+        fStats = true;
     }
-    delete pcursor;
-    stats.nHeight = GetBestBlock()->nHeight;
-    stats.hashSerialized = ss.GetHash();
-    stats.nTotalAmount = nTotalAmount;
+
+    stats.hashBlock = pindexBest->GetBlockHash();
+    stats.nHeight = pindexBest->nHeight;
+    stats.nTransactions = runningstats.nTransactions;
+    stats.nTransactionOutputs = runningstats.nTransactionOutputs;
+    stats.nSerializedSize = runningstats.nSerializedSize;
+    stats.hashSet = runningstats.GetSetHash();
+    stats.nTotalAmount = runningstats.nTotalAmount;
     return true;
 }
 
@@ -8,23 +8,153 @@
 #include "main.h"
 #include "leveldb.h"
 
+#include <boost/thread.hpp>
+
+/** Closure representing one read of the coin database                              Закрытое исполнение одного чтения из базы данных монет
+ *  (used to load the inputs of a block concurrently)                               (используется для параллельной загрузки входов блока) */
+class CCoinsFetch
+{
+private:
+    CLevelDB *pdb;
+    const uint256 *ptxid;
+    CCoins *pcoins;
+
+public:
+    CCoinsFetch() : pdb(NULL), ptxid(NULL), pcoins(NULL) {}
+    CCoinsFetch(CLevelDB &dbIn, const uint256 &txidIn, CCoins &coinsOut) :
+        pdb(&dbIn), ptxid(&txidIn), pcoins(&coinsOut) { }
+
+    bool operator()() const;
+
+    void swap(CCoinsFetch &fetch) {
+        std::swap(pdb, fetch.pdb);
+        std::swap(ptxid, fetch.ptxid);
+        std::swap(pcoins, fetch.pcoins);
+    }
+};
+
+/** Run an instance of the coin database read thread
+ *                  Запустить экземпляр потока чтения базы данных монет*/
+void ThreadCoinsFetch();
+
+/** Totals over the coin database, kept up to date by every write to it.            Итоги по базе данных монет, обновляемые каждой записью в неё.
+    pchSet is the multiset hash (Secp256k1::MultisetUpdate) of the entries, so      pchSet - хеш мультимножества (Secp256k1::MultisetUpdate) записей, поэтому
+    entries can be added and removed in any order. Changes are collected and        записи можно добавлять и удалять в любом порядке. Изменения собираются и
+    applied in batches by Finish.                                                   применяются пачками в Finish.
+ */
+class CCoinsRunningStats
+{
+public:
+    uint256 hashBlock;      // best block the totals belong to                    лучший блок, которому соответствуют итоги
+    uint64 nTransactions;
+    uint64 nTransactionOutputs;
+    uint64 nSerializedSize;
+    int64 nTotalAmount;
+    unsigned char pchSet[64];
+    std::vector<uint256> vSetAdd, vSetRemove;   // not applied to pchSet yet     ещё не применены к pchSet
+
+    CCoinsRunningStats() : hashBlock(0), nTransactions(0), nTransactionOutputs(0), nSerializedSize(0), nTotalAmount(0) {
+        memset(pchSet, 0, sizeof(pchSet));
+    }
+
+    IMPLEMENT_SERIALIZE(
+        READWRITE(hashBlock);
+        READWRITE(nTransactions);
+        READWRITE(nTransactionOutputs);
+        READWRITE(nSerializedSize);
+        READWRITE(nTotalAmount);
+        READWRITE(FLATDATA(pchSet));
+    )
+
+    void Add(const uint256 &txid, const CCoins &coins);
+    void Remove(const uint256 &txid, const CCoins &coins);
+    bool Finish();
+    uint256 GetSetHash() const;
+};
+
 /** CCoinsView backed by the LevelDB coin database (chainstate/)                    CCoinsView опирается на базу данных монет LevelDB */
 class CCoinsViewDB : public CCoinsView
 {
 protected:
     CLevelDB db;
+
+    // Running totals, valid once fStats is set; until then GetStats                Текущие итоги, действительные после установки fStats; до этого GetStats
+    // computes them with a full scan                                               вычисляет их полным просмотром
+    CCriticalSection cs_stats;
+    bool fStats;
+    CCoinsRunningStats runningstats;
 public:
     CCoinsViewDB(size_t nCacheSize, bool fMemory = false, bool fWipe = false);
 
     bool GetCoins(const uint256 &txid, CCoins &coins);
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins);
     bool SetCoins(const uint256 &txid, const CCoins &coins);
     bool HaveCoins(const uint256 &txid);
     CBlockIndex *GetBestBlock();
     bool SetBestBlock(CBlockIndex *pindex);
-    bool BatchWrite(const std::map<uint256, CCoins> &mapCoins, CBlockIndex *pindex);
+    bool BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex);
     bool GetStats(CCoinsStats &stats);
 };
 
+/** Statistics about the background writes of the coin database                     Статистика фоновых записей базы данных монет */
+struct CCoinsFlushStats
+{
+    uint64 nFlushes;        // batches handed to the writer                        пакетов, переданных писателю
+    int64 nStallLast;       // microseconds the last flush waited for the writer   микросекунд ожидания писателя при последнем сбросе
+    int64 nStallMax;
+    int64 nStallTotal;
+    int64 nWriteLast;       // microseconds the last background write took         микросекунд, занятых последней фоновой записью
+    bool fWriting;          // a batch is being written right now                  пакет записывается прямо сейчас
+
+    CCoinsFlushStats() : nFlushes(0), nStallLast(0), nStallMax(0), nStallTotal(0), nWriteLast(0), fWriting(false) {}
+};
+
+/** CCoinsView that passes the batches it receives to its base on a background      CCoinsView, передающий получаемые пакеты своей базе в фоновом
+    thread. A batch stays readable here until the base has it, so the cache on      потоке. Пакет остаётся доступным для чтения здесь, пока его нет в базе, поэтому
+    top continues with an empty map while the previous one is being written.       кэш сверху продолжает работу с пустой таблицей, пока пишется предыдущая.
+    Only one batch is in flight at a time; the next BatchWrite waits for it, so     Одновременно в пути только один пакет; следующий BatchWrite ждёт его, поэтому
+    the base sees the batches (and their best block) in order.                      база получает пакеты (и их лучший блок) по порядку.
+ */
+class CCoinsViewBackgroundFlush : public CCoinsViewBacked
+{
+private:
+    boost::mutex mutex;
+    boost::condition_variable condWriter;
+    boost::condition_variable condIdle;
+
+    // The batch being written and its best block                                  Записываемый пакет и его лучший блок
+    CCoinsMap mapWriting;
+    CBlockIndex *pindexWriting;
+
+    bool fWriting;
+    bool fFailed;
+    bool fQuit;
+    CCoinsFlushStats flushstats;
+
+    boost::thread threadWriter;
+
+    void ThreadWrite();
+    void WaitIdle(boost::unique_lock<boost::mutex> &lock);
+
+public:
+    CCoinsViewBackgroundFlush(CCoinsView &viewIn);
+    ~CCoinsViewBackgroundFlush();
+
+    bool GetCoins(const uint256 &txid, CCoins &coins);
+    void GetCoinsBatch(const std::vector<uint256> &vTxid, std::vector<CCoins> &vCoins);
+    bool SetCoins(const uint256 &txid, const CCoins &coins);
+    bool HaveCoins(const uint256 &txid);
+    CBlockIndex *GetBestBlock();
+    bool SetBestBlock(CBlockIndex *pindex);
+    bool BatchWrite(CCoinsMap &mapCoins, CBlockIndex *pindex);
+    bool GetStats(CCoinsStats &stats);
+
+    // Wait until the batch in flight is written; false if a write failed          Дождаться записи находящегося в пути пакета; false, если запись не удалась
+    bool Sync();
+
+    CCoinsFlushStats GetFlushStats();
+};
+
 /** Access to the block database (blocks/index/)                                    Доступ к базе данных блоков (blocks/index/) */
 class CBlockTreeDB : public CLevelDB
 {
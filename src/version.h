@@ -25,7 +25,7 @@ extern const std::string CLIENT_DATE;
 // network protocol versioning                                                      Управления версиями сетевого протокола
 //
 
-static const int PROTOCOL_VERSION = 70001;
+static const int PROTOCOL_VERSION = 70002;
 
 // earlier versions not supported as of Feb 2012, and are disconnected              Более ранние версии не поддерживаются начиная с февраля 2012 года и являются отключенными
 static const int MIN_PROTO_VERSION = 209;
@@ -44,4 +44,13 @@ static const int BIP0031_VERSION = 60000;
 // "mempool" command, enhanced "getdata" behavior starts with this version:         команда, усиливающая "getdata" поведение(режим) начиная с этой версии:
 static const int MEMPOOL_GD_VERSION = 60002;
 
+// "sendcmpct", "cmpctblock", "getblocktxn" and "blocktxn" start with this version  "sendcmpct", "cmpctblock", "getblocktxn" и "blocktxn" начинаются с этой версии
+static const int COMPACT_BLOCKS_VERSION = 70002;
+
+// "sendfast" and "fastblock" start with this version; peers that send "sendfast"  "sendfast" и "fastblock" начинаются с этой версии; пиры, отправившие "sendfast",
+// accept blocks relayed before they are connected, and those blocks come after a   принимают блоки, ретранслированные до подключения, и такие блоки приходят после
+// "fastblock" so that the relayer isn't punished if one then fails. The version    "fastblock", чтобы ретранслятор не наказывался, если блок не подошёл. Версия
+// only decides whether to offer it: it is shared with compact blocks.              решает лишь, предлагать ли это: она общая с компактными блоками.
+static const int FAST_RELAY_VERSION = 70002;
+
 #endif